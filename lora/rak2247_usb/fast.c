@@ -6,18 +6,29 @@
  * 20 March 2013
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "mpsse.h"
 #include "support.h"
 
-// add by taylor
-unsigned char fast_rw_buf[SPI_RW_SIZE + CMD_SIZE];
+/* Read position in the data to transmit, for the Fast* functions */
+struct fast_cursor
+{
+	const struct fast_iovec *iov;
+	int iovcnt;
+	int index;
+	int offset;
+};
 
-/* Builds a block buffer for the Fast* functions. For internal use only. */
-int fast_build_block_buffer(struct mpsse_context *mpsse, uint8_t cmd, unsigned char *data, int size, int *buf_size)
+/*
+ * Builds a block buffer for the Fast* functions at buf, room bytes available,
+ * gathering the data to transmit from the cursor. For internal use only.
+ * The data are copied once, from the caller's buffers to the block buffer.
+ */
+static int fast_build_block_buffer_gather(struct mpsse_context *mpsse, uint8_t cmd, struct fast_cursor *src, int size, unsigned char *buf, int room, int *buf_size)
 {
-       	int i = 0;
- 	uint16_t rsize = 0;
+	int i = 0, n = 0, chunk = 0;
+	uint16_t rsize = 0;
 
 	*buf_size = 0;
 
@@ -25,14 +36,45 @@ int fast_build_block_buffer(struct mpsse_context *mpsse, uint8_t cmd, unsigned c
 	rsize = size - 1;
 
 	/* Copy in the command for this block */
-	fast_rw_buf[i++] = cmd;
-	fast_rw_buf[i++] = (rsize & 0xFF);
-	fast_rw_buf[i++] = ((rsize >> 8) & 0xFF);
+	if(room < CMD_SIZE)
+	{
+		return MPSSE_FAIL;
+	}
+	buf[i++] = cmd;
+	buf[i++] = (rsize & 0xFF);
+	buf[i++] = ((rsize >> 8) & 0xFF);
 
 	/* On a write, copy the data to transmit after the command */
-	if((cmd == mpsse->tx || cmd == mpsse->txrx) && (i + size) <= sizeof(fast_rw_buf))
+	if(cmd == mpsse->tx || cmd == mpsse->txrx)
 	{
-		memcpy(fast_rw_buf+i, data, size);
+		if(src == NULL || (i + size) > room)
+		{
+			return MPSSE_FAIL;
+		}
+
+		while(n < size && src->index < src->iovcnt)
+		{
+			chunk = src->iov[src->index].size - src->offset;
+			if(chunk > size - n)
+			{
+				chunk = size - n;
+			}
+
+			memcpy(buf + i + n, src->iov[src->index].data + src->offset, chunk);
+			n += chunk;
+			src->offset += chunk;
+
+			if(src->offset >= src->iov[src->index].size)
+			{
+				src->index++;
+				src->offset = 0;
+			}
+		}
+
+		if(n != size)
+		{
+			return MPSSE_FAIL;
+		}
 
 		/* i == offset into buf */
 		i += size;
@@ -43,6 +85,15 @@ int fast_build_block_buffer(struct mpsse_context *mpsse, uint8_t cmd, unsigned c
 	return MPSSE_OK;
 }
 
+/* Builds a block buffer for the Fast* functions. For internal use only. */
+int fast_build_block_buffer(struct mpsse_context *mpsse, uint8_t cmd, unsigned char *data, int size, int *buf_size)
+{
+	struct fast_iovec iov = { (char *) data, size };
+	struct fast_cursor src = { &iov, 1, 0, 0 };
+
+	return fast_build_block_buffer_gather(mpsse, cmd, (data == NULL) ? NULL : &src, size, mpsse->fast_rw_buf, sizeof(mpsse->fast_rw_buf), buf_size);
+}
+
 /*
  * Function for performing fast writes in MPSSE.
  *
@@ -54,12 +105,35 @@ int fast_build_block_buffer(struct mpsse_context *mpsse, uint8_t cmd, unsigned c
  */
 int FastWrite(struct mpsse_context *mpsse, char *data, int size)
 {
-	int buf_size = 0, txsize = 0, n = 0;
+	struct fast_iovec iov = { data, size };
 
-	if(is_valid_context(mpsse))
+	return FastWritev(mpsse, &iov, 1);
+}
+
+/*
+ * Function for performing fast writes in MPSSE, from several buffers sent back to back.
+ * Each USB write carries up to xsize bytes, copied once in the block buffer of the context.
+ *
+ * @mpsse  - libmpsse context pointer.
+ * @iov    - The buffers to write, in order.
+ * @iovcnt - The number of buffers.
+ *
+ * Returns MPSSE_OK on success, MPSSE_FAIL on failure.
+ */
+int FastWritev(struct mpsse_context *mpsse, const struct fast_iovec *iov, int iovcnt)
+{
+	struct fast_cursor src = { iov, iovcnt, 0, 0 };
+	int buf_size = 0, txsize = 0, n = 0, size = 0, i = 0;
+
+	if(is_valid_context(mpsse) && iov != NULL)
 	{
 		if(mpsse->mode)
 		{
+			for(i = 0; i < iovcnt; i++)
+			{
+				size += iov[i].size;
+			}
+
 			while(n < size)
 			{
 				txsize = size - n;
@@ -68,9 +142,9 @@ int FastWrite(struct mpsse_context *mpsse, char *data, int size)
 					txsize = mpsse->xsize;
 				}
 	
-				if(fast_build_block_buffer(mpsse, mpsse->tx, (unsigned char *) (data + n), txsize, &buf_size) == MPSSE_OK)
+				if(fast_build_block_buffer_gather(mpsse, mpsse->tx, &src, txsize, mpsse->fast_rw_buf, sizeof(mpsse->fast_rw_buf), &buf_size) == MPSSE_OK)
 				{	
-					if(raw_write(mpsse, fast_rw_buf, buf_size) == MPSSE_OK)
+					if(raw_write(mpsse, mpsse->fast_rw_buf, buf_size) == MPSSE_OK)
 					{
 						n += txsize;
 					}
@@ -124,7 +198,7 @@ int FastRead(struct mpsse_context *mpsse, char *data, int size)
 
 				if(fast_build_block_buffer(mpsse, mpsse->rx, NULL, rxsize, &data_size) == MPSSE_OK)
 				{
-					if(raw_write(mpsse, fast_rw_buf, data_size) == MPSSE_OK)
+					if(raw_write(mpsse, mpsse->fast_rw_buf, data_size) == MPSSE_OK)
 					{
 						n += raw_read(mpsse, (unsigned char *)(data+n), rxsize);
 					}
@@ -178,9 +252,9 @@ int FastTransfer(struct mpsse_context *mpsse, char *wdata, char *rdata, int size
 					rxsize = SPI_TRANSFER_SIZE;
 				}
 
-				if(build_block_buffer(mpsse, mpsse->txrx, (unsigned char *) (wdata + n), rxsize, &data_size) == MPSSE_OK)
+				if(fast_build_block_buffer(mpsse, mpsse->txrx, (unsigned char *) (wdata + n), rxsize, &data_size) == MPSSE_OK)
 				{
-					if(raw_write(mpsse, fast_rw_buf, data_size) == MPSSE_OK)
+					if(raw_write(mpsse, mpsse->fast_rw_buf, data_size) == MPSSE_OK)
 					{
 						n += raw_read(mpsse, (unsigned char *)(rdata + n), rxsize);
 					}
@@ -208,3 +282,283 @@ int FastTransfer(struct mpsse_context *mpsse, char *wdata, char *rdata, int size
 }
 
 
+/* Pending commands of FastBatch, sent in one USB write */
+struct fast_batch
+{
+	struct mpsse_context *mpsse;
+	int size;
+	int rx_size;
+	int nb_rx;
+	char *rx_data[FAST_BATCH_RX_NB];
+	int rx_len[FAST_BATCH_RX_NB];
+};
+
+/* Sends the pending commands and reads back their data. For internal use only. */
+static int fast_batch_flush(struct fast_batch *b)
+{
+	struct mpsse_context *mpsse = b->mpsse;
+	int i = 0, n = 0, offset = 0;
+
+	if(b->size == 0)
+	{
+		return MPSSE_OK;
+	}
+
+	/* Ask the chip to return the read data without waiting for its latency timer */
+	if(b->rx_size > 0)
+	{
+		mpsse->fast_rw_buf[b->size++] = SEND_IMMEDIATE;
+	}
+
+	if(raw_write(mpsse, mpsse->fast_rw_buf, b->size) != MPSSE_OK)
+	{
+		return MPSSE_FAIL;
+	}
+
+	/* Read straight into the caller buffer when there is only one, else read into the block buffer and scatter */
+	if(b->nb_rx == 1)
+	{
+		n = raw_read(mpsse, (unsigned char *) b->rx_data[0], b->rx_size);
+	}
+	else if(b->nb_rx > 1)
+	{
+		n = raw_read(mpsse, mpsse->fast_rw_buf, b->rx_size);
+		for(i = 0; i < b->nb_rx && n == b->rx_size; i++)
+		{
+			memcpy(b->rx_data[i], mpsse->fast_rw_buf + offset, b->rx_len[i]);
+			offset += b->rx_len[i];
+		}
+	}
+
+	if(n != b->rx_size)
+	{
+		return MPSSE_FAIL;
+	}
+
+	b->size = 0;
+	b->rx_size = 0;
+	b->nb_rx = 0;
+
+	return MPSSE_OK;
+}
+
+/* Makes room for size bytes of commands, plus the final SEND_IMMEDIATE. For internal use only. */
+static int fast_batch_room(struct fast_batch *b, int size)
+{
+	if((b->size + size + 1) > (int) sizeof(b->mpsse->fast_rw_buf))
+	{
+		return fast_batch_flush(b);
+	}
+
+	return MPSSE_OK;
+}
+
+/* Queues a change of the low GPIO pins (CS, clock idle state), as Start and Stop do. For internal use only. */
+static int fast_batch_pins(struct fast_batch *b, uint8_t port)
+{
+	struct mpsse_context *mpsse = b->mpsse;
+
+	if(fast_batch_room(b, 3) != MPSSE_OK)
+	{
+		return MPSSE_FAIL;
+	}
+
+	mpsse->fast_rw_buf[b->size++] = SET_BITS_LOW;
+	mpsse->fast_rw_buf[b->size++] = port;
+	mpsse->fast_rw_buf[b->size++] = mpsse->tris;
+
+	return MPSSE_OK;
+}
+
+/* Queues the write of the data of a transaction. For internal use only. */
+static int fast_batch_tx(struct fast_batch *b, const struct fast_iovec *iov, int iovcnt)
+{
+	struct mpsse_context *mpsse = b->mpsse;
+	struct fast_cursor src = { iov, iovcnt, 0, 0 };
+	int size = 0, n = 0, txsize = 0, buf_size = 0, i = 0;
+
+	for(i = 0; i < iovcnt; i++)
+	{
+		size += iov[i].size;
+	}
+
+	while(n < size)
+	{
+		/* At least one data byte after the block command */
+		if(fast_batch_room(b, CMD_SIZE + 1) != MPSSE_OK)
+		{
+			return MPSSE_FAIL;
+		}
+
+		txsize = size - n;
+		if(txsize > mpsse->xsize)
+		{
+			txsize = mpsse->xsize;
+		}
+		if(txsize > (int) sizeof(mpsse->fast_rw_buf) - b->size - CMD_SIZE - 1)
+		{
+			txsize = (int) sizeof(mpsse->fast_rw_buf) - b->size - CMD_SIZE - 1;
+		}
+
+		if(fast_build_block_buffer_gather(mpsse, mpsse->tx, &src, txsize, mpsse->fast_rw_buf + b->size, sizeof(mpsse->fast_rw_buf) - b->size, &buf_size) != MPSSE_OK)
+		{
+			return MPSSE_FAIL;
+		}
+
+		b->size += buf_size;
+		n += txsize;
+	}
+
+	return MPSSE_OK;
+}
+
+/* Queues the read of the data of a transaction. For internal use only. */
+static int fast_batch_rx(struct fast_batch *b, char *data, int size)
+{
+	struct mpsse_context *mpsse = b->mpsse;
+	int n = 0, rxsize = 0, buf_size = 0;
+
+	while(n < size)
+	{
+		rxsize = size - n;
+		if(rxsize > mpsse->xsize)
+		{
+			rxsize = mpsse->xsize;
+		}
+
+		/*
+		 * The chip stops executing commands when its transmit buffer is full, commands
+		 * must not follow more than FAST_BATCH_RX_SIZE bytes of pending read data.
+		 */
+		if((b->rx_size > 0 && (b->rx_size + rxsize) > FAST_BATCH_RX_SIZE) || b->nb_rx == FAST_BATCH_RX_NB)
+		{
+			if(fast_batch_flush(b) != MPSSE_OK)
+			{
+				return MPSSE_FAIL;
+			}
+		}
+		if(fast_batch_room(b, CMD_SIZE) != MPSSE_OK)
+		{
+			return MPSSE_FAIL;
+		}
+
+		if(fast_build_block_buffer_gather(mpsse, mpsse->rx, NULL, rxsize, mpsse->fast_rw_buf + b->size, sizeof(mpsse->fast_rw_buf) - b->size, &buf_size) != MPSSE_OK)
+		{
+			return MPSSE_FAIL;
+		}
+
+		b->size += buf_size;
+		b->rx_data[b->nb_rx] = data + n;
+		b->rx_len[b->nb_rx] = rxsize;
+		b->nb_rx++;
+		b->rx_size += rxsize;
+		n += rxsize;
+
+		/* A large read is sent alone */
+		if(b->rx_size > FAST_BATCH_RX_SIZE)
+		{
+			if(fast_batch_flush(b) != MPSSE_OK)
+			{
+				return MPSSE_FAIL;
+			}
+		}
+	}
+
+	return MPSSE_OK;
+}
+
+/*
+ * Function performing a batch of SPI transactions, each one in its own chip select frame.
+ * The chip select toggles, writes and reads of all the transactions are queued in the
+ * block buffer of the context and sent in as few USB writes as possible, the read data
+ * of each USB write being read back at once.
+ *
+ * @mpsse - libmpsse context pointer.
+ * @ops   - The transactions, performed in order.
+ * @nb_op - The number of transactions.
+ *
+ * Returns MPSSE_OK on success, MPSSE_FAIL on failure.
+ */
+int FastBatch(struct mpsse_context *mpsse, const struct fast_batch_op *ops, int nb_op)
+{
+	struct fast_batch b;
+	int i = 0, retval = MPSSE_OK;
+
+	if(!is_valid_context(mpsse) || ops == NULL || !(mpsse->mode >= SPI0 && mpsse->mode <= SPI3))
+	{
+		return MPSSE_FAIL;
+	}
+
+	memset(&b, 0, sizeof(b));
+	b.mpsse = mpsse;
+
+	for(i = 0; i < nb_op && retval == MPSSE_OK; i++)
+	{
+		/* Start condition, with the same work around as Start for SPI mode 3 */
+		retval |= fast_batch_pins(&b, mpsse->pstart);
+		if(mpsse->mode == SPI3)
+		{
+			retval |= fast_batch_pins(&b, (mpsse->pstart & ~SK));
+		}
+
+		if(ops[i].txcnt > 0)
+		{
+			retval |= fast_batch_tx(&b, ops[i].tx, ops[i].txcnt);
+		}
+		if(ops[i].rxsize > 0)
+		{
+			retval |= fast_batch_rx(&b, ops[i].rx, ops[i].rxsize);
+		}
+
+		/* Stop condition, then pins back to their idle states, as Stop does */
+		retval |= fast_batch_pins(&b, mpsse->pstop);
+		retval |= fast_batch_pins(&b, mpsse->pidle);
+	}
+
+	if(retval == MPSSE_OK)
+	{
+		retval = fast_batch_flush(&b);
+	}
+	mpsse->status = STOPPED;
+
+	return (retval == MPSSE_OK) ? MPSSE_OK : MPSSE_FAIL;
+}
+
+/*
+ * Index, among the devices matching vid/pid, of the device at a USB bus and
+ * device address, to be passed to OpenIndex. Returns -1 if there is none.
+ */
+int IndexOfUsbPath(int vid, int pid, int bus, int address)
+{
+	struct ftdi_context *ftdi = NULL;
+	struct ftdi_device_list *devlist = NULL, *dev = NULL;
+	int index = -1, i = 0;
+
+	ftdi = ftdi_new();
+	if(ftdi == NULL)
+	{
+		return -1;
+	}
+
+	/* Same order as the devices counted by ftdi_usb_open_desc_index in OpenIndex */
+	if(ftdi_usb_find_all(ftdi, &devlist, vid, pid) > 0)
+	{
+		for(dev = devlist, i = 0; dev != NULL; dev = dev->next, i++)
+		{
+#if LIBFTDI1 == 1
+			if((libusb_get_bus_number(dev->dev) == bus) && (libusb_get_device_address(dev->dev) == address))
+#else
+			if((atoi(dev->dev->bus->dirname) == bus) && (atoi(dev->dev->filename) == address))
+#endif
+			{
+				index = i;
+				break;
+			}
+		}
+	}
+
+	ftdi_list_free(&devlist);
+	ftdi_free(ftdi);
+
+	return index;
+}
@@ -49,6 +49,9 @@ pushd lora_gateway
 
 cp ./libloragw/99-libftdi.rules /etc/udev/rules.d/99-libftdi.rules
 cp $SCRIPT_DIR/loragw_spi.ftdi.c ./libloragw/src/
+cp $SCRIPT_DIR/loragw_spi_trace.c ./libloragw/src/
+cp $SCRIPT_DIR/loragw_spi_trace.h ./libloragw/inc/
+cp $SCRIPT_DIR/loragw_spi_ext.h ./libloragw/inc/
 cp $SCRIPT_DIR/Makefile-gw-lib ./libloragw/Makefile
 cp $SCRIPT_DIR/Makefile-lbt-test ./util_lbt_test/Makefile
 cp $SCRIPT_DIR/Makefile-pkt-logger ./util_pkt_logger/Makefile
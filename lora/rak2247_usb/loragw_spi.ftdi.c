@@ -25,10 +25,13 @@ Maintainer: Sylvain Miermont
 #include <stdio.h>		/* printf fprintf */
 #include <stdlib.h>		/* malloc free */
 #include <string.h>		/* memcpy */
+#include <pthread.h>	/* mutex */
 
 #include <mpsse.h>
 
 #include "loragw_spi.h"
+#include "loragw_spi_ext.h"
+#include "loragw_spi_trace.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -54,25 +57,93 @@ Maintainer: Sylvain Miermont
 #define VID		0x0403
 #define PID		0x6010
 
+#define SPI_BATCH_OP_MAX	64	/* register accesses per FastBatch call */
+
+/* device selection, the first FT2232H found is used if none is set */
+#define SPI_DEV_SERIAL		getenv("LORAGW_SPI_SERIAL")	/* FTDI serial number */
+#define SPI_DEV_USB_PATH	getenv("LORAGW_SPI_USB_PATH")	/* USB bus and device numbers, eg. "001/004" as listed by lsusb */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct spi_ftdi_s {
+	struct mpsse_context *mpsse;
+	pthread_mutex_t mx_spi;	/* one transaction at a time in the block buffer of the MPSSE context */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Index, among the FTDI devices matching VID/PID, of the device at a USB bus/device path */
+static int spi_usb_path_index(const char *usb_path) {
+	int bus, address;
+	int index;
+	
+	if (sscanf(usb_path, "%d/%d", &bus, &address) != 2) {
+		DEBUG_PRINTF("ERROR: invalid USB path %s, expected bus/device\n", usb_path);
+		return -1;
+	}
+	
+	/* listed by libmpsse, which links libftdi/libusb */
+	index = IndexOfUsbPath(VID, PID, bus, address);
+	if (index < 0) {
+		DEBUG_PRINTF("ERROR: no FTDI device %04X:%04X at USB path %s\n", VID, PID, usb_path);
+	}
+	return index;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 /* SPI initialization and configuration */
 int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_dev(spi_target_ptr, SPI_DEV_SERIAL, SPI_DEV_USB_PATH);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI initialization and configuration, of a given FTDI device */
+int lgw_spi_open_dev(void **spi_target_ptr, const char *serial, const char *usb_path) {
+	struct spi_ftdi_s *spi_device = NULL;
 	struct mpsse_context *mpsse = NULL;
+	int index = 0;
 	int a, b;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
 	
-	/* try to open the first available FTDI device matching VID/PID parameters */
-	mpsse = OpenIndex(VID,PID,SPI0, SIX_MHZ, MSB, IFACE_A, NULL, NULL, 0);
+	/* SPI access tracing, if enabled by LORAGW_SPI_TRACE */
+	lgw_spi_trace_init();
+	
+	/* device at a USB path, else first device with that serial number, else first device */
+	if ((usb_path != NULL) && (usb_path[0] != '\0')) {
+		index = spi_usb_path_index(usb_path);
+		if (index < 0) {
+			return LGW_SPI_ERROR;
+		}
+		serial = NULL;
+	} else if ((serial != NULL) && (serial[0] == '\0')) {
+		serial = NULL;
+	}
+	
+	/* allocate memory for the device descriptor */
+	spi_device = malloc(sizeof(struct spi_ftdi_s));
+	if (spi_device == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	/* try to open the FTDI device matching VID/PID parameters */
+	mpsse = OpenIndex(VID,PID,SPI0, SIX_MHZ, MSB, IFACE_A, NULL, serial, index);
 	if (mpsse == NULL) {
 		DEBUG_MSG("ERROR: MPSSE OPEN FUNCTION RETURNED NULL\n");
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 	if (mpsse->open != 1) {
 		DEBUG_MSG("ERROR: MPSSE OPEN FUNCTION FAILED\n");
+		Close(mpsse);
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 	
@@ -82,11 +153,16 @@ int lgw_spi_open(void **spi_target_ptr) {
 	b = PinLow(mpsse, GPIOL1);
 	if ((a != MPSSE_OK) || (b != MPSSE_OK)) {
 		DEBUG_MSG("ERROR: IMPOSSIBLE TO TOGGLE GPIOL1/ADBUS5\n");
+		Close(mpsse);
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 	
+	spi_device->mpsse = mpsse;
+	pthread_mutex_init(&spi_device->mx_spi, NULL);
+	
 	DEBUG_PRINTF("SPI port opened and configured ok\ndesc: %s\nPID: 0x%04X\nVID: 0x%04X\nclock: %d\nLibmpsse version: 0x%02X\n", GetDescription(mpsse), GetPid(mpsse), GetVid(mpsse), GetClock(mpsse), Version());
-	*spi_target_ptr = (void *)mpsse;
+	*spi_target_ptr = (void *)spi_device;
 	return LGW_SPI_SUCCESS;
 }
 
@@ -94,12 +170,14 @@ int lgw_spi_open(void **spi_target_ptr) {
 
 /* SPI release */
 int lgw_spi_close(void *spi_target) {
-	struct mpsse_context *mpsse = spi_target;
+	struct spi_ftdi_s *spi_device = spi_target;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
 	
-	Close(mpsse);
+	Close(spi_device->mpsse);
+	pthread_mutex_destroy(&spi_device->mx_spi);
+	free(spi_device);
 	
 	/* close return no status, assume success (0_o) */
 	return LGW_SPI_SUCCESS;
@@ -108,11 +186,9 @@ int lgw_spi_close(void *spi_target) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Simple write */
-/* transaction time: .6 to 1 ms typically */
-int lgw_spi_w(void *spi_target,uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t out_buf[2];
-	int a, b, c;
+/* transaction time: one USB write (Start/FastWrite/Stop used to be three) */
+static int spi_w(void *spi_target,uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+	struct lgw_spi_op_s op;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
@@ -120,17 +196,12 @@ int lgw_spi_w(void *spi_target,uint8_t spi_mux_mode, uint8_t spi_mux_target, uin
 		DEBUG_MSG("WARNING: SPI address > 127\n");
 	}
 	
-	/* prepare frame to be sent */
-	out_buf[0] = WRITE_ACCESS | (address & 0x7F);
-	out_buf[1] = data;
-	
 	/* MPSSE transaction */
-	a = Start(mpsse);
-	b = FastWrite(mpsse, (char *)out_buf, 2);
-	c = Stop(mpsse);
-	
-	/* determine return code */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK)) {
+	op.access = LGW_SPI_OP_WRITE;
+	op.address = address;
+	op.data = &data;
+	op.size = 1;
+	if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI WRITE FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -141,13 +212,22 @@ int lgw_spi_w(void *spi_target,uint8_t spi_mux_mode, uint8_t spi_mux_target, uin
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Simple read (using Transfer function) */
-/* transaction time: 1.1 to 2 ms typically */
-int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t out_buf[2];
-	uint8_t *in_buf = NULL;
-	int a, b;
+/* Simple write, recorded by the SPI trace */
+int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+	uint64_t start = lgw_spi_trace_start();
+	int status;
+	
+	status = spi_w(spi_target, spi_mux_mode, spi_mux_target, address, data);
+	lgw_spi_trace_end(start, LGW_SPI_TRACE_W, address, 1, status);
+	return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple read */
+/* transaction time: one USB write and one USB read (Start/Transfer/Stop used to be three writes) */
+static int spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data) {
+	struct lgw_spi_op_s op;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target);
@@ -156,42 +236,39 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uin
 	}
 	CHECK_NULL(data);
 	
-	/* prepare frame to be sent */
-	out_buf[0] = READ_ACCESS | (address & 0x7F);
-	out_buf[1] = 0x00;
-	
 	/* MPSSE transaction */
-	a = Start(mpsse);
-	in_buf = (uint8_t *)Transfer(mpsse, (char *)out_buf, 2);
-	b = Stop(mpsse);
-	
-	/* determine return code */
-	if ((in_buf == NULL) || (a != MPSSE_OK) || (b != MPSSE_OK)) {
+	op.access = LGW_SPI_OP_READ;
+	op.address = address;
+	op.data = data;
+	op.size = 1;
+	if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI READ FAILURE\n");
-		if (in_buf != NULL) {
-			free(in_buf);
-		}
 		return LGW_SPI_ERROR;
 	} else {
 		DEBUG_MSG("Note: SPI read success\n");
-		*data = in_buf[1];
-		free(in_buf);
 		return LGW_SPI_SUCCESS;
 	}
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* Simple read, recorded by the SPI trace */
+int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+	uint64_t start = lgw_spi_trace_start();
+	int status;
+	
+	status = spi_r(spi_target, spi_mux_mode, spi_mux_target, address, data);
+	lgw_spi_trace_end(start, LGW_SPI_TRACE_R, address, 1, status);
+	return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Burst (multiple-byte) write */
-/* transaction time: 3.7ms for 2500 data bytes @6MHz, 1kB chunks */
-/* transaction time: 0.5ms for 16 data bytes @6MHz, 1kB chunks */
-int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data, uint16_t size) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t command;
-	uint8_t *out_buf = NULL;
-	int size_to_do, buf_size, chunk_size, offset;
-	int a=0, b=0, c=0;
-	int i;
+/* command byte and data are gathered in the block buffer of the MPSSE context, */
+/* sent with the chip select toggles in one USB write up to SPI_RW_SIZE bytes */
+static int spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data, uint16_t size) {
+	struct lgw_spi_op_s op;
 	
 	/* check input parameters */
 	CHECK_NULL(spi_target);
@@ -204,41 +281,12 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,ui
 		return LGW_SPI_ERROR;
 	}
 	
-	/* prepare command byte */
-	command = WRITE_ACCESS | (address & 0x7F);
-	size_to_do = size + 1; /* add a byte for the address */
-	
-	/* allocate data buffer */
-	buf_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-	out_buf = malloc(buf_size);
-	if (out_buf == NULL) {
-		DEBUG_MSG("ERROR: MALLOC FAIL\n");
-		return LGW_SPI_ERROR;
-	}
-	
-	/* start MPSSE transaction */
-	a = Start(mpsse);
-	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		if (i == 0) {
-			/* first chunk, need to append the address */
-			out_buf[0] = command;
-			memcpy(out_buf+1, data, chunk_size-1);
-		} else {
-			/* following chunks, just copy the data */
-			offset = (i * LGW_BURST_CHUNK) - 1;
-			memcpy(out_buf, data + offset, chunk_size);
-		}
-		b = FastWrite(mpsse, (char *)out_buf, chunk_size);
-		size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
-	}
-	c = Stop(mpsse);
-	
-	/* deallocate data buffer */
-	free(out_buf);
-	
-	/* determine return code (only the last FastWrite is checked) */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK)) {
+	/* MPSSE transaction */
+	op.access = LGW_SPI_OP_WRITE;
+	op.address = address;
+	op.data = data;
+	op.size = size;
+	if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI BURST WRITE FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -249,15 +297,22 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,ui
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Burst (multiple-byte) read (using FastWrite & FastRead functions) */
-/* transaction time: 7-12ms for 2500 data bytes @6MHz, 1kB chunks */
-/* transaction time: 2ms for 16 data bytes @6MHz, 1kB chunks */
-int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data, uint16_t size) {
-	struct mpsse_context *mpsse = spi_target;
-	uint8_t command;
-	int size_to_do, chunk_size, offset;
-	int a=0, b=0, c=0, d=0;
-	int i;
+/* Burst (multiple-byte) write, recorded by the SPI trace */
+int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+	uint64_t start = lgw_spi_trace_start();
+	int status;
+	
+	status = spi_wb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+	lgw_spi_trace_end(start, LGW_SPI_TRACE_WB, address, size, status);
+	return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read */
+/* transaction time: one USB write and one USB read, the data read being returned at once */
+static int spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,uint8_t address, uint8_t *data, uint16_t size) {
+	struct lgw_spi_op_s op;
 	
 	/* check input parameters */
 	CHECK_NULL(spi_target);
@@ -270,23 +325,12 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,ui
 		return LGW_SPI_ERROR;
 	}
 	
-	/* prepare command byte */
-	command = READ_ACCESS | (address & 0x7F);
-	size_to_do = size;
-	
-	/* start MPSSE transaction */
-	a = Start(mpsse);
-	b = FastWrite(mpsse, (char *)&command, 1);
-	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
-		c = FastRead(mpsse, (char *)(data + offset), chunk_size);
-		size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
-	}
-	d = Stop(mpsse);
-	
-	/* determine return code (only the last FastRead is checked) */
-	if ((a != MPSSE_OK) || (b != MPSSE_OK) || (c != MPSSE_OK) || (d != MPSSE_OK)) {
+	/* MPSSE transaction */
+	op.access = LGW_SPI_OP_READ;
+	op.address = address;
+	op.data = data;
+	op.size = size;
+	if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI BURST READ FAILURE\n");
 		return LGW_SPI_ERROR;
 	} else {
@@ -295,4 +339,76 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target,ui
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read, recorded by the SPI trace */
+int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+	uint64_t start = lgw_spi_trace_start();
+	int status;
+	
+	status = spi_rb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+	lgw_spi_trace_end(start, LGW_SPI_TRACE_RB, address, size, status);
+	return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of register accesses (using FastBatch function) */
+/* chip select toggles, commands and data of all accesses are sent in as few USB writes */
+/* as the block buffer allows, the data read are returned at once */
+int lgw_spi_batch(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_spi_op_s *ops, int nb_op) {
+	struct spi_ftdi_s *spi_device = spi_target;
+	int status = LGW_SPI_SUCCESS;
+	uint8_t command[SPI_BATCH_OP_MAX];
+	struct fast_iovec iov[SPI_BATCH_OP_MAX][2];
+	struct fast_batch_op batch[SPI_BATCH_OP_MAX];
+	int i, j, n;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(ops);
+	for (i = 0; i < nb_op; ++i) {
+		CHECK_NULL(ops[i].data);
+		if (ops[i].size == 0) {
+			DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+			return LGW_SPI_ERROR;
+		}
+	}
+	
+	/* MPSSE transactions, SPI_BATCH_OP_MAX accesses at a time */
+	pthread_mutex_lock(&spi_device->mx_spi);
+	for (i = 0; (i < nb_op) && (status == LGW_SPI_SUCCESS); i += n) {
+		n = ((nb_op - i) < SPI_BATCH_OP_MAX) ? (nb_op - i) : SPI_BATCH_OP_MAX;
+		for (j = 0; j < n; ++j) {
+			iov[j][0].data = (char *)&command[j];
+			iov[j][0].size = 1;
+			batch[j].tx = iov[j];
+			if (ops[i+j].access == LGW_SPI_OP_WRITE) {
+				command[j] = WRITE_ACCESS | (ops[i+j].address & 0x7F);
+				iov[j][1].data = (char *)ops[i+j].data;
+				iov[j][1].size = ops[i+j].size;
+				batch[j].txcnt = 2;
+				batch[j].rx = NULL;
+				batch[j].rxsize = 0;
+			} else {
+				command[j] = READ_ACCESS | (ops[i+j].address & 0x7F);
+				batch[j].txcnt = 1;
+				batch[j].rx = (char *)ops[i+j].data;
+				batch[j].rxsize = ops[i+j].size;
+			}
+		}
+		if (FastBatch(spi_device->mpsse, batch, n) != MPSSE_OK) {
+			status = LGW_SPI_ERROR;
+		}
+	}
+	pthread_mutex_unlock(&spi_device->mx_spi);
+	
+	if (status != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI BATCH FAILURE\n");
+	} else {
+		DEBUG_MSG("Note: SPI batch success\n");
+	}
+	return status;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
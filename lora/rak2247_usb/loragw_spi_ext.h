@@ -0,0 +1,78 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Extensions of the host specific SPI functions, not in loragw_spi.h.
+    Batched transfers: a list of register accesses, with their chip select
+    toggles, queued in as few USB writes to the FTDI bridge as its buffer
+    allows, the data read being returned at once.
+    Device selection: several USB concentrators on one host, each SPI
+    target having its own FTDI device, buffers and lock.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SPI_EXT_H
+#define _LORAGW_SPI_EXT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types*/
+
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SPI_OP_READ     0
+#define LGW_SPI_OP_WRITE    1
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_op_s
+@brief One register access of a batch, done in its own chip select frame
+*/
+struct lgw_spi_op_s {
+    uint8_t     access;     /*!> LGW_SPI_OP_READ or LGW_SPI_OP_WRITE */
+    uint8_t     address;    /*!> 7-bit register address */
+    uint8_t     *data;      /*!> data to write, or buffer receiving the data read */
+    uint16_t    size;       /*!> number of bytes, 1 for a single register access */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief LoRa concentrator SPI setup, of a given FTDI device (lgw_spi_open uses
+the LORAGW_SPI_SERIAL and LORAGW_SPI_USB_PATH environment variables)
+@param spi_target_ptr pointer on a generic pointer to SPI target
+@param serial FTDI serial number, NULL for any
+@param usb_path USB bus and device numbers, eg. "001/004" as listed by lsusb,
+NULL for any, has priority over the serial number
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_open_dev(void **spi_target_ptr, const char *serial, const char *usb_path);
+
+/**
+@brief LoRa concentrator SPI batch of register accesses
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param spi_mux_mode SPI mux mode (LGW_SPI_MUX_MODE0 or LGW_SPI_MUX_MODE1)
+@param spi_mux_target SPI mux target, used in mux mode 1 only
+@param ops array of register accesses, done in that order
+@param nb_op number of register accesses
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_spi_op_s *ops, int nb_op);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,133 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Tracing of the SPI register accesses (lgw_spi_w/r/wb/rb).
+    Each access is recorded (address, direction, size, duration) in a ring
+    owned by the calling thread, without lock, and counted in a latency
+    histogram per register address.
+    Enabled by setting the LORAGW_SPI_TRACE environment variable to 1, a
+    binary dump is then written on SIGUSR1 to LORAGW_SPI_TRACE_FILE
+    (default /tmp/lgw_spi_trace.bin).
+
+    Dump format, native endianness:
+      header      struct lgw_spi_trace_hdr_s
+      nb_ring x { struct lgw_spi_trace_ring_hdr_s, nb_rec x struct lgw_spi_trace_rec_s }
+      histograms  uint32_t [LGW_SPI_TRACE_DIR_NB][128][LGW_SPI_TRACE_BINS]
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SPI_TRACE_H
+#define _LORAGW_SPI_TRACE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types*/
+#include <stdbool.h>       /* bool type */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SPI_TRACE_MAGIC     0x52545053  /* "SPTR" */
+#define LGW_SPI_TRACE_VERSION   1
+
+#define LGW_SPI_TRACE_RING_SIZE 4096    /* records kept per thread, power of 2 */
+#define LGW_SPI_TRACE_BINS      16      /* bin 0: < 1us, bin n: [2^(n-1), 2^n[ us, last bin: above */
+
+/* access types, bit 0 is the direction */
+#define LGW_SPI_TRACE_W         0
+#define LGW_SPI_TRACE_R         1
+#define LGW_SPI_TRACE_WB        2
+#define LGW_SPI_TRACE_RB        3
+#define LGW_SPI_TRACE_DIR_NB    2       /* histograms per address: write, read */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_trace_rec_s
+@brief One SPI register access
+*/
+struct lgw_spi_trace_rec_s {
+    uint64_t    start_ns;   /*!> CLOCK_MONOTONIC time of the call, in ns */
+    uint32_t    duration_ns;/*!> duration of the call, in ns */
+    uint16_t    size;       /*!> number of data bytes */
+    uint8_t     address;    /*!> 7-bit register address */
+    uint8_t     access;     /*!> LGW_SPI_TRACE_W/R/WB/RB, bit 7 set if the call failed */
+};
+
+/**
+@struct lgw_spi_trace_hdr_s
+@brief Header of a binary dump
+*/
+struct lgw_spi_trace_hdr_s {
+    uint32_t    magic;      /*!> LGW_SPI_TRACE_MAGIC */
+    uint16_t    version;    /*!> LGW_SPI_TRACE_VERSION */
+    uint16_t    rec_size;   /*!> sizeof(struct lgw_spi_trace_rec_s) */
+    uint32_t    nb_ring;    /*!> number of thread rings following */
+    uint32_t    nb_bins;    /*!> LGW_SPI_TRACE_BINS */
+    uint64_t    dump_ns;    /*!> CLOCK_MONOTONIC time of the dump, in ns */
+};
+
+/**
+@struct lgw_spi_trace_ring_hdr_s
+@brief Header of the records of one thread in a binary dump
+*/
+struct lgw_spi_trace_ring_hdr_s {
+    uint32_t    thread;     /*!> index of the thread, in order of its first SPI access */
+    uint32_t    nb_rec;     /*!> number of records following, oldest first */
+    uint64_t    nb_total;   /*!> number of accesses recorded by the thread, including overwritten ones */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Read the LORAGW_SPI_TRACE environment variable and, if enabled, install
+the SIGUSR1 handler. Called by lgw_spi_open, only the first call has effect.
+*/
+void lgw_spi_trace_init(void);
+
+/**
+@brief Start timing a SPI access
+@return start time, 0 if tracing is disabled
+*/
+uint64_t lgw_spi_trace_start(void);
+
+/**
+@brief Record a SPI access in the ring of the calling thread and in the histograms
+@param start value returned by lgw_spi_trace_start, nothing is done if 0
+@param access LGW_SPI_TRACE_W/R/WB/RB
+@param address register address
+@param size number of data bytes
+@param status return code of the access (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+void lgw_spi_trace_end(uint64_t start, uint8_t access, uint8_t address, uint16_t size, int status);
+
+/**
+@brief Write the binary dump of all the rings and histograms, only uses async-signal-safe functions
+@param path file to write, overwritten
+@return 0 on success, -1 on error
+*/
+int lgw_spi_trace_dump(const char *path);
+
+/**
+@brief Get the latency histogram of a register address
+@param dir 0 for write accesses, 1 for read accesses
+@param address register address
+@param bins array of LGW_SPI_TRACE_BINS counters
+@return 0 on success, -1 if tracing is disabled
+*/
+int lgw_spi_trace_hist(uint8_t dir, uint8_t address, uint32_t *bins);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
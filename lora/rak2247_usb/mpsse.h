@@ -18,6 +18,8 @@
 #define CHUNK_SIZE		65535
 #define SPI_RW_SIZE		(63 * 1024) 
 #define SPI_TRANSFER_SIZE	512
+#define FAST_BATCH_RX_SIZE	4096	/* FT2232H transmit buffer, read data pending in one FastBatch write */
+#define FAST_BATCH_RX_NB	256	/* reads pending in one FastBatch write */
 #define I2C_TRANSFER_SIZE	64
 
 #define LATENCY_MS		2
@@ -138,6 +140,22 @@ enum low_bits_status
 	STOPPED
 };
 
+/* One piece of data for FastWritev */
+struct fast_iovec
+{
+	char *data;
+	int size;
+};
+
+/* One SPI transaction for FastBatch: write tx, then read rxsize bytes in rx */
+struct fast_batch_op
+{
+	const struct fast_iovec *tx;
+	int txcnt;
+	char *rx;
+	int rxsize;
+};
+
 struct vid_pid
 {
 	int vid;
@@ -170,12 +188,14 @@ struct mpsse_context
 	uint8_t txrx;
 	uint8_t tack;
 	uint8_t rack;
+	unsigned char fast_rw_buf[SPI_RW_SIZE + CMD_SIZE];	/* block buffer of the Fast* functions, allocated with the context */
 };
 
 struct mpsse_context *MPSSE(enum modes mode, int freq, int endianess);
 struct mpsse_context *Open(int vid, int pid, enum modes mode, int freq, int endianess, int interface, const char *description, const char *serial);
 struct mpsse_context *OpenIndex(int vid, int pid, enum modes mode, int freq, int endianess, int interface, const char *description, const char *serial, int index);
 void Close(struct mpsse_context *mpsse);
+int IndexOfUsbPath(int vid, int pid, int bus, int address);
 const char *ErrorString(struct mpsse_context *mpsse);
 int SetMode(struct mpsse_context *mpsse, int endianess);
 void EnableBitmode(struct mpsse_context *mpsse, int tf);
@@ -219,8 +239,10 @@ char *Read(struct mpsse_context *mpsse, int size);
 char *Transfer(struct mpsse_context *mpsse, char *data, int size);
 
 int FastWrite(struct mpsse_context *mpsse, char *data, int size);
+int FastWritev(struct mpsse_context *mpsse, const struct fast_iovec *iov, int iovcnt);
 int FastRead(struct mpsse_context *mpsse, char *data, int size);
 int FastTransfer(struct mpsse_context *mpsse, char *wdata, char *rdata, int size);
+int FastBatch(struct mpsse_context *mpsse, const struct fast_batch_op *ops, int nb_op);
 #endif
 
 
@@ -31,14 +31,22 @@ make clean
 cp ../loragw_stts751.c libloragw/src/ -f
 cp ../loragw_gps.c libloragw/src/ -f
 cp ../loragw_hal.c libloragw/src/ -f
+cp ../loragw_sim.c libloragw/src/ -f
+cp ../loragw_sim.h libloragw/inc/ -f
 cp ../test_loragw_gps_uart.c libloragw/tst/test_loragw_gps.c -f
 cp ../test_loragw_gps_i2c.c libloragw/tst/ -f
+cp ../test_loragw_merge.c libloragw/tst/ -f
 cp ../Makefile libloragw/ -f
 
 #mkdir -p packet_forwarder/lora_pkt_fwd/
 #cp ../reset_lgw.sh packet_forwarder/lora_pkt_fwd/reset_lgw.sh -f
 
 cp ../lora_pkt_fwd.c packet_forwarder/src/
+cp ../jitqueue.c packet_forwarder/src/ -f
+cp ../jitqueue.h packet_forwarder/inc/ -f
+mkdir -p packet_forwarder/tst
+cp ../test_jitqueue.c packet_forwarder/tst/ -f
+cp ../Makefile-pk packet_forwarder/Makefile -f
 make
 rm packet_forwarder/lora_pkt_fwd/obj/* -f
 popd
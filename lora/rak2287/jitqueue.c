@@ -0,0 +1,693 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : Just In Time TX scheduling queue
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc, free */
+#include <string.h>     /* memset, memcpy */
+#include <pthread.h>
+#include <assert.h>
+#include <math.h>
+
+#include "trace.h"
+#include "jitqueue.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+#define TX_START_DELAY          1500    /* microseconds */
+                                        /* TODO: get this value from HAL? */
+#define TX_MARGIN_DELAY         1000    /* Packet overlap margin in microseconds */
+                                        /* TODO: How much margin should we take? */
+#define TX_JIT_DELAY            40000   /* Pre-delay to program packet for TX in microseconds */
+#define TX_MAX_ADVANCE_DELAY    ((JIT_NUM_BEACON_IN_QUEUE + 1) * 128 * 1E6) /* Maximum advance delay accepted for a TX packet, compared to current time */
+
+#define BEACON_GUARD            3000000 /* Interval where no ping slot can be placed,
+                                            to ensure beacon can be sent */
+#define BEACON_RESERVED         2120000 /* Time on air of the beacon, with some margin */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Timestamps are extended to 64 bits to be ordered across the 32-bit counter
+ * roll-over (~71 minutes). All queued packets are within TX_MAX_ADVANCE_DELAY
+ * of the current time, and the queue is given the current time at least once
+ * per JIT thread loop, so a signed 32-bit difference is never ambiguous. */
+static int64_t jit_extend_time(struct jit_queue_s *queue, uint32_t time_us) {
+    queue->last_time_ext_us += (int32_t)(time_us - queue->last_time_us);
+    queue->last_time_us = time_us;
+    return queue->last_time_ext_us;
+}
+
+static int64_t jit_extend_count(const struct jit_queue_s *queue, uint32_t count_us) {
+    return queue->last_time_ext_us + (int32_t)(count_us - queue->last_time_us);
+}
+
+static uint32_t jit_rand(struct jit_queue_s *queue) {
+    /* xorshift32, only used to balance the interval tree */
+    queue->rand_state ^= queue->rand_state << 13;
+    queue->rand_state ^= queue->rand_state >> 17;
+    queue->rand_state ^= queue->rand_state << 5;
+    return queue->rand_state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* min-heap of node indexes, on packet timestamp */
+
+static void heap_set(struct jit_queue_s *queue, int pos, int n) {
+    queue->heap[pos] = n;
+    queue->nodes[n].heap_pos = pos;
+}
+
+static void heap_sift_up(struct jit_queue_s *queue, int pos) {
+    int n = queue->heap[pos];
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (queue->nodes[queue->heap[parent]].time_us <= queue->nodes[n].time_us) {
+            break;
+        }
+        heap_set(queue, pos, queue->heap[parent]);
+        pos = parent;
+    }
+    heap_set(queue, pos, n);
+}
+
+static void heap_sift_down(struct jit_queue_s *queue, int pos) {
+    int n = queue->heap[pos];
+    int child;
+
+    while ((child = 2 * pos + 1) < queue->num_pkt) {
+        if (((child + 1) < queue->num_pkt) && (queue->nodes[queue->heap[child + 1]].time_us < queue->nodes[queue->heap[child]].time_us)) {
+            child += 1;
+        }
+        if (queue->nodes[n].time_us <= queue->nodes[queue->heap[child]].time_us) {
+            break;
+        }
+        heap_set(queue, pos, queue->heap[child]);
+        pos = child;
+    }
+    heap_set(queue, pos, n);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* interval tree: treap ordered on TX window start, augmented with the highest
+ * TX window end of each subtree */
+
+static bool tree_before(const struct jit_node_s *nodes, int a, int b) {
+    if (nodes[a].start_us != nodes[b].start_us) {
+        return (nodes[a].start_us < nodes[b].start_us);
+    }
+    return (a < b);
+}
+
+static void tree_update(struct jit_node_s *nodes, int n) {
+    int64_t max_end_us = nodes[n].end_us;
+
+    if ((nodes[n].left != -1) && (nodes[nodes[n].left].max_end_us > max_end_us)) {
+        max_end_us = nodes[nodes[n].left].max_end_us;
+    }
+    if ((nodes[n].right != -1) && (nodes[nodes[n].right].max_end_us > max_end_us)) {
+        max_end_us = nodes[nodes[n].right].max_end_us;
+    }
+    nodes[n].max_end_us = max_end_us;
+}
+
+static int tree_rotate_right(struct jit_node_s *nodes, int n) {
+    int l = nodes[n].left;
+
+    nodes[n].left = nodes[l].right;
+    nodes[l].right = n;
+    tree_update(nodes, n);
+    tree_update(nodes, l);
+    return l;
+}
+
+static int tree_rotate_left(struct jit_node_s *nodes, int n) {
+    int r = nodes[n].right;
+
+    nodes[n].right = nodes[r].left;
+    nodes[r].left = n;
+    tree_update(nodes, n);
+    tree_update(nodes, r);
+    return r;
+}
+
+static int tree_insert(struct jit_node_s *nodes, int root, int n) {
+    if (root == -1) {
+        return n;
+    }
+    if (tree_before(nodes, n, root)) {
+        nodes[root].left = tree_insert(nodes, nodes[root].left, n);
+        if (nodes[nodes[root].left].prio > nodes[root].prio) {
+            root = tree_rotate_right(nodes, root);
+        }
+    } else {
+        nodes[root].right = tree_insert(nodes, nodes[root].right, n);
+        if (nodes[nodes[root].right].prio > nodes[root].prio) {
+            root = tree_rotate_left(nodes, root);
+        }
+    }
+    tree_update(nodes, root);
+    return root;
+}
+
+static int tree_remove(struct jit_node_s *nodes, int root, int n) {
+    int l, r;
+
+    assert(root != -1);
+    if (root == n) {
+        l = nodes[n].left;
+        r = nodes[n].right;
+        if (l == -1) {
+            return r;
+        }
+        if (r == -1) {
+            return l;
+        }
+        /* rotate the node down until it has at most one child */
+        if (nodes[l].prio > nodes[r].prio) {
+            root = tree_rotate_right(nodes, n);
+            nodes[root].right = tree_remove(nodes, nodes[root].right, n);
+        } else {
+            root = tree_rotate_left(nodes, n);
+            nodes[root].left = tree_remove(nodes, nodes[root].left, n);
+        }
+    } else if (tree_before(nodes, n, root)) {
+        nodes[root].left = tree_remove(nodes, nodes[root].left, n);
+    } else {
+        nodes[root].right = tree_remove(nodes, nodes[root].right, n);
+    }
+    tree_update(nodes, root);
+    return root;
+}
+
+/* Check if a queued packet collides with the TX window [start_us, end_us] of a
+ * new packet, margin included. This is the test done by jit_enqueue on every
+ * queued packet before the queue was indexed:
+ *      t_packet_new - pre_delay_packet_new < t_packet_prev + post_delay_packet_prev (OVERLAP on post delay)
+ *      t_packet_new + post_delay_packet_new > t_packet_prev - pre_delay_packet_prev (OVERLAP on pre delay)
+ */
+static bool jit_collision_test(const struct jit_node_s *node, enum jit_pkt_type_e pkt_type, int64_t start_us, int64_t end_us) {
+    int64_t node_start_us = node->start_us;
+
+    /* We ignore Beacon Guard for Class A/C downlinks */
+    if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (node->pkt_type == JIT_PKT_TYPE_BEACON)) {
+        node_start_us = node->time_us - TX_START_DELAY;
+    }
+
+    return ((node_start_us <= end_us) && (node->end_us >= start_us));
+}
+
+/* Return the first queued packet (in TX window start order) colliding with a
+ * new packet, -1 if none.
+ * Subtrees ending before the new window are skipped, and the search stops on
+ * the first node starting after it. Windows of the queued packets do not
+ * overlap each other, except beacon guards which may contain Class A/C
+ * downlinks, so only O(log n) nodes are visited. */
+static int tree_find_collision(const struct jit_node_s *nodes, int root, enum jit_pkt_type_e pkt_type, int64_t start_us, int64_t end_us) {
+    int found;
+
+    while ((root != -1) && (nodes[root].max_end_us >= start_us)) {
+        found = tree_find_collision(nodes, nodes[root].left, pkt_type, start_us, end_us);
+        if (found != -1) {
+            return found;
+        }
+        if (nodes[root].start_us > end_us) {
+            /* this node and its right subtree start after the new window */
+            return -1;
+        }
+        if (jit_collision_test(&nodes[root], pkt_type, start_us, end_us) == true) {
+            return root;
+        }
+        root = nodes[root].right;
+    }
+
+    return -1;
+}
+
+static int jit_find_collision(struct jit_queue_s *queue, uint32_t count_us, uint32_t pre_delay, uint32_t post_delay, enum jit_pkt_type_e pkt_type) {
+    int64_t time_us = jit_extend_count(queue, count_us);
+
+    return tree_find_collision(queue->nodes, queue->tree, pkt_type,
+                                time_us - pre_delay - TX_MARGIN_DELAY,
+                                time_us + post_delay + TX_MARGIN_DELAY);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+/* queue nodes, to be called with mx_jit_queue locked */
+
+static void jit_insert_node(struct jit_queue_s *queue, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type, uint32_t pre_delay, uint32_t post_delay) {
+    int n;
+    struct jit_node_s *node;
+
+    /* Take a free node, the caller checked that the queue is not full */
+    n = queue->free_nodes[queue->capacity - queue->num_pkt - 1];
+    node = &(queue->nodes[n]);
+
+    memcpy(&(node->pkt), packet, sizeof(struct lgw_pkt_tx_s));
+    node->pkt_type = pkt_type;
+    node->pre_delay = pre_delay;
+    node->post_delay = post_delay;
+    node->time_us = jit_extend_count(queue, packet->count_us);
+    node->start_us = node->time_us - pre_delay;
+    node->end_us = node->time_us + post_delay;
+    node->max_end_us = node->end_us;
+    node->left = -1;
+    node->right = -1;
+    node->prio = jit_rand(queue);
+
+    queue->tree = tree_insert(queue->nodes, queue->tree, n);
+    queue->num_pkt++;
+    heap_set(queue, queue->num_pkt - 1, n);
+    heap_sift_up(queue, queue->num_pkt - 1);
+    if (pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon++;
+    }
+}
+
+static void jit_remove_node(struct jit_queue_s *queue, int n) {
+    int pos = queue->nodes[n].heap_pos;
+    int last;
+
+    queue->tree = tree_remove(queue->nodes, queue->tree, n);
+
+    /* Replace removed node with last node of the heap */
+    queue->num_pkt--;
+    if (pos != queue->num_pkt) {
+        last = queue->heap[queue->num_pkt];
+        heap_set(queue, pos, last);
+        heap_sift_down(queue, pos);
+        heap_sift_up(queue, queue->nodes[last].heap_pos);
+    }
+    if (queue->nodes[n].pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon--;
+    }
+
+    memset(&(queue->nodes[n]), 0, sizeof(struct jit_node_s));
+    queue->nodes[n].heap_pos = -1;
+    queue->free_nodes[queue->capacity - queue->num_pkt - 1] = n;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+
+bool jit_queue_is_full(struct jit_queue_s *queue) {
+    bool result;
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    result = (queue->num_pkt == queue->capacity)?true:false;
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return result;
+}
+
+bool jit_queue_is_empty(struct jit_queue_s *queue) {
+    bool result;
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    result = (queue->num_pkt == 0)?true:false;
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return result;
+}
+
+int jit_queue_num_beacon(struct jit_queue_s *queue) {
+    int result;
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    result = queue->num_beacon;
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return result;
+}
+
+bool jit_queue_next(struct jit_queue_s *queue, uint32_t *count_us) {
+    bool result = false;
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    if (queue->num_pkt > 0) {
+        *count_us = queue->nodes[queue->heap[0]].pkt.count_us;
+        result = true;
+    }
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return result;
+}
+
+enum jit_error_e jit_queue_init(struct jit_queue_s *queue, uint16_t capacity) {
+    int i;
+    struct jit_node_s *nodes;
+    int *heap;
+    int *free_nodes;
+
+    if ((capacity == 0) || (capacity > JIT_QUEUE_MAX_SIZE)) {
+        MSG("ERROR: invalid JIT queue capacity %u, must be 1 to %u\n", capacity, JIT_QUEUE_MAX_SIZE);
+        return JIT_ERROR_INVALID;
+    }
+
+    nodes = malloc(capacity * sizeof(struct jit_node_s));
+    heap = malloc(capacity * sizeof(int));
+    free_nodes = malloc(capacity * sizeof(int));
+    if ((nodes == NULL) || (heap == NULL) || (free_nodes == NULL)) {
+        MSG("ERROR: failed to allocate JIT queue of %u packets\n", capacity);
+        free(nodes);
+        free(heap);
+        free(free_nodes);
+        return JIT_ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    free(queue->nodes);
+    free(queue->heap);
+    free(queue->free_nodes);
+    memset(queue, 0, sizeof(*queue));
+    memset(nodes, 0, capacity * sizeof(struct jit_node_s));
+
+    queue->capacity = capacity;
+    queue->nodes = nodes;
+    queue->heap = heap;
+    queue->free_nodes = free_nodes;
+    queue->tree = -1;
+    queue->rand_state = 0x9E3779B9;
+    for (i=0; i<capacity; i++) {
+        queue->nodes[i].heap_pos = -1;
+        /* free nodes are taken from the end, first index first */
+        queue->free_nodes[i] = capacity - 1 - i;
+    }
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
+    int i;
+    uint32_t packet_post_delay = 0;
+    uint32_t packet_pre_delay = 0;
+    enum jit_error_e err_collision;
+    uint32_t asap_count_us;
+
+    MSG_DEBUG(DEBUG_JIT, "Current concentrator time is %u, pkt_type=%d\n", time_us, pkt_type);
+
+    if ((packet == NULL) || (queue->nodes == NULL)) {
+        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    /* Compute packet pre/post delays depending on packet's type */
+    switch (pkt_type) {
+        case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
+        case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
+        case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
+            packet_pre_delay = TX_START_DELAY + TX_JIT_DELAY;
+            packet_post_delay = lgw_time_on_air(packet) * 1000UL; /* in us */
+            break;
+        case JIT_PKT_TYPE_BEACON:
+            /* As defined in LoRaWAN spec */
+            packet_pre_delay = TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY;
+            packet_post_delay = BEACON_RESERVED;
+            break;
+        default:
+            break;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    /* thread_down and thread_beacon both enqueue, check and insert under the same lock */
+    if (queue->num_pkt == queue->capacity) {
+        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: cannot enqueue packet, JIT queue is full\n");
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_FULL;
+    }
+
+    jit_extend_time(queue, time_us);
+
+    /* An immediate downlink becomes a timestamped downlink "ASAP" */
+    /* Set the packet count_us to the first available slot */
+    if (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C) {
+        /* change tx_mode to timestamped */
+        packet->tx_mode = TIMESTAMPED;
+
+        /* Search for the ASAP timestamp to be given to the packet:
+            - ASAP meaning NOW + MARGIN
+            - else right after the packet it collides with, until a free slot is found
+        */
+        asap_count_us = time_us + 1000000; /* TODO: Take 1 second margin, to be refined */
+        for (i = 0; i <= queue->num_pkt; i++) {
+            int n = jit_find_collision(queue, asap_count_us, packet_pre_delay, packet_post_delay, pkt_type);
+            if (n == -1) {
+                MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink at count_us=%u\n", asap_count_us);
+                break;
+            }
+            MSG_DEBUG(DEBUG_JIT, "DEBUG: cannot insert IMMEDIATE downlink at count_us=%u, collides with %u\n", asap_count_us, queue->nodes[n].pkt.count_us);
+            asap_count_us = queue->nodes[n].pkt.count_us + queue->nodes[n].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
+        }
+        /* Set packet with ASAP timestamp */
+        packet->count_us = asap_count_us;
+    }
+
+    /* Check criteria_1: is it already too late to send this packet ?
+     *  The packet should arrive at least at (tmst - TX_START_DELAY) to be programmed into concentrator
+     *  Note: - Also add some margin, to be checked how much is needed, if needed
+     *        - Valid for both Downlinks and Beacon packets
+     *
+     *  Warning: unsigned arithmetic (handle roll-over)
+     *      t_packet < t_current + TX_START_DELAY + MARGIN
+     */
+    if ((packet->count_us - time_us) <= (TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY)) {
+        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, already too late to send it (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_TOO_LATE;
+    }
+
+    /* Check criteria_2: Does packet timestamp seem plausible compared to current time
+     *  We do not expect the server to program a downlink too early compared to current time
+     *  Class A: downlink has to be sent in a 1s or 2s time window after RX
+     *  Class B: downlink has to occur in a 128s time window
+     *  Class C: departure time has been calculated previously, but may be pushed back by a long queue
+     *  So let's define a safe delay above which we can say that the packet is out of bound: TX_MAX_ADVANCE_DELAY
+     *  Note: - Valid for both Downlinks and Beacon packets: jit_peek would drop them anyway,
+     *          and queued timestamps must be close enough to be ordered across the roll-over
+     *
+     *  Warning: unsigned arithmetic (handle roll-over)
+                t_packet > t_current + TX_MAX_ADVANCE_DELAY
+     */
+    if ((packet->count_us - time_us) > TX_MAX_ADVANCE_DELAY) {
+        MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, timestamp seems wrong, too much in advance (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_TOO_EARLY;
+    }
+
+    /* Check criteria_3: does this new packet overlap with a packet already enqueued ?
+     *  Note: - need to take into account packet's pre_delay and post_delay of each packet
+     *        - Valid for both Downlinks and beacon packets
+     *        - Beacon guard can be ignored if we try to queue a Class A downlink
+     */
+    i = jit_find_collision(queue, packet->count_us, packet_pre_delay, packet_post_delay, pkt_type);
+    if (i != -1) {
+        switch (queue->nodes[i].pkt_type) {
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
+            case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
+                MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet (type=%d) REJECTED, collision with packet already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
+                err_collision = JIT_ERROR_COLLISION_PACKET;
+                break;
+            case JIT_PKT_TYPE_BEACON:
+                if (pkt_type != JIT_PKT_TYPE_BEACON) {
+                    /* do not overload logs for beacon/beacon collision, as it is expected to happen with beacon pre-scheduling algorith used */
+                    MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet (type=%d) REJECTED, collision with beacon already programmed at %u (%u)\n", pkt_type, queue->nodes[i].pkt.count_us, packet->count_us);
+                }
+                err_collision = JIT_ERROR_COLLISION_BEACON;
+                break;
+            default:
+                MSG("ERROR: Unknown packet type, should not occur, BUG?\n");
+                assert(0);
+                err_collision = JIT_ERROR_INVALID;
+                break;
+        }
+        pthread_mutex_unlock(&mx_jit_queue);
+        return err_collision;
+    }
+
+    /* Finally enqueue it */
+    jit_insert_node(queue, packet, pkt_type, packet_pre_delay, packet_post_delay);
+
+    /* Done */
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    jit_print_queue(queue, false, DEBUG_JIT);
+
+    MSG_DEBUG(DEBUG_JIT, "enqueued packet with count_us=%u (size=%u bytes, toa=%u us, type=%u)\n", packet->count_us, packet->size, packet_post_delay, pkt_type);
+
+    return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e *pkt_type) {
+    if ((packet == NULL) || (pkt_type == NULL)) {
+        MSG("ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    if ((index < 0) || (index >= queue->capacity)) {
+        MSG("ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    if (jit_queue_is_empty(queue)) {
+        MSG("ERROR: cannot dequeue packet, JIT queue is empty\n");
+        return JIT_ERROR_EMPTY;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    if (queue->nodes[index].heap_pos < 0) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        MSG("ERROR: cannot dequeue packet, no packet at index %d\n", index);
+        return JIT_ERROR_INVALID;
+    }
+
+    /* Dequeue requested packet */
+    memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
+    *pkt_type = queue->nodes[index].pkt_type;
+    if (*pkt_type == JIT_PKT_TYPE_BEACON) {
+        MSG_DEBUG(DEBUG_BEACON, "--- Beacon dequeued ---\n");
+    }
+    jit_remove_node(queue, index);
+
+    /* Done */
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    jit_print_queue(queue, false, DEBUG_JIT);
+
+    MSG_DEBUG(DEBUG_JIT, "dequeued packet with count_us=%u from index %d\n", packet->count_us, index);
+
+    return JIT_ERROR_OK;
+}
+
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_idx) {
+    /* Return index of node containing a packet inline with given time */
+    int n;
+
+    if (pkt_idx == NULL) {
+        MSG("ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    if (jit_queue_is_empty(queue)) {
+        return JIT_ERROR_EMPTY;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    jit_extend_time(queue, time_us);
+
+    /* Highest priority packet to be sent is at the top of the heap */
+    *pkt_idx = -1;
+    while (queue->num_pkt > 0) {
+        n = queue->heap[0];
+
+        /* First check if that packet is outdated:
+         *  If a packet seems too much in advance, and was not rejected at enqueue time,
+         *  it means that we missed it for peeking, we need to drop it
+         *
+         *  Warning: unsigned arithmetic
+         *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
+         */
+        if ((queue->nodes[n].pkt.count_us - time_us) >= TX_MAX_ADVANCE_DELAY) {
+            /* We drop the packet to avoid lock-up */
+            if (queue->nodes[n].pkt_type == JIT_PKT_TYPE_BEACON) {
+                MSG("WARNING: --- Beacon dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[n].pkt.count_us);
+            } else {
+                MSG("WARNING: --- Packet dropped (current_time=%u, packet_time=%u) ---\n", time_us, queue->nodes[n].pkt.count_us);
+            }
+            jit_remove_node(queue, n);
+            continue;
+        }
+
+        /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+         *  Warning: unsigned arithmetic (handle roll-over)
+         *      t_packet < t_current + TX_JIT_DELAY
+         */
+        if ((queue->nodes[n].pkt.count_us - time_us) < TX_JIT_DELAY) {
+            *pkt_idx = n;
+            MSG_DEBUG(DEBUG_JIT, "peek packet with count_us=%u at index %d\n", queue->nodes[n].pkt.count_us, n);
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return JIT_ERROR_OK;
+}
+
+void jit_print_queue(struct jit_queue_s *queue, bool show_all, int debug_level) {
+    int i = 0;
+    int n;
+
+    if (queue->num_pkt == 0) {
+        MSG_DEBUG(debug_level, "INFO: [jit] queue is empty\n");
+    } else {
+        MSG_DEBUG(debug_level, "INFO: [jit] queue contains %d packets:\n", queue->num_pkt);
+        MSG_DEBUG(debug_level, "INFO: [jit] queue contains %d beacons:\n", queue->num_beacon);
+        if (show_all == true) {
+            for (i=0; i<queue->capacity; i++) {
+                MSG_DEBUG(debug_level, " - node[%d]: count_us=%u - type=%d%s\n",
+                            i,
+                            queue->nodes[i].pkt.count_us,
+                            queue->nodes[i].pkt_type,
+                            (queue->nodes[i].heap_pos < 0) ? " (free)" : "");
+            }
+        } else {
+            /* heap order: the first one is the next to be sent */
+            for (i=0; i<queue->num_pkt; i++) {
+                n = queue->heap[i];
+                MSG_DEBUG(debug_level, " - node[%d]: count_us=%u - type=%d\n",
+                            n,
+                            queue->nodes[n].pkt.count_us,
+                            queue->nodes[n].pkt_type);
+            }
+        }
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
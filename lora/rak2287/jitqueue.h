@@ -0,0 +1,185 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : Just In Time TX scheduling queue
+
+    Packets are kept in a pool of nodes allocated by jit_queue_init(), indexed
+    by two structures:
+     - a binary min-heap ordered on the packet timestamp, giving the next
+       packet to be sent,
+     - an interval tree (treap) of the TX windows [count_us - pre_delay,
+       count_us + post_delay], used for collision detection.
+    Enqueue, dequeue and collision detection are O(log n).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_JIT_H
+#define _LORA_PKTFWD_JIT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define JIT_QUEUE_MAX           32      /* default number of TX packets in a JIT queue */
+#define JIT_QUEUE_MAX_SIZE      4096    /* maximum capacity accepted by jit_queue_init */
+#define JIT_NUM_BEACON_IN_QUEUE 3       /* Number of beacons to be loaded in JiT queue at any given time */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+enum jit_pkt_type_e {
+    JIT_PKT_TYPE_DOWNLINK_CLASS_A,
+    JIT_PKT_TYPE_DOWNLINK_CLASS_B,
+    JIT_PKT_TYPE_DOWNLINK_CLASS_C,
+    JIT_PKT_TYPE_BEACON
+};
+
+enum jit_error_e {
+    JIT_ERROR_OK,               /* Packet ok to be sent */
+    JIT_ERROR_TOO_LATE,         /* Too late to send this packet */
+    JIT_ERROR_TOO_EARLY,        /* Too early to queue this packet */
+    JIT_ERROR_FULL,             /* Downlink queue is full */
+    JIT_ERROR_EMPTY,            /* Downlink queue is empty */
+    JIT_ERROR_COLLISION_PACKET, /* A packet is already enqueued for this timeframe */
+    JIT_ERROR_COLLISION_BEACON, /* A beacon is planned for this timeframe */
+    JIT_ERROR_TX_FREQ,          /* The required frequency for downlink is not supported */
+    JIT_ERROR_TX_POWER,         /* The required power for downlink is not supported */
+    JIT_ERROR_GPS_UNLOCKED,     /* GPS timestamp could not be used as GPS is unlocked */
+    JIT_ERROR_INVALID,          /* Packet is invalid */
+    JIT_ERROR_DUTY_CYCLE        /* Duty-cycle budget of the sub-band is exhausted */
+};
+
+struct jit_node_s {
+    /* API fields */
+    struct lgw_pkt_tx_s pkt;        /* TX packet */
+    enum jit_pkt_type_e pkt_type;   /* Packet type: Downlink, Beacon... */
+    uint32_t pre_delay;             /* Amount of time before packet timestamp to be reserved */
+    uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
+
+    /* Internal fields, only used by jitqueue.c */
+    int64_t time_us;                /* packet timestamp, extended to 64 bits (no roll-over) */
+    int64_t start_us;               /* start of the TX window: time_us - pre_delay */
+    int64_t end_us;                 /* end of the TX window: time_us + post_delay */
+    int64_t max_end_us;             /* highest end_us in the interval tree below this node */
+    int heap_pos;                   /* position in the heap, -1 if the node is free */
+    int left, right;                /* children in the interval tree, -1 if none */
+    uint32_t prio;                  /* random priority, balancing the interval tree */
+};
+
+struct jit_queue_s {
+    uint16_t capacity;              /* Number of nodes allocated */
+    uint16_t num_pkt;               /* Total number of packets in the queue (downlinks, beacons...) */
+    uint8_t num_beacon;             /* Number of beacons in the queue */
+    struct jit_node_s *nodes;       /* Node pool, indexed by jit_peek and jit_dequeue */
+
+    /* Internal fields, only used by jitqueue.c */
+    int *heap;                      /* node indexes, min-heap on the packet timestamp */
+    int *free_nodes;                /* stack of free node indexes */
+    int tree;                       /* root of the interval tree, -1 if empty */
+    uint32_t rand_state;            /* generator of the interval tree priorities */
+    uint32_t last_time_us;          /* last concentrator time given to the queue */
+    int64_t last_time_ext_us;       /* same, extended to 64 bits */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Allocate and initialize a JIT queue, or reset and resize a queue already initialized
+@param queue JIT queue to be initialized
+@param capacity maximum number of packets in the queue, 1 to JIT_QUEUE_MAX_SIZE
+@return JIT_ERROR_OK on success, JIT_ERROR_INVALID if the capacity is out of range or allocation failed
+*/
+enum jit_error_e jit_queue_init(struct jit_queue_s *queue, uint16_t capacity);
+
+/**
+@brief Check if a JIT queue is full.
+
+@param queue[in] Just in Time queue to be checked.
+@return true if queue is full, false otherwise.
+*/
+bool jit_queue_is_full(struct jit_queue_s *queue);
+
+/**
+@brief Check if a JIT queue is empty.
+
+@param queue[in] Just in Time queue to be checked.
+@return true if queue is empty, false otherwise.
+*/
+bool jit_queue_is_empty(struct jit_queue_s *queue);
+
+/**
+@brief Get the number of beacons in a JIT queue.
+
+@param queue[in] Just in Time queue to be checked.
+@return number of beacons currently queued
+*/
+int jit_queue_num_beacon(struct jit_queue_s *queue);
+
+/**
+@brief Get the timestamp of the next packet to be sent
+
+@param queue[in] Just in Time queue to be checked.
+@param count_us[out] timestamp of the first packet of the queue
+@return true if a packet is queued, false if the queue is empty
+*/
+bool jit_queue_next(struct jit_queue_s *queue, uint32_t *count_us);
+
+/**
+@brief Add a packet in a Just-in-Time queue
+
+@param queue[in/out] Just in Time queue in which the packet should be inserted
+@param time_us[in] current concentrator count
+@param packet[in] Packet to be queued in JiT queue
+@param pkt_type[in] Type of packet to be queued: Downlink, Beacon
+@return success if the function was able to queue the packet
+*/
+enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type);
+
+/**
+@brief Dequeue a packet from a Just-in-Time queue
+
+@param queue[in/out] Just in Time queue from which the packet should be removed
+@param index[in] in the queue where to get the packet to be removed
+@param packet[out] that was removed from the queue
+@param pkt_type[out] Type of packet removed
+@return success if the function was able to dequeue the packet
+*/
+enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e *pkt_type);
+
+/**
+@brief Check if there is a packet soon to be sent from the JiT queue.
+
+@param queue[in] Just in Time queue to parse for peeking a packet
+@param time_us[in] current concentrator count
+@param pkt_idx[out] index of the packet to be sent soon, -1 if none
+@return success if the function was able to parse the queue
+*/
+enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_idx);
+
+/**
+@brief Debug function to print the queue's content on console
+
+@param queue[in] Just in Time queue to be displayed
+@param show_all[in] Indicates if empty nodes have to be displayed or not
+@param debug_level[in] Debug level used for printing
+*/
+void jit_print_queue(struct jit_queue_s *queue, bool show_all, int debug_level);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
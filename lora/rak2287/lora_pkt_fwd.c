@@ -44,6 +44,11 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <netdb.h>      /* gai_strerror */
 
 #include <pthread.h>
+#include <semaphore.h>  /* sem_timedwait */
+#include <poll.h>       /* poll */
+#include <fcntl.h>      /* open */
+#include <sys/ioctl.h>  /* ioctl */
+#include <linux/gpio.h> /* gpiochip line events */
 
 #include "trace.h"
 #include "jitqueue.h"
@@ -53,6 +58,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_aux.h"
 #include "loragw_reg.h"
 #include "loragw_gps.h"
+#include "loragw_sim.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -80,9 +86,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEFAULT_STAT 30     /* default time interval for statistics */
 #define PUSH_TIMEOUT_MS 100
 #define PULL_TIMEOUT_MS 200
-#define GPS_REF_MAX_AGE 30 /* maximum admitted delay in seconds of GPS loss before considering latest GPS sync unusable */
-#define FETCH_SLEEP_MS 10  /* nb of ms waited when a fetch return no packets */
-#define BEACON_POLL_MS 50  /* time in ms between polling of beacon TX status */
+#define GPS_REF_MAX_AGE 30  /* maximum admitted delay in seconds of GPS loss before considering latest GPS sync unusable */
+#define FETCH_SLEEP_MS 10   /* nb of ms waited when a fetch return no packets */
+#define FETCH_POLL_MIN_MS 1 /* nb of ms waited after the first fetch that returns no packets */
+#define BEACON_POLL_MS 50   /* time in ms between polling of beacon TX status */
+#define BEACON_SCHED_MS 500 /* time in ms between runs of the beacon scheduler */
+
+#define JIT_PEEK_ADVANCE_US 40000 /* TX_JIT_DELAY of jitqueue.c: jit_peek returns the packets due within this delay */
+#define JIT_SLEEP_MIN_US 1000     /* JIT thread sleep when a packet is already due */
+#define JIT_SLEEP_MAX_MS 1000     /* JIT thread sleep when no packet is queued, an enqueue wakes it up anyway */
+
+#define TX_POWER_MAP_MIN -10 /* lowest TX power in dBm resolved by the direct TX gain LUT lookup */
+#define TX_POWER_MAP_MAX 30  /* highest TX power in dBm resolved by the direct TX gain LUT lookup */
 
 #define PROTOCOL_VERSION 2 /* v1.6 */
 #define PROTOCOL_JSON_RXPK_FRAME_FORMAT 1
@@ -99,15 +114,22 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define NB_PKT_MAX 255 /* max number of packets per fetch/send cycle */
 
+#define RX_RING_SIZE 1024 /* nb of packets buffered between fetch and upstream threads, must be a power of 2 */
+#define PUSH_WINDOW_SIZE 32 /* max nb of PUSH_DATA datagrams waiting for their PUSH_ACK, must be a power of 2 */
+
 #define MIN_LORA_PREAMB 6 /* minimum Lora preamble length for this application */
 #define STD_LORA_PREAMB 8
 #define MIN_FSK_PREAMB 3 /* minimum FSK preamble length for this application */
 #define STD_FSK_PREAMB 5
 
-#define STATUS_SIZE 200
+#define STATUS_SIZE 300
 #define TX_BUFF_SIZE ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
 #define ACK_BUFF_SIZE 64
 
+#define RXPK_META_MAX 280                                     /* worst case size of a rxpk object, excluding its base64 payload */
+#define COALESCE_BYTES_LIMIT (TX_BUFF_SIZE - STATUS_SIZE - 4) /* room kept for the status report and the end of the JSON */
+#define DEFAULT_COALESCE_MAX_BYTES 1472                       /* Ethernet MTU minus IPv4 and UDP headers */
+
 #define UNIX_GPS_EPOCH_OFFSET 315964800 /* Number of seconds ellapsed between 01.Jan.1970 00:00:00 \
                                                                           and 06.Jan.1980 00:00:00 */
 
@@ -119,6 +141,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEFAULT_BEACON_POWER 14
 #define DEFAULT_BEACON_INFODESC 0
 
+#define DUTY_CYCLE_BANDS_MAX 8         /* max number of duty-cycle sub-bands */
+#define DUTY_CYCLE_SLICES 60           /* number of time slices of the duty-cycle sliding window */
+#define DEFAULT_DUTY_CYCLE_WINDOW 3600 /* duty-cycle observation window, in seconds */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
@@ -132,6 +158,31 @@ typedef struct spectral_scan_s
     uint32_t pace_s;        /* number of seconds between 2 scans in the thread */
 } spectral_scan_t;
 
+/* PUSH_DATA datagram waiting for its PUSH_ACK */
+typedef struct push_inflight_s
+{
+    bool pending;              /* true until the PUSH_ACK is received or the slot is reused */
+    uint16_t token;            /* token of the datagram, its low bits are the slot index */
+    struct timespec send_time; /* time at which the datagram was sent */
+} push_inflight_t;
+
+/* TX gain LUT entry to be used for a requested TX power */
+typedef struct tx_power_map_s
+{
+    int8_t lut_index; /* index in txlut, -1 if all LUT powers are above the requested one */
+    int8_t rf_power;  /* power actually used, in dBm: that LUT entry, or the lowest LUT power if lut_index is -1 */
+} tx_power_map_t;
+
+/* downlink airtime accounting of a duty-cycle sub-band */
+typedef struct duty_cycle_band_s
+{
+    uint32_t freq_min;                        /* lowest frequency of the sub-band, in Hz */
+    uint32_t freq_max;                        /* highest frequency of the sub-band (excluded), in Hz */
+    uint32_t max_airtime_ms;                  /* airtime allowed over the window, in ms */
+    uint32_t airtime_ms;                      /* airtime used over the window, sum of slice_ms */
+    uint32_t slice_ms[DUTY_CYCLE_SLICES + 1]; /* airtime used in each slice, the current one included */
+} duty_cycle_band_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -163,6 +214,7 @@ static int sock_up;   /* socket for upstream traffic */
 static int sock_down; /* socket for downstream traffic */
 
 /* network protocol variables */
+static uint32_t push_timeout_ms = PUSH_TIMEOUT_MS;                      /* time-out of the upstream PUSH_DATA acknowledges */
 static struct timeval push_timeout_half = {0, (PUSH_TIMEOUT_MS * 500)}; /* cut in half, critical for throughput */
 static struct timeval pull_timeout = {0, (PULL_TIMEOUT_MS * 1000)};     /* non critical for throughput */
 
@@ -172,6 +224,12 @@ static pthread_mutex_t mx_xcorr = PTHREAD_MUTEX_INITIALIZER; /* control access t
 static bool xtal_correct_ok = false;                         /* set true when XTAL correction is stable enough */
 static double xtal_correct = 1.0;
 
+/* adaptive concentrator polling, the interval doubles at each empty fetch from min to max */
+static unsigned fetch_poll_min_ms = FETCH_POLL_MIN_MS; /* interval after the first empty fetch */
+static unsigned fetch_poll_max_ms = FETCH_SLEEP_MS;    /* interval when idle */
+static char fetch_irq_chip[64] = "\0";                 /* gpiochip device the SX130x interrupt is wired on, empty = none */
+static int fetch_irq_line = -1;                        /* line offset of the SX130x interrupt on that gpiochip */
+
 /* GPS configuration and synchronization */
 static char gps_tty_path[64] = "\0"; /* path of the TTY port GPS is connected on */
 static int gps_tty_fd = -1;          /* file descriptor of the GPS TTY port */
@@ -199,6 +257,12 @@ static uint32_t meas_up_network_byte = 0;                      /* sum of UDP byt
 static uint32_t meas_up_payload_byte = 0;                      /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t meas_up_dgram_sent = 0;                        /* number of datagrams sent for upstream traffic */
 static uint32_t meas_up_ack_rcv = 0;                           /* number of datagrams acknowledged for upstream traffic */
+static uint32_t meas_nb_rx_drop = 0;                           /* count packets dropped because the RX ring was full */
+static uint32_t meas_up_ack_rtt_sum = 0;                       /* sum of PUSH_DATA/PUSH_ACK round-trip times, in ms */
+static uint32_t meas_up_ack_rtt_max = 0;                       /* max PUSH_DATA/PUSH_ACK round-trip time, in ms */
+static uint32_t meas_up_coalesce_max = 0;                      /* max time a rxpk was held for coalescing, in ms */
+static uint32_t meas_nb_fetch = 0;                             /* number of lgw_receive calls */
+static uint32_t meas_nb_fetch_irq = 0;                         /* number of fetches woken up by the SX130x interrupt */
 
 static pthread_mutex_t mx_meas_dw = PTHREAD_MUTEX_INITIALIZER; /* control access to the downstream measurements */
 static uint32_t meas_dw_pull_sent = 0;                         /* number of PULL requests sent for downstream traffic */
@@ -213,6 +277,7 @@ static uint32_t meas_nb_tx_rejected_collision_packet = 0;      /* count packets
 static uint32_t meas_nb_tx_rejected_collision_beacon = 0;      /* count packets were TX request were rejected due to collision with a beacon already programmed */
 static uint32_t meas_nb_tx_rejected_too_late = 0;              /* count packets were TX request were rejected because it is too late to program it */
 static uint32_t meas_nb_tx_rejected_too_early = 0;             /* count packets were TX request were rejected because timestamp is too much in advance */
+static uint32_t meas_nb_tx_rejected_duty_cycle = 0;            /* count packets were TX request were rejected because the sub-band duty-cycle was exhausted */
 static uint32_t meas_nb_beacon_queued = 0;                     /* count beacon inserted in jit queue */
 static uint32_t meas_nb_beacon_sent = 0;                       /* count beacon actually sent to concentrator */
 static uint32_t meas_nb_beacon_rejected = 0;                   /* count beacon rejected for queuing */
@@ -239,8 +304,34 @@ static uint8_t beacon_infodesc = DEFAULT_BEACON_INFODESC;    /* set beacon infor
 /* auto-quit function */
 static uint32_t autoquit_threshold = 0; /* enable auto-quit after a number of non-acknowledged PULL_DATA (0 = disabled)*/
 
+/* uplink coalescing, rxpk are accumulated across fetch cycles in one PUSH_DATA */
+static unsigned coalesce_max_pkt = NB_PKT_MAX; /* max number of rxpk in a PUSH_DATA */
+static unsigned coalesce_max_bytes = 0;        /* max size of a PUSH_DATA, 0 = default */
+static unsigned coalesce_max_latency_ms = 0;   /* max time a rxpk is held before being sent (0 = coalescing disabled) */
+
+/* RX ring, single producer (fetch thread) / single consumer (upstream thread), lock-free */
+static struct lgw_pkt_rx_s rx_ring[RX_RING_SIZE];
+static uint32_t rx_ring_head = 0; /* next slot to be written, only modified by the fetch thread */
+static uint32_t rx_ring_tail = 0; /* next slot to be read, only modified by the upstream thread */
+static sem_t rx_ring_sem;         /* posted by the fetch thread when new packets are available */
+
+/* PUSH_DATA datagrams in flight, indexed by the low bits of their token */
+static pthread_mutex_t mx_push_inflight = PTHREAD_MUTEX_INITIALIZER; /* control access to the in-flight table */
+static push_inflight_t push_inflight[PUSH_WINDOW_SIZE];
+
 /* Just In Time TX scheduling */
 static struct jit_queue_s jit_queue[LGW_RF_CHAIN_NB];
+static uint16_t jit_queue_size = JIT_QUEUE_MAX;                 /* capacity of each JIT queue */
+static pthread_mutex_t mx_jit_wake = PTHREAD_MUTEX_INITIALIZER; /* control access to the JIT thread wake-up flag */
+static pthread_cond_t cond_jit_wake;                            /* signaled on enqueue, uses CLOCK_MONOTONIC */
+static bool jit_wake_pending = false;
+
+/* downlink duty-cycle, the airtime of each sub-band is summed over a window sliding by slices */
+static pthread_mutex_t mx_duty_cycle = PTHREAD_MUTEX_INITIALIZER; /* control access to the duty-cycle accounting */
+static duty_cycle_band_t duty_cycle_bands[DUTY_CYCLE_BANDS_MAX];
+static int duty_cycle_nb_bands = 0;                              /* 0 = no duty-cycle limitation */
+static uint32_t duty_cycle_window_s = DEFAULT_DUTY_CYCLE_WINDOW; /* observation window, in seconds */
+static uint64_t duty_cycle_slice = 0;                            /* index of the current slice since the monotonic clock origin */
 
 /* Gateway specificities */
 static int8_t antenna_gain = 0;
@@ -250,6 +341,7 @@ static struct lgw_tx_gain_lut_s txlut[LGW_RF_CHAIN_NB]; /* TX gain table */
 static uint32_t tx_freq_min[LGW_RF_CHAIN_NB];           /* lowest frequency supported by TX chain */
 static uint32_t tx_freq_max[LGW_RF_CHAIN_NB];           /* highest frequency supported by TX chain */
 static bool tx_enable[LGW_RF_CHAIN_NB] = {false};       /* Is TX enabled for a given RF chain ? */
+static tx_power_map_t tx_power_map[LGW_RF_CHAIN_NB][TX_POWER_MAP_MAX - TX_POWER_MAP_MIN + 1]; /* txlut lookup, indexed by requested dBm */
 
 static uint32_t nb_pkt_log[LGW_IF_CHAIN_NB][8]; /* [CH][SF] */
 static uint32_t nb_pkt_received_lora = 0;
@@ -278,6 +370,9 @@ static void sig_handler(int sigio);
 
 static int parse_SX130x_configuration(const char *conf_file);
 
+/* defined in loragw_hal.c, not exported by loragw_hal.h */
+int lgw_temperature_setconf(uint32_t max_age_ms);
+
 static int parse_gateway_configuration(const char *conf_file);
 
 static int parse_debug_configuration(const char *conf_file);
@@ -290,11 +385,40 @@ static void gps_process_sync(void);
 
 static void gps_process_coords(void);
 
-static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t *lut_index);
+static int tx_gain_lut_search(uint8_t rf_chain, int8_t rf_power);
+
+static void tx_power_map_build(uint8_t rf_chain);
+
+static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t *lut_index, int8_t *lut_power);
+
+static bool rx_ring_push(const struct lgw_pkt_rx_s *pkt);
+
+static int rx_ring_pop(struct lgw_pkt_rx_s *pkt_array, int max_pkt);
+
+static int fetch_irq_open(void);
+
+static bool fetch_wait(int irq_fd, unsigned timeout_ms);
+
+static void jit_wake(void);
+
+static uint32_t jit_next_sleep_us(uint32_t time_us);
+
+static void jit_sleep(uint32_t sleep_us);
+
+static int duty_cycle_band(uint32_t freq_hz);
+
+static void duty_cycle_slide(void);
+
+static bool duty_cycle_check(uint32_t freq_hz, uint32_t airtime_ms);
+
+static void duty_cycle_add(uint32_t freq_hz, uint32_t airtime_ms);
 
 /* threads */
+void thread_fetch(void);
 void thread_up(void);
+void thread_up_ack(void);
 void thread_down(void);
+void thread_beacon(void);
 void thread_jit(void);
 void thread_gps(void);
 void thread_valid(void);
@@ -462,6 +586,23 @@ static int parse_SX130x_configuration(const char *conf_file)
     }
     MSG("INFO: antenna_gain %d dBi\n", antenna_gain);
 
+    /* set staleness bound of the temperature used for RSSI compensation */
+    val = json_object_get_value(conf_obj, "temperature_max_age_ms"); /* fetch value (if possible) */
+    if (val != NULL)
+    {
+        if (json_value_get_type(val) != JSONNumber)
+        {
+            MSG("ERROR: Data type for temperature_max_age_ms seems wrong, please check\n");
+            return -1;
+        }
+        if (lgw_temperature_setconf((uint32_t)json_value_get_number(val)) != LGW_HAL_SUCCESS)
+        {
+            MSG("ERROR: Failed to configure temperature sampling\n");
+            return -1;
+        }
+        MSG("INFO: temperature used for RSSI compensation is at most %u ms old\n", (uint32_t)json_value_get_number(val));
+    }
+
     /* set timestamp configuration */
     conf_ts_obj = json_object_get_object(conf_obj, "fine_timestamp");
     if (conf_ts_obj == NULL)
@@ -1001,6 +1142,7 @@ static int parse_SX130x_configuration(const char *conf_file)
             }
             MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d, single input mode %d\n", i, str, rfconf.freq_hz, rfconf.rssi_offset, rfconf.tx_enable, rfconf.single_input_mode);
         }
+        tx_power_map_build(i); /* txlut is empty if TX is disabled */
         /* all parameters parsed, submitting configuration to the HAL */
         if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS)
         {
@@ -1289,6 +1431,10 @@ static int parse_gateway_configuration(const char *conf_file)
     JSON_Value *val = NULL; /* needed to detect the absence of some fields */
     const char *str;        /* pointer to sub-strings in the JSON data */
     unsigned long long ull = 0;
+    JSON_Array *conf_dc_array = NULL;
+    JSON_Object *conf_dc_obj = NULL;
+    double dc_percent;
+    int i;
 
     /* try to parse JSON */
     root_val = json_parse_file_with_comments(conf_file);
@@ -1362,8 +1508,83 @@ static int parse_gateway_configuration(const char *conf_file)
     val = json_object_get_value(conf_obj, "push_timeout_ms");
     if (val != NULL)
     {
-        push_timeout_half.tv_usec = 500 * (long int)json_value_get_number(val);
-        MSG("INFO: upstream PUSH_DATA time-out is configured to %u ms\n", (unsigned)(push_timeout_half.tv_usec / 500));
+        push_timeout_ms = (uint32_t)json_value_get_number(val);
+        /* half of it, normalized so that long time-outs (eg. cellular backhaul) give a valid timeval */
+        push_timeout_half.tv_sec = push_timeout_ms / 2000;
+        push_timeout_half.tv_usec = 500 * (long int)(push_timeout_ms % 2000);
+        MSG("INFO: upstream PUSH_DATA time-out is configured to %u ms\n", push_timeout_ms);
+    }
+
+    /* uplink coalescing parameters (optional) */
+    val = json_object_get_value(conf_obj, "coalesce_max_latency_ms");
+    if (val != NULL)
+    {
+        coalesce_max_latency_ms = (unsigned)json_value_get_number(val);
+        if (coalesce_max_latency_ms > 0)
+        {
+            MSG("INFO: upstream coalescing enabled, rxpk held for up to %u ms\n", coalesce_max_latency_ms);
+        }
+        else
+        {
+            MSG("INFO: upstream coalescing disabled\n");
+        }
+    }
+    val = json_object_get_value(conf_obj, "coalesce_max_pkt");
+    if (val != NULL)
+    {
+        coalesce_max_pkt = (unsigned)json_value_get_number(val);
+        if ((coalesce_max_pkt < 1) || (coalesce_max_pkt > NB_PKT_MAX))
+        {
+            MSG("ERROR: invalid configuration for coalesce_max_pkt, must be in [1..%u]\n", NB_PKT_MAX);
+            return -1;
+        }
+        MSG("INFO: upstream coalescing limited to %u rxpk per PUSH_DATA\n", coalesce_max_pkt);
+    }
+    val = json_object_get_value(conf_obj, "coalesce_max_bytes");
+    if (val != NULL)
+    {
+        coalesce_max_bytes = (unsigned)json_value_get_number(val);
+        if (coalesce_max_bytes > (unsigned)COALESCE_BYTES_LIMIT)
+        {
+            MSG("ERROR: invalid configuration for coalesce_max_bytes, must be <= %u\n", (unsigned)COALESCE_BYTES_LIMIT);
+            return -1;
+        }
+        MSG("INFO: upstream coalescing limited to %u bytes per PUSH_DATA\n", coalesce_max_bytes);
+    }
+
+    /* concentrator polling interval bounds (optional) */
+    val = json_object_get_value(conf_obj, "fetch_poll_min_ms");
+    if (val != NULL)
+    {
+        fetch_poll_min_ms = (unsigned)json_value_get_number(val);
+    }
+    val = json_object_get_value(conf_obj, "fetch_poll_max_ms");
+    if (val != NULL)
+    {
+        fetch_poll_max_ms = (unsigned)json_value_get_number(val);
+    }
+    if ((fetch_poll_min_ms < 1) || (fetch_poll_min_ms > fetch_poll_max_ms))
+    {
+        MSG("ERROR: invalid configuration for concentrator polling, must be 1 <= fetch_poll_min_ms <= fetch_poll_max_ms\n");
+        return -1;
+    }
+    MSG("INFO: concentrator polled every %u to %u ms\n", fetch_poll_min_ms, fetch_poll_max_ms);
+
+    /* SX130x interrupt line (optional) */
+    str = json_object_get_string(conf_obj, "fetch_irq_gpiochip");
+    if (str != NULL)
+    {
+        strncpy(fetch_irq_chip, str, sizeof fetch_irq_chip);
+        fetch_irq_chip[sizeof fetch_irq_chip - 1] = '\0'; /* ensure string termination */
+    }
+    val = json_object_get_value(conf_obj, "fetch_irq_line");
+    if (val != NULL)
+    {
+        fetch_irq_line = (int)json_value_get_number(val);
+    }
+    if ((fetch_irq_chip[0] != '\0') && (fetch_irq_line >= 0))
+    {
+        MSG("INFO: concentrator interrupt expected on %s line %d\n", fetch_irq_chip, fetch_irq_line);
     }
 
     /* packet filtering parameters */
@@ -1510,6 +1731,73 @@ static int parse_gateway_configuration(const char *conf_file)
         MSG("INFO: Auto-quit after %u non-acknowledged PULL_DATA\n", autoquit_threshold);
     }
 
+    /* JIT queue capacity (optional) */
+    val = json_object_get_value(conf_obj, "jit_queue_size");
+    if (val != NULL)
+    {
+        if ((json_value_get_type(val) != JSONNumber) || (json_value_get_number(val) < 1) || (json_value_get_number(val) > JIT_QUEUE_MAX_SIZE))
+        {
+            MSG("ERROR: jit_queue_size must be a number from 1 to %u, please check\n", JIT_QUEUE_MAX_SIZE);
+            return -1;
+        }
+        jit_queue_size = (uint16_t)json_value_get_number(val);
+        MSG("INFO: JIT queues can hold up to %u packets\n", jit_queue_size);
+    }
+
+    /* Duty-cycle observation window (optional) */
+    val = json_object_get_value(conf_obj, "duty_cycle_window");
+    if (val != NULL)
+    {
+        if ((json_value_get_type(val) != JSONNumber) || (json_value_get_number(val) < DUTY_CYCLE_SLICES) || (json_value_get_number(val) > 86400))
+        {
+            MSG("ERROR: duty_cycle_window must be a number of seconds from %u to 86400, please check\n", DUTY_CYCLE_SLICES);
+            json_value_free(root_val);
+            return -1;
+        }
+        duty_cycle_window_s = (uint32_t)json_value_get_number(val);
+    }
+
+    /* Duty-cycle sub-bands (optional) */
+    conf_dc_array = json_object_get_array(conf_obj, "duty_cycle");
+    if (conf_dc_array != NULL)
+    {
+        if (json_array_get_count(conf_dc_array) > DUTY_CYCLE_BANDS_MAX)
+        {
+            MSG("ERROR: too many duty-cycle sub-bands (max:%u), please check\n", DUTY_CYCLE_BANDS_MAX);
+            json_value_free(root_val);
+            return -1;
+        }
+        memset(duty_cycle_bands, 0, sizeof duty_cycle_bands);
+        duty_cycle_nb_bands = (int)json_array_get_count(conf_dc_array);
+        for (i = 0; i < duty_cycle_nb_bands; i++)
+        {
+            conf_dc_obj = json_array_get_object(conf_dc_array, i);
+            if (conf_dc_obj == NULL)
+            {
+                MSG("ERROR: duty-cycle sub-band %d is not a JSON object, please check\n", i);
+                json_value_free(root_val);
+                return -1;
+            }
+            duty_cycle_bands[i].freq_min = (uint32_t)json_object_get_number(conf_dc_obj, "freq_min");
+            duty_cycle_bands[i].freq_max = (uint32_t)json_object_get_number(conf_dc_obj, "freq_max");
+            dc_percent = json_object_get_number(conf_dc_obj, "max_duty_cycle");
+            if ((duty_cycle_bands[i].freq_min >= duty_cycle_bands[i].freq_max) || (dc_percent <= 0.0) || (dc_percent > 100.0))
+            {
+                MSG("ERROR: invalid duty-cycle sub-band %d (freq_min:%u, freq_max:%u, max_duty_cycle:%.2f%%), please check\n", i, duty_cycle_bands[i].freq_min, duty_cycle_bands[i].freq_max, dc_percent);
+                json_value_free(root_val);
+                return -1;
+            }
+            duty_cycle_bands[i].max_airtime_ms = (uint32_t)(duty_cycle_window_s * 10.0 * dc_percent); /* window in ms * percent / 100 */
+            if (duty_cycle_bands[i].max_airtime_ms == 0)
+            {
+                MSG("ERROR: duty-cycle sub-band %d allows less than 1 ms of airtime per %u s (max_duty_cycle:%.4f%%), please check\n", i, duty_cycle_window_s, dc_percent);
+                json_value_free(root_val);
+                return -1;
+            }
+            MSG("INFO: Downlink duty-cycle limited to %.2f%% (%u ms per %u s) from %u Hz to %u Hz\n", dc_percent, duty_cycle_bands[i].max_airtime_ms, duty_cycle_window_s, duty_cycle_bands[i].freq_min, duty_cycle_bands[i].freq_max);
+        }
+    }
+
     /* free JSON parsing data structure */
     json_value_free(root_val);
     return 0;
@@ -1628,6 +1916,253 @@ static double difftimespec(struct timespec end, struct timespec beginning)
     return x;
 }
 
+static bool rx_ring_push(const struct lgw_pkt_rx_s *pkt)
+{
+    uint32_t head = rx_ring_head; /* only written by this thread */
+    uint32_t tail = __atomic_load_n(&rx_ring_tail, __ATOMIC_ACQUIRE);
+
+    if ((head - tail) >= RX_RING_SIZE)
+    {
+        return false; /* ring is full */
+    }
+
+    rx_ring[head & (RX_RING_SIZE - 1)] = *pkt;
+    __atomic_store_n(&rx_ring_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static int rx_ring_pop(struct lgw_pkt_rx_s *pkt_array, int max_pkt)
+{
+    uint32_t tail = rx_ring_tail; /* only written by this thread */
+    uint32_t head = __atomic_load_n(&rx_ring_head, __ATOMIC_ACQUIRE);
+    int nb_pkt = 0;
+
+    while ((tail != head) && (nb_pkt < max_pkt))
+    {
+        pkt_array[nb_pkt] = rx_ring[tail & (RX_RING_SIZE - 1)];
+        ++nb_pkt;
+        ++tail;
+    }
+    __atomic_store_n(&rx_ring_tail, tail, __ATOMIC_RELEASE);
+
+    return nb_pkt;
+}
+
+static int fetch_irq_open(void)
+{
+    int chip_fd;
+    struct gpioevent_request req;
+
+    if ((fetch_irq_chip[0] == '\0') || (fetch_irq_line < 0))
+    {
+        return -1;
+    }
+
+    chip_fd = open(fetch_irq_chip, O_RDONLY);
+    if (chip_fd < 0)
+    {
+        MSG("WARNING: [fetch] failed to open %s (%s), concentrator will be polled\n", fetch_irq_chip, strerror(errno));
+        return -1;
+    }
+
+    memset(&req, 0, sizeof req);
+    req.lineoffset = (uint32_t)fetch_irq_line;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(req.consumer_label, "lora_pkt_fwd", sizeof req.consumer_label - 1);
+    if (ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0)
+    {
+        MSG("WARNING: [fetch] failed to request events on %s line %d (%s), concentrator will be polled\n", fetch_irq_chip, fetch_irq_line, strerror(errno));
+        close(chip_fd);
+        return -1;
+    }
+    close(chip_fd); /* the line event fd stays valid */
+
+    return req.fd;
+}
+
+static bool fetch_wait(int irq_fd, unsigned timeout_ms)
+{
+    struct pollfd pfd;
+    struct gpioevent_data evt;
+
+    if (irq_fd < 0)
+    {
+        wait_ms(timeout_ms);
+        return false;
+    }
+
+    pfd.fd = irq_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if ((poll(&pfd, 1, (int)timeout_ms) <= 0) || ((pfd.revents & POLLIN) == 0))
+    {
+        return false;
+    }
+
+    /* consume the edge event(s), the concentrator is read right after */
+    while (read(irq_fd, &evt, sizeof evt) == (ssize_t)sizeof evt)
+    {
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, 0) <= 0) || ((pfd.revents & POLLIN) == 0))
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void jit_wake(void)
+{
+    pthread_mutex_lock(&mx_jit_wake);
+    jit_wake_pending = true;
+    pthread_cond_signal(&cond_jit_wake);
+    pthread_mutex_unlock(&mx_jit_wake);
+}
+
+static uint32_t jit_next_sleep_us(uint32_t time_us)
+{
+    int32_t min_us = (JIT_SLEEP_MAX_MS * 1000) + JIT_PEEK_ADVANCE_US;
+    int32_t diff_us;
+    uint32_t count_us;
+    int i;
+
+    /* jit_enqueue wakes this thread up when done: a value read before an enqueue is superseded right away */
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++)
+    {
+        if (jit_queue_next(&jit_queue[i], &count_us) == true)
+        {
+            diff_us = (int32_t)(count_us - time_us);
+            if (diff_us < min_us)
+            {
+                min_us = diff_us;
+            }
+        }
+    }
+
+    /* jit_peek returns a packet JIT_PEEK_ADVANCE_US before its timestamp */
+    min_us -= JIT_PEEK_ADVANCE_US;
+
+    return (min_us < JIT_SLEEP_MIN_US) ? JIT_SLEEP_MIN_US : (uint32_t)min_us;
+}
+
+static void jit_sleep(uint32_t sleep_us)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += sleep_us / 1000000;
+    deadline.tv_nsec += (long)(sleep_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&mx_jit_wake);
+    while ((jit_wake_pending == false) && !exit_sig && !quit_sig)
+    {
+        if (pthread_cond_timedwait(&cond_jit_wake, &mx_jit_wake, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    jit_wake_pending = false;
+    pthread_mutex_unlock(&mx_jit_wake);
+}
+
+static int duty_cycle_band(uint32_t freq_hz)
+{
+    int i;
+
+    for (i = 0; i < duty_cycle_nb_bands; i++)
+    {
+        if ((freq_hz >= duty_cycle_bands[i].freq_min) && (freq_hz < duty_cycle_bands[i].freq_max))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void duty_cycle_slide(void)
+{
+    struct timespec now;
+    uint64_t slice;
+    uint64_t nb_slices;
+    uint64_t k;
+    uint32_t idx;
+    int i;
+
+    /* must be called with mx_duty_cycle locked */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slice = ((uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000) / ((uint64_t)duty_cycle_window_s * 1000 / DUTY_CYCLE_SLICES);
+    if (slice <= duty_cycle_slice)
+    {
+        return;
+    }
+
+    /* the ring holds the current slice and the DUTY_CYCLE_SLICES previous ones, so that the airtime
+       is summed over at least the whole window: clear the slices leaving it, all of them after a long idle time */
+    nb_slices = slice - duty_cycle_slice;
+    if (nb_slices > (DUTY_CYCLE_SLICES + 1))
+    {
+        nb_slices = DUTY_CYCLE_SLICES + 1;
+    }
+    for (k = 1; k <= nb_slices; k++)
+    {
+        idx = (uint32_t)((duty_cycle_slice + k) % (DUTY_CYCLE_SLICES + 1));
+        for (i = 0; i < duty_cycle_nb_bands; i++)
+        {
+            duty_cycle_bands[i].airtime_ms -= duty_cycle_bands[i].slice_ms[idx];
+            duty_cycle_bands[i].slice_ms[idx] = 0;
+        }
+    }
+    duty_cycle_slice = slice;
+}
+
+static bool duty_cycle_check(uint32_t freq_hz, uint32_t airtime_ms)
+{
+    int band;
+    bool ok;
+
+    /* frequencies outside of the configured sub-bands are not restricted */
+    band = duty_cycle_band(freq_hz);
+    if (band < 0)
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&mx_duty_cycle);
+    duty_cycle_slide();
+    ok = ((duty_cycle_bands[band].airtime_ms + airtime_ms) <= duty_cycle_bands[band].max_airtime_ms);
+    pthread_mutex_unlock(&mx_duty_cycle);
+
+    return ok;
+}
+
+static void duty_cycle_add(uint32_t freq_hz, uint32_t airtime_ms)
+{
+    int band;
+    uint32_t idx;
+
+    band = duty_cycle_band(freq_hz);
+    if (band < 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&mx_duty_cycle);
+    duty_cycle_slide();
+    idx = (uint32_t)(duty_cycle_slice % (DUTY_CYCLE_SLICES + 1));
+    duty_cycle_bands[band].slice_ms[idx] += airtime_ms;
+    duty_cycle_bands[band].airtime_ms += airtime_ms;
+    pthread_mutex_unlock(&mx_duty_cycle);
+}
+
 static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error, int32_t error_value)
 {
     uint8_t buff_ack[ACK_BUFF_SIZE]; /* buffer to give feedback to server */
@@ -1700,6 +2235,14 @@ static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error,
             meas_nb_tx_rejected_collision_beacon += 1;
             pthread_mutex_unlock(&mx_meas_dw);
             break;
+        case JIT_ERROR_DUTY_CYCLE:
+            memcpy((void *)(buff_ack + buff_index), (void *)"\"DUTY_CYCLE\"", 12);
+            buff_index += 12;
+            /* update stats */
+            pthread_mutex_lock(&mx_meas_dw);
+            meas_nb_tx_rejected_duty_cycle += 1;
+            pthread_mutex_unlock(&mx_meas_dw);
+            break;
         case JIT_ERROR_TX_FREQ:
             memcpy((void *)(buff_ack + buff_index), (void *)"\"TX_FREQ\"", 9);
             buff_index += 9;
@@ -1764,12 +2307,16 @@ int main(int argc, char **argv)
     const char *local_conf_fname = default_local_conf_fname;
 
     /* threads */
+    pthread_t thrid_fetch;
     pthread_t thrid_up;
+    pthread_t thrid_up_ack;
     pthread_t thrid_down;
+    pthread_t thrid_beacon;
     pthread_t thrid_gps;
     pthread_t thrid_valid;
     pthread_t thrid_jit;
     pthread_t thrid_ss;
+    pthread_condattr_t cond_attr;
 
     /* network socket creation */
     struct addrinfo hints;
@@ -1788,6 +2335,12 @@ int main(int argc, char **argv)
     uint32_t cp_up_payload_byte;
     uint32_t cp_up_dgram_sent;
     uint32_t cp_up_ack_rcv;
+    uint32_t cp_nb_rx_drop;
+    uint32_t cp_up_ack_rtt_sum;
+    uint32_t cp_up_ack_rtt_max;
+    uint32_t cp_up_coalesce_max;
+    uint32_t cp_nb_fetch;
+    uint32_t cp_nb_fetch_irq;
     uint32_t cp_dw_pull_sent;
     uint32_t cp_dw_ack_rcv;
     uint32_t cp_dw_dgram_rcv;
@@ -1800,6 +2353,7 @@ int main(int argc, char **argv)
     uint32_t cp_nb_tx_rejected_collision_beacon = 0;
     uint32_t cp_nb_tx_rejected_too_late = 0;
     uint32_t cp_nb_tx_rejected_too_early = 0;
+    uint32_t cp_nb_tx_rejected_duty_cycle = 0;
     uint32_t cp_nb_beacon_queued = 0;
     uint32_t cp_nb_beacon_sent = 0;
     uint32_t cp_nb_beacon_rejected = 0;
@@ -1822,6 +2376,9 @@ int main(int argc, char **argv)
     float rx_nocrc_ratio;
     float up_ack_ratio;
     float dw_ack_ratio;
+    uint32_t dc_airtime_ms[DUTY_CYCLE_BANDS_MAX];
+    float dc_usage[DUTY_CYCLE_BANDS_MAX]; /* percentage of the duty-cycle budget used */
+    int status_len;
 
     /* Parse command line options */
     while ((i = getopt(argc, argv, "hc:")) != -1)
@@ -2009,7 +2566,7 @@ int main(int argc, char **argv)
     }
     freeaddrinfo(result);
 
-    if (com_type == LGW_COM_SPI)
+    if ((com_type == LGW_COM_SPI) && (lgw_sim_enabled() == false))
     {
         /* Board reset */
         if (system("./reset_lgw.sh start") != 0)
@@ -2051,12 +2608,48 @@ int main(int argc, char **argv)
     }
 
     /* spawn threads to manage upstream and downstream */
+    if (sem_init(&rx_ring_sem, 0, 0) != 0)
+    {
+        MSG("ERROR: [main] impossible to initialize RX ring semaphore\n");
+        exit(EXIT_FAILURE);
+    }
+    /* before any thread can reach jit_wake() */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC); /* JIT deadlines must not follow system time changes */
+    i = pthread_cond_init(&cond_jit_wake, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    if (i != 0)
+    {
+        MSG("ERROR: [main] impossible to initialize JIT condition variable\n");
+        exit(EXIT_FAILURE);
+    }
+    i = pthread_create(&thrid_fetch, NULL, (void *(*)(void *))thread_fetch, NULL);
+    if (i != 0)
+    {
+        MSG("ERROR: [main] impossible to create fetch thread\n");
+        exit(EXIT_FAILURE);
+    }
     i = pthread_create(&thrid_up, NULL, (void *(*)(void *))thread_up, NULL);
     if (i != 0)
     {
         MSG("ERROR: [main] impossible to create upstream thread\n");
         exit(EXIT_FAILURE);
     }
+    i = pthread_create(&thrid_up_ack, NULL, (void *(*)(void *))thread_up_ack, NULL);
+    if (i != 0)
+    {
+        MSG("ERROR: [main] impossible to create upstream ACK thread\n");
+        exit(EXIT_FAILURE);
+    }
+    /* JIT queues, allocated before the threads using them are started */
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++)
+    {
+        if (jit_queue_init(&jit_queue[i], jit_queue_size) != JIT_ERROR_OK)
+        {
+            MSG("ERROR: [main] impossible to allocate JIT queue %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
     i = pthread_create(&thrid_down, NULL, (void *(*)(void *))thread_down, NULL);
     if (i != 0)
     {
@@ -2069,6 +2662,15 @@ int main(int argc, char **argv)
         MSG("ERROR: [main] impossible to create JIT thread\n");
         exit(EXIT_FAILURE);
     }
+    if (beacon_period != 0)
+    {
+        i = pthread_create(&thrid_beacon, NULL, (void *(*)(void *))thread_beacon, NULL);
+        if (i != 0)
+        {
+            MSG("ERROR: [main] impossible to create beacon thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
     /* spawn thread for background spectral scan */
     if (spectral_scan_params.enable == true)
@@ -2127,6 +2729,12 @@ int main(int argc, char **argv)
         cp_up_payload_byte = meas_up_payload_byte;
         cp_up_dgram_sent = meas_up_dgram_sent;
         cp_up_ack_rcv = meas_up_ack_rcv;
+        cp_nb_rx_drop = meas_nb_rx_drop;
+        cp_up_ack_rtt_sum = meas_up_ack_rtt_sum;
+        cp_up_ack_rtt_max = meas_up_ack_rtt_max;
+        cp_up_coalesce_max = meas_up_coalesce_max;
+        cp_nb_fetch = meas_nb_fetch;
+        cp_nb_fetch_irq = meas_nb_fetch_irq;
         meas_nb_rx_rcv = 0;
         meas_nb_rx_ok = 0;
         meas_nb_rx_bad = 0;
@@ -2136,6 +2744,12 @@ int main(int argc, char **argv)
         meas_up_payload_byte = 0;
         meas_up_dgram_sent = 0;
         meas_up_ack_rcv = 0;
+        meas_nb_rx_drop = 0;
+        meas_up_ack_rtt_sum = 0;
+        meas_up_ack_rtt_max = 0;
+        meas_up_coalesce_max = 0;
+        meas_nb_fetch = 0;
+        meas_nb_fetch_irq = 0;
         pthread_mutex_unlock(&mx_meas_up);
         if (cp_nb_rx_rcv > 0)
         {
@@ -2172,6 +2786,7 @@ int main(int argc, char **argv)
         cp_nb_tx_rejected_collision_beacon += meas_nb_tx_rejected_collision_beacon;
         cp_nb_tx_rejected_too_late += meas_nb_tx_rejected_too_late;
         cp_nb_tx_rejected_too_early += meas_nb_tx_rejected_too_early;
+        cp_nb_tx_rejected_duty_cycle += meas_nb_tx_rejected_duty_cycle;
         cp_nb_beacon_queued += meas_nb_beacon_queued;
         cp_nb_beacon_sent += meas_nb_beacon_sent;
         cp_nb_beacon_rejected += meas_nb_beacon_rejected;
@@ -2187,10 +2802,19 @@ int main(int argc, char **argv)
         meas_nb_tx_rejected_collision_beacon = 0;
         meas_nb_tx_rejected_too_late = 0;
         meas_nb_tx_rejected_too_early = 0;
+        meas_nb_tx_rejected_duty_cycle = 0;
         meas_nb_beacon_queued = 0;
         meas_nb_beacon_sent = 0;
         meas_nb_beacon_rejected = 0;
         pthread_mutex_unlock(&mx_meas_dw);
+        pthread_mutex_lock(&mx_duty_cycle);
+        duty_cycle_slide();
+        for (i = 0; i < duty_cycle_nb_bands; i++)
+        {
+            dc_airtime_ms[i] = duty_cycle_bands[i].airtime_ms;
+            dc_usage[i] = (duty_cycle_bands[i].max_airtime_ms > 0) ? (100.0 * duty_cycle_bands[i].airtime_ms / duty_cycle_bands[i].max_airtime_ms) : 100.0;
+        }
+        pthread_mutex_unlock(&mx_duty_cycle);
         if (cp_dw_pull_sent > 0)
         {
             dw_ack_ratio = (float)cp_dw_ack_rcv / (float)cp_dw_pull_sent;
@@ -2221,8 +2845,18 @@ int main(int argc, char **argv)
         printf("# RF packets received by concentrator: %u\n", cp_nb_rx_rcv);
         printf("# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio, 100.0 * rx_nocrc_ratio);
         printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
+        printf("# RF packets dropped (RX ring full): %u\n", cp_nb_rx_drop);
+        printf("# Concentrator fetches: %u (%u woken up by interrupt)\n", cp_nb_fetch, cp_nb_fetch_irq);
         printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
+        if (cp_up_ack_rcv > 0)
+        {
+            printf("# PUSH_ACK round-trip time: avg %u ms, max %u ms\n", cp_up_ack_rtt_sum / cp_up_ack_rcv, cp_up_ack_rtt_max);
+        }
+        if ((coalesce_max_latency_ms > 0) && (cp_up_dgram_sent > 0))
+        {
+            printf("# PUSH_DATA coalescing: %.2f rxpk per datagram, max added latency %u ms\n", (float)cp_up_pkt_fwd / (float)cp_up_dgram_sent, cp_up_coalesce_max);
+        }
         printf("### [DOWNSTREAM] ###\n");
         printf("# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
         printf("# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
@@ -2234,6 +2868,7 @@ int main(int argc, char **argv)
             printf("# TX rejected (collision beacon): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_collision_beacon / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_collision_beacon);
             printf("# TX rejected (too late): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_too_late / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_too_late);
             printf("# TX rejected (too early): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_too_early / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_too_early);
+            printf("# TX rejected (duty cycle): %.2f%% (req:%u, rej:%u)\n", 100.0 * cp_nb_tx_rejected_duty_cycle / cp_nb_tx_requested, cp_nb_tx_requested, cp_nb_tx_rejected_duty_cycle);
         }
         printf("### SX1302 Status ###\n");
         pthread_mutex_lock(&mx_concent);
@@ -2257,6 +2892,14 @@ int main(int argc, char **argv)
         jit_print_queue(&jit_queue[0], false, DEBUG_LOG);
         printf("#--------\n");
         jit_print_queue(&jit_queue[1], false, DEBUG_LOG);
+        if (duty_cycle_nb_bands > 0)
+        {
+            printf("### [DUTY CYCLE] ###\n");
+            for (i = 0; i < duty_cycle_nb_bands; i++)
+            {
+                printf("# %.3f-%.3f MHz: %u ms of %u ms over %u s (%.1f%%)\n", duty_cycle_bands[i].freq_min / 1e6, duty_cycle_bands[i].freq_max / 1e6, dc_airtime_ms[i], duty_cycle_bands[i].max_airtime_ms, duty_cycle_window_s, dc_usage[i]);
+            }
+        }
         printf("### [GPS] ###\n");
         if (gps_enabled == true)
         {
@@ -2303,27 +2946,60 @@ int main(int argc, char **argv)
         pthread_mutex_lock(&mx_stat_rep);
         if (((gps_enabled == true) && (coord_ok == true)) || (gps_fake_enable == true))
         {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
         }
         else
         {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
         }
+        /* duty-cycle budget used in each sub-band, in the order of the configuration */
+        /* (snprintf returns the length it would have written: clamped so that the room left never wraps) */
+        status_len = strlen(status_report);
+        for (i = 0; i < duty_cycle_nb_bands; i++)
+        {
+            status_len += snprintf(status_report + status_len, STATUS_SIZE - status_len, "%s%.1f", (i == 0) ? ",\"dutc\":[" : ",", dc_usage[i]);
+            status_len = (status_len < STATUS_SIZE) ? status_len : (STATUS_SIZE - 1);
+        }
+        if (duty_cycle_nb_bands > 0)
+        {
+            status_len += snprintf(status_report + status_len, STATUS_SIZE - status_len, "]");
+            status_len = (status_len < STATUS_SIZE) ? status_len : (STATUS_SIZE - 1);
+        }
+        snprintf(status_report + status_len, STATUS_SIZE - status_len, "}");
         report_ready = true;
         pthread_mutex_unlock(&mx_stat_rep);
     }
 
     /* wait for all threads with a COM with the concentrator board to finish (1 fetch cycle max) */
+    i = pthread_join(thrid_fetch, NULL);
+    if (i != 0)
+    {
+        printf("ERROR: failed to join fetch thread with %d - %s\n", i, strerror(errno));
+    }
     i = pthread_join(thrid_up, NULL);
     if (i != 0)
     {
         printf("ERROR: failed to join upstream thread with %d - %s\n", i, strerror(errno));
     }
+    i = pthread_join(thrid_up_ack, NULL);
+    if (i != 0)
+    {
+        printf("ERROR: failed to join upstream ACK thread with %d - %s\n", i, strerror(errno));
+    }
     i = pthread_join(thrid_down, NULL);
     if (i != 0)
     {
         printf("ERROR: failed to join downstream thread with %d - %s\n", i, strerror(errno));
     }
+    if (beacon_period != 0)
+    {
+        i = pthread_join(thrid_beacon, NULL);
+        if (i != 0)
+        {
+            printf("ERROR: failed to join beacon thread with %d - %s\n", i, strerror(errno));
+        }
+    }
+    jit_wake(); /* do not wait for the next TX deadline */
     i = pthread_join(thrid_jit, NULL);
     if (i != 0)
     {
@@ -2371,7 +3047,7 @@ int main(int argc, char **argv)
         }
     }
 
-    if (com_type == LGW_COM_SPI)
+    if ((com_type == LGW_COM_SPI) && (lgw_sim_enabled() == false))
     {
         /* Board reset */
         if (system("./reset_lgw.sh stop") != 0)
@@ -2385,20 +3061,106 @@ int main(int argc, char **argv)
     exit(EXIT_SUCCESS);
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 0: FETCHING PACKETS FROM CONCENTRATOR INTO THE RX RING -------- */
+
+void thread_fetch(void)
+{
+    int i; /* loop variable */
+
+    /* allocate memory for packet fetching */
+    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
+    int nb_pkt;
+    uint32_t nb_drop;
+
+    /* adaptive polling */
+    unsigned poll_ms = 0; /* interval before the next fetch, 0 while packets keep coming */
+    int irq_fd;           /* SX130x interrupt line events, -1 if not available */
+    bool irq;
+
+    irq_fd = fetch_irq_open();
+
+    while (!exit_sig && !quit_sig)
+    {
+        /* fetch packets */
+        pthread_mutex_lock(&mx_concent);
+        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);
+        pthread_mutex_unlock(&mx_concent);
+        if (nb_pkt == LGW_HAL_ERROR)
+        {
+            MSG("ERROR: [fetch] failed packet fetch, exiting\n");
+            exit(EXIT_FAILURE);
+        }
+
+        /* no packets: back off, from min to max interval, or until the concentrator interrupt fires */
+        if (nb_pkt == 0)
+        {
+            if (irq_fd >= 0)
+            {
+                poll_ms = fetch_poll_max_ms;
+            }
+            else if (poll_ms == 0)
+            {
+                poll_ms = fetch_poll_min_ms;
+            }
+            else
+            {
+                poll_ms = (2 * poll_ms < fetch_poll_max_ms) ? (2 * poll_ms) : fetch_poll_max_ms;
+            }
+            irq = fetch_wait(irq_fd, poll_ms);
+            pthread_mutex_lock(&mx_meas_up);
+            meas_nb_fetch += 1;
+            meas_nb_fetch_irq += (irq == true) ? 1 : 0;
+            pthread_mutex_unlock(&mx_meas_up);
+            continue;
+        }
+
+        /* packets: fetch again right away, a burst is likely to go on */
+        poll_ms = 0;
+
+        /* hand packets over to the upstream thread, never wait for it */
+        nb_drop = 0;
+        for (i = 0; i < nb_pkt; ++i)
+        {
+            if (rx_ring_push(&rxpkt[i]) == false)
+            {
+                nb_drop += 1;
+            }
+        }
+        sem_post(&rx_ring_sem);
+
+        if (nb_drop > 0)
+        {
+            MSG("WARNING: [fetch] RX ring full, %u packets dropped\n", nb_drop);
+        }
+        pthread_mutex_lock(&mx_meas_up);
+        meas_nb_fetch += 1;
+        meas_nb_rx_drop += nb_drop;
+        pthread_mutex_unlock(&mx_meas_up);
+    }
+    if (irq_fd >= 0)
+    {
+        close(irq_fd);
+    }
+    sem_post(&rx_ring_sem); /* make sure the upstream thread does not wait for nothing */
+    MSG("\nINFO: End of fetch thread\n");
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
 
 void thread_up(void)
 {
-    int i, j, k;           /* loop variables */
-    unsigned pkt_in_dgram; /* nb on Lora packet in the current datagram */
+    int j, k;                  /* loop variables */
+    unsigned pkt_in_dgram = 0; /* nb on Lora packet in the current datagram */
     char stat_timestamp[24];
     time_t t;
 
     /* allocate memory for packet fetching and processing */
     struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
     struct lgw_pkt_rx_s *p;                /* pointer on a RX packet */
-    int nb_pkt;
+    int nb_pkt = 0;
+    int pkt_next = 0; /* next packet of rxpkt to be serialized */
 
     /* local copy of GPS time reference */
     bool ref_ok = false;   /* determine if GPS time reference must be used or not */
@@ -2406,16 +3168,23 @@ void thread_up(void)
 
     /* data buffers */
     uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
-    int buff_index;
-    uint8_t buff_ack[32]; /* buffer to receive acknowledges */
+    int buff_index = 0;            /* 0 when no datagram is being composed */
+
+    /* coalescing variables */
+    int max_bytes;        /* max size of a datagram */
+    bool dgram_full;      /* no more rxpk can be added to the current datagram */
+    uint32_t held_ms = 0; /* time elapsed since the first rxpk was added to the current datagram */
+    struct timespec now;
+    struct timespec dgram_time; /* time the first rxpk was added to the current datagram */
 
     /* protocol variables */
-    uint8_t token_h; /* random token for acknowledgement matching */
-    uint8_t token_l; /* random token for acknowledgement matching */
+    uint16_t token;        /* random token for acknowledgement matching */
+    uint32_t push_seq = 0; /* sequence number of the datagram, selects its in-flight slot */
+    push_inflight_t *slot; /* in-flight slot of the datagram */
 
-    /* ping measurement variables */
-    struct timespec send_time;
-    struct timespec recv_time;
+    /* RX ring wait deadline */
+    struct timespec wait_time;
+    long poll_wait_ms;
 
     /* GPS synchronization variables */
     struct timespec pkt_utc_time;
@@ -2430,46 +3199,64 @@ void thread_up(void)
     uint32_t mote_addr = 0;
     uint16_t mote_fcnt = 0;
 
-    /* set upstream socket RX timeout */
-    i = setsockopt(sock_up, SOL_SOCKET, SO_RCVTIMEO, (void *)&push_timeout_half, sizeof push_timeout_half);
-    if (i != 0)
-    {
-        MSG("ERROR: [up] setsockopt returned %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
     /* pre-fill the data buffer with fixed fields */
     buff_up[0] = PROTOCOL_VERSION;
     buff_up[3] = PKT_PUSH_DATA;
     *(uint32_t *)(buff_up + 4) = net_mac_h;
     *(uint32_t *)(buff_up + 8) = net_mac_l;
 
+    /* without coalescing, a datagram is only limited by the buffer size */
+    if (coalesce_max_bytes > 0)
+    {
+        max_bytes = (int)coalesce_max_bytes;
+    }
+    else
+    {
+        max_bytes = (coalesce_max_latency_ms > 0) ? DEFAULT_COALESCE_MAX_BYTES : COALESCE_BYTES_LIMIT;
+    }
+
     while (!exit_sig && !quit_sig)
     {
 
-        /* fetch packets */
-        pthread_mutex_lock(&mx_concent);
-        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);
-        pthread_mutex_unlock(&mx_concent);
-        if (nb_pkt == LGW_HAL_ERROR)
+        /* get packets drained from the concentrator by the fetch thread, once the previous ones are serialized */
+        if (pkt_next >= nb_pkt)
         {
-            MSG("ERROR: [up] failed packet fetch, exiting\n");
-            exit(EXIT_FAILURE);
+            nb_pkt = rx_ring_pop(rxpkt, NB_PKT_MAX);
+            pkt_next = 0;
         }
 
         /* check if there are status report to send */
         send_report = report_ready; /* copy the variable so it doesn't change mid-function */
         /* no mutex, we're only reading */
 
-        /* wait a short time if no packets, nor status report */
-        if ((nb_pkt == 0) && (send_report == false))
+        /* age of the rxpk waiting in the current datagram */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (pkt_in_dgram > 0)
+        {
+            held_ms = (uint32_t)(1000 * difftimespec(now, dgram_time));
+        }
+
+        /* wait for the fetch thread if no packets, nor status report, nor datagram due for sending */
+        if ((pkt_next >= nb_pkt) && (send_report == false) && ((pkt_in_dgram == 0) || (held_ms < coalesce_max_latency_ms)))
         {
-            wait_ms(FETCH_SLEEP_MS);
+            poll_wait_ms = FETCH_SLEEP_MS;
+            if ((pkt_in_dgram > 0) && ((coalesce_max_latency_ms - held_ms) < (uint32_t)poll_wait_ms))
+            {
+                poll_wait_ms = coalesce_max_latency_ms - held_ms;
+            }
+            clock_gettime(CLOCK_REALTIME, &wait_time);
+            wait_time.tv_nsec += poll_wait_ms * 1000000L;
+            if (wait_time.tv_nsec >= 1000000000L)
+            {
+                wait_time.tv_sec += 1;
+                wait_time.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait(&rx_ring_sem, &wait_time);
             continue;
         }
 
         /* get a copy of GPS time reference (avoid 1 mutex per packet) */
-        if ((nb_pkt > 0) && (gps_enabled == true))
+        if ((pkt_next < nb_pkt) && (gps_enabled == true))
         {
             pthread_mutex_lock(&mx_timeref);
             ref_ok = gps_ref_valid;
@@ -2486,22 +3273,28 @@ void thread_up(void)
         strftime(stat_timestamp, sizeof stat_timestamp, "%F %T %Z", gmtime(&t));
         MSG_DEBUG(DEBUG_PKT_FWD, "\nCurrent time: %s \n", stat_timestamp);
 
-        /* start composing datagram with the header */
-        token_h = (uint8_t)rand(); /* random token */
-        token_l = (uint8_t)rand(); /* random token */
-        buff_up[1] = token_h;
-        buff_up[2] = token_l;
-        buff_index = 12; /* 12-byte header */
+        /* start composing datagram, unless rxpk are already waiting in it */
+        if (buff_index == 0)
+        {
+            buff_index = 12; /* 12-byte header, token is set when sending */
 
-        /* start of JSON structure */
-        memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-        buff_index += 9;
+            /* start of JSON structure */
+            memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
+            buff_index += 9;
+        }
 
         /* serialize Lora packets metadata and payload */
-        pkt_in_dgram = 0;
-        for (i = 0; i < nb_pkt; ++i)
+        dgram_full = false;
+        for (; pkt_next < nb_pkt; ++pkt_next)
         {
-            p = &rxpkt[i];
+            p = &rxpkt[pkt_next];
+
+            /* keep that packet for the next datagram if it could exceed the size limit */
+            if ((pkt_in_dgram > 0) && ((buff_index + RXPK_META_MAX + 4 * ((p->size + 2) / 3)) > max_bytes))
+            {
+                dgram_full = true;
+                break;
+            }
 
             /* Get mote information from current packet (addr, fcnt) */
             /* FHDR - DevAddr */
@@ -2873,6 +3666,11 @@ void thread_up(void)
             /* End of packet serialization */
             buff_up[buff_index] = '}';
             ++buff_index;
+            if (pkt_in_dgram == 0)
+            {
+                dgram_time = now;
+                held_ms = 0;
+            }
             ++pkt_in_dgram;
 
             if (p->modulation == MOD_LORA)
@@ -2898,6 +3696,13 @@ void thread_up(void)
                 nb_pkt_log[p->if_chain][0] += 1;
                 nb_pkt_received_fsk += 1;
             }
+
+            if (pkt_in_dgram >= coalesce_max_pkt)
+            {
+                ++pkt_next;
+                dgram_full = true;
+                break;
+            }
         }
 
         /* DEBUG: print the number of packets received per channel and per SF */
@@ -2923,6 +3728,12 @@ void thread_up(void)
             }
         }
 
+        /* keep accumulating rxpk while the datagram has room and the oldest one is within its latency budget */
+        if ((pkt_in_dgram > 0) && (dgram_full == false) && (send_report == false) && (held_ms < coalesce_max_latency_ms))
+        {
+            continue;
+        }
+
         /* restart fetch sequence without sending empty JSON if all packets have been filtered out */
         if (pkt_in_dgram == 0)
         {
@@ -2975,68 +3786,129 @@ void thread_up(void)
 
         printf("\nJSON up: %s\n", (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
 
-        /* send datagram to server */
+        /* random token, its low bits select the in-flight slot */
+        slot = &push_inflight[push_seq & (PUSH_WINDOW_SIZE - 1)];
+        token = ((uint16_t)rand() & ~(PUSH_WINDOW_SIZE - 1)) | (push_seq & (PUSH_WINDOW_SIZE - 1));
+        buff_up[1] = (uint8_t)(token >> 8);
+        buff_up[2] = (uint8_t)token;
+
+        /* register datagram in the in-flight table before sending it, the PUSH_ACK is matched by thread_up_ack */
+        pthread_mutex_lock(&mx_push_inflight);
+        if (slot->pending == true)
+        {
+            MSG_DEBUG(DEBUG_PKT_FWD, "WARNING: [up] PUSH_DATA window full, giving up on token 0x%04X\n", slot->token);
+        }
+        slot->pending = true;
+        slot->token = token;
+        clock_gettime(CLOCK_MONOTONIC, &slot->send_time);
+        pthread_mutex_unlock(&mx_push_inflight);
+        ++push_seq;
+
+        /* send datagram to server, do not wait for the acknowledge */
         send(sock_up, (void *)buff_up, buff_index, 0);
-        clock_gettime(CLOCK_MONOTONIC, &send_time);
         pthread_mutex_lock(&mx_meas_up);
         meas_up_dgram_sent += 1;
         meas_up_network_byte += buff_index;
+        if ((pkt_in_dgram > 0) && (held_ms > meas_up_coalesce_max))
+        {
+            meas_up_coalesce_max = held_ms;
+        }
+        pthread_mutex_unlock(&mx_meas_up);
+
+        /* next rxpk start a new datagram */
+        buff_index = 0;
+        pkt_in_dgram = 0;
+    }
+    MSG("\nINFO: End of upstream thread\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 1b: MATCHING PUSH_ACK WITH DATAGRAMS IN FLIGHT ---------------- */
+
+void thread_up_ack(void)
+{
+    int i; /* temporary variable for return value */
+
+    /* data buffers */
+    uint8_t buff_ack[32]; /* buffer to receive acknowledges */
+
+    /* protocol variables */
+    uint16_t token;
+    push_inflight_t *slot;
+    bool ack_match;
+
+    /* ping measurement variables */
+    struct timespec recv_time;
+    uint32_t rtt_ms;
+
+    /* set upstream socket RX timeout */
+    i = setsockopt(sock_up, SOL_SOCKET, SO_RCVTIMEO, (void *)&push_timeout_half, sizeof push_timeout_half);
+    if (i != 0)
+    {
+        MSG("ERROR: [up] setsockopt returned %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 
-        /* wait for acknowledge (in 2 times, to catch extra packets) */
-        for (i = 0; i < 2; ++i)
+    while (!exit_sig && !quit_sig)
+    {
+        i = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
+        clock_gettime(CLOCK_MONOTONIC, &recv_time);
+        if (i == -1)
         {
-            j = recv(sock_up, (void *)buff_ack, sizeof buff_ack, 0);
-            clock_gettime(CLOCK_MONOTONIC, &recv_time);
-            if (j == -1)
-            {
-                if (errno == EAGAIN)
-                { /* timeout */
-                    continue;
-                }
-                else
-                { /* server connection error */
-                    break;
-                }
-            }
-            else if ((j < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK))
-            {
-                // MSG("WARNING: [up] ignored invalid non-ACL packet\n");
-                continue;
-            }
-            else if ((buff_ack[1] != token_h) || (buff_ack[2] != token_l))
-            {
-                // MSG("WARNING: [up] ignored out-of sync ACK packet\n");
-                continue;
-            }
-            else
-            {
-                MSG("INFO: [up] PUSH_ACK received in %i ms\n", (int)(1000 * difftimespec(recv_time, send_time)));
-                meas_up_ack_rcv += 1;
-                break;
+            if (errno != EAGAIN)
+            { /* server connection error, do not spin on it */
+                wait_ms(FETCH_SLEEP_MS);
             }
+            continue;
+        }
+        else if ((i < 4) || (buff_ack[0] != PROTOCOL_VERSION) || (buff_ack[3] != PKT_PUSH_ACK))
+        {
+            // MSG("WARNING: [up] ignored invalid non-ACL packet\n");
+            continue;
+        }
+
+        /* the low bits of the token give the slot, the whole token must match */
+        token = ((uint16_t)buff_ack[1] << 8) | buff_ack[2];
+        slot = &push_inflight[token & (PUSH_WINDOW_SIZE - 1)];
+        ack_match = false;
+        pthread_mutex_lock(&mx_push_inflight);
+        if ((slot->pending == true) && (slot->token == token))
+        {
+            rtt_ms = (uint32_t)(1000 * difftimespec(recv_time, slot->send_time));
+            slot->pending = false;
+            /* ACKs later than the PUSH_DATA time-out are not counted, as before */
+            ack_match = (rtt_ms <= push_timeout_ms);
+        }
+        pthread_mutex_unlock(&mx_push_inflight);
+        if (ack_match == false)
+        {
+            // MSG("WARNING: [up] ignored out-of sync ACK packet\n");
+            continue;
+        }
+
+        MSG("INFO: [up] PUSH_ACK received in %u ms\n", rtt_ms);
+        pthread_mutex_lock(&mx_meas_up);
+        meas_up_ack_rcv += 1;
+        meas_up_ack_rtt_sum += rtt_ms;
+        if (rtt_ms > meas_up_ack_rtt_max)
+        {
+            meas_up_ack_rtt_max = rtt_ms;
         }
         pthread_mutex_unlock(&mx_meas_up);
     }
-    MSG("\nINFO: End of upstream thread\n");
+    MSG("\nINFO: End of upstream ACK thread\n");
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 2: POLLING SERVER AND ENQUEUING PACKETS IN JIT QUEUE ---------- */
 
-static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t *lut_index)
+static int tx_gain_lut_search(uint8_t rf_chain, int8_t rf_power)
 {
     uint8_t pow_index;
     int current_best_index = -1;
     uint8_t current_best_match = 0xFF;
     int diff;
 
-    /* Check input parameters */
-    if (lut_index == NULL)
-    {
-        MSG("ERROR: %s - wrong parameter\n", __FUNCTION__);
-        return -1;
-    }
-
     /* Search requested power in TX gain LUT */
     for (pow_index = 0; pow_index < txlut[rf_chain].size; pow_index++)
     {
@@ -3057,15 +3929,70 @@ static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t *lut
         }
     }
 
-    /* Return corresponding index */
+    return current_best_index;
+}
+
+/* LUT entry used when all LUT powers are above the requested one */
+static int tx_gain_lut_lowest(uint8_t rf_chain)
+{
+    uint8_t pow_index;
+    int lowest_index = 0;
+
+    for (pow_index = 1; pow_index < txlut[rf_chain].size; pow_index++)
+    {
+        if (txlut[rf_chain].lut[pow_index].rf_power < txlut[rf_chain].lut[lowest_index].rf_power)
+        {
+            lowest_index = pow_index;
+        }
+    }
+
+    return lowest_index;
+}
+
+static void tx_power_map_build(uint8_t rf_chain)
+{
+    int rf_power;
+    int lut_index;
+
+    for (rf_power = TX_POWER_MAP_MIN; rf_power <= TX_POWER_MAP_MAX; rf_power++)
+    {
+        lut_index = tx_gain_lut_search(rf_chain, (int8_t)rf_power);
+        tx_power_map[rf_chain][rf_power - TX_POWER_MAP_MIN].lut_index = (int8_t)lut_index;
+        tx_power_map[rf_chain][rf_power - TX_POWER_MAP_MIN].rf_power = txlut[rf_chain].lut[(lut_index < 0) ? tx_gain_lut_lowest(rf_chain) : lut_index].rf_power;
+    }
+}
+
+static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t *lut_index, int8_t *lut_power)
+{
+    int current_best_index;
+
+    /* Check input parameters */
+    if ((lut_index == NULL) || (lut_power == NULL))
+    {
+        MSG("ERROR: %s - wrong parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    /* Direct lookup for usual powers, LUT search otherwise */
+    if ((rf_power >= TX_POWER_MAP_MIN) && (rf_power <= TX_POWER_MAP_MAX))
+    {
+        current_best_index = tx_power_map[rf_chain][rf_power - TX_POWER_MAP_MIN].lut_index;
+        *lut_power = tx_power_map[rf_chain][rf_power - TX_POWER_MAP_MIN].rf_power;
+    }
+    else
+    {
+        current_best_index = tx_gain_lut_search(rf_chain, rf_power);
+        *lut_power = txlut[rf_chain].lut[(current_best_index < 0) ? tx_gain_lut_lowest(rf_chain) : current_best_index].rf_power;
+    }
+
+    /* Return corresponding index, or the lowest power entry if all are above the requested power */
     if (current_best_index > -1)
     {
         *lut_index = (uint8_t)current_best_index;
     }
     else
     {
-        *lut_index = 0;
-        MSG("ERROR: %s - failed to find tx gain lut index\n", __FUNCTION__);
+        *lut_index = (uint8_t)tx_gain_lut_lowest(rf_chain);
         return -1;
     }
 
@@ -3107,25 +4034,8 @@ void thread_down(void)
     struct tref local_ref;  /* time reference used for GPS <-> timestamp conversion */
     struct timespec gps_tx; /* GPS time that needs to be converted to timestamp */
 
-    /* beacon variables */
-    struct lgw_pkt_tx_s beacon_pkt;
-    uint8_t beacon_chan;
-    uint8_t beacon_loop;
-    size_t beacon_RFU1_size = 0;
-    size_t beacon_RFU2_size = 0;
-    uint8_t beacon_pyld_idx = 0;
-    time_t diff_beacon_time;
-    struct timespec next_beacon_gps_time; /* gps time of next beacon packet */
-    struct timespec last_beacon_gps_time; /* gps time of last enqueued beacon packet */
-    int retry;
-
-    /* beacon data fields, byte 0 is Least Significant Byte */
-    int32_t field_latitude;  /* 3 bytes, derived from reference latitude */
-    int32_t field_longitude; /* 3 bytes, derived from reference longitude */
-    uint16_t field_crc1, field_crc2;
-
-    /* auto-quit variable */
-    uint32_t autoquit_cnt = 0; /* count the number of PULL_DATA sent since the latest PULL_ACK */
+    /* auto-quit variable */
+    uint32_t autoquit_cnt = 0; /* count the number of PULL_DATA sent since the latest PULL_ACK */
 
     /* Just In Time downlink */
     uint32_t current_concentrator_time;
@@ -3134,6 +4044,8 @@ void thread_down(void)
     enum jit_error_e warning_result = JIT_ERROR_OK;
     int32_t warning_value = 0;
     uint8_t tx_lut_idx = 0;
+    int8_t tx_lut_power = 0;
+    uint32_t toa_ms = 0; /* time on air of the downlink, for duty-cycle accounting */
 
     /* set downstream socket RX timeout */
     i = setsockopt(sock_down, SOL_SOCKET, SO_RCVTIMEO, (void *)&pull_timeout, sizeof pull_timeout);
@@ -3149,116 +4061,6 @@ void thread_down(void)
     *(uint32_t *)(buff_req + 4) = net_mac_h;
     *(uint32_t *)(buff_req + 8) = net_mac_l;
 
-    /* beacon variables initialization */
-    last_beacon_gps_time.tv_sec = 0;
-    last_beacon_gps_time.tv_nsec = 0;
-
-    /* beacon packet parameters */
-    beacon_pkt.tx_mode = ON_GPS; /* send on PPS pulse */
-    beacon_pkt.rf_chain = 0;     /* antenna A */
-    beacon_pkt.rf_power = beacon_power;
-    beacon_pkt.modulation = MOD_LORA;
-    switch (beacon_bw_hz)
-    {
-    case 125000:
-        beacon_pkt.bandwidth = BW_125KHZ;
-        break;
-    case 500000:
-        beacon_pkt.bandwidth = BW_500KHZ;
-        break;
-    default:
-        /* should not happen */
-        MSG("ERROR: unsupported bandwidth for beacon\n");
-        exit(EXIT_FAILURE);
-    }
-    switch (beacon_datarate)
-    {
-    case 8:
-        beacon_pkt.datarate = DR_LORA_SF8;
-        beacon_RFU1_size = 1;
-        beacon_RFU2_size = 3;
-        break;
-    case 9:
-        beacon_pkt.datarate = DR_LORA_SF9;
-        beacon_RFU1_size = 2;
-        beacon_RFU2_size = 0;
-        break;
-    case 10:
-        beacon_pkt.datarate = DR_LORA_SF10;
-        beacon_RFU1_size = 3;
-        beacon_RFU2_size = 1;
-        break;
-    case 12:
-        beacon_pkt.datarate = DR_LORA_SF12;
-        beacon_RFU1_size = 5;
-        beacon_RFU2_size = 3;
-        break;
-    default:
-        /* should not happen */
-        MSG("ERROR: unsupported datarate for beacon\n");
-        exit(EXIT_FAILURE);
-    }
-    beacon_pkt.size = beacon_RFU1_size + 4 + 2 + 7 + beacon_RFU2_size + 2;
-    beacon_pkt.coderate = CR_LORA_4_5;
-    beacon_pkt.invert_pol = false;
-    beacon_pkt.preamble = 10;
-    beacon_pkt.no_crc = true;
-    beacon_pkt.no_header = true;
-
-    /* network common part beacon fields (little endian) */
-    for (i = 0; i < (int)beacon_RFU1_size; i++)
-    {
-        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
-    }
-
-    /* network common part beacon fields (little endian) */
-    beacon_pyld_idx += 4; /* time (variable), filled later */
-    beacon_pyld_idx += 2; /* crc1 (variable), filled later */
-
-    /* calculate the latitude and longitude that must be publicly reported */
-    field_latitude = (int32_t)((reference_coord.lat / 90.0) * (double)(1 << 23));
-    if (field_latitude > (int32_t)0x007FFFFF)
-    {
-        field_latitude = (int32_t)0x007FFFFF; /* +90 N is represented as 89.99999 N */
-    }
-    else if (field_latitude < (int32_t)0xFF800000)
-    {
-        field_latitude = (int32_t)0xFF800000;
-    }
-    field_longitude = (int32_t)((reference_coord.lon / 180.0) * (double)(1 << 23));
-    if (field_longitude > (int32_t)0x007FFFFF)
-    {
-        field_longitude = (int32_t)0x007FFFFF; /* +180 E is represented as 179.99999 E */
-    }
-    else if (field_longitude < (int32_t)0xFF800000)
-    {
-        field_longitude = (int32_t)0xFF800000;
-    }
-
-    /* gateway specific beacon fields */
-    beacon_pkt.payload[beacon_pyld_idx++] = beacon_infodesc;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_latitude;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >> 8);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >> 16);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_longitude;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >> 8);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >> 16);
-
-    /* RFU */
-    for (i = 0; i < (int)beacon_RFU2_size; i++)
-    {
-        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
-    }
-
-    /* CRC of the beacon gateway specific part fields */
-    field_crc2 = crc16((beacon_pkt.payload + 6 + beacon_RFU1_size), 7 + beacon_RFU2_size);
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_crc2;
-    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc2 >> 8);
-
-    /* JIT queue initialization */
-    jit_queue_init(&jit_queue[0]);
-    jit_queue_init(&jit_queue[1]);
-
     while (!exit_sig && !quit_sig)
     {
 
@@ -3294,126 +4096,6 @@ void thread_down(void)
             msg_len = recv(sock_down, (void *)buff_down, (sizeof buff_down) - 1, 0);
             clock_gettime(CLOCK_MONOTONIC, &recv_time);
 
-            /* Pre-allocate beacon slots in JiT queue, to check downlink collisions */
-            beacon_loop = JIT_NUM_BEACON_IN_QUEUE - jit_queue[0].num_beacon;
-            retry = 0;
-            while (beacon_loop && (beacon_period != 0))
-            {
-                pthread_mutex_lock(&mx_timeref);
-                /* Wait for GPS to be ready before inserting beacons in JiT queue */
-                if ((gps_ref_valid == true) && (xtal_correct_ok == true))
-                {
-
-                    /* compute GPS time for next beacon to come      */
-                    /*   LoRaWAN: T = k*beacon_period + TBeaconDelay */
-                    /*            with TBeaconDelay = [1.5ms +/- 1µs]*/
-                    if (last_beacon_gps_time.tv_sec == 0)
-                    {
-                        /* if no beacon has been queued, get next slot from current GPS time */
-                        diff_beacon_time = time_reference_gps.gps.tv_sec % ((time_t)beacon_period);
-                        next_beacon_gps_time.tv_sec = time_reference_gps.gps.tv_sec +
-                                                      ((time_t)beacon_period - diff_beacon_time);
-                    }
-                    else
-                    {
-                        /* if there is already a beacon, take it as reference */
-                        next_beacon_gps_time.tv_sec = last_beacon_gps_time.tv_sec + beacon_period;
-                    }
-                    /* now we can add a beacon_period to the reference to get next beacon GPS time */
-                    next_beacon_gps_time.tv_sec += (retry * beacon_period);
-                    next_beacon_gps_time.tv_nsec = 0;
-
-#if DEBUG_BEACON
-                    {
-                        time_t time_unix;
-
-                        time_unix = time_reference_gps.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
-                        MSG_DEBUG(DEBUG_BEACON, "GPS-now : %s", ctime(&time_unix));
-                        time_unix = last_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
-                        MSG_DEBUG(DEBUG_BEACON, "GPS-last: %s", ctime(&time_unix));
-                        time_unix = next_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
-                        MSG_DEBUG(DEBUG_BEACON, "GPS-next: %s", ctime(&time_unix));
-                    }
-#endif
-
-                    /* convert GPS time to concentrator time, and set packet counter for JiT trigger */
-                    lgw_gps2cnt(time_reference_gps, next_beacon_gps_time, &(beacon_pkt.count_us));
-                    pthread_mutex_unlock(&mx_timeref);
-
-                    /* apply frequency correction to beacon TX frequency */
-                    if (beacon_freq_nb > 1)
-                    {
-                        beacon_chan = (next_beacon_gps_time.tv_sec / beacon_period) % beacon_freq_nb; /* floor rounding */
-                    }
-                    else
-                    {
-                        beacon_chan = 0;
-                    }
-                    /* Compute beacon frequency */
-                    beacon_pkt.freq_hz = beacon_freq_hz + (beacon_chan * beacon_freq_step);
-
-                    /* load time in beacon payload */
-                    beacon_pyld_idx = beacon_RFU1_size;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & next_beacon_gps_time.tv_sec;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 8);
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 16);
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 24);
-
-                    /* calculate CRC */
-                    field_crc1 = crc16(beacon_pkt.payload, 4 + beacon_RFU1_size); /* CRC for the network common part */
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_crc1;
-                    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc1 >> 8);
-
-                    /* Insert beacon packet in JiT queue */
-                    pthread_mutex_lock(&mx_concent);
-                    lgw_get_instcnt(&current_concentrator_time);
-                    pthread_mutex_unlock(&mx_concent);
-                    jit_result = jit_enqueue(&jit_queue[0], current_concentrator_time, &beacon_pkt, JIT_PKT_TYPE_BEACON);
-                    if (jit_result == JIT_ERROR_OK)
-                    {
-                        /* update stats */
-                        pthread_mutex_lock(&mx_meas_dw);
-                        meas_nb_beacon_queued += 1;
-                        pthread_mutex_unlock(&mx_meas_dw);
-
-                        /* One more beacon in the queue */
-                        beacon_loop--;
-                        retry = 0;
-                        last_beacon_gps_time.tv_sec = next_beacon_gps_time.tv_sec; /* keep this beacon time as reference for next one to be programmed */
-
-                        /* display beacon payload */
-                        MSG("INFO: Beacon queued (count_us=%u, freq_hz=%u, size=%u):\n", beacon_pkt.count_us, beacon_pkt.freq_hz, beacon_pkt.size);
-                        printf("   => ");
-                        for (i = 0; i < beacon_pkt.size; ++i)
-                        {
-                            MSG("%02X ", beacon_pkt.payload[i]);
-                        }
-                        MSG("\n");
-                    }
-                    else
-                    {
-                        MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing failed with %d\n", jit_result);
-                        /* update stats */
-                        pthread_mutex_lock(&mx_meas_dw);
-                        if (jit_result != JIT_ERROR_COLLISION_BEACON)
-                        {
-                            meas_nb_beacon_rejected += 1;
-                        }
-                        pthread_mutex_unlock(&mx_meas_dw);
-                        /* In case previous enqueue failed, we retry one period later until it succeeds */
-                        /* Note: In case the GPS has been unlocked for a while, there can be lots of retries */
-                        /*       to be done from last beacon time to a new valid one */
-                        retry++;
-                        MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing retry=%d\n", retry);
-                    }
-                }
-                else
-                {
-                    pthread_mutex_unlock(&mx_timeref);
-                    break;
-                }
-            }
-
             /* if no network message was received, got back to listening sock_down socket */
             if (msg_len == -1)
             {
@@ -3849,14 +4531,30 @@ void thread_down(void)
             /* check TX power before trying to queue packet, send a warning if not supported */
             if (jit_result == JIT_ERROR_OK)
             {
-                i = get_tx_gain_lut_index(txpkt.rf_chain, txpkt.rf_power, &tx_lut_idx);
-                if ((i < 0) || (txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power != txpkt.rf_power))
+                i = get_tx_gain_lut_index(txpkt.rf_chain, txpkt.rf_power, &tx_lut_idx, &tx_lut_power);
+                if (tx_lut_power != txpkt.rf_power)
                 {
-                    /* this RF power is not supported, throw a warning, and use the closest lower power supported */
+                    /* this RF power is not supported, throw a warning, and use the closest lower power supported,
+                       or the lowest one if they are all above the requested power */
                     warning_result = JIT_ERROR_TX_POWER;
-                    warning_value = (int32_t)txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power;
-                    printf("WARNING: Requested TX power is not supported (%ddBm), actual power used: %ddBm\n", txpkt.rf_power, warning_value);
-                    txpkt.rf_power = txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power;
+                    warning_value = (int32_t)tx_lut_power;
+                    printf("WARNING: Requested TX power is not supported (%ddBm), actual power used: %ddBm%s\n", txpkt.rf_power, tx_lut_power, (i < 0) ? " (lowest supported, above the request)" : "");
+                    txpkt.rf_power = tx_lut_power;
+                }
+            }
+
+            /* check the duty-cycle of the sub-band before trying to queue packet, the RX window
+               of the downlink cannot be moved so the packet is rejected rather than deferred */
+            if ((jit_result == JIT_ERROR_OK) && (duty_cycle_nb_bands > 0))
+            {
+                toa_ms = lgw_time_on_air(&txpkt);
+                if (duty_cycle_check(txpkt.freq_hz, toa_ms) == false)
+                {
+                    jit_result = JIT_ERROR_DUTY_CYCLE;
+                    MSG("ERROR: Packet REJECTED, duty-cycle budget exhausted at %u Hz (toa:%u ms)\n", txpkt.freq_hz, toa_ms);
+                    pthread_mutex_lock(&mx_meas_dw);
+                    meas_nb_tx_requested += 1;
+                    pthread_mutex_unlock(&mx_meas_dw);
                 }
             }
 
@@ -3873,6 +4571,12 @@ void thread_down(void)
                 }
                 else
                 {
+                    jit_wake(); /* the packet may be due before the JIT thread planned to wake up */
+                    /* the airtime is accounted when queued, it is sent unless the queue drops it */
+                    if (duty_cycle_nb_bands > 0)
+                    {
+                        duty_cycle_add(txpkt.freq_hz, toa_ms);
+                    }
                     /* In case of a warning having been raised before, we notify it */
                     jit_result = warning_result;
                 }
@@ -3888,6 +4592,289 @@ void thread_down(void)
     MSG("\nINFO: End of downstream thread\n");
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 2b: KEEPING BEACONS PRE-ALLOCATED IN JIT QUEUE ---------------- */
+
+void thread_beacon(void)
+{
+    int i; /* loop variables */
+
+    /* beacon variables */
+    struct lgw_pkt_tx_s beacon_pkt;
+    uint8_t beacon_chan;
+    uint8_t beacon_loop;
+    size_t beacon_RFU1_size = 0;
+    size_t beacon_RFU2_size = 0;
+    uint8_t beacon_pyld_idx = 0;
+    time_t diff_beacon_time;
+    struct timespec next_beacon_gps_time; /* gps time of next beacon packet */
+    struct timespec last_beacon_gps_time; /* gps time of last enqueued beacon packet */
+    int retry;
+
+    /* beacon data fields, byte 0 is Least Significant Byte */
+    int32_t field_latitude;  /* 3 bytes, derived from reference latitude */
+    int32_t field_longitude; /* 3 bytes, derived from reference longitude */
+    uint16_t field_crc1, field_crc2;
+
+    /* time reference, copied to keep mx_timeref locked only for the copy */
+    struct tref local_ref;
+    bool ref_ok;
+
+    /* Just In Time downlink */
+    uint32_t current_concentrator_time;
+    enum jit_error_e jit_result = JIT_ERROR_OK;
+    uint8_t tx_lut_idx = 0;
+    int8_t tx_lut_power = 0;
+
+    /* beacon variables initialization */
+    last_beacon_gps_time.tv_sec = 0;
+    last_beacon_gps_time.tv_nsec = 0;
+
+    /* beacon packet parameters */
+    beacon_pkt.tx_mode = ON_GPS; /* send on PPS pulse */
+    beacon_pkt.rf_chain = 0;     /* antenna A */
+    beacon_pkt.rf_power = beacon_power;
+    i = get_tx_gain_lut_index(0, beacon_power, &tx_lut_idx, &tx_lut_power);
+    if (tx_lut_power != beacon_power)
+    {
+        /* this RF power is not supported, use the closest lower power supported, or the lowest one if they are all above */
+        beacon_pkt.rf_power = tx_lut_power;
+        if (i < 0)
+        {
+            MSG("WARNING: [beacon] beacon TX power is below all the TX gain LUT powers (%ddBm), lowest power used: %ddBm\n", beacon_power, beacon_pkt.rf_power);
+        }
+        else
+        {
+            MSG("WARNING: [beacon] beacon TX power is not supported (%ddBm), closest lower power used: %ddBm\n", beacon_power, beacon_pkt.rf_power);
+        }
+    }
+    beacon_pkt.modulation = MOD_LORA;
+    switch (beacon_bw_hz)
+    {
+    case 125000:
+        beacon_pkt.bandwidth = BW_125KHZ;
+        break;
+    case 500000:
+        beacon_pkt.bandwidth = BW_500KHZ;
+        break;
+    default:
+        /* should not happen */
+        MSG("ERROR: unsupported bandwidth for beacon\n");
+        exit(EXIT_FAILURE);
+    }
+    switch (beacon_datarate)
+    {
+    case 8:
+        beacon_pkt.datarate = DR_LORA_SF8;
+        beacon_RFU1_size = 1;
+        beacon_RFU2_size = 3;
+        break;
+    case 9:
+        beacon_pkt.datarate = DR_LORA_SF9;
+        beacon_RFU1_size = 2;
+        beacon_RFU2_size = 0;
+        break;
+    case 10:
+        beacon_pkt.datarate = DR_LORA_SF10;
+        beacon_RFU1_size = 3;
+        beacon_RFU2_size = 1;
+        break;
+    case 12:
+        beacon_pkt.datarate = DR_LORA_SF12;
+        beacon_RFU1_size = 5;
+        beacon_RFU2_size = 3;
+        break;
+    default:
+        /* should not happen */
+        MSG("ERROR: unsupported datarate for beacon\n");
+        exit(EXIT_FAILURE);
+    }
+    beacon_pkt.size = beacon_RFU1_size + 4 + 2 + 7 + beacon_RFU2_size + 2;
+    beacon_pkt.coderate = CR_LORA_4_5;
+    beacon_pkt.invert_pol = false;
+    beacon_pkt.preamble = 10;
+    beacon_pkt.no_crc = true;
+    beacon_pkt.no_header = true;
+
+    /* network common part beacon fields (little endian) */
+    for (i = 0; i < (int)beacon_RFU1_size; i++)
+    {
+        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
+    }
+
+    /* network common part beacon fields (little endian) */
+    beacon_pyld_idx += 4; /* time (variable), filled later */
+    beacon_pyld_idx += 2; /* crc1 (variable), filled later */
+
+    /* calculate the latitude and longitude that must be publicly reported */
+    field_latitude = (int32_t)((reference_coord.lat / 90.0) * (double)(1 << 23));
+    if (field_latitude > (int32_t)0x007FFFFF)
+    {
+        field_latitude = (int32_t)0x007FFFFF; /* +90 N is represented as 89.99999 N */
+    }
+    else if (field_latitude < (int32_t)0xFF800000)
+    {
+        field_latitude = (int32_t)0xFF800000;
+    }
+    field_longitude = (int32_t)((reference_coord.lon / 180.0) * (double)(1 << 23));
+    if (field_longitude > (int32_t)0x007FFFFF)
+    {
+        field_longitude = (int32_t)0x007FFFFF; /* +180 E is represented as 179.99999 E */
+    }
+    else if (field_longitude < (int32_t)0xFF800000)
+    {
+        field_longitude = (int32_t)0xFF800000;
+    }
+
+    /* gateway specific beacon fields */
+    beacon_pkt.payload[beacon_pyld_idx++] = beacon_infodesc;
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_latitude;
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >> 8);
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_latitude >> 16);
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_longitude;
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >> 8);
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_longitude >> 16);
+
+    /* RFU */
+    for (i = 0; i < (int)beacon_RFU2_size; i++)
+    {
+        beacon_pkt.payload[beacon_pyld_idx++] = 0x0;
+    }
+
+    /* CRC of the beacon gateway specific part fields */
+    field_crc2 = crc16((beacon_pkt.payload + 6 + beacon_RFU1_size), 7 + beacon_RFU2_size);
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_crc2;
+    beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc2 >> 8);
+
+    while (!exit_sig && !quit_sig)
+    {
+        pthread_mutex_lock(&mx_timeref);
+        /* Wait for GPS to be ready before inserting beacons in JiT queue */
+        ref_ok = (gps_ref_valid == true) && (xtal_correct_ok == true);
+        local_ref = time_reference_gps;
+        pthread_mutex_unlock(&mx_timeref);
+
+        /* Pre-allocate beacon slots in JiT queue, to check downlink collisions */
+        beacon_loop = (ref_ok == true) ? (JIT_NUM_BEACON_IN_QUEUE - jit_queue_num_beacon(&jit_queue[0])) : 0;
+        retry = 0;
+        while (beacon_loop && !exit_sig && !quit_sig)
+        {
+            /* compute GPS time for next beacon to come      */
+            /*   LoRaWAN: T = k*beacon_period + TBeaconDelay */
+            /*            with TBeaconDelay = [1.5ms +/- 1µs]*/
+            if (last_beacon_gps_time.tv_sec == 0)
+            {
+                /* if no beacon has been queued, get next slot from current GPS time */
+                diff_beacon_time = local_ref.gps.tv_sec % ((time_t)beacon_period);
+                next_beacon_gps_time.tv_sec = local_ref.gps.tv_sec +
+                                              ((time_t)beacon_period - diff_beacon_time);
+            }
+            else
+            {
+                /* if there is already a beacon, take it as reference */
+                next_beacon_gps_time.tv_sec = last_beacon_gps_time.tv_sec + beacon_period;
+            }
+            /* now we can add a beacon_period to the reference to get next beacon GPS time */
+            next_beacon_gps_time.tv_sec += (retry * beacon_period);
+            next_beacon_gps_time.tv_nsec = 0;
+
+#if DEBUG_BEACON
+            {
+                time_t time_unix;
+
+                time_unix = local_ref.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
+                MSG_DEBUG(DEBUG_BEACON, "GPS-now : %s", ctime(&time_unix));
+                time_unix = last_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
+                MSG_DEBUG(DEBUG_BEACON, "GPS-last: %s", ctime(&time_unix));
+                time_unix = next_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
+                MSG_DEBUG(DEBUG_BEACON, "GPS-next: %s", ctime(&time_unix));
+            }
+#endif
+
+            /* convert GPS time to concentrator time, and set packet counter for JiT trigger */
+            lgw_gps2cnt(local_ref, next_beacon_gps_time, &(beacon_pkt.count_us));
+
+            /* apply frequency correction to beacon TX frequency */
+            if (beacon_freq_nb > 1)
+            {
+                beacon_chan = (next_beacon_gps_time.tv_sec / beacon_period) % beacon_freq_nb; /* floor rounding */
+            }
+            else
+            {
+                beacon_chan = 0;
+            }
+            /* Compute beacon frequency */
+            beacon_pkt.freq_hz = beacon_freq_hz + (beacon_chan * beacon_freq_step);
+
+            /* load time in beacon payload */
+            beacon_pyld_idx = beacon_RFU1_size;
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & next_beacon_gps_time.tv_sec;
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 8);
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 16);
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (next_beacon_gps_time.tv_sec >> 24);
+
+            /* calculate CRC */
+            field_crc1 = crc16(beacon_pkt.payload, 4 + beacon_RFU1_size); /* CRC for the network common part */
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & field_crc1;
+            beacon_pkt.payload[beacon_pyld_idx++] = 0xFF & (field_crc1 >> 8);
+
+            /* Insert beacon packet in JiT queue */
+            pthread_mutex_lock(&mx_concent);
+            lgw_get_instcnt(&current_concentrator_time);
+            pthread_mutex_unlock(&mx_concent);
+            jit_result = jit_enqueue(&jit_queue[0], current_concentrator_time, &beacon_pkt, JIT_PKT_TYPE_BEACON);
+            if (jit_result == JIT_ERROR_OK)
+            {
+                jit_wake();
+                /* update stats */
+                pthread_mutex_lock(&mx_meas_dw);
+                meas_nb_beacon_queued += 1;
+                pthread_mutex_unlock(&mx_meas_dw);
+
+                /* beacons are never rejected for duty-cycle, but they use the sub-band budget */
+                if (duty_cycle_nb_bands > 0)
+                {
+                    duty_cycle_add(beacon_pkt.freq_hz, lgw_time_on_air(&beacon_pkt));
+                }
+
+                /* One more beacon in the queue */
+                beacon_loop--;
+                retry = 0;
+                last_beacon_gps_time.tv_sec = next_beacon_gps_time.tv_sec; /* keep this beacon time as reference for next one to be programmed */
+
+                /* display beacon payload */
+                MSG("INFO: Beacon queued (count_us=%u, freq_hz=%u, size=%u):\n", beacon_pkt.count_us, beacon_pkt.freq_hz, beacon_pkt.size);
+                printf("   => ");
+                for (i = 0; i < beacon_pkt.size; ++i)
+                {
+                    MSG("%02X ", beacon_pkt.payload[i]);
+                }
+                MSG("\n");
+            }
+            else
+            {
+                MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing failed with %d\n", jit_result);
+                /* update stats */
+                pthread_mutex_lock(&mx_meas_dw);
+                if (jit_result != JIT_ERROR_COLLISION_BEACON)
+                {
+                    meas_nb_beacon_rejected += 1;
+                }
+                pthread_mutex_unlock(&mx_meas_dw);
+                /* In case previous enqueue failed, we retry one period later until it succeeds */
+                /* Note: In case the GPS has been unlocked for a while, there can be lots of retries */
+                /*       to be done from last beacon time to a new valid one */
+                retry++;
+                MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing retry=%d\n", retry);
+            }
+        }
+
+        /* a beacon leaves the queue once per period at most, refilling it in time is all that matters */
+        wait_ms(BEACON_SCHED_MS);
+    }
+    MSG("\nINFO: End of beacon thread\n");
+}
+
 void print_tx_status(uint8_t tx_status)
 {
     switch (tx_status)
@@ -3926,14 +4913,14 @@ void thread_jit(void)
 
     while (!exit_sig && !quit_sig)
     {
-        wait_ms(10);
+        /* the same counter value is used for all RF chains */
+        pthread_mutex_lock(&mx_concent);
+        lgw_get_instcnt(&current_concentrator_time);
+        pthread_mutex_unlock(&mx_concent);
 
         for (i = 0; i < LGW_RF_CHAIN_NB; i++)
         {
             /* transfer data and metadata to the concentrator, and schedule TX */
-            pthread_mutex_lock(&mx_concent);
-            lgw_get_instcnt(&current_concentrator_time);
-            pthread_mutex_unlock(&mx_concent);
             jit_result = jit_peek(&jit_queue[i], current_concentrator_time, &pkt_index);
             if (jit_result == JIT_ERROR_OK)
             {
@@ -4028,6 +5015,13 @@ void thread_jit(void)
                 MSG("ERROR: jit_peek failed on rf_chain %d with %d\n", i, jit_result);
             }
         }
+
+        /* sleep until the next packet has to be programmed, or until a new one is enqueued,
+         * counted from now: lgw_send may have taken a while */
+        pthread_mutex_lock(&mx_concent);
+        lgw_get_instcnt(&current_concentrator_time);
+        pthread_mutex_unlock(&mx_concent);
+        jit_sleep(jit_next_sleep_us(current_concentrator_time));
     }
 
     MSG("\nINFO: End of JIT thread\n");
@@ -32,6 +32,11 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <string.h>     /* memcpy */
 #include <unistd.h>     /* symlink, unlink */
 #include <inttypes.h>
+#include <errno.h>      /* ETIMEDOUT */
+#include <pthread.h>    /* temperature sampler thread */
+#include <time.h>       /* clock_gettime */
+#include <sys/resource.h> /* setpriority */
+#include <sys/syscall.h>  /* SYS_gettid */
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
@@ -47,6 +52,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_stts751.h"
 #include "loragw_ad5338r.h"
 #include "loragw_debug.h"
+#include "loragw_sim.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG CONSTANTS ------------------------------------------------------ */
@@ -101,6 +107,49 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define LGW_RF_RX_FREQ_MIN          100E6
 #define LGW_RF_RX_FREQ_MAX          1E9
 
+#define MERGE_PAIRWISE_MAX          32      /* up to this many packets, comparing all pairs is faster than sorting */
+
+#define TEMPERATURE_MAX_AGE_MS      60000   /* default age above which lgw_receive reads the sensor itself */
+#define TEMPERATURE_MAX_AGE_MS_MIN  100
+
+/* RSSI temperature compensation table, per RF chain, covering the industrial temperature range */
+#define RSSI_TCOMP_TEMP_MIN         -40     /* degC */
+#define RSSI_TCOMP_TEMP_MAX         85      /* degC */
+#define RSSI_TCOMP_STEPS_PER_DEG    10      /* 0.1 degC resolution */
+#define RSSI_TCOMP_LUT_SIZE         ((RSSI_TCOMP_TEMP_MAX - RSSI_TCOMP_TEMP_MIN) * RSSI_TCOMP_STEPS_PER_DEG + 1)
+
+/* Time on air cache: ToA of every payload size, for a few sets of TX parameters */
+#define TOA_CACHE_PROFILES          24      /* sets of TX parameters cached, the oldest one filled at run time is replaced */
+#define TOA_CACHE_SIZE_MAX          256     /* payload sizes cached */
+#define TOA_CACHE_UNKNOWN           0xFFFFFFFF
+#define TOA_LORA_PREAMBLE_DEFAULT   8       /* usual downlink parameters, cached for the channel plan by lgw_start */
+#define TOA_FSK_PREAMBLE_DEFAULT    5
+
+/* Packet descriptor used to search for duplicates, duplicates are adjacent once sorted */
+typedef struct {
+    uint64_t    key;        /* datarate, if_chain and size */
+    uint32_t    hash;       /* FNV-1a hash of the payload, only computed for packets close in time */
+    uint32_t    rel_us;     /* count_us, relative to half a counter period before the first packet */
+    uint8_t     index;      /* index of the packet in the array */
+} pkt_dedup_t;
+
+/* TX parameters of a time on air cache entry, parameters unused by the modulation are 0 */
+typedef struct {
+    uint8_t     modulation;
+    uint8_t     bandwidth;
+    uint32_t    datarate;
+    uint8_t     coderate;
+    uint16_t    preamble;
+    bool        no_header;
+    bool        no_crc;
+} toa_key_t;
+
+typedef struct {
+    bool        used;
+    toa_key_t   key;
+    uint32_t    toa_ms[TOA_CACHE_SIZE_MAX]; /* TOA_CACHE_UNKNOWN until computed */
+} toa_profile_t;
+
 /* Version string, used to identify the library version/options once compiled */
 const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 
@@ -207,6 +256,29 @@ static uint8_t ts_addr = 0xFF;
 /* I2C AD5338 handles */
 static int     ad_fd = -1;
 
+/* Cached temperature for RSSI compensation, refreshed by the sampler thread (SPI) or by lgw_get_temperature (USB) */
+static pthread_mutex_t mx_temperature = PTHREAD_MUTEX_INITIALIZER; /* control access to the cached temperature */
+static pthread_mutex_t mx_temperature_read = PTHREAD_MUTEX_INITIALIZER; /* one sensor read at a time, kept apart so the cache stays readable during I2C */
+static pthread_cond_t cond_temperature;       /* wakes up the sampler thread when stopping, uses CLOCK_MONOTONIC */
+static pthread_t thrid_temperature;
+static bool temperature_sampler_run = false;
+static bool temperature_valid = false;
+static float temperature_cached = 0.0;
+static struct timespec temperature_time;    /* CLOCK_MONOTONIC time of the cached sample */
+static uint32_t temperature_max_age_ms = TEMPERATURE_MAX_AGE_MS;
+
+/* Virtual concentrator used instead of the hardware, decided by lgw_start */
+static bool sim_enabled = false;
+
+/* RSSI temperature offset for each temperature step, built from the rssi_tcomp coefficients by lgw_rxrf_setconf */
+static float rssi_tcomp_lut[LGW_RF_CHAIN_NB][RSSI_TCOMP_LUT_SIZE];
+
+/* Time on air of the TX parameters in use, filled by lgw_time_on_air and for the channel plan by lgw_start */
+static pthread_mutex_t mx_toa_cache = PTHREAD_MUTEX_INITIALIZER; /* control access to the time on air cache */
+static toa_profile_t toa_cache[TOA_CACHE_PROFILES];
+static int toa_cache_next = 0; /* next profile to be replaced */
+static int toa_cache_pinned = 0; /* first profiles, filled for the channel plan by toa_cache_prefill, never replaced */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -215,7 +287,24 @@ int32_t lgw_bw_getval(int x);
 
 static bool is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2);
 static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index);
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+static void remove_duplicates_pairwise(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+static void remove_duplicates_sorted(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt); /* not static, benchmarked by test_loragw_merge */
+int lgw_temperature_setconf(uint32_t max_age_ms); /* not in loragw_hal.h, used by lora_pkt_fwd */
+
+static void rssi_tcomp_lut_build(uint8_t rf_chain);
+static float rssi_tcomp_lut_get(uint8_t rf_chain, float temperature);
+
+static uint32_t toa_compute(const struct lgw_pkt_tx_s * packet);
+static void toa_key_set(toa_key_t * key, const struct lgw_pkt_tx_s * packet);
+static toa_profile_t * toa_profile_get(const toa_key_t * key);
+static void toa_profile_fill(struct lgw_pkt_tx_s * packet);
+static void toa_cache_prefill(void);
+
+static int temperature_read(float * temperature);
+static void temperature_store(float temperature);
+static int temperature_get_cached(float * temperature);
+static void * thread_temperature(void * arg);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -270,27 +359,16 @@ static bool is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index) {
-    /* Check input parameters */
-    CHECK_NULL(p);
-    CHECK_NULL(nb_pkt);
-    if (pkt_index > ((*nb_pkt) - 1)) {
-        printf("ERROR: failed to remove packet index %u\n", pkt_index);
-        return -1;
-    }
+static uint32_t payload_hash(const uint8_t * payload, uint16_t size) {
+    uint32_t h = 2166136261U; /* FNV-1a */
+    uint16_t i;
 
-    /* Remove pkt from array, by replacing it with last packet of array */
-    if (pkt_index == ((*nb_pkt) - 1)) {
-        /* If we remove last element, just decrement nb packet counter */
-        /* Do nothing */
-    } else {
-        /* Copy last packet onto the packet to be removed */
-        memcpy(p + pkt_index, p + (*nb_pkt) - 1, sizeof(struct lgw_pkt_rx_s));
+    for (i = 0; i < size; i++) {
+        h ^= payload[i];
+        h *= 16777619U;
     }
 
-    *nb_pkt -= 1;
-
-    return 0;
+    return h;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -314,42 +392,60 @@ int compare_pkt_tmst(const void *a, const void *b, void *arg)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
-    uint8_t cpt;
-    int j, k, pkt_dup_idx, x;
-#if DEBUG_HAL == 1
-    int pkt_idx;
-#endif
-    bool dup_restart = false;
-    int counter_qsort_swap = 0;
+static int compare_pkt_dedup(const void *a, const void *b)
+{
+    const pkt_dedup_t *p = (const pkt_dedup_t *)a;
+    const pkt_dedup_t *q = (const pkt_dedup_t *)b;
+
+    if (p->key != q->key) {
+        return (p->key > q->key) ? 1 : -1;
+    }
+    if (p->hash != q->hash) {
+        return (p->hash > q->hash) ? 1 : -1;
+    }
+    if (p->rel_us != q->rel_us) {
+        return (p->rel_us > q->rel_us) ? 1 : -1;
+    }
+    return (int)p->index - (int)q->index;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index) {
     /* Check input parameters */
     CHECK_NULL(p);
     CHECK_NULL(nb_pkt);
-
-    /* Init number of packets in array before merge */
-    cpt = *nb_pkt;
-
-    /* --------------------------------------------- */
-    /* ---------- For Debug only - START ----------- */
-    if (cpt > 0) {
-        DEBUG_MSG("<----- Searching for DUPLICATEs ------\n");
+    if (pkt_index > ((*nb_pkt) - 1)) {
+        printf("ERROR: failed to remove packet index %u\n", pkt_index);
+        return -1;
     }
-    for (j = 0; j < cpt; j++) {
-        DEBUG_PRINTF("  %d: tmst=%u SF=%u CRC_status=%d freq=%u chan=%u", j, p[j].count_us, p[j].datarate, p[j].status, p[j].freq_hz, p[j].if_chain);
-        if (p[j].ftime_received == true) {
-            DEBUG_PRINTF(" ftime=%u\n", p[j].ftime);
-        } else {
-            DEBUG_MSG   (" ftime=NONE\n");
-        }
+
+    /* Remove pkt from array, by replacing it with last packet of array */
+    if (pkt_index == ((*nb_pkt) - 1)) {
+        /* If we remove last element, just decrement nb packet counter */
+        /* Do nothing */
+    } else {
+        /* Copy last packet onto the packet to be removed */
+        memcpy(p + pkt_index, p + (*nb_pkt) - 1, sizeof(struct lgw_pkt_rx_s));
     }
-    /* ---------- For Debug only - END ------------- */
-    /* --------------------------------------------- */
 
-    /* Remove duplicates */
+    *nb_pkt -= 1;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void remove_duplicates_pairwise(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+    int j, k, pkt_dup_idx, x;
+#if DEBUG_HAL == 1
+    int pkt_idx;
+#endif
+    bool dup_restart = false;
+
     j = 0;
-    while (j < cpt) {
-        for (k = (j+1); k < cpt; k++) {
+    while (j < *nb_pkt) {
+        for (k = (j+1); k < *nb_pkt; k++) {
             /* Searching for duplicated packets:
                 -- count_us should be equal or can have up to 24µs of difference (3 samples)
                 -- channel should be same
@@ -390,7 +486,7 @@ static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
                 /* pkt_dup_idx contains the index to be deleted */
                 DEBUG_PRINTF("duplicate found %d:%d, deleting %d\n", pkt_idx, pkt_dup_idx, pkt_dup_idx);
                 /* Remove duplicated packet from packet array */
-                x = remove_pkt(p, &cpt, pkt_dup_idx);
+                x = remove_pkt(p, nb_pkt, pkt_dup_idx);
                 if (x != 0) {
                     printf("ERROR: failed to remove packet from array (%d)\n", x);
                 }
@@ -402,18 +498,146 @@ static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
             /* Duplicate found, restart searching for duplicate from first element */
             j = 0;
             dup_restart = false;
-#if 0
-            printf( "restarting search for duplicate\n" ); /* Too verbose */
-#endif
         } else {
             /* No duplicate found, continue... */
             j += 1;
-#if 0
-            printf( "no duplicate found\n" ); /* Too verbose */
-#endif
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void remove_duplicates_sorted(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+    uint8_t cpt = *nb_pkt;
+    int j, k, s;
+    int a, b, pkt_dup_idx;
+    uint32_t ref_us;
+    pkt_dedup_t dedup[256];
+    bool removed[256];
+
+    /* Sort packets by datarate, channel, size and timestamp, instead of
+        comparing all pairs. Timestamps are taken relative to half a counter
+        period before the first packet, so that a counter wrap-around during
+        the fetch does not break the sort.
+    */
+    ref_us = p[0].count_us - 0x80000000U;
+    for (j = 0; j < cpt; j++) {
+        dedup[j].key = ((uint64_t)p[j].datarate << 24) | ((uint64_t)p[j].if_chain << 16) | p[j].size;
+        dedup[j].hash = 0;
+        dedup[j].rel_us = p[j].count_us - ref_us;
+        dedup[j].index = (uint8_t)j;
+        removed[j] = false;
+    }
+    qsort(dedup, cpt, sizeof dedup[0], compare_pkt_dedup);
+
+    /* Packets received within 24us of each other with the same datarate, channel
+        and size form a cluster. Only their payloads are hashed, and the cluster
+        is sorted by hash so that duplicates end up next to each other.
+    */
+    for (j = 0; j < cpt; j = k) {
+        for (k = j + 1; (k < cpt) && (dedup[k].key == dedup[j].key) && ((dedup[k].rel_us - dedup[k - 1].rel_us) <= 24); k++) {
+            /* extend the cluster */
+        }
+        if ((k - j) > 1) {
+            for (s = j; s < k; s++) {
+                dedup[s].hash = payload_hash(p[dedup[s].index].payload, p[dedup[s].index].size);
+            }
+            qsort(dedup + j, k - j, sizeof dedup[0], compare_pkt_dedup);
         }
     }
 
+    /* Remove duplicates */
+    s = 0; /* packet kept so far in the current group of duplicates */
+    for (k = 1; k < cpt; k++) {
+        /* Searching for duplicated packets:
+            -- count_us should be equal or can have up to 24µs of difference (3 samples)
+            -- channel should be same
+            -- datarate should be same
+            -- payload should be same
+        */
+        if ((dedup[k].key != dedup[s].key) || (dedup[k].hash != dedup[s].hash) || (is_same_pkt(&p[dedup[s].index], &p[dedup[k].index]) == false)) {
+            s = k;
+            continue;
+        }
+
+        a = dedup[s].index;
+        b = dedup[k].index;
+        /* We keep the packet which has CRC checked */
+        if ((p[a].status == STAT_CRC_OK) && (p[b].status == STAT_CRC_BAD)) {
+            pkt_dup_idx = b;
+        } else if ((p[a].status == STAT_CRC_BAD) && (p[b].status == STAT_CRC_OK)) {
+            pkt_dup_idx = a;
+        } else {
+            /* we keep the packet which has a fine timestamp */
+            if (p[a].ftime_received == true) {
+                pkt_dup_idx = b;
+            } else {
+                pkt_dup_idx = a;
+            }
+            /* sanity check */
+            if (((p[a].ftime_received == true) && (p[b].ftime_received == true)) ||
+                ((p[a].ftime_received == false) && (p[b].ftime_received == false))) {
+                DEBUG_MSG("WARNING: both duplicates have fine timestamps, or none has ? TBC\n");
+            }
+        }
+        /* pkt_dup_idx contains the index to be deleted, next duplicates are compared to the one kept */
+        if (pkt_dup_idx == a) {
+            s = k;
+        }
+        DEBUG_PRINTF("duplicate found %d:%d, deleting %d\n", a, b, pkt_dup_idx);
+        removed[pkt_dup_idx] = true;
+    }
+
+    /* Remove duplicated packets from packet array, by replacing them with the last packet of array */
+    for (j = (cpt - 1); j >= 0; j--) {
+        if (removed[j] == true) {
+            if (j != (cpt - 1)) {
+                memcpy(p + j, p + cpt - 1, sizeof(struct lgw_pkt_rx_s));
+            }
+            cpt -= 1;
+        }
+    }
+
+    *nb_pkt = cpt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+    uint8_t cpt;
+    int j;
+    int counter_qsort_swap = 0;
+
+    /* Check input parameters */
+    CHECK_NULL(p);
+    CHECK_NULL(nb_pkt);
+
+    /* Init number of packets in array before merge */
+    cpt = *nb_pkt;
+
+    /* --------------------------------------------- */
+    /* ---------- For Debug only - START ----------- */
+    if (cpt > 0) {
+        DEBUG_MSG("<----- Searching for DUPLICATEs ------\n");
+    }
+    for (j = 0; j < cpt; j++) {
+        DEBUG_PRINTF("  %d: tmst=%u SF=%u CRC_status=%d freq=%u chan=%u", j, p[j].count_us, p[j].datarate, p[j].status, p[j].freq_hz, p[j].if_chain);
+        if (p[j].ftime_received == true) {
+            DEBUG_PRINTF(" ftime=%u\n", p[j].ftime);
+        } else {
+            DEBUG_MSG   (" ftime=NONE\n");
+        }
+    }
+    /* ---------- For Debug only - END ------------- */
+    /* --------------------------------------------- */
+
+    /* Remove duplicates */
+    if (cpt <= MERGE_PAIRWISE_MAX) {
+        remove_duplicates_pairwise(p, &cpt);
+    } else {
+        remove_duplicates_sorted(p, &cpt);
+    }
+
     /* Sort the packet array by ascending counter_us value */
     qsort_r(p, cpt, sizeof(p[0]), compare_pkt_tmst, &counter_qsort_swap);
     DEBUG_PRINTF("%d elements swapped during sorting...\n", counter_qsort_swap);
@@ -443,6 +667,302 @@ static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
     return 0;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void rssi_tcomp_lut_build(uint8_t rf_chain) {
+    int i;
+
+    for (i = 0; i < RSSI_TCOMP_LUT_SIZE; i++) {
+        rssi_tcomp_lut[rf_chain][i] = sx1302_rssi_get_temperature_offset(&CONTEXT_RF_CHAIN[rf_chain].rssi_tcomp, RSSI_TCOMP_TEMP_MIN + (float)i / RSSI_TCOMP_STEPS_PER_DEG);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static float rssi_tcomp_lut_get(uint8_t rf_chain, float temperature) {
+    float pos = (temperature - RSSI_TCOMP_TEMP_MIN) * RSSI_TCOMP_STEPS_PER_DEG;
+
+    /* out of the table (or sensor failure): evaluate the polynomial */
+    if (!((pos >= 0.0) && (pos <= (float)(RSSI_TCOMP_LUT_SIZE - 1)))) {
+        return sx1302_rssi_get_temperature_offset(&CONTEXT_RF_CHAIN[rf_chain].rssi_tcomp, temperature);
+    }
+
+    return rssi_tcomp_lut[rf_chain][(int)(pos + 0.5)];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t toa_compute(const struct lgw_pkt_tx_s * packet) {
+    double t_fsk;
+    uint32_t toa_ms, toa_us;
+
+    if (packet->modulation == MOD_LORA) {
+        toa_us = lora_packet_time_on_air(packet->bandwidth, packet->datarate, packet->coderate, packet->preamble, packet->no_header, packet->no_crc, packet->size, NULL, NULL, NULL);
+        toa_ms = (uint32_t)( (double)toa_us / 1000.0 + 0.5 );
+        DEBUG_PRINTF("INFO: LoRa packet ToA: %u ms\n", toa_ms);
+    } else if (packet->modulation == MOD_FSK) {
+        /* PREAMBLE + SYNC_WORD + PKT_LEN + PKT_PAYLOAD + CRC
+                PREAMBLE: default 5 bytes
+                SYNC_WORD: default 3 bytes
+                PKT_LEN: 1 byte (variable length mode)
+                PKT_PAYLOAD: x bytes
+                CRC: 0 or 2 bytes
+        */
+        t_fsk = (8 * (double)(packet->preamble + CONTEXT_FSK.sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
+
+        /* Duration of packet */
+        toa_ms = (uint32_t)t_fsk + 1; /* add margin for rounding */
+    } else {
+        toa_ms = 0;
+        printf("ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n", packet->modulation);
+    }
+
+    return toa_ms;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void toa_key_set(toa_key_t * key, const struct lgw_pkt_tx_s * packet) {
+    memset(key, 0, sizeof *key);
+    key->modulation = packet->modulation;
+    key->datarate = packet->datarate;
+    key->preamble = packet->preamble;
+    key->no_crc = packet->no_crc;
+    if (packet->modulation == MOD_LORA) {
+        key->bandwidth = packet->bandwidth;
+        key->coderate = packet->coderate;
+        key->no_header = packet->no_header;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* to be called with mx_toa_cache locked */
+static toa_profile_t * toa_profile_get(const toa_key_t * key) {
+    toa_profile_t * prof;
+    int i;
+
+    for (i = 0; i < TOA_CACHE_PROFILES; i++) {
+        if ((toa_cache[i].used == true) && (memcmp(&toa_cache[i].key, key, sizeof *key) == 0)) {
+            return &toa_cache[i];
+        }
+    }
+
+    /* not cached yet, replace the oldest profile, only among the ones filled at run time */
+    prof = &toa_cache[toa_cache_next];
+    toa_cache_next += 1;
+    if (toa_cache_next >= TOA_CACHE_PROFILES) {
+        toa_cache_next = toa_cache_pinned;
+    }
+    prof->used = true;
+    prof->key = *key;
+    for (i = 0; i < TOA_CACHE_SIZE_MAX; i++) {
+        prof->toa_ms[i] = TOA_CACHE_UNKNOWN;
+    }
+
+    return prof;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* to be called with mx_toa_cache locked */
+static void toa_profile_fill(struct lgw_pkt_tx_s * packet) {
+    toa_key_t key;
+    toa_profile_t * prof;
+    int size;
+
+    toa_key_set(&key, packet);
+    prof = toa_profile_get(&key);
+    for (size = 0; size < TOA_CACHE_SIZE_MAX; size++) {
+        packet->size = size;
+        prof->toa_ms[size] = toa_compute(packet);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void toa_cache_prefill(void) {
+    struct lgw_pkt_tx_s pkt;
+    int i, sf;
+    bool multisf_enabled = false;
+
+    memset(&pkt, 0, sizeof pkt);
+
+    pthread_mutex_lock(&mx_toa_cache);
+
+    /* the FSK sync word size may have changed */
+    memset(toa_cache, 0, sizeof toa_cache);
+    toa_cache_next = 0;
+    toa_cache_pinned = 0;
+
+    for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+        if (CONTEXT_IF_CHAIN[i].enable != true) {
+            continue;
+        }
+        switch (sx1302_get_ifmod_config(i)) {
+            case IF_LORA_MULTI:
+                multisf_enabled = true;
+                break;
+            case IF_LORA_STD:
+                pkt.modulation = MOD_LORA;
+                pkt.bandwidth = CONTEXT_LORA_SERVICE.bandwidth;
+                pkt.datarate = CONTEXT_LORA_SERVICE.datarate;
+                pkt.coderate = CR_LORA_4_5;
+                pkt.preamble = TOA_LORA_PREAMBLE_DEFAULT;
+                pkt.no_header = false;
+                pkt.no_crc = true;
+                toa_profile_fill(&pkt);
+                break;
+            case IF_FSK_STD:
+                pkt.modulation = MOD_FSK;
+                pkt.datarate = CONTEXT_FSK.datarate;
+                pkt.preamble = TOA_FSK_PREAMBLE_DEFAULT;
+                pkt.no_crc = false;
+                toa_profile_fill(&pkt);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* downlinks on the multi-SF channels use the spreading factors enabled for uplinks */
+    if (multisf_enabled == true) {
+        pkt.modulation = MOD_LORA;
+        pkt.bandwidth = BW_125KHZ;
+        pkt.coderate = CR_LORA_4_5;
+        pkt.preamble = TOA_LORA_PREAMBLE_DEFAULT;
+        pkt.no_header = false;
+        pkt.no_crc = true;
+        for (sf = DR_LORA_SF5; sf <= DR_LORA_SF12; sf++) {
+            if ((CONTEXT_DEMOD.multisf_datarate & (1 << (sf - DR_LORA_SF5))) == 0) {
+                continue;
+            }
+            pkt.datarate = sf;
+            toa_profile_fill(&pkt);
+        }
+    }
+
+    /* an unusual TX parameter set must not evict the channel plan, keep one slot for run time */
+    toa_cache_pinned = (toa_cache_next < TOA_CACHE_PROFILES) ? toa_cache_next : (TOA_CACHE_PROFILES - 1);
+    toa_cache_next = toa_cache_pinned;
+
+    pthread_mutex_unlock(&mx_toa_cache);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int temperature_read(float * temperature) {
+    int err = LGW_HAL_ERROR;
+
+    if (sim_enabled == true) {
+        return lgw_sim_get_temperature(temperature);
+    }
+
+    /* sampler thread, lgw_receive and lgw_get_temperature all end up here */
+    pthread_mutex_lock(&mx_temperature_read);
+    switch (CONTEXT_COM_TYPE) {
+        case LGW_COM_SPI:
+            err = stts751_get_temperature(ts_fd, ts_addr, temperature);
+            break;
+        case LGW_COM_USB:
+            err = lgw_com_get_temperature(temperature);
+            break;
+        default:
+            printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
+            break;
+    }
+    pthread_mutex_unlock(&mx_temperature_read);
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void temperature_store(float temperature) {
+    pthread_mutex_lock(&mx_temperature);
+    temperature_cached = temperature;
+    clock_gettime(CLOCK_MONOTONIC, &temperature_time);
+    temperature_valid = true;
+    pthread_mutex_unlock(&mx_temperature);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int temperature_get_cached(float * temperature) {
+    struct timespec now;
+    int32_t age_ms;
+    bool fresh = false;
+    int err;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&mx_temperature);
+    if (temperature_valid == true) {
+        age_ms = (int32_t)(now.tv_sec - temperature_time.tv_sec) * 1000 + (int32_t)(now.tv_nsec - temperature_time.tv_nsec) / 1000000;
+        if (age_ms <= (int32_t)temperature_max_age_ms) {
+            *temperature = temperature_cached;
+            fresh = true;
+        }
+    }
+    pthread_mutex_unlock(&mx_temperature);
+    if (fresh == true) {
+        return LGW_HAL_SUCCESS;
+    }
+
+    /* No sample or too old (sampler not running or starved): read the sensor, the caller holds the concentrator */
+    DEBUG_MSG("INFO: cached temperature is stale, reading sensor\n");
+    err = temperature_read(temperature);
+    if (err == LGW_HAL_SUCCESS) {
+        temperature_store(*temperature);
+    }
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void * thread_temperature(void * arg) {
+    struct timespec deadline;
+    float temperature;
+    uint32_t period_ms;
+
+    (void)arg;
+
+    /* Lowest priority: a late sample only makes lgw_receive read the sensor itself */
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19) != 0) {
+        DEBUG_MSG("WARNING: failed to lower temperature sampler priority\n");
+    }
+
+    pthread_mutex_lock(&mx_temperature);
+    while (temperature_sampler_run == true) {
+        pthread_mutex_unlock(&mx_temperature);
+        temperature = 0.0; /* left untouched by the sensor driver when no sensor is fitted */
+        if (temperature_read(&temperature) == LGW_HAL_SUCCESS) {
+            temperature_store(temperature);
+        } else {
+            printf("WARNING: temperature sampler failed to read the sensor\n");
+        }
+
+        /* Sample 4 times per staleness period, so that the cache is never stale while the sampler runs */
+        pthread_mutex_lock(&mx_temperature);
+        period_ms = temperature_max_age_ms / 4;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += period_ms / 1000;
+        deadline.tv_nsec += (long)(period_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (temperature_sampler_run == true) {
+            if (pthread_cond_timedwait(&cond_temperature, &mx_temperature, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mx_temperature);
+
+    return NULL;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -526,6 +1046,9 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s * conf) {
     CONTEXT_RF_CHAIN[rf_chain].tx_enable = conf->tx_enable;
     CONTEXT_RF_CHAIN[rf_chain].single_input_mode = conf->single_input_mode;
 
+    /* Coefficients are fixed from now on: tabulate the RSSI temperature offset */
+    rssi_tcomp_lut_build(rf_chain);
+
     DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d single_input_mode:%d\n",  rf_chain,
                                                                                                                 CONTEXT_RF_CHAIN[rf_chain].enable,
                                                                                                                 CONTEXT_RF_CHAIN[rf_chain].freq_hz,
@@ -845,8 +1368,27 @@ int lgw_debug_setconf(struct lgw_conf_debug_s * conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_temperature_setconf(uint32_t max_age_ms) {
+    if (max_age_ms < TEMPERATURE_MAX_AGE_MS_MIN) {
+        printf("ERROR: temperature max age must be at least %u ms\n", TEMPERATURE_MAX_AGE_MS_MIN);
+        return LGW_HAL_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_temperature);
+    temperature_max_age_ms = max_age_ms;
+    pthread_mutex_unlock(&mx_temperature);
+
+    DEBUG_PRINTF("Note: temperature configuration: max_age_ms:%u\n", max_age_ms);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_start(void) {
     int i, err;
+    float temperature;
+    pthread_condattr_t cond_attr;
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
@@ -854,6 +1396,22 @@ int lgw_start(void) {
         DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
     }
 
+    /* No hardware access at all with the virtual concentrator */
+    sim_enabled = lgw_sim_enabled();
+    if (sim_enabled == true) {
+        err = lgw_sim_start(&lgw_context);
+        if (err != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to start simulated concentrator\n");
+            return LGW_HAL_ERROR;
+        }
+        pthread_mutex_lock(&mx_temperature);
+        temperature_valid = false;
+        pthread_mutex_unlock(&mx_temperature);
+        toa_cache_prefill();
+        CONTEXT_STARTED = true;
+        return LGW_HAL_SUCCESS;
+    }
+
     err = lgw_connect(CONTEXT_COM_TYPE, CONTEXT_COM_PATH);
     if (err == LGW_REG_ERROR) {
         DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
@@ -1175,6 +1733,36 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
+    /* Get a first temperature sample, lgw_receive reads the sensor itself while there is none */
+    pthread_mutex_lock(&mx_temperature);
+    temperature_valid = false;
+    pthread_mutex_unlock(&mx_temperature);
+    temperature = 0.0;
+    if (temperature_read(&temperature) == LGW_HAL_SUCCESS) {
+        temperature_store(temperature);
+    } else {
+        printf("WARNING: failed to get initial temperature\n");
+    }
+
+    /* The I2C sensor does not share the SPI bus: sample it in the background.
+       Over USB, the sensor is read through the MCU, the cache is refreshed by lgw_get_temperature and lgw_receive */
+    if ((CONTEXT_COM_TYPE == LGW_COM_SPI) && (temperature_sampler_run == false)) {
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&cond_temperature, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+        temperature_sampler_run = true;
+        err = pthread_create(&thrid_temperature, NULL, thread_temperature, NULL);
+        if (err != 0) {
+            printf("WARNING: failed to create temperature sampler thread, temperature will be read on reception\n");
+            temperature_sampler_run = false;
+            pthread_cond_destroy(&cond_temperature);
+        }
+    }
+
+    /* time on air of the downlinks expected with this channel plan */
+    toa_cache_prefill();
+
     /* set hal state */
     CONTEXT_STARTED = true;
 
@@ -1195,6 +1783,12 @@ int lgw_stop(void) {
         return LGW_HAL_SUCCESS;
     }
 
+    if (sim_enabled == true) {
+        lgw_sim_stop();
+        CONTEXT_STARTED = false;
+        return LGW_HAL_SUCCESS;
+    }
+
     /* Abort current TX if needed */
     for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
         DEBUG_PRINTF("INFO: aborting TX on chain %u\n", i);
@@ -1218,9 +1812,21 @@ int lgw_stop(void) {
         err = LGW_HAL_ERROR;
     }
 
+    if (temperature_sampler_run == true) {
+        DEBUG_MSG("INFO: Stopping temperature sampler\n");
+        pthread_mutex_lock(&mx_temperature);
+        temperature_sampler_run = false;
+        pthread_cond_signal(&cond_temperature);
+        pthread_mutex_unlock(&mx_temperature);
+        pthread_join(thrid_temperature, NULL);
+        pthread_cond_destroy(&cond_temperature);
+    }
+
     if (CONTEXT_COM_TYPE == LGW_COM_SPI) {
         DEBUG_MSG("INFO: Closing I2C for temperature sensor\n");
+        pthread_mutex_lock(&mx_temperature_read);
         x = i2c_linuxdev_close(ts_fd);
+        pthread_mutex_unlock(&mx_temperature_read);
         if (x != 0) {
             printf("ERROR: failed to close I2C temperature sensor device (err=%i)\n", x);
             err = LGW_HAL_ERROR;
@@ -1251,6 +1857,8 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
     uint8_t nb_pkt_found = 0;
     uint8_t nb_pkt_left = 0;
     float current_temperature = 0.0, rssi_temperature_offset = 0.0;
+    float rssi_corr[LGW_RF_CHAIN_NB];
+    int i;
     /* performances variables */
     struct timeval tm;
 
@@ -1259,57 +1867,68 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
     /* Record function start time */
     _meas_time_start(&tm);
 
-    /* Get packets from SX1302, if any */
-    res = sx1302_fetch(&nb_pkt_fetched);
-    if (res != LGW_REG_SUCCESS) {
-        printf("ERROR: failed to fetch packets from SX1302\n");
-        return LGW_HAL_ERROR;
-    }
+    if (sim_enabled == true) {
+        /* Get packets from the virtual concentrator, already parsed */
+        nb_pkt_found = (uint8_t)lgw_sim_receive(max_pkt, pkt_data);
+        if (nb_pkt_found == 0) {
+            _meas_time_stop(1, tm, __FUNCTION__);
+            return 0;
+        }
+    } else {
+        /* Get packets from SX1302, if any */
+        res = sx1302_fetch(&nb_pkt_fetched);
+        if (res != LGW_REG_SUCCESS) {
+            printf("ERROR: failed to fetch packets from SX1302\n");
+            return LGW_HAL_ERROR;
+        }
 
-    /* Update internal counter */
-    /* WARNING: this needs to be called regularly by the upper layer */
-    res = sx1302_update();
-    if (res != LGW_REG_SUCCESS) {
-        return LGW_HAL_ERROR;
-    }
+        /* Update internal counter */
+        /* WARNING: this needs to be called regularly by the upper layer */
+        res = sx1302_update();
+        if (res != LGW_REG_SUCCESS) {
+            return LGW_HAL_ERROR;
+        }
 
-    /* Exit now if no packet fetched */
-    if (nb_pkt_fetched == 0) {
-        _meas_time_stop(1, tm, __FUNCTION__);
-        return 0;
-    }
-    if (nb_pkt_fetched > max_pkt) {
-        nb_pkt_left = nb_pkt_fetched - max_pkt;
-        printf("WARNING: not enough space allocated, fetched %d packet(s), %d will be left in RX buffer\n", nb_pkt_fetched, nb_pkt_left);
+        /* Exit now if no packet fetched */
+        if (nb_pkt_fetched == 0) {
+            _meas_time_stop(1, tm, __FUNCTION__);
+            return 0;
+        }
+        if (nb_pkt_fetched > max_pkt) {
+            nb_pkt_left = nb_pkt_fetched - max_pkt;
+            printf("WARNING: not enough space allocated, fetched %d packet(s), %d will be left in RX buffer\n", nb_pkt_fetched, nb_pkt_left);
+        }
+
+        /* Iterate on the RX buffer to get parsed packets */
+        for (nb_pkt_found = 0; nb_pkt_found < ((nb_pkt_fetched <= max_pkt) ? nb_pkt_fetched : max_pkt); nb_pkt_found++) {
+            /* Get packet and move to next one */
+            res = sx1302_parse(&lgw_context, &pkt_data[nb_pkt_found]);
+            if (res == LGW_REG_WARNING) {
+                printf("WARNING: parsing error on packet %d, discarding fetched packets\n", nb_pkt_found);
+                return LGW_HAL_SUCCESS;
+            } else if (res == LGW_REG_ERROR) {
+                printf("ERROR: fatal parsing error on packet %d, aborting...\n", nb_pkt_found);
+                return LGW_HAL_ERROR;
+            }
+        }
     }
 
-    /* Apply RSSI temperature compensation */
-    res = lgw_get_temperature(&current_temperature);
+    /* Apply RSSI temperature compensation, with the cached temperature to keep the sensor access out of the RX path */
+    res = temperature_get_cached(&current_temperature);
     if (res != LGW_I2C_SUCCESS) {
         printf("ERROR: failed to get current temperature\n");
         return LGW_HAL_ERROR;
     }
 
-    /* Iterate on the RX buffer to get parsed packets */
-    for (nb_pkt_found = 0; nb_pkt_found < ((nb_pkt_fetched <= max_pkt) ? nb_pkt_fetched : max_pkt); nb_pkt_found++) {
-        /* Get packet and move to next one */
-        res = sx1302_parse(&lgw_context, &pkt_data[nb_pkt_found]);
-        if (res == LGW_REG_WARNING) {
-            printf("WARNING: parsing error on packet %d, discarding fetched packets\n", nb_pkt_found);
-            return LGW_HAL_SUCCESS;
-        } else if (res == LGW_REG_ERROR) {
-            printf("ERROR: fatal parsing error on packet %d, aborting...\n", nb_pkt_found);
-            return LGW_HAL_ERROR;
-        }
-
-        /* Appli RSSI offset calibrated for the board */
-        pkt_data[nb_pkt_found].rssic += CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_offset;
-        pkt_data[nb_pkt_found].rssis += CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_offset;
-
-        rssi_temperature_offset = sx1302_rssi_get_temperature_offset(&CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_tcomp, current_temperature);
-        pkt_data[nb_pkt_found].rssic += rssi_temperature_offset;
-        pkt_data[nb_pkt_found].rssis += rssi_temperature_offset;
-        DEBUG_PRINTF("INFO: RSSI temperature offset applied: %.3f dB (current temperature %.1f C)\n", rssi_temperature_offset, current_temperature);
+    /* Apply RSSI offset calibrated for the board and temperature offset, the same for all packets of an RF chain */
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        rssi_temperature_offset = rssi_tcomp_lut_get(i, current_temperature);
+        rssi_corr[i] = CONTEXT_RF_CHAIN[i].rssi_offset + rssi_temperature_offset;
+        DEBUG_PRINTF("INFO: RSSI temperature offset for chain %d: %.3f dB (current temperature %.1f C)\n", i, rssi_temperature_offset, current_temperature);
+    }
+    for (i = 0; i < nb_pkt_found; i++) {
+        pkt_data[i].rssic += rssi_corr[pkt_data[i].rf_chain];
+        pkt_data[i].rssis += rssi_corr[pkt_data[i].rf_chain];
     }
 
     DEBUG_PRINTF("INFO: nb pkt found:%u left:%u\n", nb_pkt_found, nb_pkt_left);
@@ -1408,6 +2027,12 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         return LGW_HAL_ERROR;
     }
 
+    if (sim_enabled == true) {
+        err = lgw_sim_send(pkt_data);
+        _meas_time_stop(1, tm, __FUNCTION__);
+        return err;
+    }
+
     /* Set PA gain with AD5338R when using full duplex CN490 ref design */
     if (CONTEXT_BOARD.full_duplex == true) {
         uint8_t volt_val[AD5338R_CMD_SIZE] = {0x39, VOLTAGE2HEX_H(2.51), VOLTAGE2HEX_L(2.51)}; /* set to 2.51V */
@@ -1498,12 +2123,16 @@ int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t *code) {
     if (select == TX_STATUS) {
         if (CONTEXT_STARTED == false) {
             *code = TX_OFF;
+        } else if (sim_enabled == true) {
+            *code = lgw_sim_tx_status(rf_chain);
         } else {
             *code = sx1302_tx_status(rf_chain);
         }
     } else if (select == RX_STATUS) {
         if (CONTEXT_STARTED == false) {
             *code = RX_OFF;
+        } else if (sim_enabled == true) {
+            *code = RX_ON;
         } else {
             *code = sx1302_rx_status(rf_chain);
         }
@@ -1532,7 +2161,11 @@ int lgw_abort_tx(uint8_t rf_chain) {
     }
 
     /* Abort current TX */
-    err = sx1302_tx_abort(rf_chain);
+    if (sim_enabled == true) {
+        err = lgw_sim_abort_tx(rf_chain);
+    } else {
+        err = sx1302_tx_abort(rf_chain);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1546,7 +2179,11 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
     CHECK_NULL(trig_cnt_us);
 
-    *trig_cnt_us = sx1302_timestamp_counter(true);
+    if (sim_enabled == true) {
+        *trig_cnt_us = lgw_sim_counter(true);
+    } else {
+        *trig_cnt_us = sx1302_timestamp_counter(true);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1560,7 +2197,11 @@ int lgw_get_instcnt(uint32_t* inst_cnt_us) {
 
     CHECK_NULL(inst_cnt_us);
 
-    *inst_cnt_us = sx1302_timestamp_counter(false);
+    if (sim_enabled == true) {
+        *inst_cnt_us = lgw_sim_counter(false);
+    } else {
+        *inst_cnt_us = sx1302_timestamp_counter(false);
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1574,6 +2215,10 @@ int lgw_get_eui(uint64_t* eui) {
 
     CHECK_NULL(eui);
 
+    if (sim_enabled == true) {
+        return lgw_sim_get_eui(eui);
+    }
+
     if (sx1302_get_eui(eui) != LGW_REG_SUCCESS) {
         return LGW_HAL_ERROR;
     }
@@ -1592,16 +2237,9 @@ int lgw_get_temperature(float* temperature) {
 
     CHECK_NULL(temperature);
 
-    switch (CONTEXT_COM_TYPE) {
-        case LGW_COM_SPI:
-            err = stts751_get_temperature(ts_fd, ts_addr, temperature);
-            break;
-        case LGW_COM_USB:
-            err = lgw_com_get_temperature(temperature);
-            break;
-        default:
-            printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
-            break;
+    err = temperature_read(temperature);
+    if (err == LGW_HAL_SUCCESS) {
+        temperature_store(*temperature);
     }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
@@ -1618,8 +2256,9 @@ const char* lgw_version_info() {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet) {
-    double t_fsk;
-    uint32_t toa_ms, toa_us;
+    toa_key_t key;
+    toa_profile_t * prof;
+    uint32_t toa_ms;
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
@@ -1628,26 +2267,20 @@ uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet) {
         return 0;
     }
 
-    if (packet->modulation == MOD_LORA) {
-        toa_us = lora_packet_time_on_air(packet->bandwidth, packet->datarate, packet->coderate, packet->preamble, packet->no_header, packet->no_crc, packet->size, NULL, NULL, NULL);
-        toa_ms = (uint32_t)( (double)toa_us / 1000.0 + 0.5 );
-        DEBUG_PRINTF("INFO: LoRa packet ToA: %u ms\n", toa_ms);
-    } else if (packet->modulation == MOD_FSK) {
-        /* PREAMBLE + SYNC_WORD + PKT_LEN + PKT_PAYLOAD + CRC
-                PREAMBLE: default 5 bytes
-                SYNC_WORD: default 3 bytes
-                PKT_LEN: 1 byte (variable length mode)
-                PKT_PAYLOAD: x bytes
-                CRC: 0 or 2 bytes
-        */
-        t_fsk = (8 * (double)(packet->preamble + CONTEXT_FSK.sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
+    if (((packet->modulation != MOD_LORA) && (packet->modulation != MOD_FSK)) || (packet->size >= TOA_CACHE_SIZE_MAX)) {
+        return toa_compute(packet);
+    }
 
-        /* Duration of packet */
-        toa_ms = (uint32_t)t_fsk + 1; /* add margin for rounding */
-    } else {
-        toa_ms = 0;
-        printf("ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n", packet->modulation);
+    /* memoized per set of TX parameters */
+    toa_key_set(&key, packet);
+    pthread_mutex_lock(&mx_toa_cache);
+    prof = toa_profile_get(&key);
+    toa_ms = prof->toa_ms[packet->size];
+    if (toa_ms == TOA_CACHE_UNKNOWN) {
+        toa_ms = toa_compute(packet);
+        prof->toa_ms[packet->size] = toa_ms;
     }
+    pthread_mutex_unlock(&mx_toa_cache);
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1664,6 +2297,10 @@ int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
         return LGW_HAL_ERROR;
     }
 
+    if (sim_enabled == true) {
+        return lgw_sim_spectral_scan_start(freq_hz, nb_scan);
+    }
+
     err = sx1261_set_rx_params(freq_hz, BW_125KHZ);
     if (err != LGW_REG_SUCCESS) {
         printf("ERROR: Failed to set RX params for Spectral Scan\n");
@@ -1682,18 +2319,27 @@ int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_get_status(lgw_spectral_scan_status_t * status) {
+    if (sim_enabled == true) {
+        return lgw_sim_spectral_scan_get_status(status);
+    }
     return sx1261_spectral_scan_status(status);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_get_results(int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RESULT_SIZE], uint16_t results[static LGW_SPECTRAL_SCAN_RESULT_SIZE]) {
+    if (sim_enabled == true) {
+        return lgw_sim_spectral_scan_get_results(CONTEXT_SX1261.rssi_offset, levels_dbm, results);
+    }
     return sx1261_spectral_scan_get_results(CONTEXT_SX1261.rssi_offset, levels_dbm, results);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_abort() {
+    if (sim_enabled == true) {
+        return lgw_sim_spectral_scan_abort();
+    }
     return sx1261_spectral_scan_abort();
 }
 
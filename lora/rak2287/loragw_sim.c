@@ -0,0 +1,565 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Virtual SX1302 concentrator: traffic generator, free-running counter,
+    TX scheduling and spectral scan without hardware
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* getenv, strtoul */
+#include <string.h>     /* strncpy, strtok_r */
+#include <math.h>       /* log */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_sx1302.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_EUI                 0x53494D0000000001ULL   /* "SIM" */
+#define SIM_MODEL_MAX_LEN       256
+#define SIM_SCAN_US_PER_POINT   100     /* spectral scan duration per point */
+#define SIM_SCAN_LEVEL_MIN      -130    /* dBm, first histogram bin */
+#define SIM_SCAN_LEVEL_STEP     2       /* dB per histogram bin */
+#define SIM_NOISE_FLOOR         -110    /* dBm */
+#define SIM_DUP_MAX_DELAY_US    16      /* delay of the second demodulation of a packet */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct sim_model_s {
+    double      rate;       /* packets per second */
+    uint8_t     sf_min;
+    uint8_t     sf_max;
+    uint16_t    size_min;
+    uint16_t    size_max;
+    uint8_t     crc_bad_pct;
+    uint8_t     no_crc_pct;
+    uint8_t     dup_pct;
+    uint32_t    cnt_start;  /* counter value at start */
+    float       temperature;
+    uint32_t    seed;
+};
+
+struct sim_tx_s {
+    bool        pending;    /* a packet is scheduled or being sent */
+    uint32_t    start_us;   /* counter value at the start of the emission */
+    uint32_t    toa_us;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const lgw_context_t * sim_ctx = NULL;
+
+static struct sim_model_s sim_model;
+static uint32_t sim_rng;                /* xorshift32 state */
+static struct timespec sim_t0;          /* monotonic time of the start, counter is cnt_start */
+static uint64_t sim_next_rx_us;         /* arrival of the next packet, in us since start */
+
+static struct sim_tx_s sim_tx[LGW_RF_CHAIN_NB];
+
+static lgw_spectral_scan_status_t sim_scan_status = LGW_SPECTRAL_SCAN_STATUS_NONE;
+static uint64_t sim_scan_end_us;
+static uint16_t sim_scan_nb;
+
+/* statistics, printed by lgw_sim_stop */
+static uint32_t sim_nb_rx;
+static uint32_t sim_nb_rx_dup;
+static uint32_t sim_nb_tx;
+static uint32_t sim_nb_tx_late;
+static uint32_t sim_nb_tx_overlap;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t sim_rand(void) {
+    sim_rng ^= sim_rng << 13;
+    sim_rng ^= sim_rng >> 17;
+    sim_rng ^= sim_rng << 5;
+    return sim_rng;
+}
+
+/* uniform in [min, max] */
+static uint32_t sim_rand_range(uint32_t min, uint32_t max) {
+    return min + sim_rand() % (max - min + 1);
+}
+
+/* uniform in ]0, 1] */
+static double sim_rand_unit(void) {
+    return ((double)sim_rand() + 1.0) / 4294967296.0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* time elapsed since lgw_sim_start, in us */
+static uint64_t sim_elapsed_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - sim_t0.tv_sec) * 1000000 + (now.tv_nsec - sim_t0.tv_nsec) / 1000;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t sim_next_arrival(uint64_t from_us) {
+    if (sim_model.rate <= 0.0) {
+        return UINT64_MAX;
+    }
+    return from_us + (uint64_t)(-log(sim_rand_unit()) / sim_model.rate * 1E6);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int sim_parse_range(const char * str, uint32_t * min, uint32_t * max) {
+    unsigned int a, b;
+
+    switch (sscanf(str, "%u-%u", &a, &b)) {
+        case 1:
+            b = a;
+            break;
+        case 2:
+            break;
+        default:
+            return -1;
+    }
+    if (a > b) {
+        return -1;
+    }
+    *min = a;
+    *max = b;
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int sim_parse_model(const char * str) {
+    char buf[SIM_MODEL_MAX_LEN];
+    char *tok, *save, *val, *end;
+    uint32_t min, max;
+
+    /* default traffic model */
+    sim_model.rate = 10.0;
+    sim_model.sf_min = 7;
+    sim_model.sf_max = 12;
+    sim_model.size_min = 10;
+    sim_model.size_max = 50;
+    sim_model.crc_bad_pct = 5;
+    sim_model.no_crc_pct = 0;
+    sim_model.dup_pct = 50;
+    sim_model.cnt_start = 0;
+    sim_model.temperature = 25.0;
+    sim_model.seed = 1;
+
+    if (str == NULL) {
+        return 0;
+    }
+    strncpy(buf, str, sizeof buf);
+    buf[sizeof buf - 1] = '\0'; /* ensure string termination */
+
+    for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        val = strchr(tok, '=');
+        if (val == NULL) {
+            if (strcmp(tok, "1") == 0) {
+                continue; /* LORAGW_SIM=1: default model */
+            }
+            printf("ERROR: invalid simulation parameter \"%s\" (expected key=value)\n", tok);
+            return -1;
+        }
+        *val++ = '\0';
+        if (strcmp(tok, "rate") == 0) {
+            sim_model.rate = strtod(val, &end);
+            if ((end == val) || (*end != '\0') || (sim_model.rate < 0.0)) {
+                break;
+            }
+        } else if (strcmp(tok, "sf") == 0) {
+            if ((sim_parse_range(val, &min, &max) != 0) || (min < DR_LORA_SF5) || (max > DR_LORA_SF12)) {
+                break;
+            }
+            sim_model.sf_min = (uint8_t)min;
+            sim_model.sf_max = (uint8_t)max;
+        } else if (strcmp(tok, "size") == 0) {
+            if ((sim_parse_range(val, &min, &max) != 0) || (min < 1) || (max > 255)) {
+                break;
+            }
+            sim_model.size_min = (uint16_t)min;
+            sim_model.size_max = (uint16_t)max;
+        } else if (strcmp(tok, "crc_bad") == 0) {
+            sim_model.crc_bad_pct = (uint8_t)strtoul(val, NULL, 10);
+        } else if (strcmp(tok, "no_crc") == 0) {
+            sim_model.no_crc_pct = (uint8_t)strtoul(val, NULL, 10);
+        } else if (strcmp(tok, "dup") == 0) {
+            sim_model.dup_pct = (uint8_t)strtoul(val, NULL, 10);
+        } else if (strcmp(tok, "cnt") == 0) {
+            sim_model.cnt_start = (uint32_t)strtoul(val, NULL, 0);
+        } else if (strcmp(tok, "temp") == 0) {
+            sim_model.temperature = strtof(val, &end);
+            if ((end == val) || (*end != '\0')) {
+                break;
+            }
+        } else if (strcmp(tok, "seed") == 0) {
+            sim_model.seed = (uint32_t)strtoul(val, NULL, 0);
+        } else {
+            printf("ERROR: unknown simulation parameter \"%s\"\n", tok);
+            return -1;
+        }
+    }
+    if (tok != NULL) {
+        printf("ERROR: invalid value \"%s\" for simulation parameter \"%s\"\n", val, tok);
+        return -1;
+    }
+    if ((sim_model.crc_bad_pct + sim_model.no_crc_pct > 100) || (sim_model.dup_pct > 100)) {
+        printf("ERROR: invalid simulation percentages\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fill a received packet on a random enabled IF chain, return -1 if no IF chain is enabled */
+static int sim_build_pkt(uint64_t arrival_us, struct lgw_pkt_rx_s * p) {
+    uint8_t if_list[LGW_IF_CHAIN_NB];
+    uint8_t sf_list[8];
+    int nb_if = 0, nb_sf = 0;
+    int i, sf;
+    uint32_t x;
+
+    for (i = 0; i < LGW_IF_CHAIN_NB; i++) {
+        if ((sim_ctx->if_chain_cfg[i].enable == true) && (sim_ctx->rf_chain_cfg[sim_ctx->if_chain_cfg[i].rf_chain].enable == true)) {
+            if_list[nb_if++] = (uint8_t)i;
+        }
+    }
+    if (nb_if == 0) {
+        return -1;
+    }
+
+    memset(p, 0, sizeof *p);
+    p->if_chain = if_list[sim_rand() % nb_if];
+    p->rf_chain = sim_ctx->if_chain_cfg[p->if_chain].rf_chain;
+    p->freq_hz = (uint32_t)((int32_t)sim_ctx->rf_chain_cfg[p->rf_chain].freq_hz + sim_ctx->if_chain_cfg[p->if_chain].freq_hz);
+    p->freq_offset = (int32_t)sim_rand_range(0, 2000) - 1000;
+    p->count_us = sim_model.cnt_start + (uint32_t)arrival_us; /* free-running, wraps around */
+    p->modem_id = p->if_chain;
+
+    if (p->if_chain < 8) {
+        /* multi-SF channel: any enabled SF of the model */
+        for (sf = sim_model.sf_min; sf <= sim_model.sf_max; sf++) {
+            if ((sim_ctx->demod_cfg.multisf_datarate & (1 << (sf - DR_LORA_SF5))) != 0) {
+                sf_list[nb_sf++] = (uint8_t)sf;
+            }
+        }
+        p->modulation = MOD_LORA;
+        p->bandwidth = BW_125KHZ;
+        p->datarate = (nb_sf > 0) ? sf_list[sim_rand() % nb_sf] : DR_LORA_SF7;
+        p->coderate = CR_LORA_4_5;
+    } else if (p->if_chain == 8) {
+        p->modulation = MOD_LORA;
+        p->bandwidth = sim_ctx->lora_service_cfg.bandwidth;
+        p->datarate = sim_ctx->lora_service_cfg.datarate;
+        p->coderate = CR_LORA_4_5;
+    } else {
+        p->modulation = MOD_FSK;
+        p->bandwidth = sim_ctx->fsk_cfg.bandwidth;
+        p->datarate = sim_ctx->fsk_cfg.datarate;
+        p->coderate = CR_UNDEFINED;
+    }
+
+    x = sim_rand() % 100;
+    if (x < sim_model.crc_bad_pct) {
+        p->status = STAT_CRC_BAD;
+    } else if (x < (uint32_t)(sim_model.crc_bad_pct + sim_model.no_crc_pct)) {
+        p->status = STAT_NO_CRC;
+    } else {
+        p->status = STAT_CRC_OK;
+    }
+
+    p->rssic = -40.0 - (float)sim_rand_range(0, 800) / 10.0;
+    p->rssis = p->rssic - 1.0;
+    if (p->modulation == MOD_LORA) {
+        p->snr = 10.0 - (float)sim_rand_range(0, 50 + 25 * (p->datarate - DR_LORA_SF7)) / 10.0;
+        p->snr_min = p->snr - 1.0;
+        p->snr_max = p->snr + 1.0;
+    }
+    p->crc = (uint16_t)sim_rand();
+    p->size = (uint16_t)sim_rand_range(sim_model.size_min, sim_model.size_max);
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = (uint8_t)sim_rand();
+    }
+    p->ftime_received = false;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+bool lgw_sim_enabled(void) {
+#if HAL_SIM == 1
+    return true;
+#else
+    return (getenv("LORAGW_SIM") != NULL);
+#endif
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_start(const lgw_context_t * context) {
+    int i;
+
+    if (context == NULL) {
+        return LGW_HAL_ERROR;
+    }
+    if (sim_parse_model(getenv("LORAGW_SIM")) != 0) {
+        return LGW_HAL_ERROR;
+    }
+    sim_ctx = context;
+    sim_rng = (sim_model.seed != 0) ? sim_model.seed : 1; /* xorshift state must not be 0 */
+
+    clock_gettime(CLOCK_MONOTONIC, &sim_t0);
+    sim_next_rx_us = sim_next_arrival(0);
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        sim_tx[i].pending = false;
+    }
+    sim_scan_status = LGW_SPECTRAL_SCAN_STATUS_NONE;
+    sim_nb_rx = 0;
+    sim_nb_rx_dup = 0;
+    sim_nb_tx = 0;
+    sim_nb_tx_late = 0;
+    sim_nb_tx_overlap = 0;
+
+    printf("INFO: using simulated concentrator: %.1f pkt/s, SF%u-%u, %u-%u bytes, CRC bad %u%%, no CRC %u%%, duplicates %u%%, counter start %u\n",
+            sim_model.rate, sim_model.sf_min, sim_model.sf_max, sim_model.size_min, sim_model.size_max,
+            sim_model.crc_bad_pct, sim_model.no_crc_pct, sim_model.dup_pct, sim_model.cnt_start);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_stop(void) {
+    printf("INFO: simulated concentrator: %u packets received (%u duplicates), %u packets sent (%u late, %u overlapping)\n",
+            sim_nb_rx, sim_nb_rx_dup, sim_nb_tx, sim_nb_tx_late, sim_nb_tx_overlap);
+    sim_ctx = NULL;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_receive(uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data) {
+    uint64_t now_us = sim_elapsed_us();
+    int nb_pkt = 0;
+    bool dup;
+
+    /* packets that arrived since the previous call, the others stay in the "RX buffer" */
+    while ((sim_next_rx_us <= now_us) && (nb_pkt < max_pkt)) {
+        /* the second demodulation must fit in the same fetch */
+        dup = (sim_ctx->ftime_cfg.enable == true) && ((sim_rand() % 100) < sim_model.dup_pct);
+        if ((dup == true) && ((nb_pkt + 2) > max_pkt)) {
+            break;
+        }
+        if (sim_build_pkt(sim_next_rx_us, &pkt_data[nb_pkt]) != 0) {
+            sim_next_rx_us = UINT64_MAX; /* no channel enabled: nothing will ever be received */
+            break;
+        }
+        nb_pkt += 1;
+        sim_nb_rx += 1;
+        if (dup == true) {
+            pkt_data[nb_pkt] = pkt_data[nb_pkt - 1];
+            pkt_data[nb_pkt].count_us += sim_rand_range(0, SIM_DUP_MAX_DELAY_US);
+            pkt_data[nb_pkt].ftime_received = true;
+            pkt_data[nb_pkt].ftime = sim_rand() % 1000000000;
+            nb_pkt += 1;
+            sim_nb_rx_dup += 1;
+        }
+        sim_next_rx_us = sim_next_arrival(sim_next_rx_us);
+    }
+
+    DEBUG_PRINTF("INFO: simulated fetch: %d packets\n", nb_pkt);
+
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_send(const struct lgw_pkt_tx_s * pkt_data) {
+    struct sim_tx_s * tx = &sim_tx[pkt_data->rf_chain];
+    uint32_t now = lgw_sim_counter(false);
+
+    if (lgw_sim_tx_status(pkt_data->rf_chain) != TX_FREE) {
+        sim_nb_tx_overlap += 1; /* replaces the previous one, as the SX1302 does */
+    }
+
+    tx->pending = true;
+    tx->toa_us = lgw_time_on_air(pkt_data) * 1000;
+    if (pkt_data->tx_mode == IMMEDIATE) {
+        tx->start_us = now;
+    } else {
+        tx->start_us = pkt_data->count_us;
+        if ((int32_t)(tx->start_us - now) < 0) {
+            /* the hardware would wait for the counter to wrap around */
+            sim_nb_tx_late += 1;
+            DEBUG_PRINTF("WARNING: simulated TX late by %d us\n", (int32_t)(now - tx->start_us));
+        }
+    }
+    sim_nb_tx += 1;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint8_t lgw_sim_tx_status(uint8_t rf_chain) {
+    struct sim_tx_s * tx = &sim_tx[rf_chain];
+    int32_t diff;
+
+    if (tx->pending == false) {
+        return TX_FREE;
+    }
+    diff = (int32_t)(lgw_sim_counter(false) - tx->start_us);
+    if (diff < 0) {
+        return TX_SCHEDULED;
+    }
+    if ((uint32_t)diff < tx->toa_us) {
+        return TX_EMITTING;
+    }
+    tx->pending = false;
+
+    return TX_FREE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_abort_tx(uint8_t rf_chain) {
+    sim_tx[rf_chain].pending = false;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_sim_counter(bool pps) {
+    uint32_t cnt = sim_model.cnt_start + (uint32_t)sim_elapsed_us();
+    struct timespec now;
+
+    if (pps == true) {
+        /* PPS at each second of system time */
+        clock_gettime(CLOCK_REALTIME, &now);
+        cnt -= (uint32_t)(now.tv_nsec / 1000);
+    }
+
+    return cnt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_eui(uint64_t * eui) {
+    *eui = SIM_EUI;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_temperature(float * temperature) {
+    *temperature = sim_model.temperature;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
+    DEBUG_PRINTF("INFO: simulated spectral scan at %u Hz, %u points\n", freq_hz, nb_scan);
+    (void)freq_hz;
+
+    sim_scan_nb = nb_scan;
+    sim_scan_end_us = sim_elapsed_us() + (uint64_t)nb_scan * SIM_SCAN_US_PER_POINT;
+    sim_scan_status = LGW_SPECTRAL_SCAN_STATUS_ON_GOING;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_spectral_scan_get_status(lgw_spectral_scan_status_t * status) {
+    if ((sim_scan_status == LGW_SPECTRAL_SCAN_STATUS_ON_GOING) && (sim_elapsed_us() >= sim_scan_end_us)) {
+        sim_scan_status = LGW_SPECTRAL_SCAN_STATUS_COMPLETED;
+    }
+    *status = sim_scan_status;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_spectral_scan_get_results(int8_t rssi_offset, int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RESULT_SIZE], uint16_t results[static LGW_SPECTRAL_SCAN_RESULT_SIZE]) {
+    int i, bin;
+    int level;
+
+    if (sim_scan_status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
+        printf("ERROR: no simulated spectral scan completed\n");
+        return LGW_HAL_ERROR;
+    }
+
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        levels_dbm[i] = SIM_SCAN_LEVEL_MIN + SIM_SCAN_LEVEL_STEP * i + rssi_offset;
+        results[i] = 0;
+    }
+    /* noise floor: sum of uniform variables, close to a gaussian of 3 dB standard deviation */
+    for (i = 0; i < sim_scan_nb; i++) {
+        level = SIM_NOISE_FLOOR + (int)sim_rand_range(0, 10) + (int)sim_rand_range(0, 10) - 10;
+        bin = (level - SIM_SCAN_LEVEL_MIN) / SIM_SCAN_LEVEL_STEP;
+        results[bin] += 1;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_spectral_scan_abort(void) {
+    if (sim_scan_status == LGW_SPECTRAL_SCAN_STATUS_ON_GOING) {
+        sim_scan_status = LGW_SPECTRAL_SCAN_STATUS_ABORTED;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
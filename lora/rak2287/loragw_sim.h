@@ -0,0 +1,149 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Virtual SX1302 concentrator, used by the HAL in place of the hardware to
+    load-test the upper layers without radio.
+
+    Selected at build time with HAL_SIM=1 (see Makefile), or at run time by
+    setting the LORAGW_SIM environment variable. Its value describes the
+    traffic model, as comma separated key=value pairs (all optional):
+        rate=<pkt/s>        mean rate of received packets, Poisson arrivals (10)
+        sf=<min>-<max>      spreading factors on multi-SF channels (7-12)
+        size=<min>-<max>    payload size in bytes (10-50)
+        crc_bad=<%>         packets received with a bad CRC (5)
+        no_crc=<%>          packets received without CRC (0)
+        dup=<%>             packets demodulated twice, with fine timestamp enabled (50)
+        cnt=<us>            initial value of the 32-bit counter, to test wrap-around (0)
+        temp=<degC>         board temperature (25)
+        seed=<uint>         seed of the traffic generator (1)
+    example: LORAGW_SIM="rate=200,sf=7-9,dup=100,cnt=4290000000" ./lora_pkt_fwd
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+#include "loragw_sx1302.h"
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Check if the virtual concentrator has to be used instead of the hardware
+@return true if built with HAL_SIM=1 or if the LORAGW_SIM environment variable is set
+*/
+bool lgw_sim_enabled(void);
+
+/**
+@brief Start the virtual concentrator: parse the traffic model and start the counter
+@param context HAL context, giving the channels configuration (must remain valid until lgw_sim_stop)
+@return LGW_HAL_SUCCESS if the traffic model is valid, LGW_HAL_ERROR otherwise
+*/
+int lgw_sim_start(const lgw_context_t * context);
+
+/**
+@brief Stop the virtual concentrator and print its statistics
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_stop(void);
+
+/**
+@brief Get the packets received since the previous call, as lgw_receive before RSSI compensation
+@param max_pkt maximum number of packets to return
+@param pkt_data array of at least max_pkt packets
+@return number of packets returned, packets not returned are kept for the next call
+*/
+int lgw_sim_receive(uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data);
+
+/**
+@brief Schedule a packet for transmission, the packet is assumed valid (checked by lgw_send)
+@param pkt_data packet to be sent
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_send(const struct lgw_pkt_tx_s * pkt_data);
+
+/**
+@brief Get the TX status of an RF chain, derived from the scheduled packet and its time on air
+@param rf_chain RF chain
+@return TX_FREE, TX_SCHEDULED or TX_EMITTING
+*/
+uint8_t lgw_sim_tx_status(uint8_t rf_chain);
+
+/**
+@brief Abort the packet scheduled or being sent on an RF chain
+@param rf_chain RF chain
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_abort_tx(uint8_t rf_chain);
+
+/**
+@brief Get the value of the free-running 32-bit microsecond counter
+@param pps true to get the value latched on the last PPS (last second of system time)
+@return counter value
+*/
+uint32_t lgw_sim_counter(bool pps);
+
+/**
+@brief Get the EUI of the virtual concentrator
+@param eui pointer to the EUI
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_get_eui(uint64_t * eui);
+
+/**
+@brief Get the board temperature of the traffic model
+@param temperature pointer to the temperature
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_get_temperature(float * temperature);
+
+/**
+@brief Start a spectral scan, lasting a fixed time per scan point
+@param freq_hz scanned frequency
+@param nb_scan number of scan points
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan);
+
+/**
+@brief Get the status of the spectral scan
+@param status pointer to the status
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_spectral_scan_get_status(lgw_spectral_scan_status_t * status);
+
+/**
+@brief Get the results of the last spectral scan: noise floor histogram
+@param rssi_offset RSSI offset of the sx1261
+@param levels_dbm RSSI level of each bin
+@param results number of scan points in each bin
+@return LGW_HAL_SUCCESS if a scan has completed, LGW_HAL_ERROR otherwise
+*/
+int lgw_sim_spectral_scan_get_results(int8_t rssi_offset, int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RESULT_SIZE], uint16_t results[static LGW_SPECTRAL_SCAN_RESULT_SIZE]);
+
+/**
+@brief Abort the spectral scan
+@return LGW_HAL_SUCCESS
+*/
+int lgw_sim_spectral_scan_abort(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
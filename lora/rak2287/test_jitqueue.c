@@ -0,0 +1,530 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Stress test of the JIT queue: random Class A/B/C downlinks and beacons
+    are scheduled across the counter roll-over and checked against the former
+    array implementation (same accept/reject decisions, same TX order), then
+    enqueue/dequeue/collision speed is compared for growing queue sizes
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* qsort, rand */
+#include <string.h>     /* memcpy */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt, dup */
+#include <fcntl.h>      /* open */
+#include <pthread.h>    /* concurrent enqueue */
+
+#include "loragw_hal.h"
+#include "jitqueue.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/* same values as jitqueue.c */
+#define TX_START_DELAY          1500
+#define TX_MARGIN_DELAY         1000
+#define TX_JIT_DELAY            40000
+#define TX_MAX_ADVANCE_DELAY    ((JIT_NUM_BEACON_IN_QUEUE + 1) * 128 * 1E6)
+#define BEACON_GUARD            3000000
+#define BEACON_RESERVED         2120000
+
+#define BEACON_PERIOD_US        128000000
+#define STRESS_CAPACITY         512
+#define NB_STEP_DEFAULT         200000
+#define NB_LOOP_DEFAULT         1000
+#define RACE_CAPACITY           4
+#define RACE_ROUNDS             2000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one enqueuing thread of the race test, like thread_down or thread_beacon */
+struct race_arg_s {
+    struct jit_queue_s *queue;
+    pthread_barrier_t *start;
+    int slot;
+    int nb_ok;
+};
+
+/* former implementation: array sorted on each operation, linear search */
+struct legacy_queue_s {
+    int capacity;
+    int num_pkt;
+    int num_beacon;
+    struct jit_node_s *nodes;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -s <uint>  Number of 0-20ms time steps of the stress test\n");
+    printf(" -l <uint>  Number of loops for each queue size of the benchmark\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+/* the JIT queue logs every rejected packet, silence it during the test */
+static int stdout_mute(void) {
+    int fd_saved, fd_null;
+
+    fflush(stdout);
+    fd_saved = dup(STDOUT_FILENO);
+    fd_null = open("/dev/null", O_WRONLY);
+    if (fd_null >= 0) {
+        dup2(fd_null, STDOUT_FILENO);
+        close(fd_null);
+    }
+    return fd_saved;
+}
+
+static void stdout_restore(int fd_saved) {
+    fflush(stdout);
+    if (fd_saved >= 0) {
+        dup2(fd_saved, STDOUT_FILENO);
+        close(fd_saved);
+    }
+}
+
+static int legacy_compare(const void *a, const void *b) {
+    const struct jit_node_s *p = (const struct jit_node_s *)a;
+    const struct jit_node_s *q = (const struct jit_node_s *)b;
+    return (int)p->pkt.count_us - (int)q->pkt.count_us;
+}
+
+static bool legacy_collision_test(uint32_t p1_count_us, uint32_t p1_pre_delay, uint32_t p1_post_delay, uint32_t p2_count_us, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
+    return (((p1_count_us - p2_count_us) <= (p1_pre_delay + p2_post_delay + TX_MARGIN_DELAY)) ||
+            ((p2_count_us - p1_count_us) <= (p2_pre_delay + p1_post_delay + TX_MARGIN_DELAY)));
+}
+
+/* Class C ASAP search is not part of the reference: Class C packets are given with their timestamp */
+static enum jit_error_e legacy_enqueue(struct legacy_queue_s *queue, uint32_t time_us, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
+    int i;
+    uint32_t packet_pre_delay, packet_post_delay, target_pre_delay;
+
+    if (queue->num_pkt == queue->capacity) {
+        return JIT_ERROR_FULL;
+    }
+    if (pkt_type == JIT_PKT_TYPE_BEACON) {
+        packet_pre_delay = TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY;
+        packet_post_delay = BEACON_RESERVED;
+    } else {
+        packet_pre_delay = TX_START_DELAY + TX_JIT_DELAY;
+        packet_post_delay = lgw_time_on_air(packet) * 1000UL;
+    }
+    if ((packet->count_us - time_us) <= (TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY)) {
+        return JIT_ERROR_TOO_LATE;
+    }
+    if ((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_B)) {
+        if ((packet->count_us - time_us) > TX_MAX_ADVANCE_DELAY) {
+            return JIT_ERROR_TOO_EARLY;
+        }
+    }
+    for (i = 0; i < queue->num_pkt; i++) {
+        if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON)) {
+            target_pre_delay = TX_START_DELAY;
+        } else {
+            target_pre_delay = queue->nodes[i].pre_delay;
+        }
+        if (legacy_collision_test(packet->count_us, packet_pre_delay, packet_post_delay, queue->nodes[i].pkt.count_us, target_pre_delay, queue->nodes[i].post_delay) == true) {
+            return (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON) ? JIT_ERROR_COLLISION_BEACON : JIT_ERROR_COLLISION_PACKET;
+        }
+    }
+    memcpy(&(queue->nodes[queue->num_pkt].pkt), packet, sizeof(struct lgw_pkt_tx_s));
+    queue->nodes[queue->num_pkt].pre_delay = packet_pre_delay;
+    queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
+    queue->nodes[queue->num_pkt].pkt_type = pkt_type;
+    if (pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon++;
+    }
+    queue->num_pkt++;
+    qsort(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), legacy_compare);
+
+    return JIT_ERROR_OK;
+}
+
+static void legacy_dequeue(struct legacy_queue_s *queue, int index, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e *pkt_type) {
+    memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
+    queue->num_pkt--;
+    *pkt_type = queue->nodes[index].pkt_type;
+    if (*pkt_type == JIT_PKT_TYPE_BEACON) {
+        queue->num_beacon--;
+    }
+    memcpy(&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
+    qsort(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), legacy_compare);
+}
+
+static int legacy_peek(struct legacy_queue_s *queue, uint32_t time_us) {
+    int i;
+    int idx_highest_priority = -1;
+
+    for (i = 0; i < queue->num_pkt; i++) {
+        if ((idx_highest_priority == -1) || ((queue->nodes[i].pkt.count_us - time_us) < (queue->nodes[idx_highest_priority].pkt.count_us - time_us))) {
+            idx_highest_priority = i;
+        }
+    }
+    if ((idx_highest_priority != -1) && ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY)) {
+        return idx_highest_priority;
+    }
+    return -1;
+}
+
+static void build_downlink(struct lgw_pkt_tx_s *pkt, uint32_t count_us, uint8_t datarate, uint16_t size) {
+    memset(pkt, 0, sizeof *pkt);
+    pkt->freq_hz = 869525000;
+    pkt->tx_mode = TIMESTAMPED;
+    pkt->count_us = count_us;
+    pkt->rf_chain = 0;
+    pkt->rf_power = 14;
+    pkt->modulation = MOD_LORA;
+    pkt->bandwidth = BW_125KHZ;
+    pkt->datarate = datarate;
+    pkt->coderate = CR_LORA_4_5;
+    pkt->invert_pol = true;
+    pkt->preamble = 8;
+    pkt->size = size;
+}
+
+/* both collision codes are equivalent: the first packet found colliding depends on the search order */
+static enum jit_error_e same_class(enum jit_error_e err) {
+    return (err == JIT_ERROR_COLLISION_BEACON) ? JIT_ERROR_COLLISION_PACKET : err;
+}
+
+/* random traffic checked against the reference, return number of errors */
+static int stress(int nb_step, int *nb_sent) {
+    struct jit_queue_s queue;
+    struct legacy_queue_s ref;
+    struct lgw_pkt_tx_s pkt, pkt_ref;
+    enum jit_pkt_type_e type, type_ref;
+    enum jit_error_e err, err_ref;
+    uint32_t time_us = 0xFFFFFFFF - 60000000; /* roll-over after 1 minute */
+    uint32_t next_beacon_us = time_us + 10000000;
+    uint32_t asap_min_us;
+    int step, idx, idx_ref;
+    int nb_err = 0;
+
+    memset(&queue, 0, sizeof queue);
+    if (jit_queue_init(&queue, STRESS_CAPACITY) != JIT_ERROR_OK) {
+        return 1;
+    }
+    ref.capacity = STRESS_CAPACITY;
+    ref.num_pkt = 0;
+    ref.num_beacon = 0;
+    ref.nodes = calloc(STRESS_CAPACITY, sizeof(struct jit_node_s));
+
+    *nb_sent = 0;
+    for (step = 0; step < nb_step; step++) {
+        time_us += rand() % 20000;
+
+        /* beacons, as pre-scheduled by thread_down: the next JIT_NUM_BEACON_IN_QUEUE periods */
+        if ((queue.num_beacon < JIT_NUM_BEACON_IN_QUEUE) && ((next_beacon_us - time_us) < (JIT_NUM_BEACON_IN_QUEUE * BEACON_PERIOD_US))) {
+            build_downlink(&pkt, next_beacon_us, DR_LORA_SF9, 17);
+            pkt_ref = pkt;
+            err = jit_enqueue(&queue, time_us, &pkt, JIT_PKT_TYPE_BEACON);
+            err_ref = legacy_enqueue(&ref, time_us, &pkt_ref, JIT_PKT_TYPE_BEACON);
+            if (same_class(err) != same_class(err_ref)) {
+                fprintf(stderr, "ERROR: step %d, beacon at %u: %d instead of %d\n", step, next_beacon_us, err, err_ref);
+                nb_err += 1;
+            }
+            if (err != JIT_ERROR_FULL) {
+                next_beacon_us += BEACON_PERIOD_US;
+            }
+        }
+
+        /* downlinks */
+        switch (rand() % 16) {
+            case 0: /* Class A, RX1 or RX2, sometimes late */
+            case 1:
+                build_downlink(&pkt, time_us + 1000000 * (1 + rand() % 2) - 100000 + rand() % 200000, DR_LORA_SF7 + rand() % 6, 10 + rand() % 40);
+                type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
+                break;
+            case 2: /* Class B ping slot, sometimes too early */
+            case 3:
+                build_downlink(&pkt, time_us + rand() % 600000000, DR_LORA_SF7 + rand() % 3, 10 + rand() % 20);
+                type = JIT_PKT_TYPE_DOWNLINK_CLASS_B;
+                break;
+            case 4: /* Class C */
+                build_downlink(&pkt, 0, DR_LORA_SF7 + rand() % 6, 10 + rand() % 40);
+                pkt.tx_mode = IMMEDIATE;
+                type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
+                break;
+            default:
+                type = JIT_PKT_TYPE_BEACON; /* nothing this step */
+                break;
+        }
+        if (type != JIT_PKT_TYPE_BEACON) {
+            asap_min_us = time_us + 1000000;
+            err = jit_enqueue(&queue, time_us, &pkt, type);
+            pkt_ref = pkt;
+            if (type == JIT_PKT_TYPE_DOWNLINK_CLASS_C) {
+                /* the slot found must be free and not before the 1s margin */
+                if ((err == JIT_ERROR_OK) && ((int32_t)(pkt.count_us - asap_min_us) < 0)) {
+                    fprintf(stderr, "ERROR: step %d, Class C scheduled at %u, before %u\n", step, pkt.count_us, asap_min_us);
+                    nb_err += 1;
+                }
+                err_ref = (err == JIT_ERROR_OK) ? legacy_enqueue(&ref, time_us, &pkt_ref, type) : err;
+            } else {
+                err_ref = legacy_enqueue(&ref, time_us, &pkt_ref, type);
+            }
+            if (same_class(err) != same_class(err_ref)) {
+                fprintf(stderr, "ERROR: step %d, type %d at %u: %d instead of %d\n", step, type, pkt.count_us, err, err_ref);
+                nb_err += 1;
+            }
+        }
+
+        /* JIT thread */
+        while (1) {
+            if (jit_peek(&queue, time_us, &idx) != JIT_ERROR_OK) {
+                idx = -1;
+            }
+            idx_ref = legacy_peek(&ref, time_us);
+            if ((idx == -1) || (idx_ref == -1)) {
+                if (idx != idx_ref) {
+                    fprintf(stderr, "ERROR: step %d, peek %d instead of %d\n", step, idx, idx_ref);
+                    nb_err += 1;
+                }
+                break;
+            }
+            jit_dequeue(&queue, idx, &pkt, &type);
+            legacy_dequeue(&ref, idx_ref, &pkt_ref, &type_ref);
+            if ((pkt.count_us != pkt_ref.count_us) || (type != type_ref)) {
+                fprintf(stderr, "ERROR: step %d, dequeued %u (type %d) instead of %u (type %d)\n", step, pkt.count_us, type, pkt_ref.count_us, type_ref);
+                nb_err += 1;
+            }
+            *nb_sent += 1;
+        }
+
+        if ((queue.num_pkt != ref.num_pkt) || (queue.num_beacon != ref.num_beacon)) {
+            fprintf(stderr, "ERROR: step %d, %u packets queued instead of %d\n", step, queue.num_pkt, ref.num_pkt);
+            nb_err += 1;
+            break;
+        }
+        if (nb_err > 5) {
+            break;
+        }
+    }
+
+    free(ref.nodes);
+    free(queue.nodes);
+    free(queue.heap);
+    free(queue.free_nodes);
+    return nb_err;
+}
+
+/* fill the queue with non-colliding downlinks, interleaved with the other thread */
+static void *race_enqueue(void *arg) {
+    struct race_arg_s *race = (struct race_arg_s *)arg;
+    struct lgw_pkt_tx_s pkt;
+    int i;
+
+    race->nb_ok = 0;
+    pthread_barrier_wait(race->start);
+    for (i = 0; i < RACE_CAPACITY; i++) {
+        build_downlink(&pkt, 1000000 + (2 * i + race->slot) * 10000000, DR_LORA_SF7, 12);
+        if (jit_enqueue(race->queue, 0, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_A) == JIT_ERROR_OK) {
+            race->nb_ok += 1;
+        }
+    }
+
+    return NULL;
+}
+
+/* two threads enqueue twice the capacity of the queue, exactly capacity packets must be accepted;
+ * return the number of errors */
+static int race(int nb_round) {
+    struct jit_queue_s queue;
+    struct race_arg_s arg[2];
+    pthread_t thrid[2];
+    pthread_barrier_t start;
+    int round, i;
+    int nb_err = 0;
+
+    pthread_barrier_init(&start, NULL, 2);
+    for (round = 0; round < nb_round; round++) {
+        memset(&queue, 0, sizeof queue);
+        jit_queue_init(&queue, RACE_CAPACITY);
+        for (i = 0; i < 2; i++) {
+            arg[i].queue = &queue;
+            arg[i].start = &start;
+            arg[i].slot = i;
+            pthread_create(&thrid[i], NULL, race_enqueue, &arg[i]);
+        }
+        for (i = 0; i < 2; i++) {
+            pthread_join(thrid[i], NULL);
+        }
+        if ((queue.num_pkt != RACE_CAPACITY) || ((arg[0].nb_ok + arg[1].nb_ok) != RACE_CAPACITY)) {
+            fprintf(stderr, "ERROR: round %d, %d packets queued, %d accepted, capacity %d\n", round, queue.num_pkt, arg[0].nb_ok + arg[1].nb_ok, RACE_CAPACITY);
+            nb_err += 1;
+        }
+        free(queue.nodes);
+        free(queue.heap);
+        free(queue.free_nodes);
+    }
+    pthread_barrier_destroy(&start);
+
+    return nb_err;
+}
+
+/* steady state with nb_pkt Class B downlinks queued: send the first, queue a
+ * new one at the end and try one colliding with a queued packet;
+ * return time per loop in seconds */
+static double bench(int nb_pkt, int nb_loop, bool reference) {
+    struct jit_queue_s queue;
+    struct legacy_queue_s ref;
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e type;
+    uint32_t spacing_us = 500000000 / nb_pkt;
+    uint32_t time_us = 0;
+    uint32_t first_us, last_us;
+    struct timespec start, stop;
+    int i, idx;
+
+    memset(&queue, 0, sizeof queue);
+    jit_queue_init(&queue, nb_pkt + 1);
+    ref.capacity = nb_pkt + 1;
+    ref.num_pkt = 0;
+    ref.num_beacon = 0;
+    ref.nodes = calloc(nb_pkt + 1, sizeof(struct jit_node_s));
+
+    first_us = time_us + 100000;
+    for (i = 0; i < nb_pkt; i++) {
+        build_downlink(&pkt, first_us + i * spacing_us, DR_LORA_SF7, 12);
+        if (reference == true) {
+            legacy_enqueue(&ref, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+        } else {
+            jit_enqueue(&queue, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+        }
+    }
+    last_us = first_us + (nb_pkt - 1) * spacing_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nb_loop; i++) {
+        /* the first packet is due */
+        time_us = first_us - TX_JIT_DELAY / 2;
+        first_us += spacing_us;
+        last_us += spacing_us;
+        if (reference == true) {
+            idx = legacy_peek(&ref, time_us);
+            if (idx >= 0) {
+                legacy_dequeue(&ref, idx, &pkt, &type);
+            }
+            build_downlink(&pkt, last_us, DR_LORA_SF7, 12);
+            legacy_enqueue(&ref, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+            build_downlink(&pkt, last_us - (rand() % nb_pkt) * spacing_us, DR_LORA_SF7, 12);
+            legacy_enqueue(&ref, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+        } else {
+            jit_peek(&queue, time_us, &idx);
+            if (idx >= 0) {
+                jit_dequeue(&queue, idx, &pkt, &type);
+            }
+            build_downlink(&pkt, last_us, DR_LORA_SF7, 12);
+            jit_enqueue(&queue, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+            build_downlink(&pkt, last_us - (rand() % nb_pkt) * spacing_us, DR_LORA_SF7, 12);
+            jit_enqueue(&queue, time_us, &pkt, JIT_PKT_TYPE_DOWNLINK_CLASS_B);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    if (((reference == true) ? ref.num_pkt : queue.num_pkt) != nb_pkt) {
+        fprintf(stderr, "ERROR: %d packets queued after the benchmark instead of %d\n", (reference == true) ? ref.num_pkt : queue.num_pkt, nb_pkt);
+    }
+    free(ref.nodes);
+    free(queue.nodes);
+    free(queue.heap);
+    free(queue.free_nodes);
+
+    return difftimespec(stop, start) / nb_loop;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    int nb_step = NB_STEP_DEFAULT;
+    int nb_loop = NB_LOOP_DEFAULT;
+    const int sizes[] = {JIT_QUEUE_MAX, 256, 1024, JIT_QUEUE_MAX_SIZE - 1};
+    int nb_sent;
+    int nb_err;
+    int fd;
+    double t_ref, t_new;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hs:l:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 's':
+            case 'l':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -%c argument. Use -h to print help\n", i);
+                    return EXIT_FAILURE;
+                }
+                if (i == 's') {
+                    nb_step = (int)arg_u;
+                } else {
+                    nb_loop = (int)arg_u;
+                }
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(time(NULL));
+
+    fd = stdout_mute();
+    nb_err = stress(nb_step, &nb_sent);
+    stdout_restore(fd);
+    printf("INFO: stress test, %d steps, %d packets sent: %s\n", nb_step, nb_sent, (nb_err == 0) ? "OK" : "FAILED");
+
+    fd = stdout_mute();
+    x = race(RACE_ROUNDS);
+    stdout_restore(fd);
+    printf("INFO: concurrent enqueue, %d rounds: %s\n", RACE_ROUNDS, (x == 0) ? "OK" : "FAILED");
+    nb_err += x;
+
+    for (i = 0; i < (int)(sizeof sizes / sizeof sizes[0]); i++) {
+        fd = stdout_mute();
+        t_ref = bench(sizes[i], nb_loop, true);
+        t_new = bench(sizes[i], nb_loop, false);
+        stdout_restore(fd);
+        printf("INFO: %4d packets queued, array: %9.2f us/loop, heap: %6.2f us/loop (x%.1f)\n", sizes[i], 1E6 * t_ref, 1E6 * t_new, t_ref / t_new);
+    }
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
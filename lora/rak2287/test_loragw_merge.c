@@ -0,0 +1,297 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Check the duplicate removal done by lgw_receive() when fine timestamping
+    is enabled against the former pairwise implementation, and compare their
+    speed, from small usual fetches (pairwise path kept up to 32 packets) to
+    the worst case of a full 255-packet fetch
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for qsort_r to be defined */
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* qsort_r, rand */
+#include <string.h>     /* memcpy */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_PKT_MAX      255
+#define NB_LOOP_DEFAULT 100
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum {
+    SCENARIO_TYPICAL,   /* few packets spread on channels, each demodulated twice */
+    SCENARIO_NO_DUP,    /* full fetch, same channel/datarate/size, no duplicate */
+    SCENARIO_WORST      /* full fetch, same channel/datarate/size, all within 24us, pairs of duplicates */
+} scenario_t;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/* defined in loragw_hal.c, not exported by loragw_hal.h */
+int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -l <uint>  Number of loops for each scenario\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+/* reference: pairwise implementation used before merge_packets() was reworked */
+static bool legacy_is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2) {
+    return ((abs((int)(p1->count_us - p2->count_us)) <= 24) &&
+            (p1->if_chain == p2->if_chain) &&
+            (p1->datarate == p2->datarate) &&
+            (p1->size == p2->size) &&
+            (memcmp(p1->payload, p2->payload, p1->size) == 0));
+}
+
+static int legacy_compare_pkt_tmst(const void *a, const void *b, void *arg) {
+    const struct lgw_pkt_rx_s *p = (const struct lgw_pkt_rx_s *)a;
+    const struct lgw_pkt_rx_s *q = (const struct lgw_pkt_rx_s *)b;
+    (void)arg;
+    return ((int)p->count_us - (int)q->count_us);
+}
+
+static void legacy_merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+    uint8_t cpt = *nb_pkt;
+    int j, k, pkt_dup_idx;
+    bool dup_restart = false;
+
+    j = 0;
+    while (j < cpt) {
+        for (k = (j+1); k < cpt; k++) {
+            if (legacy_is_same_pkt(&p[j], &p[k])) {
+                if ((p[j].status == STAT_CRC_OK) && (p[k].status == STAT_CRC_BAD)) {
+                    pkt_dup_idx = k;
+                } else if ((p[j].status == STAT_CRC_BAD) && (p[k].status == STAT_CRC_OK)) {
+                    pkt_dup_idx = j;
+                } else {
+                    pkt_dup_idx = (p[j].ftime_received == true) ? k : j;
+                }
+                if (pkt_dup_idx != (cpt - 1)) {
+                    memcpy(p + pkt_dup_idx, p + cpt - 1, sizeof(struct lgw_pkt_rx_s));
+                }
+                cpt -= 1;
+                dup_restart = true;
+                break;
+            }
+        }
+        if (dup_restart == true) {
+            j = 0;
+            dup_restart = false;
+        } else {
+            j += 1;
+        }
+    }
+    qsort_r(p, cpt, sizeof(p[0]), legacy_compare_pkt_tmst, NULL);
+    *nb_pkt = cpt;
+}
+
+/* order used to compare the outputs, independent of the sort stability */
+static int compare_pkt_full(const void *a, const void *b) {
+    const struct lgw_pkt_rx_s *p = (const struct lgw_pkt_rx_s *)a;
+    const struct lgw_pkt_rx_s *q = (const struct lgw_pkt_rx_s *)b;
+
+    if (p->count_us != q->count_us) {
+        return (p->count_us > q->count_us) ? 1 : -1;
+    }
+    if (p->if_chain != q->if_chain) {
+        return (int)p->if_chain - (int)q->if_chain;
+    }
+    if (p->status != q->status) {
+        return (int)p->status - (int)q->status;
+    }
+    if (p->ftime_received != q->ftime_received) {
+        return (int)p->ftime_received - (int)q->ftime_received;
+    }
+    if (p->size != q->size) {
+        return (int)p->size - (int)q->size;
+    }
+    return memcmp(p->payload, q->payload, p->size);
+}
+
+static bool same_output(struct lgw_pkt_rx_s *p, uint8_t nb_p, struct lgw_pkt_rx_s *q, uint8_t nb_q) {
+    int i;
+
+    if (nb_p != nb_q) {
+        return false;
+    }
+    qsort(p, nb_p, sizeof p[0], compare_pkt_full);
+    qsort(q, nb_q, sizeof q[0], compare_pkt_full);
+    for (i = 0; i < nb_p; i++) {
+        if (compare_pkt_full(&p[i], &q[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* build a fetch; duplicates come in pairs, as produced by the double demodulation of fine timestamping */
+static uint8_t build_fetch(scenario_t scenario, uint8_t nb_typical, struct lgw_pkt_rx_s *p) {
+    const uint8_t status[] = {STAT_CRC_OK, STAT_CRC_BAD, STAT_NO_CRC};
+    uint32_t base_us = (uint32_t)rand() * 2;
+    uint8_t nb_pkt;
+    int i, k;
+
+    nb_pkt = (scenario == SCENARIO_TYPICAL) ? nb_typical : NB_PKT_MAX;
+    memset(p, 0, nb_pkt * sizeof p[0]);
+    for (i = 0; i < nb_pkt; i++) {
+        p[i].modulation = MOD_LORA;
+        p[i].freq_hz = 868100000;
+        p[i].status = status[rand() % 3];
+        switch (scenario) {
+            case SCENARIO_TYPICAL:
+                p[i].if_chain = (i / 2) % 8;
+                p[i].datarate = DR_LORA_SF7 + (rand() % 6);
+                p[i].size = 10 + (rand() % 40);
+                p[i].count_us = base_us + (i / 2) * 100000;
+                break;
+            case SCENARIO_NO_DUP:
+            case SCENARIO_WORST:
+                /* same channel, datarate and size, only the last bytes differ: memcmp goes all the way */
+                p[i].if_chain = 0;
+                p[i].datarate = DR_LORA_SF12;
+                p[i].size = 255;
+                p[i].count_us = base_us + ((scenario == SCENARIO_WORST) ? (rand() % 24) : (i * 100));
+                break;
+        }
+        for (k = 0; k < p[i].size; k++) {
+            p[i].payload[k] = (uint8_t)(0x5A ^ k);
+        }
+        p[i].payload[p[i].size - 1] = (uint8_t)(i / 2);
+        p[i].payload[p[i].size - 2] = (uint8_t)i; /* unique unless duplicated below */
+        p[i].ftime_received = false;
+    }
+    if (scenario != SCENARIO_NO_DUP) {
+        /* second demodulation of each packet: same payload and channel, close timestamp, with a fine timestamp */
+        for (i = 1; i < nb_pkt; i += 2) {
+            p[i].if_chain = p[i - 1].if_chain;
+            p[i].datarate = p[i - 1].datarate;
+            p[i].size = p[i - 1].size;
+            memcpy(p[i].payload, p[i - 1].payload, p[i].size);
+            if (scenario == SCENARIO_TYPICAL) {
+                p[i].count_us = p[i - 1].count_us + (rand() % 25);
+            }
+            p[i].ftime_received = true;
+            p[i].ftime = (uint32_t)rand();
+        }
+    }
+    /* shuffle, the HAL does not return duplicates next to each other */
+    for (i = nb_pkt - 1; i > 0; i--) {
+        struct lgw_pkt_rx_s tmp;
+        k = rand() % (i + 1);
+        tmp = p[i];
+        p[i] = p[k];
+        p[k] = tmp;
+    }
+
+    return nb_pkt;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, l, x;
+    unsigned int arg_u;
+    int nb_loop = NB_LOOP_DEFAULT;
+    static struct lgw_pkt_rx_s fetch[NB_PKT_MAX];
+    static struct lgw_pkt_rx_s p_ref[NB_PKT_MAX];
+    static struct lgw_pkt_rx_s p_new[NB_PKT_MAX];
+    uint8_t nb_fetch = 0, nb_ref, nb_new;
+    const scenario_t scenarios[] = {SCENARIO_TYPICAL, SCENARIO_TYPICAL, SCENARIO_TYPICAL, SCENARIO_TYPICAL, SCENARIO_NO_DUP, SCENARIO_WORST};
+    const uint8_t nb_typical[] = {8, 16, 32, 64, 0, 0};
+    const char * names[] = {"typical (8 pkts)", "typical (16 pkts)", "typical (32 pkts)", "typical (64 pkts)", "no duplicate (255 pkts)", "worst case (255 pkts)"};
+    struct timespec start, stop;
+    double t_ref, t_new;
+    int nb_err = 0;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hl:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'l':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = (int)arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(time(NULL));
+    for (i = 0; i < (int)(sizeof scenarios / sizeof scenarios[0]); i++) {
+        t_ref = 0.0;
+        t_new = 0.0;
+        for (l = 0; l < nb_loop; l++) {
+            nb_fetch = build_fetch(scenarios[i], nb_typical[i], fetch);
+
+            memcpy(p_ref, fetch, nb_fetch * sizeof fetch[0]);
+            nb_ref = nb_fetch;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            legacy_merge_packets(p_ref, &nb_ref);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            t_ref += difftimespec(stop, start);
+
+            memcpy(p_new, fetch, nb_fetch * sizeof fetch[0]);
+            nb_new = nb_fetch;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            x = merge_packets(p_new, &nb_new);
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            t_new += difftimespec(stop, start);
+
+            if ((x != 0) || (same_output(p_ref, nb_ref, p_new, nb_new) == false)) {
+                if (nb_err < 5) {
+                    printf("ERROR: %s, loop %d: %u packets kept instead of %u\n", names[i], l, nb_new, nb_ref);
+                }
+                nb_err += 1;
+            }
+        }
+        printf("INFO: %-24s %3u -> %3u pkts, pairwise: %9.1f us, merge_packets: %7.1f us (x%.1f)\n", names[i], nb_fetch, nb_new, 1E6 * t_ref / nb_loop, 1E6 * t_new / nb_loop, t_ref / t_new);
+    }
+
+    if (nb_err == 0) {
+        printf("INFO: all fetches de-duplicated identically\n");
+    }
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,552 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Vectorized base64 codec (NEON, SSSE3, AVX2) with a table-driven scalar
+    fallback, drop-in replacement of bin_to_b64() and b64_to_bin()
+
+    The vector paths only process whole blocks in the middle of the buffer,
+    tail and padding are always handled by the scalar code. NEON is used when
+    the code is compiled for a NEON capable target (always the case on
+    AArch64), SSSE3/AVX2 are selected at runtime on x86.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* NULL */
+#include <pthread.h>    /* pthread_once */
+
+#include "base64_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define B64_X86
+    #include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define B64_NEON
+    #include <arm_neon.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* process whole blocks, return number of input bytes/chars consumed (-1 on invalid char) */
+typedef int (*b64_enc_blocks_t)(const uint8_t * in, int size, char * out);
+typedef int (*b64_dec_blocks_t)(const char * in, int size, uint8_t * out, int max_len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const char enc_table[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
+    'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
+    'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
+    'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'
+};
+
+/* 0xFF for chars that are not part of the base64 alphabet */
+static const uint8_t dec_table[256] = {
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,  62,0xFF,0xFF,0xFF,  63,
+      52,  53,  54,  55,  56,  57,  58,  59,  60,  61,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+      15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+      41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+    0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF
+};
+
+static int enc_blocks_none(const uint8_t * in, int size, char * out);
+static int dec_blocks_none(const char * in, int size, uint8_t * out, int max_len);
+
+static enum b64_simd_impl_e b64_impl = B64_IMPL_SCALAR;
+static b64_enc_blocks_t enc_blocks = enc_blocks_none;
+static b64_dec_blocks_t dec_blocks = dec_blocks_none;
+static bool b64_impl_selected = false;
+static pthread_once_t b64_auto_once = PTHREAD_ONCE_INIT;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int enc_blocks_none(const uint8_t * in, int size, char * out) {
+    (void)in;
+    (void)size;
+    (void)out;
+    return 0;
+}
+
+static int dec_blocks_none(const char * in, int size, uint8_t * out, int max_len) {
+    (void)in;
+    (void)size;
+    (void)out;
+    (void)max_len;
+    return 0;
+}
+
+#if defined(B64_X86)
+
+/* 12 bytes (in a 16-byte register) -> 16 six-bit indices, one per byte */
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in) {
+    __m128i t0, t1, t2, t3;
+
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+/* six-bit indices -> base64 alphabet */
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i idx) {
+    __m128i res, less;
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+    res = _mm_or_si128(res, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, res), idx);
+}
+
+/* base64 alphabet -> six-bit values, returns false if a char is invalid */
+__attribute__((target("ssse3")))
+static inline bool dec_translate_ssse3(__m128i in, __m128i * out) {
+    __m128i hi_nibbles, lo_nibbles, lo, hi, eq_2f, roll;
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+    hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+    lo_nibbles = _mm_and_si128(in, mask_2f);
+    lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+        return false;
+    }
+    eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+    roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    *out = _mm_add_epi8(in, roll);
+    return true;
+}
+
+/* 16 six-bit values -> 12 bytes at the bottom of the register */
+__attribute__((target("ssse3")))
+static inline __m128i dec_pack_ssse3(__m128i values) {
+    __m128i merge_ab_bc, merged;
+
+    merge_ab_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merge_ab_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static int enc_blocks_ssse3(const uint8_t * in, int size, char * out) {
+    int i = 0;
+    __m128i v;
+
+    /* 12 bytes consumed, 16 bytes loaded */
+    for (; (size - i) >= 16; i += 12) {
+        v = enc_translate_ssse3(enc_reshuffle_ssse3(_mm_loadu_si128((const __m128i *)(in + i))));
+        _mm_storeu_si128((__m128i *)out, v);
+        out += 16;
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static int dec_blocks_ssse3(const char * in, int size, uint8_t * out, int max_len) {
+    int i = 0;
+    int o = 0;
+    __m128i v;
+
+    /* 16 chars consumed, 12 bytes produced, 16 bytes stored */
+    for (; ((size - i) >= 16) && ((max_len - o) >= 16); i += 16, o += 12) {
+        if (dec_translate_ssse3(_mm_loadu_si128((const __m128i *)(in + i)), &v) == false) {
+            return -1;
+        }
+        _mm_storeu_si128((__m128i *)(out + o), dec_pack_ssse3(v));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int enc_blocks_avx2(const uint8_t * in, int size, char * out) {
+    int i = 0;
+    __m256i v, t0, t1, t2, t3, res, less;
+    const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                         10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    /* 24 bytes consumed (12 per 128-bit lane), 28 bytes loaded */
+    for (; (size - i) >= 28; i += 24) {
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))), _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuf);
+        t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+        t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+        t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        v = _mm256_or_si256(t1, t3);
+        res = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v);
+        res = _mm256_or_si256(res, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        res = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, res), v);
+        _mm256_storeu_si256((__m256i *)out, res);
+        out += 32;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int dec_blocks_avx2(const char * in, int size, uint8_t * out, int max_len) {
+    int i = 0;
+    int o = 0;
+    __m256i v, hi_nibbles, lo_nibbles, lo, hi, eq_2f, roll, merged;
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack_shuf = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                               2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    /* 32 chars consumed, 24 bytes produced, 32 bytes stored */
+    for (; ((size - i) >= 32) && ((max_len - o) >= 32); i += 32, o += 24) {
+        v = _mm256_loadu_si256((const __m256i *)(in + i));
+        hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+        lo_nibbles = _mm256_and_si256(v, mask_2f);
+        lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0) {
+            return -1;
+        }
+        eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+        roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        v = _mm256_add_epi8(v, roll);
+        merged = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack_shuf);
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256((__m256i *)(out + o), merged);
+    }
+    return i;
+}
+
+#endif /* B64_X86 */
+
+#if defined(B64_NEON)
+
+/* six-bit indices -> base64 alphabet, by ranges (no 64-entry table lookup on ARMv7) */
+static inline uint8x16_t enc_translate_neon(uint8x16_t idx) {
+    uint8x16_t res;
+
+    res = vaddq_u8(idx, vdupq_n_u8('A'));
+    res = vaddq_u8(res, vandq_u8(vcgeq_u8(idx, vdupq_n_u8(26)), vdupq_n_u8(6)));   /* 'a' - 26 - 'A' */
+    res = vsubq_u8(res, vandq_u8(vcgeq_u8(idx, vdupq_n_u8(52)), vdupq_n_u8(75)));  /* '0' - 52 - ('a' - 26) */
+    res = vsubq_u8(res, vandq_u8(vceqq_u8(idx, vdupq_n_u8(62)), vdupq_n_u8(15)));  /* '+' - 62 - ('0' - 52) */
+    res = vsubq_u8(res, vandq_u8(vceqq_u8(idx, vdupq_n_u8(63)), vdupq_n_u8(12)));  /* '/' - 63 - ('0' - 52) */
+    return res;
+}
+
+/* base64 alphabet -> six-bit values, 0xFF for invalid chars */
+static inline uint8x16_t dec_translate_neon(uint8x16_t c) {
+    uint8x16_t res = vdupq_n_u8(0xFF);
+    uint8x16_t t;
+
+    t = vsubq_u8(c, vdupq_n_u8('A'));
+    res = vbslq_u8(vcltq_u8(t, vdupq_n_u8(26)), t, res);
+    t = vsubq_u8(c, vdupq_n_u8('a'));
+    res = vbslq_u8(vcltq_u8(t, vdupq_n_u8(26)), vaddq_u8(t, vdupq_n_u8(26)), res);
+    t = vsubq_u8(c, vdupq_n_u8('0'));
+    res = vbslq_u8(vcltq_u8(t, vdupq_n_u8(10)), vaddq_u8(t, vdupq_n_u8(52)), res);
+    res = vbslq_u8(vceqq_u8(c, vdupq_n_u8('+')), vdupq_n_u8(62), res);
+    res = vbslq_u8(vceqq_u8(c, vdupq_n_u8('/')), vdupq_n_u8(63), res);
+    return res;
+}
+
+static int enc_blocks_neon(const uint8_t * in, int size, char * out) {
+    int i = 0;
+    uint8x16x3_t src;
+    uint8x16x4_t dst;
+
+    /* 48 bytes consumed, de-interleaved by the load */
+    for (; (size - i) >= 48; i += 48) {
+        src = vld3q_u8(in + i);
+        dst.val[0] = vshrq_n_u8(src.val[0], 2);
+        dst.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[0], 4), vshrq_n_u8(src.val[1], 4)), vdupq_n_u8(0x3F));
+        dst.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[1], 2), vshrq_n_u8(src.val[2], 6)), vdupq_n_u8(0x3F));
+        dst.val[3] = vandq_u8(src.val[2], vdupq_n_u8(0x3F));
+        dst.val[0] = enc_translate_neon(dst.val[0]);
+        dst.val[1] = enc_translate_neon(dst.val[1]);
+        dst.val[2] = enc_translate_neon(dst.val[2]);
+        dst.val[3] = enc_translate_neon(dst.val[3]);
+        vst4q_u8((uint8_t *)out, dst);
+        out += 64;
+    }
+    return i;
+}
+
+static int dec_blocks_neon(const char * in, int size, uint8_t * out, int max_len) {
+    int i = 0;
+    int o = 0;
+    uint8x16x4_t src;
+    uint8x16x3_t dst;
+    uint64x2_t err;
+
+    /* 64 chars consumed, 48 bytes produced */
+    for (; ((size - i) >= 64) && ((max_len - o) >= 48); i += 64, o += 48) {
+        src = vld4q_u8((const uint8_t *)(in + i));
+        src.val[0] = dec_translate_neon(src.val[0]);
+        src.val[1] = dec_translate_neon(src.val[1]);
+        src.val[2] = dec_translate_neon(src.val[2]);
+        src.val[3] = dec_translate_neon(src.val[3]);
+        err = vreinterpretq_u64_u8(vandq_u8(vorrq_u8(vorrq_u8(src.val[0], src.val[1]), vorrq_u8(src.val[2], src.val[3])), vdupq_n_u8(0x80)));
+        if ((vgetq_lane_u64(err, 0) | vgetq_lane_u64(err, 1)) != 0) {
+            return -1;
+        }
+        dst.val[0] = vorrq_u8(vshlq_n_u8(src.val[0], 2), vshrq_n_u8(src.val[1], 4));
+        dst.val[1] = vorrq_u8(vshlq_n_u8(src.val[1], 4), vshrq_n_u8(src.val[2], 2));
+        dst.val[2] = vorrq_u8(vshlq_n_u8(src.val[2], 6), src.val[3]);
+        vst3q_u8(out + o, dst);
+    }
+    return i;
+}
+
+#endif /* B64_NEON */
+
+static void b64_select_auto_once(void) {
+    if (b64_impl_selected == false) {
+        b64_simd_set_impl(B64_IMPL_AUTO);
+    }
+}
+
+static void b64_select_auto(void) {
+    /* the first calls come from thread_up and thread_down at the same time */
+    pthread_once(&b64_auto_once, b64_select_auto_once);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int b64_simd_set_impl(enum b64_simd_impl_e impl) {
+    b64_enc_blocks_t enc = enc_blocks_none;
+    b64_dec_blocks_t dec = dec_blocks_none;
+
+    if (impl == B64_IMPL_AUTO) {
+#if defined(B64_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            impl = B64_IMPL_AVX2;
+        } else if (__builtin_cpu_supports("ssse3")) {
+            impl = B64_IMPL_SSSE3;
+        } else {
+            impl = B64_IMPL_SCALAR;
+        }
+#elif defined(B64_NEON)
+        impl = B64_IMPL_NEON;
+#else
+        impl = B64_IMPL_SCALAR;
+#endif
+    }
+
+    switch (impl) {
+        case B64_IMPL_SCALAR:
+            break;
+#if defined(B64_X86)
+        case B64_IMPL_SSSE3:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("ssse3")) {
+                return -1;
+            }
+            enc = enc_blocks_ssse3;
+            dec = dec_blocks_ssse3;
+            break;
+        case B64_IMPL_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2")) {
+                return -1;
+            }
+            enc = enc_blocks_avx2;
+            dec = dec_blocks_avx2;
+            break;
+#endif
+#if defined(B64_NEON)
+        case B64_IMPL_NEON:
+            enc = enc_blocks_neon;
+            dec = dec_blocks_neon;
+            break;
+#endif
+        default:
+            return -1;
+    }
+
+    enc_blocks = enc;
+    dec_blocks = dec;
+    b64_impl = impl;
+    b64_impl_selected = true;
+    return 0;
+}
+
+const char * b64_simd_impl_name(void) {
+    b64_select_auto();
+    switch (b64_impl) {
+        case B64_IMPL_SSSE3:
+            return "ssse3";
+        case B64_IMPL_AVX2:
+            return "avx2";
+        case B64_IMPL_NEON:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+int bin_to_b64_simd(const uint8_t * in, int size, char * out, int max_len) {
+    int i, o;
+    int result_len;
+    uint32_t b;
+
+    if ((in == NULL) || (out == NULL) || (size < 0)) {
+        return -1;
+    }
+    result_len = 4 * ((size + 2) / 3);
+    if (max_len < (result_len + 1)) {
+        return -1;
+    }
+    b64_select_auto();
+
+    /* whole blocks with the selected vector unit, then scalar 3 bytes -> 4 chars */
+    i = enc_blocks(in, size, out);
+    o = (i / 3) * 4;
+    for (; (size - i) >= 3; i += 3, o += 4) {
+        b = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        out[o] = enc_table[(b >> 18) & 0x3F];
+        out[o + 1] = enc_table[(b >> 12) & 0x3F];
+        out[o + 2] = enc_table[(b >> 6) & 0x3F];
+        out[o + 3] = enc_table[b & 0x3F];
+    }
+
+    /* last 1 or 2 bytes, with padding */
+    if ((size - i) == 1) {
+        b = (uint32_t)in[i] << 16;
+        out[o] = enc_table[(b >> 18) & 0x3F];
+        out[o + 1] = enc_table[(b >> 12) & 0x3F];
+        out[o + 2] = '=';
+        out[o + 3] = '=';
+        o += 4;
+    } else if ((size - i) == 2) {
+        b = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8);
+        out[o] = enc_table[(b >> 18) & 0x3F];
+        out[o + 1] = enc_table[(b >> 12) & 0x3F];
+        out[o + 2] = enc_table[(b >> 6) & 0x3F];
+        out[o + 3] = '=';
+        o += 4;
+    }
+    out[o] = 0;
+
+    return o;
+}
+
+int b64_to_bin_simd(const char * in, int size, uint8_t * out, int max_len) {
+    int i, o;
+    int result_len;
+    int nopad_len;
+    uint8_t v0, v1, v2, v3;
+
+    if ((in == NULL) || (out == NULL) || (size < 0)) {
+        return -1;
+    }
+
+    /* remove padding, same as b64_to_bin(), other sizes are treated as unpadded base64 */
+    nopad_len = size;
+    if (((size % 4) == 0) && (size >= 4)) {
+        if (in[size - 2] == '=') {
+            nopad_len = size - 2;
+        } else if (in[size - 1] == '=') {
+            nopad_len = size - 1;
+        }
+    }
+    if ((nopad_len % 4) == 1) {
+        return -1;
+    }
+    result_len = (nopad_len * 3) / 4;
+    if (max_len < result_len) {
+        return -1;
+    }
+    if (nopad_len == 0) {
+        return 0;
+    }
+    b64_select_auto();
+
+    /* whole blocks with the selected vector unit, then scalar 4 chars -> 3 bytes */
+    i = dec_blocks(in, nopad_len, out, max_len);
+    if (i < 0) {
+        return -1;
+    }
+    o = (i / 4) * 3;
+    for (; (nopad_len - i) >= 4; i += 4, o += 3) {
+        v0 = dec_table[(uint8_t)in[i]];
+        v1 = dec_table[(uint8_t)in[i + 1]];
+        v2 = dec_table[(uint8_t)in[i + 2]];
+        v3 = dec_table[(uint8_t)in[i + 3]];
+        if ((v0 | v1 | v2 | v3) & 0x80) {
+            return -1;
+        }
+        out[o] = (v0 << 2) | (v1 >> 4);
+        out[o + 1] = (v1 << 4) | (v2 >> 2);
+        out[o + 2] = (v2 << 6) | v3;
+    }
+
+    /* last 2 or 3 chars */
+    switch (nopad_len - i) {
+        case 0:
+            break;
+        case 2:
+            v0 = dec_table[(uint8_t)in[i]];
+            v1 = dec_table[(uint8_t)in[i + 1]];
+            if ((v0 | v1) & 0x80) {
+                return -1;
+            }
+            out[o++] = (v0 << 2) | (v1 >> 4);
+            break;
+        case 3:
+            v0 = dec_table[(uint8_t)in[i]];
+            v1 = dec_table[(uint8_t)in[i + 1]];
+            v2 = dec_table[(uint8_t)in[i + 2]];
+            if ((v0 | v1 | v2) & 0x80) {
+                return -1;
+            }
+            out[o++] = (v0 << 2) | (v1 >> 4);
+            out[o++] = (v1 << 4) | (v2 >> 2);
+            break;
+        default:
+            return -1;
+    }
+
+    return o;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
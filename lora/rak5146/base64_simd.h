@@ -0,0 +1,76 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Vectorized base64 codec (NEON, SSSE3, AVX2) with a table-driven scalar
+    fallback, drop-in replacement of bin_to_b64() and b64_to_bin()
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_BASE64_SIMD_H
+#define _LORA_PKTFWD_BASE64_SIMD_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+enum b64_simd_impl_e {
+    B64_IMPL_AUTO,      /* best implementation supported by the CPU */
+    B64_IMPL_SCALAR,
+    B64_IMPL_SSSE3,
+    B64_IMPL_AVX2,
+    B64_IMPL_NEON
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Encode binary data to padded base64, same contract as bin_to_b64()
+@param in pointer to the binary data
+@param size number of bytes to encode
+@param out output buffer, null-terminated on success
+@param max_len size of the output buffer
+@return number of chars written (without null char), -1 on error
+*/
+int bin_to_b64_simd(const uint8_t * in, int size, char * out, int max_len);
+
+/**
+@brief Decode base64 to binary data, same contract as b64_to_bin()
+@param in pointer to the base64 string
+@param size number of chars to decode, padded (multiple of 4) or unpadded
+@param out output buffer
+@param max_len size of the output buffer
+@return number of bytes decoded, -1 on error (invalid char or size)
+*/
+int b64_to_bin_simd(const char * in, int size, uint8_t * out, int max_len);
+
+/**
+@brief Select the implementation used by the codec (default is B64_IMPL_AUTO)
+Not thread-safe, to be called before any thread uses the codec. Without it,
+the automatic selection is done once, on first use.
+@param impl requested implementation
+@return 0 if the implementation is supported by the CPU and was selected, -1 otherwise
+*/
+int b64_simd_set_impl(enum b64_simd_impl_e impl);
+
+/**
+@brief Get the name of the implementation currently used by the codec
+@return implementation name ("scalar", "ssse3", "avx2", "neon")
+*/
+const char * b64_simd_impl_name(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
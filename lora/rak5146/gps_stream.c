@@ -0,0 +1,260 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Incremental framing of the GPS serial stream, UBX and NMEA
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>         /* C99 types */
+#include <stdbool.h>        /* bool type */
+#include <string.h>         /* memcpy memset */
+
+#include "gps_stream.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RING_MASK           (GPS_STREAM_RING_SIZE - 1)
+
+#define UBX_SYNC_CHAR_1     0xB5
+#define UBX_SYNC_CHAR_2     0x62
+#define UBX_HEADER_SIZE     6   /* sync chars, class, id, length */
+#define UBX_OVERHEAD        8   /* header and checksum */
+#define NMEA_SYNC_CHAR      '$'
+
+enum gps_stream_state_e {
+    ST_SYNC,        /* looking for a frame start */
+    ST_UBX_SYNC_2,
+    ST_UBX_HEADER,  /* class, id, length */
+    ST_UBX_PAYLOAD,
+    ST_UBX_CK_A,
+    ST_UBX_CK_B,
+    ST_NMEA_BODY,   /* up to '*' */
+    ST_NMEA_CK_1,   /* checksum, 2 hexadecimal chars */
+    ST_NMEA_CK_2,
+    ST_NMEA_CR,
+    ST_NMEA_LF
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int hex_value(uint8_t c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/* byte outside of a frame, or first byte of a frame */
+static void parse_sync(struct gps_stream_s *s, uint8_t c, uint32_t pos) {
+    s->start = pos;
+    s->len = 1;
+    s->ck_a = 0;
+    s->ck_b = 0;
+    if (c == UBX_SYNC_CHAR_1) {
+        s->state = ST_UBX_SYNC_2;
+    } else if (c == NMEA_SYNC_CHAR) {
+        s->state = ST_NMEA_BODY;
+    } else {
+        s->state = ST_SYNC;
+        s->len = 0;
+        s->nb_skipped += 1;
+    }
+}
+
+/* current frame is complete and valid */
+static void frame_end(struct gps_stream_s *s, gps_stream_cb cb, uint32_t *nb_ok) {
+    *nb_ok += 1;
+    if (cb != NULL) {
+        cb(&s->ring[s->start], s->len, s->arg);
+    }
+    s->state = ST_SYNC;
+    s->len = 0;
+}
+
+static void parse_byte(struct gps_stream_s *s, uint8_t c, uint32_t pos);
+
+/* UBX frame rejected after its header: its sync chars may have been a false
+   one, look for frames again from the byte following them. This is the only
+   case where bytes are parsed twice, they are still in the ring. */
+static void ubx_resync(struct gps_stream_s *s) {
+    uint32_t pos = s->start + 1;
+    uint32_t n = s->len - 1;
+
+    s->state = ST_SYNC;
+    s->len = 0;
+    while (n-- > 0) {
+        parse_byte(s, (uint8_t)s->ring[pos & RING_MASK], pos & RING_MASK);
+        pos += 1;
+    }
+}
+
+static void parse_byte(struct gps_stream_s *s, uint8_t c, uint32_t pos) {
+    int h;
+
+    if (s->state == ST_SYNC) {
+        parse_sync(s, c, pos);
+        return;
+    }
+    s->len += 1;
+
+    switch (s->state) {
+        case ST_UBX_SYNC_2:
+            if (c == UBX_SYNC_CHAR_2) {
+                s->state = ST_UBX_HEADER;
+            } else {
+                parse_sync(s, c, pos); /* 0xB5 alone, may start another frame */
+            }
+            break;
+        case ST_UBX_HEADER:
+            s->ck_a += c;
+            s->ck_b += s->ck_a;
+            if (s->len == (UBX_HEADER_SIZE - 1)) {
+                s->expected = c; /* length LSB */
+            } else if (s->len == UBX_HEADER_SIZE) {
+                s->expected = (s->expected | ((uint32_t)c << 8)) + UBX_OVERHEAD;
+                if (s->expected > GPS_STREAM_RING_SIZE) {
+                    /* not kept in the ring, or a false sync */
+                    s->nb_oversize += 1;
+                    ubx_resync(s);
+                } else {
+                    s->state = (s->expected == UBX_OVERHEAD) ? ST_UBX_CK_A : ST_UBX_PAYLOAD;
+                }
+            }
+            break;
+        case ST_UBX_PAYLOAD:
+            s->ck_a += c;
+            s->ck_b += s->ck_a;
+            if (s->len == (s->expected - 2)) {
+                s->state = ST_UBX_CK_A;
+            }
+            break;
+        case ST_UBX_CK_A:
+            s->ck_rcv = c;
+            s->state = ST_UBX_CK_B;
+            break;
+        case ST_UBX_CK_B:
+            if ((s->ck_rcv == s->ck_a) && (c == s->ck_b)) {
+                frame_end(s, s->ubx_cb, &s->nb_ubx);
+            } else {
+                s->nb_ubx_err += 1;
+                ubx_resync(s);
+            }
+            break;
+        case ST_NMEA_BODY:
+            if (c == '*') {
+                s->state = ST_NMEA_CK_1;
+            } else if (c == NMEA_SYNC_CHAR) {
+                s->nb_nmea_err += 1;
+                parse_sync(s, c, pos); /* truncated sentence, restart on the new one */
+            } else if ((c < 0x20) || (c > 0x7E) || (s->len > GPS_STREAM_NMEA_MAX)) {
+                s->nb_nmea_err += 1;
+                parse_sync(s, c, pos); /* not text, may be an UBX frame */
+            } else {
+                s->ck_a ^= c;
+            }
+            break;
+        case ST_NMEA_CK_1:
+        case ST_NMEA_CK_2:
+            h = hex_value(c);
+            if (h < 0) {
+                s->nb_nmea_err += 1;
+                parse_sync(s, c, pos);
+            } else if (s->state == ST_NMEA_CK_1) {
+                s->ck_rcv = (uint8_t)(h << 4);
+                s->state = ST_NMEA_CK_2;
+            } else {
+                s->ck_rcv |= (uint8_t)h;
+                s->state = ST_NMEA_CR;
+            }
+            break;
+        case ST_NMEA_CR:
+        case ST_NMEA_LF:
+            if ((c == '\r') && (s->state == ST_NMEA_CR)) {
+                s->state = ST_NMEA_LF; /* CR is optional */
+            } else if (c != '\n') {
+                s->nb_nmea_err += 1;
+                parse_sync(s, c, pos);
+            } else if (s->ck_rcv == s->ck_a) {
+                frame_end(s, s->nmea_cb, &s->nb_nmea);
+            } else {
+                s->nb_nmea_err += 1;
+                s->state = ST_SYNC;
+                s->len = 0;
+            }
+            break;
+        default:
+            s->state = ST_SYNC;
+            s->len = 0;
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void gps_stream_init(struct gps_stream_s *s, gps_stream_cb ubx_cb, gps_stream_cb nmea_cb, void *arg) {
+    memset(s, 0, sizeof *s);
+    s->state = ST_SYNC;
+    s->ubx_cb = ubx_cb;
+    s->nmea_cb = nmea_cb;
+    s->arg = arg;
+}
+
+char *gps_stream_wr_ptr(struct gps_stream_s *s, size_t *room) {
+    size_t r;
+
+    /* up to the end of the ring, without overwriting the current frame */
+    r = GPS_STREAM_RING_SIZE - s->head;
+    if (r > (GPS_STREAM_RING_SIZE - s->len)) {
+        r = GPS_STREAM_RING_SIZE - s->len;
+    }
+    *room = r;
+    return &s->ring[s->head];
+}
+
+void gps_stream_commit(struct gps_stream_s *s, size_t size) {
+    size_t i;
+
+    /* mirror the new bytes, frames wrapping around the ring end are read there */
+    memcpy(&s->ring[GPS_STREAM_RING_SIZE + s->head], &s->ring[s->head], size);
+
+    for (i = 0; i < size; i++) {
+        parse_byte(s, (uint8_t)s->ring[s->head], s->head);
+        s->head = (s->head + 1) & RING_MASK;
+    }
+}
+
+void gps_stream_feed(struct gps_stream_s *s, const char *data, size_t size) {
+    char *p;
+    size_t room;
+
+    while (size > 0) {
+        p = gps_stream_wr_ptr(s, &room);
+        if (room > size) {
+            room = size;
+        }
+        memcpy(p, data, room);
+        gps_stream_commit(s, room);
+        data += room;
+        size -= room;
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,101 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Incremental framing of the GPS serial stream: UBX and NMEA frames are
+    delimited byte by byte, their checksum computed on the fly, and the
+    valid frames reported through callbacks. The bytes are read in place
+    in a ring buffer, whose first half is mirrored after its end so that
+    any frame up to GPS_STREAM_RING_SIZE bytes is contiguous.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_GPS_STREAM_H
+#define _LORA_PKTFWD_GPS_STREAM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stddef.h>     /* size_t */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define GPS_STREAM_RING_SIZE    512     /* power of 2, longest frame reported */
+#define GPS_STREAM_NMEA_MAX     128     /* longest NMEA sentence accepted (82 in the standard) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* valid frame, from its sync chars to its checksum (NMEA: line end included) */
+typedef void (*gps_stream_cb)(const char *frame, size_t size, void *arg);
+
+struct gps_stream_s {
+    char ring[2 * GPS_STREAM_RING_SIZE];    /* second half mirrors the first one */
+    uint32_t head;      /* position of the next byte received */
+    uint32_t start;     /* position of the first byte of the current frame */
+    uint32_t len;       /* bytes of the current frame received */
+    uint32_t expected;  /* UBX: total size of the frame, from its header */
+    int state;
+    uint8_t ck_a;       /* UBX Fletcher checksum, or NMEA XOR checksum in ck_a */
+    uint8_t ck_b;
+    uint8_t ck_rcv;     /* checksum received */
+    gps_stream_cb ubx_cb;
+    gps_stream_cb nmea_cb;
+    void *arg;
+    /* statistics */
+    uint32_t nb_ubx;        /* valid UBX frames */
+    uint32_t nb_nmea;       /* valid NMEA sentences */
+    uint32_t nb_ubx_err;    /* UBX frames with a wrong checksum, or false sync chars */
+    uint32_t nb_nmea_err;   /* NMEA sentences with a wrong checksum or format */
+    uint32_t nb_oversize;   /* frames longer than GPS_STREAM_RING_SIZE, skipped */
+    uint32_t nb_skipped;    /* bytes outside of any frame */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize a GPS stream parser
+@param s parser to initialize
+@param ubx_cb function called for each valid UBX frame, may be NULL
+@param nmea_cb function called for each valid NMEA sentence, may be NULL
+@param arg argument passed to the callbacks
+*/
+void gps_stream_init(struct gps_stream_s *s, gps_stream_cb ubx_cb, gps_stream_cb nmea_cb, void *arg);
+
+/**
+@brief Get where the next bytes received must be written, eg. by read()
+@param s parser
+@param room number of contiguous bytes available at that place
+@return pointer in the ring buffer
+*/
+char *gps_stream_wr_ptr(struct gps_stream_s *s, size_t *room);
+
+/**
+@brief Parse the bytes written at gps_stream_wr_ptr(), callbacks are called
+for the frames they complete. Each byte is parsed once.
+@param s parser
+@param size number of bytes written, at most the room returned by gps_stream_wr_ptr()
+*/
+void gps_stream_commit(struct gps_stream_s *s, size_t size);
+
+/**
+@brief Copy bytes in the ring buffer and parse them (for data not read in place)
+@param s parser
+@param data bytes received
+@param size number of bytes
+*/
+void gps_stream_feed(struct gps_stream_s *s, const char *data, size_t size);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -39,6 +39,20 @@ cp ../Makefile libloragw/ -f
 #cp ../reset_lgw.sh packet_forwarder/lora_pkt_fwd/ -f
 
 cp ../lora_pkt_fwd.c packet_forwarder/src/
+cp ../rxpk_json.c packet_forwarder/src/ -f
+cp ../rxpk_json.h packet_forwarder/inc/ -f
+cp ../txpk_json.c packet_forwarder/src/ -f
+cp ../txpk_json.h packet_forwarder/inc/ -f
+cp ../base64_simd.c packet_forwarder/src/ -f
+cp ../base64_simd.h packet_forwarder/inc/ -f
+cp ../gps_stream.c packet_forwarder/src/ -f
+cp ../gps_stream.h packet_forwarder/inc/ -f
+mkdir -p packet_forwarder/tst
+cp ../test_rxpk_json.c packet_forwarder/tst/ -f
+cp ../test_txpk_json.c packet_forwarder/tst/ -f
+cp ../test_base64_simd.c packet_forwarder/tst/ -f
+cp ../test_gps_stream.c packet_forwarder/tst/ -f
+cp ../Makefile-pk packet_forwarder/Makefile -f
 make
 rm packet_forwarder/lora_pkt_fwd/obj/* -f
 popd
@@ -49,7 +49,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "trace.h"
 #include "jitqueue.h"
 #include "parson.h"
-#include "base64.h"
+#include "base64_simd.h"
+#include "rxpk_json.h"
+#include "txpk_json.h"
+#include "gps_stream.h"
 #include "loragw_hal.h"
 #include "loragw_aux.h"
 #include "loragw_reg.h"
@@ -195,6 +198,7 @@ static uint32_t meas_nb_rx_ok = 0; /* count packets received with PAYLOAD CRC OK
 static uint32_t meas_nb_rx_bad = 0; /* count packets received with PAYLOAD CRC ERROR */
 static uint32_t meas_nb_rx_nocrc = 0; /* count packets received with NO PAYLOAD CRC */
 static uint32_t meas_up_pkt_fwd = 0; /* number of radio packet forwarded to the server */
+static uint32_t meas_up_pkt_drop = 0; /* number of radio packet dropped because the upstream buffer was full */
 static uint32_t meas_up_network_byte = 0; /* sum of UDP bytes sent for upstream traffic */
 static uint32_t meas_up_payload_byte = 0; /* sum of radio payload bytes sent for upstream traffic */
 static uint32_t meas_up_dgram_sent = 0; /* number of datagrams sent for upstream traffic */
@@ -291,6 +295,10 @@ static void gps_process_sync(void);
 
 static void gps_process_coords(void);
 
+static void gps_ubx_frame(const char *frame, size_t size, void *arg);
+
+static void gps_nmea_frame(const char *frame, size_t size, void *arg);
+
 static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t * lut_index);
 
 /* threads */
@@ -1456,6 +1464,7 @@ int main(int argc, char ** argv)
     uint32_t cp_nb_rx_bad;
     uint32_t cp_nb_rx_nocrc;
     uint32_t cp_up_pkt_fwd;
+    uint32_t cp_up_pkt_drop;
     uint32_t cp_up_network_byte;
     uint32_t cp_up_payload_byte;
     uint32_t cp_up_dgram_sent;
@@ -1748,6 +1757,7 @@ int main(int argc, char ** argv)
         cp_nb_rx_bad       = meas_nb_rx_bad;
         cp_nb_rx_nocrc     = meas_nb_rx_nocrc;
         cp_up_pkt_fwd      = meas_up_pkt_fwd;
+        cp_up_pkt_drop     = meas_up_pkt_drop;
         cp_up_network_byte = meas_up_network_byte;
         cp_up_payload_byte = meas_up_payload_byte;
         cp_up_dgram_sent   = meas_up_dgram_sent;
@@ -1757,6 +1767,7 @@ int main(int argc, char ** argv)
         meas_nb_rx_bad = 0;
         meas_nb_rx_nocrc = 0;
         meas_up_pkt_fwd = 0;
+        meas_up_pkt_drop = 0;
         meas_up_network_byte = 0;
         meas_up_payload_byte = 0;
         meas_up_dgram_sent = 0;
@@ -1835,6 +1846,7 @@ int main(int argc, char ** argv)
         printf("# RF packets received by concentrator: %u\n", cp_nb_rx_rcv);
         printf("# CRC_OK: %.2f%%, CRC_FAIL: %.2f%%, NO_CRC: %.2f%%\n", 100.0 * rx_ok_ratio, 100.0 * rx_bad_ratio, 100.0 * rx_nocrc_ratio);
         printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
+        printf("# RF packets dropped (upstream buffer full): %u\n", cp_up_pkt_drop);
         printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
         printf("### [DOWNSTREAM] ###\n");
@@ -1996,9 +2008,9 @@ void thread_up(void) {
 
     /* GPS synchronization variables */
     struct timespec pkt_utc_time;
-    struct tm * x; /* broken-up UTC time */
     struct timespec pkt_gps_time;
-    uint64_t pkt_gps_time_ms;
+    struct timespec * pkt_utc; /* NULL if packet UTC time is not available */
+    struct timespec * pkt_gps; /* NULL if packet GPS time is not available */
 
     /* report management variable */
     bool send_report = false;
@@ -2118,271 +2130,50 @@ void thread_up(void) {
                     continue; /* skip that packet */
                     // exit(EXIT_FAILURE);
             }
+            /* make sure the worst case rxpk object fits, keeping room for the end of the datagram */
+            if ((TX_BUFF_SIZE - buff_index) < (RXPK_JSON_MAX_SIZE + STATUS_SIZE + 4)) {
+                meas_up_pkt_drop += 1;
+                pthread_mutex_unlock(&mx_meas_up);
+                MSG("WARNING: [up] upstream buffer full, packet from mote %08X dropped\n", mote_addr);
+                continue;
+            }
             meas_up_pkt_fwd += 1;
             meas_up_payload_byte += p->size;
             pthread_mutex_unlock(&mx_meas_up);
             printf( "\nINFO: Received pkt from mote: %08X (fcnt=%u)\n", mote_addr, mote_fcnt );
 
             /* Start of packet, add inter-packet separator if necessary */
-            if (pkt_in_dgram == 0) {
-                buff_up[buff_index] = '{';
-                ++buff_index;
-            } else {
+            if (pkt_in_dgram > 0) {
                 buff_up[buff_index] = ',';
-                buff_up[buff_index+1] = '{';
-                buff_index += 2;
-            }
-
-            /* JSON rxpk frame format version, 8 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, "\"jver\":%d", PROTOCOL_JSON_RXPK_FRAME_FORMAT );
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                exit(EXIT_FAILURE);
-            }
-
-            /* RAW timestamp, 8-17 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"tmst\":%u", p->count_us);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                exit(EXIT_FAILURE);
+                ++buff_index;
             }
 
-            /* Packet RX time (GPS based), 37 useful chars */
+            /* Packet RX time (GPS based) */
+            pkt_utc = NULL;
+            pkt_gps = NULL;
             if (ref_ok == true) {
                 /* convert packet timestamp to UTC absolute time */
                 j = lgw_cnt2utc(local_ref, p->count_us, &pkt_utc_time);
                 if (j == LGW_GPS_SUCCESS) {
-                    /* split the UNIX timestamp to its calendar components */
-                    x = gmtime(&(pkt_utc_time.tv_sec));
-                    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"time\":\"%04i-%02i-%02iT%02i:%02i:%02i.%06liZ\"", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (pkt_utc_time.tv_nsec)/1000); /* ISO 8601 format */
-                    if (j > 0) {
-                        buff_index += j;
-                    } else {
-                        MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                        exit(EXIT_FAILURE);
-                    }
+                    pkt_utc = &pkt_utc_time;
                 }
                 /* convert packet timestamp to GPS absolute time */
                 j = lgw_cnt2gps(local_ref, p->count_us, &pkt_gps_time);
                 if (j == LGW_GPS_SUCCESS) {
-                    pkt_gps_time_ms = pkt_gps_time.tv_sec * 1E3 + pkt_gps_time.tv_nsec / 1E6;
-                    j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"tmms\":%" PRIu64 "", pkt_gps_time_ms); /* GPS time in milliseconds since 06.Jan.1980 */
-                    if (j > 0) {
-                        buff_index += j;
-                    } else {
-                        MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                        exit(EXIT_FAILURE);
-                    }
-                }
-            }
-
-            /* Fine timestamp */
-            if (p->ftime_received == true) {
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"ftime\":%u", p->ftime);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf,\"mid\":%2u", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6), p->modem_id);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                exit(EXIT_FAILURE);
-            }
-
-            /* Packet status, 9-10 useful chars */
-            switch (p->status) {
-                case STAT_CRC_OK:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":1", 9);
-                    buff_index += 9;
-                    break;
-                case STAT_CRC_BAD:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":-1", 10);
-                    buff_index += 10;
-                    break;
-                case STAT_NO_CRC:
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":0", 9);
-                    buff_index += 9;
-                    break;
-                default:
-                    MSG("ERROR: [up] received packet with unknown status 0x%02X\n", p->status);
-                    memcpy((void *)(buff_up + buff_index), (void *)",\"stat\":?", 9);
-                    buff_index += 9;
-                    exit(EXIT_FAILURE);
-            }
-
-            /* Packet modulation, 13-14 useful chars */
-            if (p->modulation == MOD_LORA) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-                buff_index += 14;
-
-                /* Lora datarate & bandwidth, 16-19 useful chars */
-                switch (p->datarate) {
-                    case DR_LORA_SF5:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF5", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF6:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF6", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF7", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF8", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF9:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF9", 12);
-                        buff_index += 12;
-                        break;
-                    case DR_LORA_SF10:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF10", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF11:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF11", 13);
-                        buff_index += 13;
-                        break;
-                    case DR_LORA_SF12:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF12", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG("ERROR: [up] lora packet with unknown datarate 0x%02X\n", p->datarate);
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"datr\":\"SF?", 12);
-                        buff_index += 12;
-                        exit(EXIT_FAILURE);
-                }
-                switch (p->bandwidth) {
-                    case BW_125KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW125\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_250KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW250\"", 6);
-                        buff_index += 6;
-                        break;
-                    case BW_500KHZ:
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW500\"", 6);
-                        buff_index += 6;
-                        break;
-                    default:
-                        MSG("ERROR: [up] lora packet with unknown bandwidth 0x%02X\n", p->bandwidth);
-                        memcpy((void *)(buff_up + buff_index), (void *)"BW?\"", 4);
-                        buff_index += 4;
-                        exit(EXIT_FAILURE);
-                }
-
-                /* Packet ECC coding rate, 11-13 useful chars */
-                switch (p->coderate) {
-                    case CR_LORA_4_5:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_6:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/6\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_7:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/7\"", 13);
-                        buff_index += 13;
-                        break;
-                    case CR_LORA_4_8:
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"4/8\"", 13);
-                        buff_index += 13;
-                        break;
-                    case 0: /* treat the CR0 case (mostly false sync) */
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"OFF\"", 13);
-                        buff_index += 13;
-                        break;
-                    default:
-                        MSG("ERROR: [up] lora packet with unknown coderate 0x%02X\n", p->coderate);
-                        memcpy((void *)(buff_up + buff_index), (void *)",\"codr\":\"?\"", 11);
-                        buff_index += 11;
-                        exit(EXIT_FAILURE);
-                }
-
-                /* Signal RSSI, payload size */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"rssis\":%.0f", roundf(p->rssis));
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                    exit(EXIT_FAILURE);
+                    pkt_gps = &pkt_gps_time;
                 }
-
-                /* Lora SNR */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"lsnr\":%.1f", p->snr);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                    exit(EXIT_FAILURE);
-                }
-
-                /* Lora frequency offset */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"foff\":%d", p->freq_offset);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                    exit(EXIT_FAILURE);
-                }
-            } else if (p->modulation == MOD_FSK) {
-                memcpy((void *)(buff_up + buff_index), (void *)",\"modu\":\"FSK\"", 13);
-                buff_index += 13;
-
-                /* FSK datarate, 11-14 useful chars */
-                j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"datr\":%u", p->datarate);
-                if (j > 0) {
-                    buff_index += j;
-                } else {
-                    MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                    exit(EXIT_FAILURE);
-                }
-            } else {
-                MSG("ERROR: [up] received packet with unknown modulation 0x%02X\n", p->modulation);
-                exit(EXIT_FAILURE);
             }
 
-            /* Channel RSSI, payload size, 18-23 useful chars */
-            j = snprintf((char *)(buff_up + buff_index), TX_BUFF_SIZE-buff_index, ",\"rssi\":%.0f,\"size\":%u", roundf(p->rssic), p->size);
+            /* serialize packet metadata and payload as a rxpk JSON object */
+            j = rxpk_json_serialize(p, PROTOCOL_JSON_RXPK_FRAME_FORMAT, pkt_utc, pkt_gps, (char *)(buff_up + buff_index), TX_BUFF_SIZE - buff_index);
             if (j > 0) {
                 buff_index += j;
             } else {
-                MSG("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
+                MSG("ERROR: [up] failed to serialize packet (status 0x%02X, modulation 0x%02X, datarate 0x%02X, bandwidth 0x%02X, coderate 0x%02X)\n", p->status, p->modulation, p->datarate, p->bandwidth, p->coderate);
                 exit(EXIT_FAILURE);
             }
 
-            /* Packet base64-encoded payload, 14-350 useful chars */
-            memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
-            buff_index += 9;
-            j = bin_to_b64(p->payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-            if (j>=0) {
-                buff_index += j;
-            } else {
-                MSG("ERROR: [up] bin_to_b64 failed line %u\n", (__LINE__ - 5));
-                exit(EXIT_FAILURE);
-            }
-            buff_up[buff_index] = '"';
-            ++buff_index;
-
             /* End of packet serialization */
-            buff_up[buff_index] = '}';
-            ++buff_index;
             ++pkt_in_dgram;
 
             if (p->modulation == MOD_LORA) {
@@ -2565,10 +2356,7 @@ void thread_down(void) {
     bool req_ack = false; /* keep track of whether PULL_DATA was acknowledged or not */
 
     /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *txpk_obj = NULL;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
+    struct txpk_json_s txpk; /* txpk fields found */
     short x0, x1;
     uint64_t x2;
     double x3, x4;
@@ -2892,44 +2680,39 @@ void thread_down(void) {
             MSG("INFO: [down] PULL_RESP received  - token[%d:%d] :)\n", buff_down[1], buff_down[2]); /* very verbose */
             printf("\nJSON down: %s\n", (char *)(buff_down + 4)); /* DEBUG: display JSON payload */
 
-            /* initialize TX struct and try to parse JSON */
+            /* initialize TX struct and try to parse JSON, with parson if the streaming parser cannot */
             memset(&txpkt, 0, sizeof txpkt);
-            root_val = json_parse_string_with_comments((const char *)(buff_down + 4)); /* JSON offset */
-            if (root_val == NULL) {
+            i = txpk_json_parse((const char *)(buff_down + 4), msg_len - 4, &txpk, txpkt.payload, sizeof txpkt.payload);
+            if (i == TXPK_JSON_FALLBACK) {
+                i = txpk_json_parse_dom((const char *)(buff_down + 4), &txpk, txpkt.payload, sizeof txpkt.payload); /* JSON offset */
+            }
+            if (i == TXPK_JSON_INVALID) {
                 MSG("WARNING: [down] invalid JSON, TX aborted\n");
                 continue;
             }
-
-            /* look for JSON sub-object 'txpk' */
-            txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
-            if (txpk_obj == NULL) {
+            if (i == TXPK_JSON_NO_TXPK) {
                 MSG("WARNING: [down] no \"txpk\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse "immediate" tag, or target timestamp, or UTC time to be converted by GPS (mandatory) */
-            i = json_object_get_boolean(txpk_obj,"imme"); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
-            if (i == 1) {
+            if (txpk.imme == true) {
                 /* TX procedure: send immediately */
                 sent_immediate = true;
                 downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
                 MSG("INFO: [down] a packet will be sent in \"immediate\" mode\n");
             } else {
                 sent_immediate = false;
-                val = json_object_get_value(txpk_obj,"tmst");
-                if (val != NULL) {
+                if (txpk.fields & TXPK_FIELD_TMST) {
                     /* TX procedure: send on timestamp value */
-                    txpkt.count_us = (uint32_t)json_value_get_number(val);
+                    txpkt.count_us = (uint32_t)txpk.tmst;
 
                     /* Concentrator timestamp is given, we consider it is a Class A downlink */
                     downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_A;
                 } else {
                     /* TX procedure: send on GPS time (converted to timestamp value) */
-                    val = json_object_get_value(txpk_obj, "tmms");
-                    if (val == NULL) {
+                    if ((txpk.fields & TXPK_FIELD_TMMS) == 0) {
                         MSG("WARNING: [down] no mandatory \"txpk.tmst\" or \"txpk.tmms\" objects in JSON, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                     }
                     if (gps_enabled == true) {
@@ -2940,7 +2723,6 @@ void thread_down(void) {
                         } else {
                             pthread_mutex_unlock(&mx_timeref);
                             MSG("WARNING: [down] no valid GPS time reference yet, impossible to send packet on specific GPS time, TX aborted\n");
-                            json_value_free(root_val);
 
                             /* send acknoledge datagram to server */
                             send_tx_ack(buff_down[1], buff_down[2], JIT_ERROR_GPS_UNLOCKED, 0);
@@ -2948,7 +2730,6 @@ void thread_down(void) {
                         }
                     } else {
                         MSG("WARNING: [down] GPS disabled, impossible to send packet on specific GPS time, TX aborted\n");
-                        json_value_free(root_val);
 
                         /* send acknoledge datagram to server */
                         send_tx_ack(buff_down[1], buff_down[2], JIT_ERROR_GPS_UNLOCKED, 0);
@@ -2956,7 +2737,7 @@ void thread_down(void) {
                     }
 
                     /* Get GPS time from JSON */
-                    x2 = (uint64_t)json_value_get_number(val);
+                    x2 = (uint64_t)txpk.tmms;
 
                     /* Convert GPS time from milliseconds to timespec */
                     x3 = modf((double)x2/1E3, &x4);
@@ -2967,7 +2748,6 @@ void thread_down(void) {
                     i = lgw_gps2cnt(local_ref, gps_tx, &(txpkt.count_us));
                     if (i != LGW_GPS_SUCCESS) {
                         MSG("WARNING: [down] could not convert GPS time to timestamp, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                     } else {
                         MSG("INFO: [down] a packet will be sent on timestamp value %u (calculated from GPS time)\n", txpkt.count_us);
@@ -2979,68 +2759,55 @@ void thread_down(void) {
             }
 
             /* Parse "No CRC" flag (optional field) */
-            val = json_object_get_value(txpk_obj,"ncrc");
-            if (val != NULL) {
-                txpkt.no_crc = (bool)json_value_get_boolean(val);
+            if (txpk.fields & TXPK_FIELD_NCRC) {
+                txpkt.no_crc = txpk.ncrc;
             }
 
             /* Parse "No header" flag (optional field) */
-            val = json_object_get_value(txpk_obj,"nhdr");
-            if (val != NULL) {
-                txpkt.no_header = (bool)json_value_get_boolean(val);
+            if (txpk.fields & TXPK_FIELD_NHDR) {
+                txpkt.no_header = txpk.nhdr;
             }
 
             /* parse target frequency (mandatory) */
-            val = json_object_get_value(txpk_obj,"freq");
-            if (val == NULL) {
+            if ((txpk.fields & TXPK_FIELD_FREQ) == 0) {
                 MSG("WARNING: [down] no mandatory \"txpk.freq\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+            txpkt.freq_hz = (uint32_t)((double)(1.0e6) * txpk.freq);
 
             /* parse RF chain used for TX (mandatory) */
-            val = json_object_get_value(txpk_obj,"rfch");
-            if (val == NULL) {
+            if ((txpk.fields & TXPK_FIELD_RFCH) == 0) {
                 MSG("WARNING: [down] no mandatory \"txpk.rfch\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.rf_chain = (uint8_t)json_value_get_number(val);
+            txpkt.rf_chain = (uint8_t)txpk.rfch;
             if (tx_enable[txpkt.rf_chain] == false) {
                 MSG("WARNING: [down] TX is not enabled on RF chain %u, TX aborted\n", txpkt.rf_chain);
-                json_value_free(root_val);
                 continue;
             }
 
             /* parse TX power (optional field) */
-            val = json_object_get_value(txpk_obj,"powe");
-            if (val != NULL) {
-                txpkt.rf_power = (int8_t)json_value_get_number(val) - antenna_gain;
+            if (txpk.fields & TXPK_FIELD_POWE) {
+                txpkt.rf_power = (int8_t)txpk.powe - antenna_gain;
             }
 
             /* Parse modulation (mandatory) */
-            str = json_object_get_string(txpk_obj, "modu");
-            if (str == NULL) {
+            if ((txpk.fields & TXPK_FIELD_MODU) == 0) {
                 MSG("WARNING: [down] no mandatory \"txpk.modu\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            if (strcmp(str, "LORA") == 0) {
+            if (strcmp(txpk.modu, "LORA") == 0) {
                 /* Lora modulation */
                 txpkt.modulation = MOD_LORA;
 
                 /* Parse Lora spreading-factor and modulation bandwidth (mandatory) */
-                str = json_object_get_string(txpk_obj, "datr");
-                if (str == NULL) {
+                if ((txpk.fields & TXPK_FIELD_DATR) == 0) {
                     MSG("WARNING: [down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                i = sscanf(str, "SF%2hdBW%3hd", &x0, &x1);
+                i = sscanf(txpk.datr, "SF%2hdBW%3hd", &x0, &x1);
                 if (i != 2) {
                     MSG("WARNING: [down] format error in \"txpk.datr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
                 switch (x0) {
@@ -3054,7 +2821,6 @@ void thread_down(void) {
                     case 12: txpkt.datarate = DR_LORA_SF12; break;
                     default:
                         MSG("WARNING: [down] format error in \"txpk.datr\", invalid SF, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
                 switch (x1) {
@@ -3063,39 +2829,33 @@ void thread_down(void) {
                     case 500: txpkt.bandwidth = BW_500KHZ; break;
                     default:
                         MSG("WARNING: [down] format error in \"txpk.datr\", invalid BW, TX aborted\n");
-                        json_value_free(root_val);
                         continue;
                 }
 
                 /* Parse ECC coding rate (optional field) */
-                str = json_object_get_string(txpk_obj, "codr");
-                if (str == NULL) {
+                if ((txpk.fields & TXPK_FIELD_CODR) == 0) {
                     MSG("WARNING: [down] no mandatory \"txpk.codr\" object in json, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                if      (strcmp(str, "4/5") == 0) txpkt.coderate = CR_LORA_4_5;
-                else if (strcmp(str, "4/6") == 0) txpkt.coderate = CR_LORA_4_6;
-                else if (strcmp(str, "2/3") == 0) txpkt.coderate = CR_LORA_4_6;
-                else if (strcmp(str, "4/7") == 0) txpkt.coderate = CR_LORA_4_7;
-                else if (strcmp(str, "4/8") == 0) txpkt.coderate = CR_LORA_4_8;
-                else if (strcmp(str, "1/2") == 0) txpkt.coderate = CR_LORA_4_8;
+                if      (strcmp(txpk.codr, "4/5") == 0) txpkt.coderate = CR_LORA_4_5;
+                else if (strcmp(txpk.codr, "4/6") == 0) txpkt.coderate = CR_LORA_4_6;
+                else if (strcmp(txpk.codr, "2/3") == 0) txpkt.coderate = CR_LORA_4_6;
+                else if (strcmp(txpk.codr, "4/7") == 0) txpkt.coderate = CR_LORA_4_7;
+                else if (strcmp(txpk.codr, "4/8") == 0) txpkt.coderate = CR_LORA_4_8;
+                else if (strcmp(txpk.codr, "1/2") == 0) txpkt.coderate = CR_LORA_4_8;
                 else {
                     MSG("WARNING: [down] format error in \"txpk.codr\", TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
 
                 /* Parse signal polarity switch (optional field) */
-                val = json_object_get_value(txpk_obj,"ipol");
-                if (val != NULL) {
-                    txpkt.invert_pol = (bool)json_value_get_boolean(val);
+                if (txpk.fields & TXPK_FIELD_IPOL) {
+                    txpkt.invert_pol = txpk.ipol;
                 }
 
                 /* parse Lora preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj,"prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
+                if (txpk.fields & TXPK_FIELD_PREA) {
+                    i = (int)txpk.prea;
                     if (i >= MIN_LORA_PREAMB) {
                         txpkt.preamble = (uint16_t)i;
                     } else {
@@ -3105,32 +2865,27 @@ void thread_down(void) {
                     txpkt.preamble = (uint16_t)STD_LORA_PREAMB;
                 }
 
-            } else if (strcmp(str, "FSK") == 0) {
+            } else if (strcmp(txpk.modu, "FSK") == 0) {
                 /* FSK modulation */
                 txpkt.modulation = MOD_FSK;
 
                 /* parse FSK bitrate (mandatory) */
-                val = json_object_get_value(txpk_obj,"datr");
-                if (val == NULL) {
+                if ((txpk.fields & TXPK_FIELD_DATR_NUM) == 0) {
                     MSG("WARNING: [down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.datarate = (uint32_t)(json_value_get_number(val));
+                txpkt.datarate = (uint32_t)(txpk.datr_num);
 
                 /* parse frequency deviation (mandatory) */
-                val = json_object_get_value(txpk_obj,"fdev");
-                if (val == NULL) {
+                if ((txpk.fields & TXPK_FIELD_FDEV) == 0) {
                     MSG("WARNING: [down] no mandatory \"txpk.fdev\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
                     continue;
                 }
-                txpkt.f_dev = (uint8_t)(json_value_get_number(val) / 1000.0); /* JSON value in Hz, txpkt.f_dev in kHz */
+                txpkt.f_dev = (uint8_t)(txpk.fdev / 1000.0); /* JSON value in Hz, txpkt.f_dev in kHz */
 
                 /* parse FSK preamble length (optional field, optimum min value enforced) */
-                val = json_object_get_value(txpk_obj,"prea");
-                if (val != NULL) {
-                    i = (int)json_value_get_number(val);
+                if (txpk.fields & TXPK_FIELD_PREA) {
+                    i = (int)txpk.prea;
                     if (i >= MIN_FSK_PREAMB) {
                         txpkt.preamble = (uint16_t)i;
                     } else {
@@ -3142,34 +2897,29 @@ void thread_down(void) {
 
             } else {
                 MSG("WARNING: [down] invalid modulation in \"txpk.modu\", TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
 
             /* Parse payload length (mandatory) */
-            val = json_object_get_value(txpk_obj,"size");
-            if (val == NULL) {
+            if ((txpk.fields & TXPK_FIELD_SIZE) == 0) {
                 MSG("WARNING: [down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            txpkt.size = (uint16_t)json_value_get_number(val);
+            txpkt.size = (uint16_t)txpk.size;
 
-            /* Parse payload data (mandatory) */
-            str = json_object_get_string(txpk_obj, "data");
-            if (str == NULL) {
+            /* Parse payload data (mandatory), already decoded in txpkt.payload */
+            if ((txpk.fields & TXPK_FIELD_DATA) == 0) {
                 MSG("WARNING: [down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
-                json_value_free(root_val);
                 continue;
             }
-            i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
-            if (i != txpkt.size) {
+            if (txpk.data_size < 0) {
+                MSG("WARNING: [down] invalid base64 in \"txpk.data\", TX aborted\n");
+                continue;
+            }
+            if (txpk.data_size != txpkt.size) {
                 MSG("WARNING: [down] mismatch between .size and .data size once converter to binary\n");
             }
 
-            /* free the JSON parse tree from memory */
-            json_value_free(root_val);
-
             /* select TX mode */
             if (sent_immediate) {
                 txpkt.tx_mode = IMMEDIATE;
@@ -3446,97 +3196,51 @@ static void gps_process_coords(void) {
     pthread_mutex_unlock(&mx_meas_gps);
 }
 
-void thread_gps(void) {
-    /* serial variables */
-    char serial_buff[128]; /* buffer to receive GPS data */
-    size_t wr_idx = 0;     /* pointer to end of chars in buffer */
+static void gps_ubx_frame(const char *frame, size_t size, void *arg) {
+    enum gps_msg latest_msg;
+    size_t frame_size = 0;
 
-    /* variables for PPM pulse GPS synchronization */
-    enum gps_msg latest_msg; /* keep track of latest NMEA message parsed */
+    (void)arg;
+    latest_msg = lgw_parse_ubx(frame, size, &frame_size);
+    if (latest_msg == UBX_NAV_TIMEGPS) {
+        gps_process_sync();
+    }
+}
 
-    /* initialize some variables before loop */
-    memset(serial_buff, 0, sizeof serial_buff);
+static void gps_nmea_frame(const char *frame, size_t size, void *arg) {
+    enum gps_msg latest_msg;
 
-    while (!exit_sig && !quit_sig) {
-        size_t rd_idx = 0;
-        size_t frame_end_idx = 0;
+    (void)arg;
+    latest_msg = lgw_parse_nmea(frame, size);
+    if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
+        gps_process_coords();
+    }
+}
+
+void thread_gps(void) {
+    /* serial variables, frames are delimited as the bytes are received */
+    struct gps_stream_s gps_stream;
+    char *wr_ptr;
+    size_t room;
+    uint32_t nb_ubx_err;
+
+    gps_stream_init(&gps_stream, gps_ubx_frame, gps_nmea_frame, NULL);
 
-        /* blocking non-canonical read on serial port */
-        ssize_t nb_char = read(gps_tty_fd, serial_buff + wr_idx, LGW_GPS_MIN_MSG_SIZE);
+    while (!exit_sig && !quit_sig) {
+        /* blocking non-canonical read on serial port, in place in the ring buffer */
+        wr_ptr = gps_stream_wr_ptr(&gps_stream, &room);
+        ssize_t nb_char = read(gps_tty_fd, wr_ptr, room);
         if (nb_char <= 0) {
             // MSG("WARNING: [gps] read() returned value %zd\n", nb_char);
             continue;
         }
-        wr_idx += (size_t)nb_char;
-
-        /*******************************************
-         * Scan buffer for UBX/NMEA sync chars and *
-         * attempt to decode frame if one is found *
-         *******************************************/
-        while (rd_idx < wr_idx) {
-            size_t frame_size = 0;
-
-            /* Scan buffer for UBX sync char */
-            if (serial_buff[rd_idx] == (char)LGW_GPS_UBX_SYNC_CHAR) {
-
-                /***********************
-                 * Found UBX sync char *
-                 ***********************/
-                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
-
-                if (frame_size > 0) {
-                    if (latest_msg == INCOMPLETE) {
-                        /* UBX header found but frame appears to be missing bytes */
-                        frame_size = 0;
-                    } else if (latest_msg == INVALID) {
-                        /* message header received but message appears to be corrupted */
-                        MSG("WARNING: [gps] could not get a valid message from GPS (no time)\n");
-                        frame_size = 0;
-                    } else if (latest_msg == UBX_NAV_TIMEGPS) {
-                        gps_process_sync();
-                    }
-                }
-            } else if (serial_buff[rd_idx] == (char)LGW_GPS_NMEA_SYNC_CHAR) {
-                /************************
-                 * Found NMEA sync char *
-                 ************************/
-                /* scan for NMEA end marker (LF = 0x0a) */
-                char* nmea_end_ptr = memchr(&serial_buff[rd_idx],(int)0x0a, (wr_idx - rd_idx));
-
-                if(nmea_end_ptr) {
-                    /* found end marker */
-                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
-                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
-
-                    if(latest_msg == INVALID || latest_msg == UNKNOWN) {
-                        /* checksum failed */
-                        frame_size = 0;
-                    } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
-                        gps_process_coords();
-                    }
-                }
-            }
 
-            if (frame_size > 0) {
-                /* At this point message is a checksum verified frame
-                   we're processed or ignored. Remove frame from buffer */
-                rd_idx += frame_size;
-                frame_end_idx = rd_idx;
-            } else {
-                rd_idx++;
-            }
-        } /* ...for(rd_idx = 0... */
-
-        if (frame_end_idx) {
-          /* Frames have been processed. Remove bytes to end of last processed frame */
-          memcpy(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
-          wr_idx -= frame_end_idx;
-        } /* ...for(rd_idx = 0... */
-
-        /* Prevent buffer overflow */
-        if ((sizeof(serial_buff) - wr_idx) < LGW_GPS_MIN_MSG_SIZE) {
-            memcpy(serial_buff, &serial_buff[LGW_GPS_MIN_MSG_SIZE], wr_idx - LGW_GPS_MIN_MSG_SIZE);
-            wr_idx -= LGW_GPS_MIN_MSG_SIZE;
+        /* parse the new bytes only, valid frames are processed by the callbacks */
+        nb_ubx_err = gps_stream.nb_ubx_err;
+        gps_stream_commit(&gps_stream, (size_t)nb_char);
+        if (gps_stream.nb_ubx_err != nb_ubx_err) {
+            /* message header received but message appears to be corrupted */
+            MSG("WARNING: [gps] could not get a valid message from GPS (no time)\n");
         }
     }
     MSG("\nINFO: End of GPS thread\n");
@@ -0,0 +1,282 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Serialization of received packets as "rxpk" JSON objects, without printf
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>         /* C99 types */
+#include <stdbool.h>        /* bool type */
+#include <string.h>         /* memcpy */
+#include <math.h>           /* rint, signbit */
+#include <time.h>           /* gmtime_r */
+
+#include "rxpk_json.h"
+#include "base64_simd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define PUT_STR(dst, str)   do { memcpy((dst), (str), sizeof(str) - 1); (dst) += sizeof(str) - 1; } while (0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* equivalent to "%u" / "%" PRIu64 */
+static char * put_u64(char * dst, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) {
+        *dst++ = tmp[--n];
+    }
+    return dst;
+}
+
+/* equivalent to "%d" */
+static char * put_i32(char * dst, int32_t v) {
+    if (v < 0) {
+        *dst++ = '-';
+        return put_u64(dst, (uint64_t)(-(int64_t)v));
+    }
+    return put_u64(dst, (uint64_t)v);
+}
+
+/* equivalent to "%0<width>u", for width <= 6 */
+static char * put_u32_pad(char * dst, uint32_t v, int width) {
+    int i;
+
+    for (i = width - 1; i >= 0; i--) {
+        dst[i] = '0' + (v % 10);
+        v /= 10;
+    }
+    return dst + width;
+}
+
+/* equivalent to "%.0f" of an integer-valued float, NULL if out of range */
+static char * put_float_int(char * dst, float v) {
+    if (!(fabsf(v) < 4294967296.0f)) {
+        return NULL;
+    }
+    if (signbit(v)) {
+        *dst++ = '-';
+    }
+    return put_u64(dst, (uint64_t)fabsf(v));
+}
+
+/* equivalent to "%.1f" of a float, NULL if out of range */
+static char * put_float_1dec(char * dst, float v) {
+    double x;
+
+    if (!(fabsf(v) < 4294967296.0f)) {
+        return NULL;
+    }
+    if (signbit(v)) {
+        *dst++ = '-';
+    }
+    /* exact in double for any float, rint() rounds ties to even like printf */
+    x = rint(fabs((double)v) * 10.0);
+    dst = put_u64(dst, (uint64_t)x / 10);
+    *dst++ = '.';
+    *dst++ = '0' + ((uint64_t)x % 10);
+    return dst;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int rxpk_json_serialize(const struct lgw_pkt_rx_s *p, int jver, const struct timespec *utc_time, const struct timespec *gps_time, char *out, int max_len) {
+    char * dst = out;
+    struct tm x; /* broken-up UTC time */
+    uint64_t pkt_gps_time_ms;
+    int j;
+
+    if ((p == NULL) || (out == NULL) || (max_len < RXPK_JSON_MAX_SIZE)) {
+        return -1;
+    }
+
+    /* JSON rxpk frame format version */
+    PUT_STR(dst, "{\"jver\":");
+    dst = put_i32(dst, jver);
+
+    /* RAW timestamp */
+    PUT_STR(dst, ",\"tmst\":");
+    dst = put_u64(dst, p->count_us);
+
+    /* Packet RX time (GPS based), ISO 8601 format */
+    if ((utc_time != NULL) && (gmtime_r(&(utc_time->tv_sec), &x) != NULL) && ((x.tm_year + 1900) >= 0) && ((x.tm_year + 1900) <= 9999)) {
+        PUT_STR(dst, ",\"time\":\"");
+        dst = put_u32_pad(dst, x.tm_year + 1900, 4);
+        *dst++ = '-';
+        dst = put_u32_pad(dst, x.tm_mon + 1, 2);
+        *dst++ = '-';
+        dst = put_u32_pad(dst, x.tm_mday, 2);
+        *dst++ = 'T';
+        dst = put_u32_pad(dst, x.tm_hour, 2);
+        *dst++ = ':';
+        dst = put_u32_pad(dst, x.tm_min, 2);
+        *dst++ = ':';
+        dst = put_u32_pad(dst, x.tm_sec, 2);
+        *dst++ = '.';
+        dst = put_u32_pad(dst, (uint32_t)(utc_time->tv_nsec / 1000), 6);
+        PUT_STR(dst, "Z\"");
+    }
+    if (gps_time != NULL) {
+        /* keep the floating point conversion of the original code, its rounding is part of the output */
+        pkt_gps_time_ms = gps_time->tv_sec * 1E3 + gps_time->tv_nsec / 1E6;
+        PUT_STR(dst, ",\"tmms\":");
+        dst = put_u64(dst, pkt_gps_time_ms);
+    }
+
+    /* Fine timestamp */
+    if (p->ftime_received == true) {
+        PUT_STR(dst, ",\"ftime\":");
+        dst = put_u64(dst, p->ftime);
+    }
+
+    /* Packet concentrator channel, RF chain & RX frequency (MHz, 6 decimals is exact for a frequency in Hz) */
+    PUT_STR(dst, ",\"chan\":");
+    dst = put_u64(dst, p->if_chain);
+    PUT_STR(dst, ",\"rfch\":");
+    dst = put_u64(dst, p->rf_chain);
+    PUT_STR(dst, ",\"freq\":");
+    dst = put_u64(dst, p->freq_hz / 1000000);
+    *dst++ = '.';
+    dst = put_u32_pad(dst, p->freq_hz % 1000000, 6);
+    PUT_STR(dst, ",\"mid\":");
+    if (p->modem_id < 10) {
+        *dst++ = ' '; /* "%2u" */
+    }
+    dst = put_u64(dst, p->modem_id);
+
+    /* Packet status */
+    switch (p->status) {
+        case STAT_CRC_OK:
+            PUT_STR(dst, ",\"stat\":1");
+            break;
+        case STAT_CRC_BAD:
+            PUT_STR(dst, ",\"stat\":-1");
+            break;
+        case STAT_NO_CRC:
+            PUT_STR(dst, ",\"stat\":0");
+            break;
+        default:
+            return -1;
+    }
+
+    /* Packet modulation */
+    if (p->modulation == MOD_LORA) {
+        PUT_STR(dst, ",\"modu\":\"LORA\"");
+
+        /* Lora datarate & bandwidth */
+        if ((p->datarate < DR_LORA_SF5) || (p->datarate > DR_LORA_SF12)) {
+            return -1;
+        }
+        PUT_STR(dst, ",\"datr\":\"SF");
+        dst = put_u64(dst, p->datarate);
+        switch (p->bandwidth) {
+            case BW_125KHZ:
+                PUT_STR(dst, "BW125\"");
+                break;
+            case BW_250KHZ:
+                PUT_STR(dst, "BW250\"");
+                break;
+            case BW_500KHZ:
+                PUT_STR(dst, "BW500\"");
+                break;
+            default:
+                return -1;
+        }
+
+        /* Packet ECC coding rate */
+        switch (p->coderate) {
+            case CR_LORA_4_5:
+                PUT_STR(dst, ",\"codr\":\"4/5\"");
+                break;
+            case CR_LORA_4_6:
+                PUT_STR(dst, ",\"codr\":\"4/6\"");
+                break;
+            case CR_LORA_4_7:
+                PUT_STR(dst, ",\"codr\":\"4/7\"");
+                break;
+            case CR_LORA_4_8:
+                PUT_STR(dst, ",\"codr\":\"4/8\"");
+                break;
+            case 0: /* treat the CR0 case (mostly false sync) */
+                PUT_STR(dst, ",\"codr\":\"OFF\"");
+                break;
+            default:
+                return -1;
+        }
+
+        /* Signal RSSI */
+        PUT_STR(dst, ",\"rssis\":");
+        dst = put_float_int(dst, roundf(p->rssis));
+        if (dst == NULL) {
+            return -1;
+        }
+
+        /* Lora SNR */
+        PUT_STR(dst, ",\"lsnr\":");
+        dst = put_float_1dec(dst, p->snr);
+        if (dst == NULL) {
+            return -1;
+        }
+
+        /* Lora frequency offset */
+        PUT_STR(dst, ",\"foff\":");
+        dst = put_i32(dst, p->freq_offset);
+    } else if (p->modulation == MOD_FSK) {
+        PUT_STR(dst, ",\"modu\":\"FSK\"");
+
+        /* FSK datarate */
+        PUT_STR(dst, ",\"datr\":");
+        dst = put_u64(dst, p->datarate);
+    } else {
+        return -1;
+    }
+
+    /* Channel RSSI, payload size */
+    PUT_STR(dst, ",\"rssi\":");
+    dst = put_float_int(dst, roundf(p->rssic));
+    if (dst == NULL) {
+        return -1;
+    }
+    PUT_STR(dst, ",\"size\":");
+    dst = put_u64(dst, p->size);
+
+    /* Packet base64-encoded payload */
+    PUT_STR(dst, ",\"data\":\"");
+    j = bin_to_b64_simd(p->payload, p->size, dst, 341); /* 255 bytes = 340 chars in b64 + null char */
+    if (j < 0) {
+        return -1;
+    }
+    dst += j;
+    PUT_STR(dst, "\"}");
+
+    return (int)(dst - out);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
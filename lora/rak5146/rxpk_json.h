@@ -0,0 +1,53 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Serialization of received packets as "rxpk" JSON objects, without printf
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_RXPK_JSON_H
+#define _LORA_PKTFWD_RXPK_JSON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <time.h>       /* timespec */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define RXPK_JSON_MAX_SIZE  680 /* worst case size of a serialized rxpk object, 255 bytes payload */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Serialize a received packet as a JSON rxpk object, "{...}"
+@param p pointer to the received packet
+@param jver JSON rxpk frame format version
+@param utc_time pointer to the UTC time of the packet, NULL if not available
+@param gps_time pointer to the GPS time of the packet, NULL if not available
+@param out buffer in which the JSON object is written (not null-terminated)
+@param max_len size of the output buffer, must be at least RXPK_JSON_MAX_SIZE
+@return number of chars written, -1 if the packet metadata cannot be serialized
+
+The output is byte-identical to the snprintf based serialization that was
+done in thread_up(), but uses only integer and fixed-point arithmetic.
+*/
+int rxpk_json_serialize(const struct lgw_pkt_rx_s *p, int jver, const struct timespec *utc_time, const struct timespec *gps_time, char *out, int max_len);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
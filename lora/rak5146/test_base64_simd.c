@@ -0,0 +1,196 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Check every base64 codec implementation supported by the CPU against
+    bin_to_b64()/b64_to_bin() for 1 to 255 bytes payloads and compare their speed
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt */
+#include <time.h>
+
+#include "base64.h"
+#include "base64_simd.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PAYLOAD_MAX     255
+#define B64_MAX         341 /* 255 bytes = 340 chars in b64 + null char */
+#define NB_LOOP_DEFAULT 2000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -l <uint>  Number of loops over the 1..255 bytes payloads\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+/* compare encode/decode of all payload sizes with the reference codec, return number of errors */
+static int check_impl(const uint8_t *data) {
+    char b64_ref[B64_MAX];
+    char b64_new[B64_MAX];
+    uint8_t bin_ref[PAYLOAD_MAX];
+    uint8_t bin_new[PAYLOAD_MAX];
+    int size, len_ref, len_new, len_b64, x;
+    int nb_err = 0;
+
+    /* empty payload */
+    if ((b64_to_bin(b64_ref, 0, bin_ref, sizeof bin_ref) != 0) || (b64_to_bin_simd(b64_new, 0, bin_new, sizeof bin_new) != 0)) {
+        printf("ERROR: %s decode mismatch for an empty string\n", b64_simd_impl_name());
+        nb_err += 1;
+    }
+
+    for (size = 1; size <= PAYLOAD_MAX; size++) {
+        len_ref = bin_to_b64(data, size, b64_ref, sizeof b64_ref);
+        len_new = bin_to_b64_simd(data, size, b64_new, sizeof b64_new);
+        if ((len_ref != len_new) || (strcmp(b64_ref, b64_new) != 0)) {
+            printf("ERROR: %s encode mismatch for %d bytes\n", b64_simd_impl_name(), size);
+            nb_err += 1;
+            continue;
+        }
+        len_b64 = len_new;
+        len_ref = b64_to_bin(b64_ref, len_ref, bin_ref, sizeof bin_ref);
+        len_new = b64_to_bin_simd(b64_new, len_new, bin_new, sizeof bin_new);
+        if ((len_ref != size) || (len_new != size) || (memcmp(bin_new, data, size) != 0)) {
+            printf("ERROR: %s decode mismatch for %d bytes\n", b64_simd_impl_name(), size);
+            nb_err += 1;
+            continue;
+        }
+        /* unpadded base64 is accepted too */
+        len_new = len_b64;
+        while (b64_new[len_new - 1] == '=') {
+            len_new -= 1;
+        }
+        len_ref = b64_to_bin(b64_new, len_new, bin_ref, sizeof bin_ref);
+        memset(bin_new, 0, sizeof bin_new);
+        x = b64_to_bin_simd(b64_new, len_new, bin_new, sizeof bin_new);
+        if ((len_ref != size) || (x != size) || (memcmp(bin_new, data, size) != 0)) {
+            printf("ERROR: %s unpadded decode mismatch for %d bytes\n", b64_simd_impl_name(), size);
+            nb_err += 1;
+            continue;
+        }
+        /* an invalid char anywhere must be rejected */
+        b64_new[rand() % len_new] = '*';
+        if (b64_to_bin_simd(b64_new, len_new, bin_new, sizeof bin_new) != -1) {
+            printf("ERROR: %s accepted an invalid char for %d bytes\n", b64_simd_impl_name(), size);
+            nb_err += 1;
+        }
+    }
+
+    return nb_err;
+}
+
+/* time encode+decode of all payload sizes, return time in seconds */
+static double bench_impl(const uint8_t *data, int nb_loop, bool reference) {
+    char b64[B64_MAX];
+    uint8_t bin[PAYLOAD_MAX];
+    int l, size, len;
+    struct timespec start, stop;
+    volatile int sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        for (size = 1; size <= PAYLOAD_MAX; size++) {
+            if (reference == true) {
+                len = bin_to_b64(data, size, b64, sizeof b64);
+                sink += b64_to_bin(b64, len, bin, sizeof bin);
+            } else {
+                len = bin_to_b64_simd(data, size, b64, sizeof b64);
+                sink += b64_to_bin_simd(b64, len, bin, sizeof bin);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    return difftimespec(stop, start);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    int nb_loop = NB_LOOP_DEFAULT;
+    uint8_t data[PAYLOAD_MAX];
+    const enum b64_simd_impl_e impls[] = {B64_IMPL_SCALAR, B64_IMPL_SSSE3, B64_IMPL_AVX2, B64_IMPL_NEON};
+    int nb_err = 0;
+    double t_ref, t_new;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hl:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'l':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = (int)arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(time(NULL));
+    for (i = 0; i < PAYLOAD_MAX; i++) {
+        data[i] = (uint8_t)rand();
+    }
+
+    t_ref = bench_impl(data, nb_loop, true);
+    printf("INFO: reference bin_to_b64/b64_to_bin: %.1f ns/payload\n", 1E9 * t_ref / ((double)nb_loop * PAYLOAD_MAX));
+
+    for (i = 0; i < (int)(sizeof impls / sizeof impls[0]); i++) {
+        if (b64_simd_set_impl(impls[i]) != 0) {
+            continue; /* not supported by this CPU/build */
+        }
+        x = check_impl(data);
+        nb_err += x;
+        t_new = bench_impl(data, nb_loop, false);
+        printf("INFO: %-6s %s, %.1f ns/payload (x%.2f)\n", b64_simd_impl_name(), (x == 0) ? "OK" : "FAILED", 1E9 * t_new / ((double)nb_loop * PAYLOAD_MAX), t_ref / t_new);
+    }
+
+    b64_simd_set_impl(B64_IMPL_AUTO);
+    printf("INFO: runtime selection: %s\n", b64_simd_impl_name());
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,397 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Check the incremental UBX/NMEA framing of gps_stream against the frames
+    of a GPS serial capture, whatever the size of the reads, and compare its
+    speed with the former scan of thread_gps (rescan from the buffer start,
+    shift of the remaining bytes).
+    The capture is a recording of the GPS TTY (eg. cat /dev/ttyAMA0 > gps.bin),
+    a synthetic one is generated if none is given.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt */
+#include <time.h>
+
+#include "gps_stream.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CAPTURE_MAX         (4 * 1024 * 1024)
+#define NB_SECONDS_DEFAULT  2000    /* seconds of GPS output in the synthetic capture */
+#define NB_LOOP_DEFAULT     20
+#define READ_SIZE_DEFAULT   8       /* LGW_GPS_MIN_MSG_SIZE */
+#define LEGACY_BUFF_SIZE    128     /* former serial_buff of thread_gps */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+struct frame_count_s {
+    uint32_t nb_ubx;
+    uint32_t nb_nmea;
+    uint32_t hash;      /* over the frames reported, in order */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -f <path>  GPS serial capture, synthetic capture if not set\n");
+    printf(" -l <uint>  Number of loops over the capture for the benchmark\n");
+    printf(" -r <uint>  Size of the reads for the benchmark, in bytes\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+static uint32_t hash_frame(uint32_t h, const char *frame, size_t size) {
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        h = (h ^ (uint8_t)frame[i]) * 16777619; /* FNV-1a */
+    }
+    return h;
+}
+
+static void count_ubx(const char *frame, size_t size, void *arg) {
+    struct frame_count_s *c = arg;
+
+    c->nb_ubx += 1;
+    c->hash = hash_frame(c->hash, frame, size);
+}
+
+static void count_nmea(const char *frame, size_t size, void *arg) {
+    struct frame_count_s *c = arg;
+
+    c->nb_nmea += 1;
+    c->hash = hash_frame(c->hash, frame, size);
+}
+
+/* append a NMEA sentence with its checksum */
+static int put_nmea(char *dst, const char *body) {
+    uint8_t ck = 0;
+    const char *p;
+
+    for (p = body; *p != '\0'; p++) {
+        ck ^= (uint8_t)*p;
+    }
+    return sprintf(dst, "$%s*%02X\r\n", body, ck);
+}
+
+/* append a UBX frame with its checksum */
+static int put_ubx(char *dst, uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len) {
+    uint8_t ck_a = 0, ck_b = 0;
+    int i;
+
+    dst[0] = (char)0xB5;
+    dst[1] = (char)0x62;
+    dst[2] = (char)cls;
+    dst[3] = (char)id;
+    dst[4] = (char)(len & 0xFF);
+    dst[5] = (char)(len >> 8);
+    memcpy(&dst[6], payload, len);
+    for (i = 2; i < (6 + len); i++) {
+        ck_a += (uint8_t)dst[i];
+        ck_b += ck_a;
+    }
+    dst[6 + len] = (char)ck_a;
+    dst[7 + len] = (char)ck_b;
+    return 8 + len;
+}
+
+/* one second of u-blox output per loop: NAV-TIMEGPS and the usual NMEA sentences,
+   with some noise: corrupted frames, garbage bytes, sentences without CR */
+static int make_capture(char *buf, int nb_seconds, struct frame_count_s *expected) {
+    uint8_t timegps[16];
+    char body[96];
+    int n = 0;
+    int i, k;
+
+    memset(expected, 0, sizeof *expected);
+    for (i = 0; i < nb_seconds; i++) {
+        memset(timegps, 0, sizeof timegps);
+        timegps[0] = (uint8_t)(i * 1000);
+        timegps[1] = (uint8_t)((i * 1000) >> 8);
+        timegps[8] = 0x2C; /* week */
+        timegps[9] = 0x08;
+        timegps[11] = 0x07; /* towValid, weekValid */
+        n += put_ubx(&buf[n], 0x01, 0x20, timegps, sizeof timegps);
+        expected->nb_ubx += 1;
+        sprintf(body, "GPRMC,%02d%02d%02d.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A", (i / 3600) % 24, (i / 60) % 60, i % 60);
+        n += put_nmea(&buf[n], body);
+        sprintf(body, "GPGGA,%02d%02d%02d.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,", (i / 3600) % 24, (i / 60) % 60, i % 60);
+        n += put_nmea(&buf[n], body);
+        n += put_nmea(&buf[n], "GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54");
+        for (k = 1; k <= 3; k++) {
+            sprintf(body, "GPGSV,3,%d,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,3%d", k, k);
+            n += put_nmea(&buf[n], body);
+        }
+        n += put_nmea(&buf[n], "GPVTG,77.52,T,,M,0.004,N,0.008,K,A");
+        expected->nb_nmea += 7;
+        switch (i % 10) {
+            case 3: /* corrupted UBX checksum */
+                k = put_ubx(&buf[n], 0x01, 0x20, timegps, sizeof timegps);
+                buf[n + k - 1] ^= 0x55;
+                n += k;
+                break;
+            case 5: /* garbage, including false sync chars */
+                memcpy(&buf[n], "\xB5\x00$$\x01\x02\xB5\x62\xFF\xFF", 10);
+                n += 10;
+                break;
+            case 7: /* sentence without CR, then a corrupted one */
+                k = put_nmea(&buf[n], "GPGLL,4717.11364,N,00833.91565,E,092321.00,A,A");
+                buf[n + k - 2] = '\n';
+                n += k - 1;
+                expected->nb_nmea += 1;
+                k = put_nmea(&buf[n], "GPGLL,4717.11364,N,00833.91565,E,092321.00,A,A");
+                buf[n + 5] = 'X';
+                n += k;
+                break;
+            default:
+                break;
+        }
+    }
+    return n;
+}
+
+/* feed the capture by reads of read_size bytes, in place in the ring buffer */
+static void run_stream(const char *capture, int size, int read_size, struct frame_count_s *count) {
+    struct gps_stream_s s;
+    char *p;
+    size_t room;
+    int n = 0, r;
+
+    memset(count, 0, sizeof *count);
+    gps_stream_init(&s, count_ubx, count_nmea, count);
+    while (n < size) {
+        p = gps_stream_wr_ptr(&s, &room);
+        r = ((size - n) < read_size) ? (size - n) : read_size;
+        if (r > (int)room) {
+            r = (int)room;
+        }
+        memcpy(p, &capture[n], r); /* stands for read() */
+        gps_stream_commit(&s, r);
+        n += r;
+    }
+}
+
+/* framing part of lgw_parse_ubx: frame size if complete and valid, 0 if incomplete, -1 if invalid */
+static int legacy_ubx(const char *buff, size_t size) {
+    size_t msg_size, i;
+    uint8_t ck_a = 0, ck_b = 0;
+
+    if ((size < 8) || (buff[1] != (char)0x62)) {
+        return -1;
+    }
+    msg_size = 8 + ((uint8_t)buff[4] | ((uint8_t)buff[5] << 8));
+    if (msg_size > size) {
+        return 0;
+    }
+    for (i = 2; i < (msg_size - 2); i++) {
+        ck_a += (uint8_t)buff[i];
+        ck_b += ck_a;
+    }
+    return ((ck_a == (uint8_t)buff[msg_size - 2]) && (ck_b == (uint8_t)buff[msg_size - 1])) ? (int)msg_size : -1;
+}
+
+/* checksum check of lgw_parse_nmea */
+static bool legacy_nmea(const char *buff, size_t size) {
+    uint8_t ck = 0;
+    size_t i;
+    char hex[3];
+
+    for (i = 1; (i < size) && (buff[i] != '*'); i++) {
+        ck ^= (uint8_t)buff[i];
+    }
+    if ((i + 2) >= size) {
+        return false;
+    }
+    sprintf(hex, "%02X", ck);
+    return (buff[i + 1] == hex[0]) && (buff[i + 2] == hex[1]);
+}
+
+/* former thread_gps loop, same reads */
+static void run_legacy(const char *capture, int size, int read_size, struct frame_count_s *count) {
+    char serial_buff[LEGACY_BUFF_SIZE];
+    size_t wr_idx = 0;
+    int n = 0, r, x;
+
+    memset(count, 0, sizeof *count);
+    while (n < size) {
+        size_t rd_idx = 0;
+        size_t frame_end_idx = 0;
+
+        r = ((size - n) < read_size) ? (size - n) : read_size;
+        memcpy(serial_buff + wr_idx, &capture[n], r);
+        n += r;
+        wr_idx += r;
+        while (rd_idx < wr_idx) {
+            size_t frame_size = 0;
+            if (serial_buff[rd_idx] == (char)0xB5) {
+                x = legacy_ubx(&serial_buff[rd_idx], wr_idx - rd_idx);
+                if (x > 0) {
+                    frame_size = x;
+                    count_ubx(&serial_buff[rd_idx], frame_size, count);
+                }
+            } else if (serial_buff[rd_idx] == '$') {
+                char *nmea_end_ptr = memchr(&serial_buff[rd_idx], 0x0a, wr_idx - rd_idx);
+                if (nmea_end_ptr) {
+                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
+                    if (legacy_nmea(&serial_buff[rd_idx], frame_size) == true) {
+                        count_nmea(&serial_buff[rd_idx], frame_size, count);
+                    } else {
+                        frame_size = 0;
+                    }
+                }
+            }
+            if (frame_size > 0) {
+                rd_idx += frame_size;
+                frame_end_idx = rd_idx;
+            } else {
+                rd_idx++;
+            }
+        }
+        if (frame_end_idx) {
+            memmove(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
+            wr_idx -= frame_end_idx;
+        }
+        if ((sizeof(serial_buff) - wr_idx) < (size_t)read_size) {
+            memmove(serial_buff, &serial_buff[read_size], wr_idx - read_size);
+            wr_idx -= read_size;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    int nb_loop = NB_LOOP_DEFAULT;
+    int read_size = READ_SIZE_DEFAULT;
+    const char *path = NULL;
+    FILE *f;
+    char *capture;
+    int size;
+    struct frame_count_s expected, ref, count;
+    struct timespec start, stop;
+    double t_legacy, t_stream;
+    int nb_err = 0;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hf:l:r:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'f':
+                path = optarg;
+                break;
+            case 'l':
+            case 'r':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || ((i == 'r') && (arg_u > GPS_STREAM_RING_SIZE))) {
+                    printf("ERROR: argument parsing of -%c argument. Use -h to print help\n", i);
+                    return EXIT_FAILURE;
+                }
+                if (i == 'l') {
+                    nb_loop = (int)arg_u;
+                } else {
+                    read_size = (int)arg_u;
+                }
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    capture = malloc(CAPTURE_MAX);
+    if (capture == NULL) {
+        printf("ERROR: malloc failed\n");
+        return EXIT_FAILURE;
+    }
+    if (path != NULL) {
+        f = fopen(path, "rb");
+        if (f == NULL) {
+            printf("ERROR: impossible to open %s\n", path);
+            free(capture);
+            return EXIT_FAILURE;
+        }
+        size = (int)fread(capture, 1, CAPTURE_MAX, f);
+        fclose(f);
+        run_stream(capture, size, size, &expected); /* whole capture in one read as reference */
+        printf("INFO: capture %s, %d bytes\n", path, size);
+    } else {
+        size = make_capture(capture, NB_SECONDS_DEFAULT, &expected);
+        printf("INFO: synthetic capture, %d bytes, %u UBX and %u NMEA valid frames\n", size, expected.nb_ubx, expected.nb_nmea);
+        run_stream(capture, size, size, &ref);
+        if ((ref.nb_ubx != expected.nb_ubx) || (ref.nb_nmea != expected.nb_nmea)) {
+            printf("ERROR: %u UBX and %u NMEA frames found\n", ref.nb_ubx, ref.nb_nmea);
+            nb_err += 1;
+        }
+        expected.hash = ref.hash;
+    }
+
+    /* same frames whatever the size of the reads and their position in the ring */
+    for (i = 1; i <= 64; i++) {
+        run_stream(capture, size, i, &count);
+        if ((count.nb_ubx != expected.nb_ubx) || (count.nb_nmea != expected.nb_nmea) || (count.hash != expected.hash)) {
+            printf("ERROR: reads of %d bytes: %u UBX and %u NMEA frames, hash %08X instead of %08X\n", i, count.nb_ubx, count.nb_nmea, count.hash, expected.hash);
+            nb_err += 1;
+        }
+    }
+    printf("INFO: framing %s for reads of 1 to 64 bytes\n", (nb_err == 0) ? "OK" : "FAILED");
+
+    /* throughput */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nb_loop; i++) {
+        run_legacy(capture, size, read_size, &ref);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_legacy = difftimespec(stop, start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nb_loop; i++) {
+        run_stream(capture, size, read_size, &count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_stream = difftimespec(stop, start);
+
+    printf("INFO: former scan, reads of %d bytes: %.1f MB/s, %u UBX and %u NMEA frames\n", read_size, (double)size * nb_loop / t_legacy / 1E6, ref.nb_ubx, ref.nb_nmea);
+    printf("INFO: gps_stream,  reads of %d bytes: %.1f MB/s, %u UBX and %u NMEA frames (x%.2f)\n", read_size, (double)size * nb_loop / t_stream / 1E6, count.nb_ubx, count.nb_nmea, t_legacy / t_stream);
+
+    free(capture);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
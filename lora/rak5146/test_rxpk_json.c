@@ -0,0 +1,257 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Check that the rxpk encoder output is identical to the snprintf based
+    serialization and compare their speed
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt */
+#include <math.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "loragw_hal.h"
+#include "base64.h"
+#include "rxpk_json.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define RAND_RANGE(min, max) (rand() % (max + 1 - min) + min)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_PKT_DEFAULT  1000
+#define NB_LOOP_DEFAULT 200
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -n <uint>  Number of random packets [1..65535]\n");
+    printf(" -l <uint>  Number of serialization loops over the packets\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+/* reference: serialization done by thread_up() before rxpk_json_serialize() */
+static int legacy_serialize(const struct lgw_pkt_rx_s *p, const struct timespec *utc, const struct timespec *gps, char *buff, int max_len) {
+    int idx = 0;
+    int j;
+    struct tm * x;
+    uint64_t pkt_gps_time_ms;
+    const char * dr[] = {"SF5", "SF6", "SF7", "SF8", "SF9", "SF10", "SF11", "SF12"};
+
+    idx += snprintf(buff + idx, max_len - idx, "{\"jver\":%d", 1);
+    idx += snprintf(buff + idx, max_len - idx, ",\"tmst\":%u", p->count_us);
+    if (utc != NULL) {
+        x = gmtime(&(utc->tv_sec));
+        idx += snprintf(buff + idx, max_len - idx, ",\"time\":\"%04i-%02i-%02iT%02i:%02i:%02i.%06liZ\"", (x->tm_year)+1900, (x->tm_mon)+1, x->tm_mday, x->tm_hour, x->tm_min, x->tm_sec, (utc->tv_nsec)/1000);
+    }
+    if (gps != NULL) {
+        pkt_gps_time_ms = gps->tv_sec * 1E3 + gps->tv_nsec / 1E6;
+        idx += snprintf(buff + idx, max_len - idx, ",\"tmms\":%" PRIu64 "", pkt_gps_time_ms);
+    }
+    if (p->ftime_received == true) {
+        idx += snprintf(buff + idx, max_len - idx, ",\"ftime\":%u", p->ftime);
+    }
+    idx += snprintf(buff + idx, max_len - idx, ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf,\"mid\":%2u", p->if_chain, p->rf_chain, ((double)p->freq_hz / 1e6), p->modem_id);
+    idx += snprintf(buff + idx, max_len - idx, ",\"stat\":%s", (p->status == STAT_CRC_OK) ? "1" : ((p->status == STAT_CRC_BAD) ? "-1" : "0"));
+    if (p->modulation == MOD_LORA) {
+        idx += snprintf(buff + idx, max_len - idx, ",\"modu\":\"LORA\",\"datr\":\"%sBW%s\"", dr[p->datarate - 5], (p->bandwidth == BW_125KHZ) ? "125" : ((p->bandwidth == BW_250KHZ) ? "250" : "500"));
+        idx += snprintf(buff + idx, max_len - idx, ",\"codr\":\"%s\"", (p->coderate == 0) ? "OFF" : ((p->coderate == CR_LORA_4_5) ? "4/5" : ((p->coderate == CR_LORA_4_6) ? "4/6" : ((p->coderate == CR_LORA_4_7) ? "4/7" : "4/8"))));
+        idx += snprintf(buff + idx, max_len - idx, ",\"rssis\":%.0f", roundf(p->rssis));
+        idx += snprintf(buff + idx, max_len - idx, ",\"lsnr\":%.1f", p->snr);
+        idx += snprintf(buff + idx, max_len - idx, ",\"foff\":%d", p->freq_offset);
+    } else {
+        idx += snprintf(buff + idx, max_len - idx, ",\"modu\":\"FSK\"");
+        idx += snprintf(buff + idx, max_len - idx, ",\"datr\":%u", p->datarate);
+    }
+    idx += snprintf(buff + idx, max_len - idx, ",\"rssi\":%.0f,\"size\":%u", roundf(p->rssic), p->size);
+    idx += snprintf(buff + idx, max_len - idx, ",\"data\":\"");
+    j = bin_to_b64(p->payload, p->size, buff + idx, 341);
+    if (j < 0) {
+        return -1;
+    }
+    idx += j;
+    idx += snprintf(buff + idx, max_len - idx, "\"}");
+
+    return idx;
+}
+
+static void random_packet(struct lgw_pkt_rx_s *p) {
+    const uint8_t bw[] = {BW_125KHZ, BW_250KHZ, BW_500KHZ};
+    int i;
+
+    memset(p, 0, sizeof *p);
+    p->freq_hz = RAND_RANGE(863000000, 928000000);
+    p->freq_offset = RAND_RANGE(0, 40000) - 20000;
+    p->if_chain = RAND_RANGE(0, 9);
+    p->rf_chain = RAND_RANGE(0, 1);
+    p->modem_id = RAND_RANGE(0, 15);
+    p->count_us = (uint32_t)rand() * 2 + RAND_RANGE(0, 1);
+    p->ftime_received = (rand() % 2) ? true : false;
+    p->ftime = (uint32_t)rand();
+    switch (rand() % 3) {
+        case 0: p->status = STAT_CRC_OK; break;
+        case 1: p->status = STAT_CRC_BAD; break;
+        default: p->status = STAT_NO_CRC; break;
+    }
+    if ((rand() % 10) != 0) {
+        p->modulation = MOD_LORA;
+        p->datarate = RAND_RANGE(DR_LORA_SF5, DR_LORA_SF12);
+        p->bandwidth = bw[rand() % 3];
+        p->coderate = RAND_RANGE(0, 4);
+    } else {
+        p->modulation = MOD_FSK;
+        p->datarate = RAND_RANGE(500, 250000);
+        p->bandwidth = BW_125KHZ;
+    }
+    /* SX1302 RSSI/SNR are fractional, make sure rounding ties are covered */
+    p->rssic = (float)RAND_RANGE(-5600, 0) / 40.0f;
+    p->rssis = (float)RAND_RANGE(-5600, 0) / 40.0f;
+    p->snr = (float)RAND_RANGE(-1000, 600) / 40.0f;
+    p->size = RAND_RANGE(1, 255);
+    for (i = 0; i < p->size; i++) {
+        p->payload[i] = (uint8_t)rand();
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, l, x;
+    unsigned int arg_u;
+    int nb_pkt = NB_PKT_DEFAULT;
+    int nb_loop = NB_LOOP_DEFAULT;
+    struct lgw_pkt_rx_s * pkts;
+    struct timespec * utc;
+    struct timespec * gps;
+    char buff_ref[RXPK_JSON_MAX_SIZE + 1];
+    char buff_new[RXPK_JSON_MAX_SIZE + 1];
+    int len_ref, len_new;
+    int nb_err = 0;
+    struct timespec start, stop;
+    double t_ref, t_new;
+    volatile int sink = 0;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:l:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > 65535)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_pkt = (int)arg_u;
+                break;
+            case 'l':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = (int)arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    pkts = malloc(nb_pkt * sizeof *pkts);
+    utc = malloc(nb_pkt * sizeof *utc);
+    gps = malloc(nb_pkt * sizeof *gps);
+    if ((pkts == NULL) || (utc == NULL) || (gps == NULL)) {
+        printf("ERROR: failed to allocate %d packets\n", nb_pkt);
+        return EXIT_FAILURE;
+    }
+
+    srand(time(NULL));
+    for (i = 0; i < nb_pkt; i++) {
+        random_packet(&pkts[i]);
+        utc[i].tv_sec = 1577836800 + RAND_RANGE(0, 315360000);
+        utc[i].tv_nsec = RAND_RANGE(0, 999999) * 1000 + RAND_RANGE(0, 999);
+        gps[i].tv_sec = utc[i].tv_sec - 315964800 + 18;
+        gps[i].tv_nsec = utc[i].tv_nsec;
+    }
+
+    /* check that both serializations are byte-identical, with and without GPS time */
+    for (i = 0; i < nb_pkt; i++) {
+        len_ref = legacy_serialize(&pkts[i], (i % 2) ? &utc[i] : NULL, (i % 2) ? &gps[i] : NULL, buff_ref, sizeof buff_ref);
+        len_new = rxpk_json_serialize(&pkts[i], 1, (i % 2) ? &utc[i] : NULL, (i % 2) ? &gps[i] : NULL, buff_new, sizeof buff_new);
+        if ((len_ref != len_new) || (memcmp(buff_ref, buff_new, len_ref) != 0)) {
+            if (nb_err < 5) {
+                printf("ERROR: packet %d serialization mismatch\n  ref: %.*s\n  new: %.*s\n", i, len_ref, buff_ref, (len_new > 0) ? len_new : 0, buff_new);
+            }
+            nb_err += 1;
+        }
+    }
+    printf("INFO: %d/%d packets serialized identically\n", nb_pkt - nb_err, nb_pkt);
+
+    /* measure both serializations */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < nb_pkt; i++) {
+            sink += legacy_serialize(&pkts[i], &utc[i], &gps[i], buff_ref, sizeof buff_ref);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_ref = difftimespec(stop, start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < nb_pkt; i++) {
+            sink += rxpk_json_serialize(&pkts[i], 1, &utc[i], &gps[i], buff_new, sizeof buff_new);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_new = difftimespec(stop, start);
+
+    printf("INFO: snprintf serialization: %.3f us/packet\n", 1E6 * t_ref / ((double)nb_pkt * nb_loop));
+    printf("INFO: rxpk_json_serialize:    %.3f us/packet (x%.2f)\n", 1E6 * t_new / ((double)nb_pkt * nb_loop), t_ref / t_new);
+
+    free(pkts);
+    free(utc);
+    free(gps);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,354 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Check that the streaming txpk parser gives the same fields as the parson
+    based parser, or falls back to it, and compare their speed. The parson
+    based parser decodes "data" with the libtools b64_to_bin(), as the packet
+    forwarder did before the streaming parser.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt */
+#include <time.h>
+
+#include "loragw_hal.h"
+#include "base64.h"
+#include "txpk_json.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define RAND_RANGE(min, max) (rand() % (max + 1 - min) + min)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_PKT_DEFAULT  1000
+#define NB_LOOP_DEFAULT 200
+#define JSON_MAX_SIZE   1000
+
+/* parsing stops at the null char ending the JSON string */
+static const char trailing_null[] = "{\"txpk\":{\"imme\":true,\"freq\":868.1}}\0garbage";
+
+/* layouts the streaming parser must leave to parson, or parse like it */
+static const char * edge_cases[] = {
+    "{\"txpk\":{}}",
+    " {\r\n \"txpk\" : { \"imme\" : true , \"freq\" : 868.1 } } \n",
+    "{\"txpk\":{\"imme\":1,\"freq\":868.1}}",
+    "{\"txpk\":{\"imme\":false,\"tmst\":\"12\"}}",
+    "{\"txpk\":{\"modu\":\"LO\\u0052A\",\"datr\":\"SF7BW125\"}}",
+    "{\"txpk\":{\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"modu\":\"FSK\"}}",
+    "{\"txpk\":{\"modu\":null}}",
+    "{\"txpk\":{\"size\":12,\"data\":\"YWJj\",\"brd\":{\"a\":[1,2]}}}",
+    "{\"txpk\":{\"ant\":0,\"brd\":null,\"note\":\"x\",\"ok\":false}}",
+    "{\"txpk\":{\"freq\":1e400}}",
+    "{\"txpk\":{\"freq\":-0.5e-3,\"powe\":14,\"rfch\":0}}",
+    "{\"txpk\":{\"freq\":01}}",
+    "{\"txpk\":{\"freq\":.5}}",
+    "{\"txpk\":{\"freq\":868.100000000000000000000000000000000001}}",
+    "{\"txpk\":{\"ncrc\":\"yes\",\"nhdr\":0,\"ipol\":true}}",
+    "{\"txpk\":{\"datr\":50000,\"fdev\":3000,\"modu\":\"FSK\"}}",
+    "{\"txpk\":{\"datr\":true}}",
+    "{\"txpk\":{\"data\":\"AAEC\xc3\xa9\"}}",
+    "{\"txpk\":{\"size\":2,\"data\":\"YWI\"}}",
+    "{\"txpk\":{\"size\":1,\"data\":\"YQ\"}}",
+    "{\"txpk\":{\"size\":1,\"data\":\"Y\"}}",
+    "{\"txpk\":{\"size\":0,\"data\":\"\"}}",
+    "{\"txpk\":{\"size\":1,\"data\":\"YQ=\"}}",
+    "{\"txpk\":{\"imme\":true /* comment */}}",
+    "{\"txpk\":{\"imme\":true},\"other\":1}",
+    "{\"other\":1,\"txpk\":{\"imme\":true}}",
+    "{\"txpk\":[1,2]}",
+    "{\"txpk\":{\"imme\":true}",
+    "{\"txpk\":{\"imme\":true,}}",
+    "{\"txpk\":{\"imme\" true}}",
+    "{\"txpk\":{\"imme\":tru}}",
+    "{\"rxpk\":{}}",
+    "[]",
+    "",
+    "not json"
+};
+
+#define NB_EDGE_CASES   (sizeof edge_cases / sizeof edge_cases[0])
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+void usage(void) {
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -n <uint>  Number of random txpk objects [1..65535]\n");
+    printf(" -l <uint>  Number of parsing loops over the txpk objects\n");
+}
+
+static double difftimespec(struct timespec end, struct timespec beginning) {
+    return (double)(end.tv_sec - beginning.tv_sec) + 1E-9 * (double)(end.tv_nsec - beginning.tv_nsec);
+}
+
+static const char * random_ws(void) {
+    const char * ws[] = {"", "", "", " ", "\n  ", "\t"};
+    return ws[rand() % 6];
+}
+
+/* txpk object as sent by network servers, members in random order, sometimes
+   missing or unknown */
+static int random_txpk(char *buff, int max_len) {
+    char members[20][384];
+    char tmp[384];
+    int nb = 0;
+    int idx = 0;
+    int i, j, size;
+    uint8_t payload[256];
+    char b64[344];
+    const char * codr[] = {"4/5", "4/6", "4/7", "4/8", "2/3", "1/2"};
+    const int bw[] = {125, 250, 500};
+    bool lora = (rand() % 5) != 0;
+
+    if (rand() % 3) {
+        snprintf(members[nb++], sizeof members[0], "\"imme\":%s", (rand() % 4) ? "false" : "true");
+    }
+    if (rand() % 4) {
+        snprintf(members[nb++], sizeof members[0], "\"tmst\":%u", (uint32_t)rand() * 2 + RAND_RANGE(0, 1));
+    } else {
+        snprintf(members[nb++], sizeof members[0], "\"tmms\":%u%03u", (unsigned)RAND_RANGE(1000000, 1999999), (unsigned)RAND_RANGE(0, 999));
+    }
+    snprintf(members[nb++], sizeof members[0], "\"freq\":%u.%0*u", (unsigned)RAND_RANGE(863, 928), RAND_RANGE(1, 6), (unsigned)RAND_RANGE(0, 9));
+    snprintf(members[nb++], sizeof members[0], "\"rfch\":%d", RAND_RANGE(0, 1));
+    if (rand() % 8) {
+        snprintf(members[nb++], sizeof members[0], "\"powe\":%d", RAND_RANGE(-6, 27));
+    }
+    if (lora) {
+        snprintf(members[nb++], sizeof members[0], "\"modu\":\"LORA\"");
+        snprintf(members[nb++], sizeof members[0], "\"datr\":\"SF%dBW%d\"", RAND_RANGE(5, 12), bw[rand() % 3]);
+        snprintf(members[nb++], sizeof members[0], "\"codr\":\"%s\"", codr[rand() % 6]);
+        snprintf(members[nb++], sizeof members[0], "\"ipol\":%s", (rand() % 2) ? "true" : "false");
+    } else {
+        snprintf(members[nb++], sizeof members[0], "\"modu\":\"FSK\"");
+        snprintf(members[nb++], sizeof members[0], "\"datr\":%d", RAND_RANGE(500, 250000));
+        snprintf(members[nb++], sizeof members[0], "\"fdev\":%d", RAND_RANGE(1000, 125000));
+    }
+    if (rand() % 2) {
+        snprintf(members[nb++], sizeof members[0], "\"prea\":%d", RAND_RANGE(4, 16));
+    }
+    if (rand() % 4 == 0) {
+        snprintf(members[nb++], sizeof members[0], "\"ncrc\":%s", (rand() % 2) ? "true" : "false");
+    }
+    if (rand() % 8 == 0) {
+        snprintf(members[nb++], sizeof members[0], "\"nhdr\":%s", (rand() % 2) ? "true" : "false");
+    }
+    if (rand() % 8 == 0) {
+        snprintf(members[nb++], sizeof members[0], "\"brd\":%d,\"ant\":%d", RAND_RANGE(0, 1), RAND_RANGE(0, 1));
+    }
+    size = RAND_RANGE(0, 255);
+    for (i = 0; i < size; i++) {
+        payload[i] = (uint8_t)rand();
+    }
+    j = bin_to_b64(payload, size, b64, sizeof b64);
+    if ((rand() % 4) == 0) {
+        /* some network servers send unpadded base64 */
+        while ((j > 0) && (b64[j - 1] == '=')) {
+            b64[--j] = '\0';
+        }
+    }
+    snprintf(members[nb++], sizeof members[0], "\"size\":%d", (rand() % 16) ? size : RAND_RANGE(0, 255));
+    snprintf(members[nb++], sizeof members[0], "\"data\":\"%s\"", b64);
+
+    /* shuffle */
+    for (i = nb - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        memcpy(tmp, members[i], sizeof tmp);
+        memcpy(members[i], members[j], sizeof tmp);
+        memcpy(members[j], tmp, sizeof tmp);
+    }
+
+    idx += snprintf(buff + idx, max_len - idx, "{%s\"txpk\":%s{", random_ws(), random_ws());
+    for (i = 0; i < nb; i++) {
+        idx += snprintf(buff + idx, max_len - idx, "%s%s%s", (i > 0) ? "," : "", random_ws(), members[i]);
+    }
+    idx += snprintf(buff + idx, max_len - idx, "%s}}", random_ws());
+
+    return idx;
+}
+
+static bool same_txpk(const struct txpk_json_s *a, const uint8_t *pa, const struct txpk_json_s *b, const uint8_t *pb) {
+    if ((a->fields != b->fields) || (a->imme != b->imme) || (a->ipol != b->ipol) || (a->ncrc != b->ncrc) || (a->nhdr != b->nhdr)) {
+        return false;
+    }
+    if ((a->tmst != b->tmst) || (a->tmms != b->tmms) || (a->freq != b->freq) || (a->rfch != b->rfch) || (a->powe != b->powe)) {
+        return false;
+    }
+    if ((a->prea != b->prea) || (a->size != b->size) || (a->fdev != b->fdev) || (a->datr_num != b->datr_num)) {
+        return false;
+    }
+    if ((strcmp(a->modu, b->modu) != 0) || (strcmp(a->datr, b->datr) != 0) || (strcmp(a->codr, b->codr) != 0)) {
+        return false;
+    }
+    if (a->data_size != b->data_size) {
+        return false;
+    }
+    if ((a->data_size > 0) && (memcmp(pa, pb, a->data_size) != 0)) {
+        return false;
+    }
+    return true;
+}
+
+/* streaming parser must either fall back, or give the same result as parson */
+static bool check_json(const char *json, int len, bool expect_streamed) {
+    struct txpk_json_s txpk_ref, txpk_new;
+    uint8_t payload_ref[256];
+    uint8_t payload_new[256];
+    int x_ref, x_new;
+
+    memset(payload_ref, 0, sizeof payload_ref);
+    memset(payload_new, 0, sizeof payload_new);
+    x_ref = txpk_json_parse_dom(json, &txpk_ref, payload_ref, sizeof payload_ref);
+    x_new = txpk_json_parse(json, len, &txpk_new, payload_new, sizeof payload_new);
+    if (x_new == TXPK_JSON_FALLBACK) {
+        if (expect_streamed) {
+            printf("ERROR: unexpected fallback for %.*s\n", len, json);
+            return false;
+        }
+        return true;
+    }
+    if (x_new != TXPK_JSON_OK) {
+        printf("ERROR: unexpected return code %d for %.*s\n", x_new, len, json);
+        return false;
+    }
+    if (x_ref != TXPK_JSON_OK) {
+        printf("ERROR: parson rejects (%d) what the streaming parser accepts: %.*s\n", x_ref, len, json);
+        return false;
+    }
+    if (!same_txpk(&txpk_ref, payload_ref, &txpk_new, payload_new)) {
+        printf("ERROR: txpk mismatch for %.*s\n", len, json);
+        return false;
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, l, x;
+    unsigned int arg_u;
+    int nb_pkt = NB_PKT_DEFAULT;
+    int nb_loop = NB_LOOP_DEFAULT;
+    char (* jsons)[JSON_MAX_SIZE];
+    int * lens;
+    struct txpk_json_s txpk;
+    uint8_t payload[256];
+    int nb_err = 0;
+    struct timespec start, stop;
+    double t_ref, t_new;
+    volatile int sink = 0;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:l:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1) || (arg_u > 65535)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_pkt = (int)arg_u;
+                break;
+            case 'l':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u < 1)) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = (int)arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    jsons = malloc(nb_pkt * sizeof *jsons);
+    lens = malloc(nb_pkt * sizeof *lens);
+    if ((jsons == NULL) || (lens == NULL)) {
+        printf("ERROR: failed to allocate %d txpk objects\n", nb_pkt);
+        return EXIT_FAILURE;
+    }
+
+    /* edge cases */
+    for (i = 0; i < (int)NB_EDGE_CASES; i++) {
+        if (check_json(edge_cases[i], strlen(edge_cases[i]), false) == false) {
+            nb_err += 1;
+        }
+    }
+    if (check_json(trailing_null, sizeof trailing_null - 1, true) == false) {
+        nb_err += 1;
+    }
+    printf("INFO: %d edge cases checked\n", (int)NB_EDGE_CASES);
+
+    /* usual layouts, all handled by the streaming parser */
+    srand(time(NULL));
+    for (i = 0; i < nb_pkt; i++) {
+        lens[i] = random_txpk(jsons[i], JSON_MAX_SIZE);
+        if (check_json(jsons[i], lens[i], true) == false) {
+            nb_err += 1;
+        }
+    }
+    printf("INFO: %d random txpk objects checked, %d errors\n", nb_pkt, nb_err);
+
+    /* measure both parsers */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < nb_pkt; i++) {
+            sink += txpk_json_parse_dom(jsons[i], &txpk, payload, sizeof payload);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_ref = difftimespec(stop, start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < nb_pkt; i++) {
+            sink += txpk_json_parse(jsons[i], lens[i], &txpk, payload, sizeof payload);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_new = difftimespec(stop, start);
+
+    printf("INFO: parson parsing:    %.3f us/packet\n", 1E6 * t_ref / ((double)nb_pkt * nb_loop));
+    printf("INFO: streaming parsing: %.3f us/packet (x%.2f)\n", 1E6 * t_new / ((double)nb_pkt * nb_loop), t_ref / t_new);
+
+    free(jsons);
+    free(lens);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
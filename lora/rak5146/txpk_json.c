@@ -0,0 +1,416 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Parsing of the "txpk" JSON object of PULL_RESP datagrams
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>         /* C99 types */
+#include <stdbool.h>        /* bool type */
+#include <stdlib.h>         /* strtod */
+#include <string.h>         /* memset, memcpy, strlen */
+#include <errno.h>          /* errno, rejected by parson on out of range numbers */
+
+#include "txpk_json.h"
+#include "base64_simd.h"
+#include "base64.h"
+#include "parson.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define NUMBER_MAX_LEN  32  /* longer numbers are left to parson */
+
+enum field_type_e {
+    FIELD_NUMBER,
+    FIELD_BOOL,
+    FIELD_STRING,
+    FIELD_DATR      /* string or number */
+};
+
+struct field_s {
+    const char *name;
+    uint32_t flag;
+    enum field_type_e type;
+};
+
+static const struct field_s txpk_fields[] = {
+    {"imme", TXPK_FIELD_IMME, FIELD_BOOL},
+    {"tmst", TXPK_FIELD_TMST, FIELD_NUMBER},
+    {"tmms", TXPK_FIELD_TMMS, FIELD_NUMBER},
+    {"freq", TXPK_FIELD_FREQ, FIELD_NUMBER},
+    {"rfch", TXPK_FIELD_RFCH, FIELD_NUMBER},
+    {"powe", TXPK_FIELD_POWE, FIELD_NUMBER},
+    {"modu", TXPK_FIELD_MODU, FIELD_STRING},
+    {"datr", TXPK_FIELD_DATR_NUM, FIELD_DATR},
+    {"codr", TXPK_FIELD_CODR, FIELD_STRING},
+    {"ipol", TXPK_FIELD_IPOL, FIELD_BOOL},
+    {"prea", TXPK_FIELD_PREA, FIELD_NUMBER},
+    {"size", TXPK_FIELD_SIZE, FIELD_NUMBER},
+    {"data", TXPK_FIELD_DATA, FIELD_STRING},
+    {"ncrc", TXPK_FIELD_NCRC, FIELD_BOOL},
+    {"nhdr", TXPK_FIELD_NHDR, FIELD_BOOL},
+    {"fdev", TXPK_FIELD_FDEV, FIELD_NUMBER}
+};
+
+#define TXPK_FIELDS_NB  (sizeof txpk_fields / sizeof txpk_fields[0])
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static const char * skip_ws(const char *p, const char *end) {
+    while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r'))) {
+        p++;
+    }
+    return p;
+}
+
+/* string starting after its opening quote; return pointer on the closing
+   quote, NULL if not terminated or if it contains escapes, control or
+   non-ASCII chars (UTF-8 is checked by parson) */
+static const char * scan_string(const char *p, const char *end) {
+    while (p < end) {
+        if (*p == '"') {
+            return p;
+        }
+        if ((*p == '\\') || ((unsigned char)*p < 0x20) || ((unsigned char)*p >= 0x80)) {
+            return NULL;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+/* JSON number grammar; return pointer after the number, NULL if invalid */
+static const char * scan_number(const char *p, const char *end) {
+    if ((p < end) && (*p == '-')) {
+        p++;
+    }
+    if ((p < end) && (*p == '0')) {
+        p++;
+    } else if ((p < end) && (*p >= '1') && (*p <= '9')) {
+        while ((p < end) && (*p >= '0') && (*p <= '9')) p++;
+    } else {
+        return NULL;
+    }
+    if ((p < end) && (*p == '.')) {
+        p++;
+        if ((p == end) || (*p < '0') || (*p > '9')) {
+            return NULL;
+        }
+        while ((p < end) && (*p >= '0') && (*p <= '9')) p++;
+    }
+    if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+        p++;
+        if ((p < end) && ((*p == '+') || (*p == '-'))) {
+            p++;
+        }
+        if ((p == end) || (*p < '0') || (*p > '9')) {
+            return NULL;
+        }
+        while ((p < end) && (*p >= '0') && (*p <= '9')) p++;
+    }
+    return p;
+}
+
+static bool match_literal(const char *p, const char *end, const char *lit, int n) {
+    return (((end - p) >= n) && (memcmp(p, lit, n) == 0));
+}
+
+static void copy_string(char *dst, int max_len, const char *src, int len) {
+    if (len > (max_len - 1)) {
+        len = max_len - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void set_string_field(struct txpk_json_s *txpk, uint32_t flag, const char *str, int len, uint8_t *payload, int max_payload) {
+    switch (flag) {
+        case TXPK_FIELD_MODU:
+            copy_string(txpk->modu, sizeof txpk->modu, str, len);
+            break;
+        case TXPK_FIELD_DATR_NUM:
+            copy_string(txpk->datr, sizeof txpk->datr, str, len);
+            txpk->fields |= TXPK_FIELD_DATR;
+            break;
+        case TXPK_FIELD_CODR:
+            copy_string(txpk->codr, sizeof txpk->codr, str, len);
+            break;
+        case TXPK_FIELD_DATA:
+            /* decoded straight from the datagram */
+            txpk->data_size = b64_to_bin_simd(str, len, payload, max_payload);
+            break;
+        default:
+            break;
+    }
+}
+
+static void set_number_field(struct txpk_json_s *txpk, uint32_t flag, double v) {
+    switch (flag) {
+        case TXPK_FIELD_TMST: txpk->tmst = v; break;
+        case TXPK_FIELD_TMMS: txpk->tmms = v; break;
+        case TXPK_FIELD_FREQ: txpk->freq = v; break;
+        case TXPK_FIELD_RFCH: txpk->rfch = v; break;
+        case TXPK_FIELD_POWE: txpk->powe = v; break;
+        case TXPK_FIELD_PREA: txpk->prea = v; break;
+        case TXPK_FIELD_SIZE: txpk->size = v; break;
+        case TXPK_FIELD_FDEV: txpk->fdev = v; break;
+        case TXPK_FIELD_DATR_NUM: txpk->datr_num = v; break;
+        default: break;
+    }
+}
+
+static void set_bool_field(struct txpk_json_s *txpk, uint32_t flag, bool v) {
+    switch (flag) {
+        case TXPK_FIELD_IMME: txpk->imme = v; break;
+        case TXPK_FIELD_IPOL: txpk->ipol = v; break;
+        case TXPK_FIELD_NCRC: txpk->ncrc = v; break;
+        case TXPK_FIELD_NHDR: txpk->nhdr = v; break;
+        default: break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+
+int txpk_json_parse(const char *json, int len, struct txpk_json_s *txpk, uint8_t *payload, int max_payload) {
+    const char *p = json;
+    const char *end = json + len;
+    const char *key, *str;
+    int key_len;
+    const struct field_s *field;
+    char number[NUMBER_MAX_LEN + 1];
+    double value;
+    unsigned i;
+
+    memset(txpk, 0, sizeof *txpk);
+
+    /* {"txpk":{ */
+    p = skip_ws(p, end);
+    if ((p == end) || (*p++ != '{')) {
+        return TXPK_JSON_FALLBACK;
+    }
+    p = skip_ws(p, end);
+    if (!match_literal(p, end, "\"txpk\"", 6)) {
+        return TXPK_JSON_FALLBACK;
+    }
+    p = skip_ws(p + 6, end);
+    if ((p == end) || (*p++ != ':')) {
+        return TXPK_JSON_FALLBACK;
+    }
+    p = skip_ws(p, end);
+    if ((p == end) || (*p++ != '{')) {
+        return TXPK_JSON_FALLBACK;
+    }
+    p = skip_ws(p, end);
+    if ((p < end) && (*p == '}')) {
+        p++;
+    } else {
+        /* members */
+        while (1) {
+            /* key */
+            if ((p == end) || (*p++ != '"')) {
+                return TXPK_JSON_FALLBACK;
+            }
+            key = p;
+            p = scan_string(p, end);
+            if (p == NULL) {
+                return TXPK_JSON_FALLBACK;
+            }
+            key_len = p - key;
+            p = skip_ws(p + 1, end);
+            if ((p == end) || (*p++ != ':')) {
+                return TXPK_JSON_FALLBACK;
+            }
+            p = skip_ws(p, end);
+            if (p == end) {
+                return TXPK_JSON_FALLBACK;
+            }
+
+            field = NULL;
+            if (key_len == 4) {
+                for (i = 0; i < TXPK_FIELDS_NB; i++) {
+                    if (memcmp(key, txpk_fields[i].name, 4) == 0) {
+                        field = &txpk_fields[i];
+                        break;
+                    }
+                }
+            }
+            if (field != NULL) {
+                if (txpk->fields & field->flag) {
+                    return TXPK_JSON_FALLBACK; /* duplicate key, rejected by parson */
+                }
+                txpk->fields |= field->flag;
+            }
+
+            /* value */
+            if (*p == '"') {
+                str = ++p;
+                p = scan_string(p, end);
+                if (p == NULL) {
+                    return TXPK_JSON_FALLBACK;
+                }
+                if (field != NULL) {
+                    if ((field->type != FIELD_STRING) && (field->type != FIELD_DATR)) {
+                        return TXPK_JSON_FALLBACK;
+                    }
+                    set_string_field(txpk, field->flag, str, p - str, payload, max_payload);
+                }
+                p++;
+            } else if ((*p == '-') || ((*p >= '0') && (*p <= '9'))) {
+                str = p;
+                p = scan_number(p, end);
+                if ((p == NULL) || ((p - str) > NUMBER_MAX_LEN)) {
+                    return TXPK_JSON_FALLBACK;
+                }
+                if (field != NULL) {
+                    if ((field->type != FIELD_NUMBER) && (field->type != FIELD_DATR)) {
+                        return TXPK_JSON_FALLBACK;
+                    }
+                    memcpy(number, str, p - str);
+                    number[p - str] = '\0';
+                    errno = 0;
+                    value = strtod(number, NULL);
+                    if (errno != 0) {
+                        return TXPK_JSON_FALLBACK;
+                    }
+                    set_number_field(txpk, field->flag, value);
+                }
+            } else if (match_literal(p, end, "true", 4) || match_literal(p, end, "false", 5)) {
+                if (field != NULL) {
+                    if (field->type != FIELD_BOOL) {
+                        return TXPK_JSON_FALLBACK;
+                    }
+                    set_bool_field(txpk, field->flag, (*p == 't'));
+                }
+                p += (*p == 't') ? 4 : 5;
+            } else if (match_literal(p, end, "null", 4) && (field == NULL)) {
+                p += 4;
+            } else {
+                /* object, array, null for a known field: left to parson */
+                return TXPK_JSON_FALLBACK;
+            }
+
+            /* next member */
+            p = skip_ws(p, end);
+            if (p == end) {
+                return TXPK_JSON_FALLBACK;
+            }
+            if (*p == '}') {
+                p++;
+                break;
+            }
+            if (*p++ != ',') {
+                return TXPK_JSON_FALLBACK;
+            }
+            p = skip_ws(p, end);
+        }
+    }
+
+    /* }, nothing after */
+    p = skip_ws(p, end);
+    if ((p == end) || (*p++ != '}')) {
+        return TXPK_JSON_FALLBACK;
+    }
+    p = skip_ws(p, end);
+    if ((p != end) && (*p != '\0')) {
+        return TXPK_JSON_FALLBACK;
+    }
+
+    return TXPK_JSON_OK;
+}
+
+int txpk_json_parse_dom(const char *json, struct txpk_json_s *txpk, uint8_t *payload, int max_payload) {
+    JSON_Value *root_val;
+    JSON_Object *txpk_obj;
+    JSON_Value *val;
+    const char *str;
+    unsigned i;
+
+    memset(txpk, 0, sizeof *txpk);
+
+    root_val = json_parse_string_with_comments(json);
+    if (root_val == NULL) {
+        return TXPK_JSON_INVALID;
+    }
+
+    /* look for JSON sub-object 'txpk' */
+    txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+    if (txpk_obj == NULL) {
+        json_value_free(root_val);
+        return TXPK_JSON_NO_TXPK;
+    }
+
+    for (i = 0; i < TXPK_FIELDS_NB; i++) {
+        val = json_object_get_value(txpk_obj, txpk_fields[i].name);
+        if (val == NULL) {
+            continue;
+        }
+        switch (txpk_fields[i].type) {
+            case FIELD_NUMBER:
+                /* any type, 0 if not a number */
+                txpk->fields |= txpk_fields[i].flag;
+                set_number_field(txpk, txpk_fields[i].flag, json_value_get_number(val));
+                break;
+            case FIELD_BOOL:
+                if (txpk_fields[i].flag == TXPK_FIELD_IMME) {
+                    /* true only if a JSON boolean true */
+                    txpk->fields |= txpk_fields[i].flag;
+                    txpk->imme = (json_value_get_boolean(val) == 1);
+                } else {
+                    /* any type, -1 if not a boolean */
+                    txpk->fields |= txpk_fields[i].flag;
+                    set_bool_field(txpk, txpk_fields[i].flag, (bool)json_value_get_boolean(val));
+                }
+                break;
+            case FIELD_STRING:
+                str = json_value_get_string(val);
+                if (str == NULL) {
+                    break;
+                }
+                txpk->fields |= txpk_fields[i].flag;
+                if (txpk_fields[i].flag == TXPK_FIELD_DATA) {
+                    /* decoded as before the streaming parser */
+                    txpk->data_size = b64_to_bin(str, strlen(str), payload, max_payload);
+                } else {
+                    set_string_field(txpk, txpk_fields[i].flag, str, strlen(str), payload, max_payload);
+                }
+                break;
+            case FIELD_DATR:
+                /* string for LoRa, number for FSK */
+                txpk->fields |= txpk_fields[i].flag;
+                txpk->datr_num = json_value_get_number(val);
+                str = json_value_get_string(val);
+                if (str != NULL) {
+                    set_string_field(txpk, txpk_fields[i].flag, str, strlen(str), payload, max_payload);
+                }
+                break;
+        }
+    }
+
+    /* free the JSON parse tree from memory */
+    json_value_free(root_val);
+
+    return TXPK_JSON_OK;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
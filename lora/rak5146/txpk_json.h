@@ -0,0 +1,111 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    Parsing of the "txpk" JSON object of PULL_RESP datagrams: single pass
+    streaming parser for the usual layout, parson for anything else
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_TXPK_JSON_H
+#define _LORA_PKTFWD_TXPK_JSON_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define TXPK_JSON_OK            0
+#define TXPK_JSON_FALLBACK      1   /* layout not handled by the streaming parser */
+#define TXPK_JSON_INVALID       -1  /* invalid JSON */
+#define TXPK_JSON_NO_TXPK       -2  /* no "txpk" object */
+
+/* fields found in the txpk object */
+#define TXPK_FIELD_IMME         (1 << 0)
+#define TXPK_FIELD_TMST         (1 << 1)
+#define TXPK_FIELD_TMMS         (1 << 2)
+#define TXPK_FIELD_FREQ         (1 << 3)
+#define TXPK_FIELD_RFCH         (1 << 4)
+#define TXPK_FIELD_POWE         (1 << 5)
+#define TXPK_FIELD_MODU         (1 << 6)    /* "modu" is a string */
+#define TXPK_FIELD_DATR         (1 << 7)    /* "datr" is a string (LoRa) */
+#define TXPK_FIELD_DATR_NUM     (1 << 8)    /* "datr" is present, datr_num is its value (FSK bitrate) */
+#define TXPK_FIELD_CODR         (1 << 9)    /* "codr" is a string */
+#define TXPK_FIELD_IPOL         (1 << 10)
+#define TXPK_FIELD_PREA         (1 << 11)
+#define TXPK_FIELD_SIZE         (1 << 12)
+#define TXPK_FIELD_DATA         (1 << 13)   /* "data" is a string */
+#define TXPK_FIELD_NCRC         (1 << 14)
+#define TXPK_FIELD_NHDR         (1 << 15)
+#define TXPK_FIELD_FDEV         (1 << 16)
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* txpk fields, with the values parson gives for them: numbers are 0 and
+   booleans true if the JSON type is wrong. Their interpretation (GPS time
+   conversion, TX enable, antenna gain...) is left to the caller */
+struct txpk_json_s {
+    uint32_t fields;    /* TXPK_FIELD_* found */
+    bool imme;          /* "imme" is true */
+    double tmst;
+    double tmms;
+    double freq;        /* in MHz */
+    double rfch;
+    double powe;
+    double prea;
+    double size;
+    double fdev;
+    double datr_num;
+    char modu[8];       /* strings truncated, null terminated */
+    char datr[16];
+    char codr[8];
+    bool ipol;
+    bool ncrc;
+    bool nhdr;
+    int data_size;      /* number of payload bytes decoded from "data", -1 if invalid */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Parse a PULL_RESP JSON payload in a single pass, without allocation
+@param json JSON payload of the PULL_RESP datagram
+@param len length of the JSON payload
+@param txpk txpk fields found
+@param payload buffer receiving the decoded "data" field
+@param max_payload size of the payload buffer
+@return TXPK_JSON_OK, or TXPK_JSON_FALLBACK if the payload is not a single
+"txpk" object with known fields of the expected types and strings without
+escape sequences: it must then be parsed by txpk_json_parse_dom()
+*/
+int txpk_json_parse(const char *json, int len, struct txpk_json_s *txpk, uint8_t *payload, int max_payload);
+
+/**
+@brief Parse a PULL_RESP JSON payload with parson, for any layout, "data" being
+decoded by b64_to_bin() as before the streaming parser
+@param json JSON payload of the PULL_RESP datagram, null terminated, comments allowed
+@param txpk txpk fields found
+@param payload buffer receiving the decoded "data" field
+@param max_payload size of the payload buffer
+@return TXPK_JSON_OK, TXPK_JSON_INVALID or TXPK_JSON_NO_TXPK
+*/
+int txpk_json_parse_dom(const char *json, struct txpk_json_s *txpk, uint8_t *payload, int max_payload);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -33,6 +33,9 @@ pushd lora_gateway
 cp $SCRIPT_DIR/library.cfg ./libloragw/library.cfg
 cp $SCRIPT_DIR/loragw_gps.c ./libloragw/src/loragw_gps.c
 cp $SCRIPT_DIR/loragw_spi.native.c ./libloragw/src/loragw_spi.native.c
+cp $SCRIPT_DIR/loragw_spi_ext.h ./libloragw/inc/loragw_spi_ext.h
+cp $SCRIPT_DIR/loragw_spi_trace.c ./libloragw/src/loragw_spi_trace.c
+cp $SCRIPT_DIR/loragw_spi_trace.h ./libloragw/inc/loragw_spi_trace.h
 cp $SCRIPT_DIR/test_loragw_gps_uart.c ./libloragw/tst/test_loragw_gps.c
 cp $SCRIPT_DIR/test_loragw_gps_i2c.c ./libloragw/tst/test_loragw_gps_i2c.c
 cp $SCRIPT_DIR/Makefile ./libloragw/Makefile
@@ -56,6 +56,7 @@ Maintainer: Michael Coracin
 #include "loragw_gps.h"
 #include "loragw_aux.h"
 #include "loragw_reg.h"
+#include "loragw_spi_ext.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -154,6 +155,7 @@ pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the
 static pthread_mutex_t mx_xcorr = PTHREAD_MUTEX_INITIALIZER; /* control access to the XTAL correction */
 static bool xtal_correct_ok = false; /* set true when XTAL correction is stable enough */
 static double xtal_correct = 1.0;
+extern void *lgw_spi_target; /* not in loragw_reg.h, SPI device of the concentrator */
 
 /* GPS configuration and synchronization */
 static char gps_tty_path[64] = "\0"; /* path of the TTY port GPS is connected on */
@@ -1040,6 +1042,7 @@ int main(void)
     float rx_nocrc_ratio;
     float up_ack_ratio;
     float dw_ack_ratio;
+    struct lgw_spi_cache_stats_s spi_cache;
 
     /* display version informations */
     MSG("*** Beacon Packet Forwarder for Lora Gateway ***\nVersion: " VERSION_STRING "\n");
@@ -1373,6 +1376,13 @@ int main(void)
             printf("# SX1301 time (PPS): %u\n", trig_tstamp);
         }
         jit_print_queue (&jit_queue, false, DEBUG_LOG);
+        pthread_mutex_lock(&mx_concent);
+        i = lgw_spi_cache_stats(lgw_spi_target, &spi_cache);
+        pthread_mutex_unlock(&mx_concent);
+        if ((i == LGW_SPI_SUCCESS) && (spi_cache.enabled == true) && ((spi_cache.hit + spi_cache.miss) > 0)) {
+            printf("### [SPI] ###\n");
+            printf("# Register cache: %.2f%% hits (hit:%u, miss:%u, uncached:%u, write:%u)\n", 100.0 * spi_cache.hit / (spi_cache.hit + spi_cache.miss), spi_cache.hit, spi_cache.miss, spi_cache.uncached, spi_cache.write);
+        }
         printf("### [GPS] ###\n");
         if (gps_enabled == true) {
             /* no need for mutex, display is not critical */
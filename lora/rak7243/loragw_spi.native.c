@@ -12,6 +12,8 @@ Description:
     Single-byte read/write and burst read/write.
     Does not handle pagination.
     Could be used with multiple SPI ports in parallel (explicit file descriptor)
+    SPI clock set by LORAGW_SPI_SPEED (in Hz), or calibrated with
+    LORAGW_SPI_SPEED=auto and saved per gateway model in LORAGW_SPI_SPEED_FILE
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -27,11 +29,14 @@ Maintainer: Sylvain Miermont
 #include <unistd.h>        /* lseek, close */
 #include <fcntl.h>        /* open */
 #include <string.h>        /* memset */
+#include <stdbool.h>    /* bool type */
 
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 
 #include "loragw_spi.h"
+#include "loragw_spi_ext.h"
+#include "loragw_spi_trace.h"
 #include "loragw_hal.h"
 
 /* -------------------------------------------------------------------------- */
@@ -53,24 +58,563 @@ Maintainer: Sylvain Miermont
 
 #define READ_ACCESS     0x00
 #define WRITE_ACCESS    0x80
-#define SPI_SPEED       (getenv("LORAGW_SPI_SPEED")==NULL ? 2000000 : atoi(getenv("LORAGW_SPI_SPEED")))
+#define SPI_SPEED_DEFAULT   2000000 /* SPI clock when LORAGW_SPI_SPEED is not set */
 #define SPI_DEV_PATH    (getenv("LORAGW_SPI")==NULL ? "/dev/spidev0.0" : getenv("LORAGW_SPI"))
 
+#define SPIDEV_BUFSIZ_PATH      "/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DEFAULT   4096    /* bytes per SPI_IOC_MESSAGE, default of the spidev module */
+#define SPI_BATCH_XFER_MAX      64      /* transfers per SPI_IOC_MESSAGE */
+
+#define SPI_CACHE_EN            (getenv("LORAGW_SPI_CACHE")!=NULL && atoi(getenv("LORAGW_SPI_CACHE"))!=0)
+#define SPI_CACHE_PAGES         4       /* SX1301 page register is 2-bit wide */
+#define SPI_CACHE_VALID         0x01
+#define SPI_CACHE_VOLATILE      0x02
+#define SX1301_PAGE_REG         0       /* page select, and soft reset on bit 7 */
+#define SX1301_COMMON_REG_NB    32      /* registers 0 to 31 are common to all pages */
+#define SX1301_VERSION_REG      1
+#define SX1301_VERSION          103
+#define SX1301_SCRATCH_REG      2       /* RX data buffer address, 16-bit read/write, lgw_start resets it */
+
+/* SPI clock calibration, with LORAGW_SPI_SPEED=auto */
+#define SPI_AUTOTUNE_MAX        (getenv("LORAGW_SPI_SPEED_MAX")==NULL ? 10000000 : atoi(getenv("LORAGW_SPI_SPEED_MAX")))
+#define SPI_AUTOTUNE_STEP       1000000 /* clock increment between two checks */
+#define SPI_AUTOTUNE_NB_CHECK   200     /* write/read back checks at each clock */
+#define SPI_AUTOTUNE_MARGIN     80      /* percentage of the fastest stable clock finally used */
+#define SPI_AUTOTUNE_FILE       (getenv("LORAGW_SPI_SPEED_FILE")==NULL ? "/usr/local/rak/lora/spi_speed.conf" : getenv("LORAGW_SPI_SPEED_FILE"))
+#define GW_MODEL_FILE           "/usr/local/rak/rak_gw_model.json"
+#define GW_MODEL_SIZE           32
+#define SPI_AUTOTUNE_FILE_LINES 32      /* board models kept in SPI_AUTOTUNE_FILE */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* read/write bits of the scratch register, probed at the default clock */
+struct spi_scratch_s {
+    uint8_t rw[2];          /* bits following the value written */
+    uint8_t fixed[2];       /* value read for the other bits */
+};
+
+/* transfers waiting to be submitted in one SPI_IOC_MESSAGE */
+struct spi_batch_s {
+    struct spi_ioc_transfer k[SPI_BATCH_XFER_MAX];
+    uint8_t command[SPI_BATCH_XFER_MAX][2]; /* command bytes of the frame started by transfer i */
+    int nb_xfer;
+    uint32_t size; /* sum of the transfers length */
+};
+
+/* range of SX1301 registers always read on the SPI bus */
+struct spi_cache_range_s {
+    int8_t page;            /* LGW_SPI_PAGE_ALL for the registers common to all pages */
+    uint8_t first_address;
+    uint8_t last_address;   /* included */
+};
+
+/* SPI device, spi_target points on it */
+struct spi_native_s {
+    int fd;                 /* must stay the first field, used as *(int *)spi_target */
+    uint32_t speed_hz;      /* SPI clock */
+    bool cache_en;
+    int page;               /* SX1301 page selected, -1 until written */
+    uint8_t shadow[SPI_CACHE_PAGES][128];
+    uint8_t state[SPI_CACHE_PAGES][128];   /* SPI_CACHE_VALID, SPI_CACHE_VOLATILE */
+    struct lgw_spi_cache_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint32_t spidev_bufsiz = SPIDEV_BUFSIZ_DEFAULT;
+
+/* SX1301 registers that the hardware or its MCUs change, or that share a byte
+   with such bits. Pages 0 and 3 (LoRa and FSK modem configuration) are cached. */
+static const struct spi_cache_range_s spi_cache_volatile_regs[] = {
+    {LGW_SPI_PAGE_ALL, 0, SX1301_COMMON_REG_NB - 1},   /* RX/TX data buffers, capture RAM and MCU PROM ports, RX packet FIFO count and status, BIST status */
+    {1, SX1301_COMMON_REG_NB, 127},                     /* TX triggers and status, GPS PPS enable, timestamp counter, data management status */
+    {2, SX1301_COMMON_REG_NB, 127}                      /* radio SPI master and readback, AGC/ARB MCU RAM ports, mailboxes and status */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* max number of bytes of a spidev message, tunable with the bufsiz parameter of the module */
+static void spidev_read_bufsiz(void) {
+    FILE *f;
+    unsigned val;
+
+    spidev_bufsiz = SPIDEV_BUFSIZ_DEFAULT;
+    f = fopen(SPIDEV_BUFSIZ_PATH, "r");
+    if (f == NULL) {
+        return;
+    }
+    if ((fscanf(f, "%u", &val) == 1) && (val >= 64)) {
+        spidev_bufsiz = val;
+    }
+    fclose(f);
+    DEBUG_PRINTF("Note: spidev buffer size is %u bytes\n", spidev_bufsiz);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* the cache only holds the SX1301 registers, not the FPGA, EEPROM or radio behind the SPI mux */
+static bool spi_cache_usable(struct spi_native_s *dev, uint8_t spi_mux_mode, uint8_t spi_mux_target) {
+    if ((dev->cache_en == false) || (dev->page < 0)) {
+        return false;
+    }
+    return (spi_mux_mode != LGW_SPI_MUX_MODE1) || (spi_mux_target == LGW_SPI_MUX_TARGET_SX1301);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* forget the register values, keep the volatile flags */
+static void spi_cache_flush(struct spi_native_s *dev) {
+    int p, a;
+
+    for (p = 0; p < SPI_CACHE_PAGES; p++) {
+        for (a = 0; a < 128; a++) {
+            dev->state[p][a] &= ~SPI_CACHE_VALID;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* serve a read from the cache if all the bytes are known */
+static bool spi_cache_read(struct spi_native_s *dev, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    int i;
+    uint8_t *state;
+
+    if (spi_cache_usable(dev, spi_mux_mode, spi_mux_target) == false) {
+        if (dev->cache_en == true) {
+            dev->stats.uncached += 1;
+        }
+        return false;
+    }
+    address &= 0x7F;
+    state = dev->state[dev->page];
+    if ((state[address] & SPI_CACHE_VOLATILE) != 0) {
+        dev->stats.uncached += 1;
+        return false;
+    }
+    if ((address + size) > 128) {
+        dev->stats.miss += 1;
+        return false;
+    }
+    for (i = 0; i < size; i++) {
+        if ((state[address + i] & (SPI_CACHE_VALID | SPI_CACHE_VOLATILE)) != SPI_CACHE_VALID) {
+            dev->stats.miss += 1;
+            return false;
+        }
+    }
+    memcpy(data, &dev->shadow[dev->page][address], size);
+    dev->stats.hit += 1;
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* keep track of the page selected and of the values written */
+static void spi_cache_write(struct spi_native_s *dev, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, const uint8_t *data, uint16_t size) {
+    int i;
+
+    if ((dev->cache_en == false) || ((spi_mux_mode == LGW_SPI_MUX_MODE1) && (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301))) {
+        return;
+    }
+    dev->stats.write += 1;
+    address &= 0x7F;
+
+    /* page register: the following accesses are done in that page, a soft reset restores all registers */
+    if (address == SX1301_PAGE_REG) {
+        if ((data[0] & 0x80) != 0) {
+            spi_cache_flush(dev);
+        }
+        dev->page = data[0] & (SPI_CACHE_PAGES - 1);
+        return;
+    }
+    if (dev->page < 0) {
+        return;
+    }
+
+    /* a burst on a volatile register is a data port (FIFO, RAM...), the address does not increment */
+    if ((dev->state[dev->page][address] & SPI_CACHE_VOLATILE) != 0) {
+        return;
+    }
+    for (i = 0; (i < size) && ((address + i) < 128); i++) {
+        if ((dev->state[dev->page][address + i] & SPI_CACHE_VOLATILE) == 0) {
+            dev->shadow[dev->page][address + i] = data[i];
+            dev->state[dev->page][address + i] |= SPI_CACHE_VALID;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI clock requested with LORAGW_SPI_SPEED: a frequency in Hz, or "auto" for a calibration */
+static uint32_t spi_speed_setting(bool *autotune) {
+    const char *env;
+
+    *autotune = false;
+    env = getenv("LORAGW_SPI_SPEED");
+    if (env == NULL) {
+        return SPI_SPEED_DEFAULT;
+    }
+    if (strcmp(env, "auto") == 0) {
+        *autotune = true;
+        return SPI_SPEED_DEFAULT;
+    }
+    if (atoi(env) <= 0) {
+        DEBUG_PRINTF("WARNING: invalid LORAGW_SPI_SPEED %s, using %d Hz\n", env, SPI_SPEED_DEFAULT);
+        return SPI_SPEED_DEFAULT;
+    }
+    return (uint32_t)atoi(env);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_set_speed(struct spi_native_s *dev, uint32_t speed_hz) {
+    int a, b;
+
+    a = ioctl(dev->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz);
+    b = ioctl(dev->fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed_hz);
+    if ((a < 0) || (b < 0)) {
+        DEBUG_MSG("ERROR: SPI PORT FAIL TO SET MAX SPEED\n");
+        return LGW_SPI_ERROR;
+    }
+    dev->speed_hz = speed_hz;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* gateway model set by the installer, the SPI wiring depends on it */
+static void spi_board_model(char *model, int size) {
+    FILE *f;
+    char line[128];
+    char *p;
+
+    snprintf(model, size, "unknown");
+    f = fopen(GW_MODEL_FILE, "r");
+    if (f == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof line, f) != NULL) {
+        p = strstr(line, "\"gw_model\"");
+        if (p == NULL) {
+            continue;
+        }
+        p = strchr(p + 10, '"');
+        if ((p != NULL) && (sscanf(p + 1, "%31[^\"]", model) == 1)) {
+            break;
+        }
+    }
+    fclose(f);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI clock calibrated before on that board model, 0 if none */
+static uint32_t spi_speed_load(const char *model) {
+    FILE *f;
+    char line_model[GW_MODEL_SIZE];
+    unsigned speed_hz;
+    uint32_t found = 0;
+
+    f = fopen(SPI_AUTOTUNE_FILE, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    while (fscanf(f, "%31s %u", line_model, &speed_hz) == 2) {
+        if (strcmp(line_model, model) == 0) {
+            found = speed_hz;
+            break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* keep the SPI clock of the other board models, replace the one of this model */
+static void spi_speed_save(const char *model, uint32_t speed_hz) {
+    FILE *f;
+    char models[SPI_AUTOTUNE_FILE_LINES][GW_MODEL_SIZE];
+    unsigned speeds[SPI_AUTOTUNE_FILE_LINES];
+    char tmp_path[256];
+    int nb_line = 0;
+    int i;
+
+    f = fopen(SPI_AUTOTUNE_FILE, "r");
+    if (f != NULL) {
+        while ((nb_line < SPI_AUTOTUNE_FILE_LINES) && (fscanf(f, "%31s %u", models[nb_line], &speeds[nb_line]) == 2)) {
+            if (strcmp(models[nb_line], model) != 0) {
+                nb_line += 1;
+            }
+        }
+        fclose(f);
+    }
+
+    /* written aside then renamed, so that an interrupted write does not lose the file */
+    snprintf(tmp_path, sizeof tmp_path, "%s.tmp", SPI_AUTOTUNE_FILE);
+    f = fopen(tmp_path, "w");
+    if (f == NULL) {
+        DEBUG_PRINTF("WARNING: failed to save SPI clock in %s\n", tmp_path);
+        return;
+    }
+    for (i = 0; i < nb_line; i++) {
+        fprintf(f, "%s %u\n", models[i], speeds[i]);
+    }
+    fprintf(f, "%s %u\n", model, speed_hz);
+    fclose(f);
+    if (rename(tmp_path, SPI_AUTOTUNE_FILE) != 0) {
+        DEBUG_PRINTF("WARNING: failed to save SPI clock in %s\n", SPI_AUTOTUNE_FILE);
+        remove(tmp_path);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* at the default clock, check that the SX1301 is addressed directly and find the bits of the scratch register that can be written */
+static bool spi_scratch_probe(struct spi_native_s *dev, struct spi_scratch_s *scratch) {
+    uint8_t version = 0;
+    uint8_t ones[2] = {0xFF, 0xFF};
+    uint8_t zeros[2] = {0x00, 0x00};
+    uint8_t read_ones[2], read_zeros[2];
+    int i;
+
+    if (spi_set_speed(dev, SPI_SPEED_DEFAULT) != LGW_SPI_SUCCESS) {
+        return false;
+    }
+    if ((lgw_spi_r(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_VERSION_REG, &version) != LGW_SPI_SUCCESS) || (version != SX1301_VERSION)) {
+        DEBUG_PRINTF("WARNING: SX1301 not found for SPI clock calibration (version %u)\n", version);
+        return false;
+    }
+    if ((lgw_spi_wb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, ones, 2) != LGW_SPI_SUCCESS) ||
+        (lgw_spi_rb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, read_ones, 2) != LGW_SPI_SUCCESS) ||
+        (lgw_spi_wb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, zeros, 2) != LGW_SPI_SUCCESS) ||
+        (lgw_spi_rb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, read_zeros, 2) != LGW_SPI_SUCCESS)) {
+        return false;
+    }
+    for (i = 0; i < 2; i++) {
+        scratch->rw[i] = read_ones[i] & ~read_zeros[i];
+        scratch->fixed[i] = read_zeros[i] & ~scratch->rw[i];
+    }
+    if ((scratch->rw[0] | scratch->rw[1]) == 0) {
+        DEBUG_MSG("WARNING: SPI scratch register cannot be written, no SPI clock calibration\n");
+        return false;
+    }
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write patterns in the scratch register and read them back, with single and burst accesses */
+static bool spi_speed_check(struct spi_native_s *dev, uint32_t speed_hz, const struct spi_scratch_s *scratch, int nb_check) {
+    uint16_t lfsr = 0xACE1;
+    uint8_t pattern[2];
+    uint8_t expected[2];
+    uint8_t readback[3];
+    uint8_t data;
+    int i, j;
+
+    if (spi_set_speed(dev, speed_hz) != LGW_SPI_SUCCESS) {
+        return false;
+    }
+    for (i = 0; i < nb_check; i++) {
+        lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+        pattern[0] = (uint8_t)(lfsr >> 8);
+        pattern[1] = (uint8_t)lfsr;
+        for (j = 0; j < 2; j++) {
+            expected[j] = (pattern[j] & scratch->rw[j]) | scratch->fixed[j];
+        }
+
+        /* burst write, burst read from the version register */
+        if ((lgw_spi_wb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, pattern, 2) != LGW_SPI_SUCCESS) ||
+            (lgw_spi_rb(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_VERSION_REG, readback, 3) != LGW_SPI_SUCCESS)) {
+            return false;
+        }
+        if ((readback[0] != SX1301_VERSION) || (readback[1] != expected[0]) || (readback[2] != expected[1])) {
+            DEBUG_PRINTF("Note: SPI check failed at %u Hz (%02X %02X %02X)\n", speed_hz, readback[0], readback[1], readback[2]);
+            return false;
+        }
+
+        /* single write and read */
+        if ((lgw_spi_w(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, pattern[1]) != LGW_SPI_SUCCESS) ||
+            (lgw_spi_r(dev, LGW_SPI_MUX_MODE0, LGW_SPI_MUX_TARGET_SX1301, SX1301_SCRATCH_REG, &data) != LGW_SPI_SUCCESS)) {
+            return false;
+        }
+        if (data != ((pattern[1] & scratch->rw[0]) | scratch->fixed[0])) {
+            DEBUG_PRINTF("Note: SPI check failed at %u Hz (%02X)\n", speed_hz, data);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fastest stable SPI clock, minus a safety margin, calibrated at the first start on a board model */
+static uint32_t spi_speed_autotune(struct spi_native_s *dev) {
+    struct spi_scratch_s scratch;
+    char model[GW_MODEL_SIZE];
+    uint32_t speed_hz, max_hz, stable_hz;
+
+    if (spi_scratch_probe(dev, &scratch) == false) {
+        return SPI_SPEED_DEFAULT;
+    }
+
+    /* clock saved for that board model, checked again as the hardware may have changed */
+    spi_board_model(model, sizeof model);
+    speed_hz = spi_speed_load(model);
+    if ((speed_hz > 0) && (spi_speed_check(dev, speed_hz, &scratch, SPI_AUTOTUNE_NB_CHECK) == true)) {
+        DEBUG_PRINTF("Note: SPI clock %u Hz loaded for %s\n", speed_hz, model);
+        return speed_hz;
+    }
+
+    /* step the clock up until a check fails */
+    max_hz = (SPI_AUTOTUNE_MAX > SPI_SPEED_DEFAULT) ? (uint32_t)SPI_AUTOTUNE_MAX : SPI_SPEED_DEFAULT;
+    stable_hz = 0;
+    for (speed_hz = SPI_SPEED_DEFAULT; speed_hz <= max_hz; speed_hz += SPI_AUTOTUNE_STEP) {
+        if (spi_speed_check(dev, speed_hz, &scratch, SPI_AUTOTUNE_NB_CHECK) == false) {
+            break;
+        }
+        stable_hz = speed_hz;
+    }
+    if (stable_hz == 0) {
+        printf("WARNING: SPI clock calibration failed at %u Hz\n", SPI_SPEED_DEFAULT);
+        return SPI_SPEED_DEFAULT;
+    }
+    speed_hz = (uint32_t)(((uint64_t)stable_hz * SPI_AUTOTUNE_MARGIN) / 100);
+    if (speed_hz < SPI_SPEED_DEFAULT) {
+        speed_hz = SPI_SPEED_DEFAULT;
+    }
+    printf("INFO: SPI clock calibrated for %s: stable up to %u Hz, using %u Hz\n", model, stable_hz, speed_hz);
+    spi_speed_save(model, speed_hz);
+    return speed_hz;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* submit the pending transfers */
+static int spi_batch_flush(int spi_device, struct spi_batch_s *batch) {
+    int a;
+
+    if (batch->nb_xfer == 0) {
+        return LGW_SPI_SUCCESS;
+    }
+
+    /* cs_change on the last transfer would keep the chip selected after the message */
+    batch->k[batch->nb_xfer - 1].cs_change = 0;
+    a = ioctl(spi_device, SPI_IOC_MESSAGE(batch->nb_xfer), batch->k);
+    DEBUG_PRINTF("BATCH: %d transfers # %u bytes # transferred %d\n", batch->nb_xfer, batch->size, a);
+
+    memset(batch->k, 0, batch->nb_xfer * sizeof(struct spi_ioc_transfer));
+    if (a != (int)batch->size) {
+        batch->nb_xfer = 0;
+        batch->size = 0;
+        return LGW_SPI_ERROR;
+    }
+    batch->nb_xfer = 0;
+    batch->size = 0;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* queue one register access, in one chip select frame if it fits in a spidev message */
+static int spi_batch_add(int spi_device, struct spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, const struct lgw_spi_op_s *op) {
+    uint8_t command_size;
+    uint8_t *data = op->data;
+    int size_to_do = op->size;
+    int frame_size, chunk_size;
+    int max_bytes, max_xfer;
+    struct spi_ioc_transfer *k;
+
+    command_size = (spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+
+    while (size_to_do > 0) {
+        /* room left in the pending message: one transfer for the command, up to LGW_BURST_CHUNK bytes per data transfer */
+        max_bytes = (int)spidev_bufsiz - (int)batch->size - command_size;
+        max_xfer = SPI_BATCH_XFER_MAX - batch->nb_xfer - 1;
+        frame_size = size_to_do;
+        if (frame_size > max_bytes) {
+            frame_size = max_bytes;
+        }
+        if (frame_size > (max_xfer * LGW_BURST_CHUNK)) {
+            frame_size = max_xfer * LGW_BURST_CHUNK;
+        }
+
+        /* do not split the access if it fits in the next message */
+        if ((frame_size < size_to_do) && (batch->nb_xfer > 0)) {
+            if (spi_batch_flush(spi_device, batch) != LGW_SPI_SUCCESS) {
+                return LGW_SPI_ERROR;
+            }
+            continue;
+        }
+
+        /* command: the address is sent again for each frame of a split access, as the FIFO registers do not auto-increment */
+        k = &batch->k[batch->nb_xfer];
+        if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+            batch->command[batch->nb_xfer][0] = spi_mux_target;
+            batch->command[batch->nb_xfer][1] = ((op->access == LGW_SPI_OP_WRITE) ? WRITE_ACCESS : READ_ACCESS) | (op->address & 0x7F);
+        } else {
+            batch->command[batch->nb_xfer][0] = ((op->access == LGW_SPI_OP_WRITE) ? WRITE_ACCESS : READ_ACCESS) | (op->address & 0x7F);
+        }
+        k->tx_buf = (unsigned long)batch->command[batch->nb_xfer];
+        k->len = command_size;
+        batch->nb_xfer += 1;
+        batch->size += command_size;
+
+        /* data, the chip stays selected until the end of the frame */
+        while (frame_size > 0) {
+            chunk_size = (frame_size < LGW_BURST_CHUNK) ? frame_size : LGW_BURST_CHUNK;
+            k = &batch->k[batch->nb_xfer];
+            if (op->access == LGW_SPI_OP_WRITE) {
+                k->tx_buf = (unsigned long)data;
+            } else {
+                k->rx_buf = (unsigned long)data;
+            }
+            k->len = chunk_size;
+            batch->nb_xfer += 1;
+            batch->size += chunk_size;
+            data += chunk_size;
+            frame_size -= chunk_size;
+            size_to_do -= chunk_size;
+        }
+        k->cs_change = 1; /* end of frame */
+
+        if ((batch->nb_xfer >= (SPI_BATCH_XFER_MAX - 1)) || ((batch->size + command_size) >= spidev_bufsiz)) {
+            if (spi_batch_flush(spi_device, batch) != LGW_SPI_SUCCESS) {
+                return LGW_SPI_ERROR;
+            }
+        }
+    }
+
+    return LGW_SPI_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 /* SPI initialization and configuration */
 int lgw_spi_open(void **spi_target_ptr) {
-    int *spi_device = NULL;
+    struct spi_native_s *spi_device = NULL;
     int dev;
     int a=0, b=0;
     int i;
+    uint32_t speed_hz;
+    bool autotune;
 
     /* check input variables */
     CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
 
+    /* size limit of the batched transfers */
+    spidev_read_bufsiz();
+
+    /* SPI access tracing, if enabled by LORAGW_SPI_TRACE */
+    lgw_spi_trace_init();
+
     /* allocate memory for the device descriptor */
-    spi_device = malloc(sizeof(int));
+    spi_device = malloc(sizeof(struct spi_native_s));
     if (spi_device == NULL) {
         DEBUG_MSG("ERROR: MALLOC FAIL\n");
         return LGW_SPI_ERROR;
@@ -95,7 +639,7 @@ int lgw_spi_open(void **spi_target_ptr) {
     }
 
     /* setting SPI max clk (in Hz) */
-    i = SPI_SPEED;
+    i = SPI_SPEED_DEFAULT;
     a = ioctl(dev, SPI_IOC_WR_MAX_SPEED_HZ, &i);
     b = ioctl(dev, SPI_IOC_RD_MAX_SPEED_HZ, &i);
     if ((a < 0) || (b < 0)) {
@@ -126,7 +670,34 @@ int lgw_spi_open(void **spi_target_ptr) {
         return LGW_SPI_ERROR;
     }
 
-    *spi_device = dev;
+    /* shadow register cache, empty until the page register is written */
+    memset(spi_device, 0, sizeof(struct spi_native_s));
+    spi_device->fd = dev;
+    spi_device->page = -1;
+    spi_device->cache_en = SPI_CACHE_EN;
+    spi_device->stats.enabled = spi_device->cache_en;
+    for (i = 0; i < (int)(sizeof spi_cache_volatile_regs / sizeof spi_cache_volatile_regs[0]); i++) {
+        lgw_spi_cache_volatile(spi_device, spi_cache_volatile_regs[i].page, spi_cache_volatile_regs[i].first_address, spi_cache_volatile_regs[i].last_address);
+    }
+    if (spi_device->cache_en == true) {
+        DEBUG_MSG("Note: SPI shadow register cache enabled\n");
+    }
+
+    /* SPI clock, fixed or calibrated */
+    spi_device->speed_hz = SPI_SPEED_DEFAULT;
+    speed_hz = spi_speed_setting(&autotune);
+    if (autotune == true) {
+        speed_hz = spi_speed_autotune(spi_device);
+        memset(&spi_device->stats, 0, sizeof spi_device->stats); /* calibration accesses are not counted */
+        spi_device->stats.enabled = spi_device->cache_en;
+    }
+    if (spi_set_speed(spi_device, speed_hz) != LGW_SPI_SUCCESS) {
+        close(dev);
+        free(spi_device);
+        return LGW_SPI_ERROR;
+    }
+    DEBUG_PRINTF("Note: SPI clock set to %u Hz\n", spi_device->speed_hz);
+
     *spi_target_ptr = (void *)spi_device;
     DEBUG_MSG("Note: SPI port opened and configured ok\n");
     return LGW_SPI_SUCCESS;
@@ -160,7 +731,7 @@ int lgw_spi_close(void *spi_target) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Simple write */
-int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+static int spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
     int spi_device;
     uint8_t out_buf[3];
     uint8_t command_size;
@@ -191,7 +762,7 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     memset(&k, 0, sizeof(k)); /* clear k */
     k.tx_buf = (unsigned long) out_buf;
     k.len = command_size;
-    k.speed_hz = SPI_SPEED;
+    k.speed_hz = ((struct spi_native_s *)spi_target)->speed_hz;
     k.cs_change = 0;
     k.bits_per_word = 8;
     a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
@@ -199,17 +770,32 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     /* determine return code */
     if (a != (int)k.len) {
         DEBUG_MSG("ERROR: SPI WRITE FAILURE\n");
+        spi_cache_flush((struct spi_native_s *)spi_target);
+        ((struct spi_native_s *)spi_target)->page = -1;
         return LGW_SPI_ERROR;
     } else {
         DEBUG_MSG("Note: SPI write success\n");
+        spi_cache_write((struct spi_native_s *)spi_target, spi_mux_mode, spi_mux_target, address, &data, 1);
         return LGW_SPI_SUCCESS;
     }
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* Simple write, recorded by the SPI trace */
+int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    uint64_t start = lgw_spi_trace_start();
+    int status;
+
+    status = spi_w(spi_target, spi_mux_mode, spi_mux_target, address, data);
+    lgw_spi_trace_end(start, LGW_SPI_TRACE_W, address, 1, status);
+    return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Simple read */
-int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+static int spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
     int spi_device;
     uint8_t out_buf[3];
     uint8_t command_size;
@@ -224,6 +810,11 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     }
     CHECK_NULL(data);
 
+    /* registers written by the host are read back from the cache */
+    if (spi_cache_read((struct spi_native_s *)spi_target, spi_mux_mode, spi_mux_target, address, data, 1) == true) {
+        return LGW_SPI_SUCCESS;
+    }
+
     spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
 
     /* prepare frame to be sent */
@@ -259,15 +850,21 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* Simple read, recorded by the SPI trace */
+int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    uint64_t start = lgw_spi_trace_start();
+    int status;
+
+    status = spi_r(spi_target, spi_mux_mode, spi_mux_target, address, data);
+    lgw_spi_trace_end(start, LGW_SPI_TRACE_R, address, 1, status);
+    return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Burst (multiple-byte) write */
-int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
-    int spi_device;
-    uint8_t command[2];
-    uint8_t command_size;
-    struct spi_ioc_transfer k[2];
-    int size_to_do, chunk_size, offset;
-    int byte_transfered = 0;
-    int i;
+static int spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_spi_op_s op;
 
     /* check input parameters */
     CHECK_NULL(spi_target);
@@ -280,37 +877,12 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
         return LGW_SPI_ERROR;
     }
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
-
-    /* prepare command byte */
-    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
-        command[0] = spi_mux_target;
-        command[1] = WRITE_ACCESS | (address & 0x7F);
-        command_size = 2;
-    } else {
-        command[0] = WRITE_ACCESS | (address & 0x7F);
-        command_size = 1;
-    }
-    size_to_do = size;
-
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k[0].tx_buf = (unsigned long) &command[0];
-    k[0].len = command_size;
-    k[0].cs_change = 0;
-    k[1].cs_change = 0;
-    for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
-        k[1].tx_buf = (unsigned long)(data + offset);
-        k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
-        DEBUG_PRINTF("BURST WRITE: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
-        size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
-    }
-
-    /* determine return code */
-    if (byte_transfered != size) {
+    /* I/O transaction, in one SPI_IOC_MESSAGE unless larger than the spidev buffer */
+    op.access = LGW_SPI_OP_WRITE;
+    op.address = address;
+    op.data = data;
+    op.size = size;
+    if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI BURST WRITE FAILURE\n");
         return LGW_SPI_ERROR;
     } else {
@@ -321,15 +893,21 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* Burst (multiple-byte) write, recorded by the SPI trace */
+int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint64_t start = lgw_spi_trace_start();
+    int status;
+
+    status = spi_wb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    lgw_spi_trace_end(start, LGW_SPI_TRACE_WB, address, size, status);
+    return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Burst (multiple-byte) read */
-int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
-    int spi_device;
-    uint8_t command[2];
-    uint8_t command_size;
-    struct spi_ioc_transfer k[2];
-    int size_to_do, chunk_size, offset;
-    int byte_transfered = 0;
-    int i;
+static int spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_spi_op_s op;
 
     /* check input parameters */
     CHECK_NULL(spi_target);
@@ -342,37 +920,17 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
         return LGW_SPI_ERROR;
     }
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
-
-    /* prepare command byte */
-    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
-        command[0] = spi_mux_target;
-        command[1] = READ_ACCESS | (address & 0x7F);
-        command_size = 2;
-    } else {
-        command[0] = READ_ACCESS | (address & 0x7F);
-        command_size = 1;
-    }
-    size_to_do = size;
-
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k[0].tx_buf = (unsigned long) &command[0];
-    k[0].len = command_size;
-    k[0].cs_change = 0;
-    k[1].cs_change = 0;
-    for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
-        k[1].rx_buf = (unsigned long)(data + offset);
-        k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
-        DEBUG_PRINTF("BURST READ: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
-        size_to_do -= chunk_size;  /* subtract the quantity of data already transferred */
+    /* registers written by the host are read back from the cache */
+    if (spi_cache_read((struct spi_native_s *)spi_target, spi_mux_mode, spi_mux_target, address, data, size) == true) {
+        return LGW_SPI_SUCCESS;
     }
 
-    /* determine return code */
-    if (byte_transfered != size) {
+    /* I/O transaction, in one SPI_IOC_MESSAGE unless larger than the spidev buffer */
+    op.access = LGW_SPI_OP_READ;
+    op.address = address;
+    op.data = data;
+    op.size = size;
+    if (lgw_spi_batch(spi_target, spi_mux_mode, spi_mux_target, &op, 1) != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI BURST READ FAILURE\n");
         return LGW_SPI_ERROR;
     } else {
@@ -381,4 +939,107 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read, recorded by the SPI trace */
+int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint64_t start = lgw_spi_trace_start();
+    int status;
+
+    status = spi_rb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    lgw_spi_trace_end(start, LGW_SPI_TRACE_RB, address, size, status);
+    return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of register accesses */
+int lgw_spi_batch(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_spi_op_s *ops, int nb_op) {
+    int spi_device;
+    struct spi_batch_s batch;
+    int i;
+
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(ops);
+
+    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+
+    /* queue the accesses, a message is submitted each time the spidev buffer is full */
+    memset(&batch, 0, sizeof batch);
+    for (i = 0; i < nb_op; i++) {
+        CHECK_NULL(ops[i].data);
+        if ((ops[i].address & 0x80) != 0) {
+            DEBUG_MSG("WARNING: SPI address > 127\n");
+        }
+        if (spi_batch_add(spi_device, &batch, spi_mux_mode, spi_mux_target, &ops[i]) != LGW_SPI_SUCCESS) {
+            break;
+        }
+        /* write-through, the page written applies to the next accesses of the batch */
+        if (ops[i].access == LGW_SPI_OP_WRITE) {
+            spi_cache_write((struct spi_native_s *)spi_target, spi_mux_mode, spi_mux_target, ops[i].address, ops[i].data, ops[i].size);
+        }
+    }
+    if ((i < nb_op) || (spi_batch_flush(spi_device, &batch) != LGW_SPI_SUCCESS)) {
+        DEBUG_MSG("ERROR: SPI BATCH FAILURE\n");
+        /* some writes may not have been done */
+        spi_cache_flush((struct spi_native_s *)spi_target);
+        ((struct spi_native_s *)spi_target)->page = -1;
+        return LGW_SPI_ERROR;
+    }
+
+    DEBUG_MSG("Note: SPI batch success\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Shadow register cache: volatile registers */
+int lgw_spi_cache_volatile(void *spi_target, int8_t page, uint8_t first_address, uint8_t last_address) {
+    struct spi_native_s *spi_device;
+    int p, a;
+
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    if ((page < LGW_SPI_PAGE_ALL) || (page >= SPI_CACHE_PAGES) || (first_address > last_address) || (last_address > 127)) {
+        DEBUG_MSG("ERROR: INVALID VOLATILE REGISTER RANGE\n");
+        return LGW_SPI_ERROR;
+    }
+
+    spi_device = (struct spi_native_s *)spi_target;
+    for (p = 0; p < SPI_CACHE_PAGES; p++) {
+        if ((page != LGW_SPI_PAGE_ALL) && (page != p)) {
+            continue;
+        }
+        for (a = first_address; a <= last_address; a++) {
+            spi_device->state[p][a] = SPI_CACHE_VOLATILE;
+        }
+    }
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Shadow register cache: invalidation */
+int lgw_spi_cache_invalidate(void *spi_target) {
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+
+    spi_cache_flush((struct spi_native_s *)spi_target);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Shadow register cache: counters */
+int lgw_spi_cache_stats(void *spi_target, struct lgw_spi_cache_stats_s *stats) {
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(stats);
+
+    *stats = ((struct spi_native_s *)spi_target)->stats;
+    return LGW_SPI_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,112 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Extensions of the host specific SPI functions, not in loragw_spi.h.
+    Batched transfers: a list of register accesses submitted to spidev in as
+    few SPI_IOC_MESSAGE as its buffer size allows.
+    Shadow register cache: SX1301 registers written by the host are kept in
+    memory, reading them back does not access the SPI bus. Enabled by setting
+    the LORAGW_SPI_CACHE environment variable to 1.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_SPI_EXT_H
+#define _LORAGW_SPI_EXT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types*/
+#include <stdbool.h>       /* bool type */
+
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SPI_OP_READ     0
+#define LGW_SPI_OP_WRITE    1
+
+#define LGW_SPI_PAGE_ALL    -1  /* register common to all pages */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_op_s
+@brief One register access of a batch, done in its own chip select frame
+*/
+struct lgw_spi_op_s {
+    uint8_t     access;     /*!> LGW_SPI_OP_READ or LGW_SPI_OP_WRITE */
+    uint8_t     address;    /*!> 7-bit register address */
+    uint8_t     *data;      /*!> data to write, or buffer receiving the data read */
+    uint16_t    size;       /*!> number of bytes, 1 for a single register access */
+};
+
+/**
+@struct lgw_spi_cache_stats_s
+@brief Counters of the shadow register cache, since the SPI port was opened
+*/
+struct lgw_spi_cache_stats_s {
+    bool        enabled;    /*!> the cache is enabled */
+    uint32_t    hit;        /*!> reads served from the cache */
+    uint32_t    miss;       /*!> reads of cacheable registers done on the SPI bus */
+    uint32_t    uncached;   /*!> reads of volatile registers or other SPI mux targets */
+    uint32_t    write;      /*!> register writes, done on the SPI bus and in the cache */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief LoRa concentrator SPI batch of register accesses
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param spi_mux_mode SPI mux mode (LGW_SPI_MUX_MODE0 or LGW_SPI_MUX_MODE1)
+@param spi_mux_target SPI mux target, used in mux mode 1 only
+@param ops array of register accesses, done in that order
+@param nb_op number of register accesses
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_spi_op_s *ops, int nb_op);
+
+/**
+@brief Declare SX1301 registers whose value can change without being written
+by the host (status, counters, data ports...), they are always read on the SPI
+bus. The registers common to all pages (0 to 31) and pages 1 and 2 (TX and
+GPS status, timestamp, radio SPI master, MCU RAM ports and status) are
+volatile by default, only the modem configuration of pages 0 and 3 is cached.
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param page register page, or LGW_SPI_PAGE_ALL
+@param first_address first register address of the range
+@param last_address last register address of the range, included
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_cache_volatile(void *spi_target, int8_t page, uint8_t first_address, uint8_t last_address);
+
+/**
+@brief Forget the cached register values, the next reads are done on the SPI
+bus (to be called when the registers are modified by other means, eg. firmware)
+@param spi_target generic pointer to SPI target (implementation dependant)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_cache_invalidate(void *spi_target);
+
+/**
+@brief Get the counters of the shadow register cache
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param stats pointer to the structure receiving the counters
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_cache_stats(void *spi_target, struct lgw_spi_cache_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
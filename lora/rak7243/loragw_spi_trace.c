@@ -0,0 +1,318 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Tracing of the SPI register accesses, see loragw_spi_trace.h.
+    Each thread writes its own ring, the only shared data are the histogram
+    counters (atomic increments) and the list of rings (filled once per
+    thread). The dump reads the rings while they are written: when a ring
+    is full, its oldest record may be overwritten during the copy.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>        /* C99 types */
+#include <stdbool.h>       /* bool type */
+#include <stdio.h>         /* printf fprintf */
+#include <stdlib.h>        /* malloc getenv */
+#include <string.h>        /* memset strncpy */
+#include <errno.h>         /* errno */
+#include <signal.h>        /* sigaction */
+#include <time.h>          /* clock_gettime */
+#include <unistd.h>        /* write close */
+#include <fcntl.h>         /* open */
+
+#include "loragw_spi.h"
+#include "loragw_spi_trace.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TRACE_EN            (getenv("LORAGW_SPI_TRACE")!=NULL && atoi(getenv("LORAGW_SPI_TRACE"))!=0)
+#define TRACE_FILE          (getenv("LORAGW_SPI_TRACE_FILE")==NULL ? "/tmp/lgw_spi_trace.bin" : getenv("LORAGW_SPI_TRACE_FILE"))
+#define TRACE_PATH_SIZE     128
+#define TRACE_THREADS_MAX   16      /* threads with a ring, the others are only counted in the histograms */
+#define TRACE_ADDR_NB       128
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct trace_ring_s {
+    uint32_t thread;
+    uint64_t count; /* records written, published after the record */
+    struct lgw_spi_trace_rec_s rec[LGW_SPI_TRACE_RING_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static bool trace_init_done = false;
+static bool trace_en = false;
+static char trace_path[TRACE_PATH_SIZE];
+
+static uint32_t trace_hist[LGW_SPI_TRACE_DIR_NB][TRACE_ADDR_NB][LGW_SPI_TRACE_BINS];
+
+static struct trace_ring_s *trace_rings[TRACE_THREADS_MAX];
+static uint32_t trace_nb_thread = 0; /* rings allocated, some slots may still be NULL while being filled */
+
+static __thread struct trace_ring_s *thread_ring = NULL;
+static __thread bool thread_ring_done = false; /* ring allocation attempted by this thread */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t trace_now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t)t.tv_sec * 1000000000) + (uint64_t)t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct trace_ring_s *trace_thread_ring(void) {
+    struct trace_ring_s *ring;
+    uint32_t slot;
+
+    if (thread_ring_done == true) {
+        return thread_ring;
+    }
+    thread_ring_done = true;
+
+    slot = __atomic_fetch_add(&trace_nb_thread, 1, __ATOMIC_RELAXED);
+    if (slot >= TRACE_THREADS_MAX) {
+        DEBUG_MSG("WARNING: too many threads accessing SPI, not recorded in a ring\n");
+        return NULL;
+    }
+    ring = malloc(sizeof(struct trace_ring_s));
+    if (ring == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return NULL;
+    }
+    ring->thread = slot;
+    ring->count = 0;
+    __atomic_store_n(&trace_rings[slot], ring, __ATOMIC_RELEASE);
+    thread_ring = ring;
+    return ring;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write() until done, async-signal-safe */
+static int trace_write(int fd, const void *buf, size_t size) {
+    const uint8_t *p = buf;
+    ssize_t n;
+
+    while (size > 0) {
+        n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void trace_sig_handler(int sigio) {
+    int saved_errno = errno;
+
+    (void)sigio;
+    lgw_spi_trace_dump(trace_path);
+    errno = saved_errno;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void lgw_spi_trace_init(void) {
+    struct sigaction sigact;
+
+    if (trace_init_done == true) {
+        return;
+    }
+    trace_init_done = true;
+
+    if (!TRACE_EN) {
+        return;
+    }
+    strncpy(trace_path, TRACE_FILE, sizeof trace_path - 1);
+    trace_path[sizeof trace_path - 1] = '\0';
+
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = SA_RESTART;
+    sigact.sa_handler = trace_sig_handler;
+    if (sigaction(SIGUSR1, &sigact, NULL) < 0) {
+        DEBUG_MSG("ERROR: failed to install SIGUSR1 handler, SPI trace disabled\n");
+        return;
+    }
+    trace_en = true;
+    DEBUG_PRINTF("Note: SPI trace enabled, dumped to %s on SIGUSR1\n", trace_path);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t lgw_spi_trace_start(void) {
+    if (trace_en == false) {
+        return 0;
+    }
+    return trace_now();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_spi_trace_end(uint64_t start, uint8_t access, uint8_t address, uint16_t size, int status) {
+    struct trace_ring_s *ring;
+    struct lgw_spi_trace_rec_s *rec;
+    uint64_t duration;
+    uint32_t us;
+    int bin;
+
+    if (start == 0) {
+        return;
+    }
+    duration = trace_now() - start;
+    if (duration > UINT32_MAX) {
+        duration = UINT32_MAX;
+    }
+    address &= 0x7F;
+
+    /* latency histogram of the address */
+    us = (uint32_t)(duration / 1000);
+    bin = (us == 0) ? 0 : (32 - __builtin_clz(us));
+    if (bin >= LGW_SPI_TRACE_BINS) {
+        bin = LGW_SPI_TRACE_BINS - 1;
+    }
+    __atomic_fetch_add(&trace_hist[access & 1][address][bin], 1, __ATOMIC_RELAXED);
+
+    /* record, published by the count increment */
+    ring = trace_thread_ring();
+    if (ring == NULL) {
+        return;
+    }
+    rec = &ring->rec[ring->count & (LGW_SPI_TRACE_RING_SIZE - 1)];
+    rec->start_ns = start;
+    rec->duration_ns = (uint32_t)duration;
+    rec->size = size;
+    rec->address = address;
+    rec->access = access | ((status == LGW_SPI_SUCCESS) ? 0 : 0x80);
+    __atomic_store_n(&ring->count, ring->count + 1, __ATOMIC_RELEASE);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_trace_dump(const char *path) {
+    struct lgw_spi_trace_hdr_s hdr;
+    struct lgw_spi_trace_ring_hdr_s ring_hdr;
+    struct trace_ring_s *rings[TRACE_THREADS_MAX];
+    uint32_t nb_ring = 0;
+    uint32_t nb_thread;
+    uint64_t count;
+    uint32_t first;
+    uint32_t i;
+    int fd;
+    int err = 0;
+
+    if (trace_en == false) {
+        return -1;
+    }
+
+    /* rings completely initialized */
+    nb_thread = __atomic_load_n(&trace_nb_thread, __ATOMIC_RELAXED);
+    if (nb_thread > TRACE_THREADS_MAX) {
+        nb_thread = TRACE_THREADS_MAX;
+    }
+    for (i = 0; i < nb_thread; i++) {
+        rings[nb_ring] = __atomic_load_n(&trace_rings[i], __ATOMIC_ACQUIRE);
+        if (rings[nb_ring] != NULL) {
+            nb_ring += 1;
+        }
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof hdr);
+    hdr.magic = LGW_SPI_TRACE_MAGIC;
+    hdr.version = LGW_SPI_TRACE_VERSION;
+    hdr.rec_size = sizeof(struct lgw_spi_trace_rec_s);
+    hdr.nb_ring = nb_ring;
+    hdr.nb_bins = LGW_SPI_TRACE_BINS;
+    hdr.dump_ns = trace_now();
+    err |= trace_write(fd, &hdr, sizeof hdr);
+
+    /* records of each thread, oldest first */
+    for (i = 0; i < nb_ring; i++) {
+        count = __atomic_load_n(&rings[i]->count, __ATOMIC_ACQUIRE);
+        memset(&ring_hdr, 0, sizeof ring_hdr);
+        ring_hdr.thread = rings[i]->thread;
+        ring_hdr.nb_total = count;
+        ring_hdr.nb_rec = (count < LGW_SPI_TRACE_RING_SIZE) ? (uint32_t)count : LGW_SPI_TRACE_RING_SIZE;
+        err |= trace_write(fd, &ring_hdr, sizeof ring_hdr);
+        first = (uint32_t)((count - ring_hdr.nb_rec) & (LGW_SPI_TRACE_RING_SIZE - 1));
+        if (first + ring_hdr.nb_rec <= LGW_SPI_TRACE_RING_SIZE) {
+            err |= trace_write(fd, &rings[i]->rec[first], ring_hdr.nb_rec * sizeof(struct lgw_spi_trace_rec_s));
+        } else {
+            err |= trace_write(fd, &rings[i]->rec[first], (LGW_SPI_TRACE_RING_SIZE - first) * sizeof(struct lgw_spi_trace_rec_s));
+            err |= trace_write(fd, &rings[i]->rec[0], (first + ring_hdr.nb_rec - LGW_SPI_TRACE_RING_SIZE) * sizeof(struct lgw_spi_trace_rec_s));
+        }
+    }
+
+    /* histograms */
+    err |= trace_write(fd, trace_hist, sizeof trace_hist);
+
+    if (close(fd) < 0) {
+        err = -1;
+    }
+    return (err == 0) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_trace_hist(uint8_t dir, uint8_t address, uint32_t *bins) {
+    int i;
+
+    if ((trace_en == false) || (bins == NULL) || (dir >= LGW_SPI_TRACE_DIR_NB)) {
+        return -1;
+    }
+    for (i = 0; i < LGW_SPI_TRACE_BINS; i++) {
+        bins[i] = __atomic_load_n(&trace_hist[dir][address & 0x7F][i], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */